@@ -0,0 +1,138 @@
+#include "dragon/bench/ast.h"
+
+#include <inttypes.h>
+#include <stdint.h>
+
+#include "dragon/ast.h"
+#include "dragon/bench/gen.h"
+#include "dragon/core/buf.h"
+#include "dragon/core/str.h"
+#include "dragon/flat_ast.h"
+#include "dragon/parser.h"
+
+// A balanced tree with 2^19 leaves has just under a million nodes.
+#define AST_BENCH_LEAVES (1U << 19U)
+#define AST_BENCH_REPS 5
+
+typedef BUF(uint64_t) ValueBuf;
+
+// Both traversals compute a wrapping checksum of the tree, so neither one can
+// be optimized away and they do the same work per node.
+static uint64_t combine(uint64_t kind, uint64_t left, uint64_t right)
+{
+	return (left * 31U + right) ^ kind;
+}
+
+static uint64_t tree_checksum(const Expression* expr)
+{
+	switch (expr->type) {
+	case EXPRESSION_TYPE_CONSTANT:
+		return (uint64_t)((const ConstantExpression*)expr)->number;
+	case EXPRESSION_TYPE_UNARY_OP: {
+		const UnaryOpExpression* unary = (const UnaryOpExpression*)expr;
+		return combine(unary->kind, 0, tree_checksum(unary->operand));
+	}
+	case EXPRESSION_TYPE_BINARY_OP: {
+		const BinaryOpExpression* binary = (const BinaryOpExpression*)expr;
+		uint64_t left = tree_checksum(binary->left);
+		return combine(binary->kind, left, tree_checksum(binary->right));
+	}
+	}
+	return 0;
+}
+
+static uint64_t flat_checksum(const FlatExpression* expr, ValueBuf* stack)
+{
+	stack->len = 0;
+	for (FlatNode node = 0; node < flat_expression_len(expr); node++) {
+		switch (flat_type(expr, node)) {
+		case EXPRESSION_TYPE_CONSTANT:
+			stack->ptr[stack->len++] = (uint64_t)flat_constant(expr, node);
+			break;
+		case EXPRESSION_TYPE_UNARY_OP: {
+			uint64_t* top = &stack->ptr[stack->len - 1];
+			*top = combine(flat_unary_op(expr, node), 0, *top);
+			break;
+		}
+		case EXPRESSION_TYPE_BINARY_OP: {
+			uint64_t right = stack->ptr[--stack->len];
+			uint64_t* left = &stack->ptr[stack->len - 1];
+			*left = combine(flat_binary_op(expr, node), *left, right);
+			break;
+		}
+		}
+	}
+	return stack->ptr[0];
+}
+
+static void report(BenchState* state, const char* what, uint64_t best, uint32_t nodes, uint64_t bytes)
+{
+	BENCH_REPORT(
+	        state,
+	        "%-12s %8" PRIu32 " nodes: %8.3f ms, %6.2f ns/node, %6.2f bytes/node",
+	        what,
+	        nodes,
+	        (double)best / 1e6,
+	        (double)best / (double)nodes,
+	        (double)bytes / (double)nodes
+	);
+}
+
+BENCH_SUITE_FUNC(state, ast)
+{
+	uint64_t tokens;
+	str source = gen_balanced_program(AST_BENCH_LEAVES, &tokens);
+	Parser parser = parser_new(source, str_lit("<bench>"));
+	ProgramResult result = parser_parse(&parser);
+	parser_free(parser);
+	str_free(source);
+	if (!result.ok) {
+		BENCH_REPORT(state, "parse failed: " STR_FMT, STR_ARG(result.get.error));
+		str_free(result.get.error);
+		return;
+	}
+	Program program = result.get.value;
+	const Expression* root = program.function.statement.expression;
+
+	uint64_t start = bench_now_ns();
+	FlatExpression flat = flat_expression_new(root);
+	uint64_t flattenTime = bench_now_ns() - start;
+	uint32_t nodes = flat_expression_len(&flat);
+	uint64_t flatBytes = flat.types.len * sizeof(*flat.types.ptr)
+	                     + flat.ops.len * sizeof(*flat.ops.ptr)
+	                     + flat.args.len * sizeof(*flat.args.ptr)
+	                     + flat.constants.len * sizeof(*flat.constants.ptr);
+
+	ValueBuf stack = BUF_NEW;
+	BUF_RESERVE(&stack, nodes);
+	uint64_t treeBest = UINT64_MAX;
+	uint64_t flatBest = UINT64_MAX;
+	uint64_t treeSum = 0;
+	uint64_t flatSum = 0;
+	for (int rep = 0; rep < AST_BENCH_REPS; rep++) {
+		start = bench_now_ns();
+		treeSum = tree_checksum(root);
+		uint64_t elapsed = bench_now_ns() - start;
+		if (elapsed < treeBest) {
+			treeBest = elapsed;
+		}
+
+		start = bench_now_ns();
+		flatSum = flat_checksum(&flat, &stack);
+		elapsed = bench_now_ns() - start;
+		if (elapsed < flatBest) {
+			flatBest = elapsed;
+		}
+	}
+
+	report(state, "pointer tree", treeBest, nodes, arena_bytes(&program.nodes));
+	report(state, "flat", flatBest, nodes, flatBytes);
+	report(state, "flatten", flattenTime, nodes, flatBytes);
+	if (treeSum != flatSum) {
+		BENCH_REPORT(state, "checksums differ: %" PRIu64 " vs %" PRIu64, treeSum, flatSum);
+	}
+
+	BUF_FREE(stack);
+	flat_expression_free(flat);
+	program_free(program);
+}
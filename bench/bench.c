@@ -0,0 +1,48 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "dragon/bench/ast.h"
+#include "dragon/bench/bench.h"
+#include "dragon/bench/codegen.h"
+#include "dragon/bench/interp.h"
+#include "dragon/bench/lexer.h"
+#include "dragon/bench/parser.h"
+#include "dragon/core/str.h"
+
+static bool wanted(int argc, char** argv, const char* name)
+{
+	if (argc <= 1) {
+		return true;
+	}
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], name) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+int main(int argc, char** argv)
+{
+	BenchState state = { .out = stdout };
+	if (wanted(argc, argv, "lexer")) {
+		RUN_BENCH_SUITE(&state, lexer, str_lit("lexer"));
+	}
+	if (wanted(argc, argv, "parser")) {
+		RUN_BENCH_SUITE(&state, parser, str_lit("parser"));
+	}
+	if (wanted(argc, argv, "ast")) {
+		RUN_BENCH_SUITE(&state, ast, str_lit("ast"));
+	}
+	if (wanted(argc, argv, "codegen")) {
+		RUN_BENCH_SUITE(&state, codegen, str_lit("codegen"));
+	}
+	if (wanted(argc, argv, "interp")) {
+		RUN_BENCH_SUITE(&state, interp, str_lit("interp"));
+	}
+	if (state.ran == 0) {
+		(void)fprintf(stderr, "no benchmark suite matched\n");
+		return 1;
+	}
+	return 0;
+}
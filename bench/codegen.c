@@ -0,0 +1,198 @@
+#include "dragon/bench/codegen.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dragon/ast.h"
+#include "dragon/codegen.h"
+#include "dragon/core/buf.h"
+#include "dragon/core/file.h"
+#include "dragon/core/source.h"
+#include "dragon/core/str.h"
+#include "dragon/fold.h"
+#include "dragon/jit.h"
+#include "dragon/object.h"
+#include "dragon/parser.h"
+#include "dragon/regalloc.h"
+#include "dragon/test/info.h"
+#include "dragon/test/list.h"
+
+// Corpus programs run in nanoseconds, so each one is called many times.
+#define RUN_REPS 10000
+
+typedef struct {
+	uint64_t instructions;
+	// instructions that load or store, explicitly or through the stack
+	uint64_t memory;
+	// programs that ran natively and the time all their calls took
+	uint64_t ran;
+	uint64_t runNs;
+} InstructionCount;
+
+// Keeps the calls from being optimized out.
+static volatile int64_t runSink;
+
+static bool is_memory_op(const char* line, const char* end)
+{
+	return strncmp(line, "push ", 5) == 0 || strncmp(line, "pop ", 4) == 0
+	       || memchr(line, '[', (size_t)(end - line)) != NULL;
+}
+
+static void count_instructions(const char* text, InstructionCount* count)
+{
+	for (const char* line = text; *line != '\0';) {
+		const char* end = strchr(line, '\n');
+		if (end == NULL) {
+			end = line + strlen(line);
+		}
+		// instructions are indented, labels aren't
+		if (line[0] == ' ') {
+			const char* op = line;
+			while (*op == ' ') {
+				op++;
+			}
+			count->instructions++;
+			if (is_memory_op(op, end)) {
+				count->memory++;
+			}
+		}
+		line = *end == '\0' ? end : end + 1;
+	}
+}
+
+static bool count_program(Program program, CodegenOptions options, InstructionCount* count)
+{
+	char* text = NULL;
+	size_t len = 0;
+	FILE* fp = open_memstream(&text, &len);
+	if (fp == NULL) {
+		return false;
+	}
+	codegen_program_file(program, fp, options);
+	(void)fclose(fp);
+	count_instructions(text, count);
+	free(text);
+	return true;
+}
+
+// Generates the code --run would and times calling it, leaving out mapping it
+// and catching signals. Programs that call other functions or trap aren't
+// timed.
+static void time_program(Program program, CodegenOptions options, InstructionCount* count)
+{
+	Object object = object_new();
+	codegen_program_object(program, &object, options);
+	JitCodeResult code = jit_load(&object, str_lit("main"));
+	object_free(object);
+	if (!code.ok) {
+		str_free(code.get.error);
+		return;
+	}
+	JitResult result = jit_run(&code.get.value);
+	if (result.ok) {
+		JitFunc func = code.get.value.func;
+		uint64_t start = bench_now_ns();
+		for (uint64_t rep = 0; rep < RUN_REPS; rep++) {
+			runSink = func();
+		}
+		count->runNs += bench_now_ns() - start;
+		count->ran++;
+	} else {
+		str_free(result.get.error);
+	}
+	jit_unload(code.get.value);
+}
+
+// Compares the code generation strategies on every valid case in the test
+// corpus, counting static instructions in the generated assembly and timing
+// the native code when it's run in-process, as --run does. Folded
+// strategies run after constant folding, the +opt ones run the IR passes, the
+// +ra ones allocate registers for IR values and the +pp ones run the peephole
+// optimizer.
+BENCH_SUITE_FUNC(state, codegen)
+{
+	static const struct {
+		const char* name;
+		CodegenStrategy strategy;
+		bool fold;
+		bool peephole;
+		bool irPasses;
+		RegallocStrategy regalloc;
+	} STRATEGIES[] = {
+		{ "stack", CODEGEN_STRATEGY_STACK, false, false, false, REGALLOC_STRATEGY_NONE },
+		{ "stack+pp", CODEGEN_STRATEGY_STACK, false, true, false, REGALLOC_STRATEGY_NONE },
+		{ "register", CODEGEN_STRATEGY_REGISTER, false, false, false, REGALLOC_STRATEGY_NONE },
+		{ "ir+pp", CODEGEN_STRATEGY_IR, false, true, false, REGALLOC_STRATEGY_NONE },
+		{ "ir+ra+pp", CODEGEN_STRATEGY_IR, false, true, false, REGALLOC_STRATEGY_LINEAR },
+		{ "ir+opt+pp", CODEGEN_STRATEGY_IR, false, true, true, REGALLOC_STRATEGY_LINEAR },
+		{ "folded", CODEGEN_STRATEGY_REGISTER, true, false, false, REGALLOC_STRATEGY_NONE },
+		{ "folded+pp", CODEGEN_STRATEGY_REGISTER, true, true, false, REGALLOC_STRATEGY_NONE },
+	};
+	InstructionCount counts[sizeof(STRATEGIES) / sizeof(STRATEGIES[0])] = {0};
+	uint64_t programs = 0;
+
+	TestCaseBuf tests = get_tests(IMPLEMENTED_STAGES);
+	for (uint64_t i = 0; i < tests.len; i++) {
+		TestCase test = tests.ptr[i];
+		SlurpFileResult source = slurp_file(test.path);
+		if (!source.ok) {
+			str_free(source.get.error);
+			str_free(test.path);
+			continue;
+		}
+		Parser parser = parser_new(source.get.value, test.path);
+		ProgramResult result = parser_parse(&parser);
+		parser_free(parser);
+		if (result.ok) {
+			programs++;
+			Program program = result.get.value;
+			// folding rewrites the program, so count the unfolded strategies first
+			for (int fold = 0; fold < 2; fold++) {
+				if (fold) {
+					SourceFile file = source_file_new(test.path, source.get.value);
+					fold_result_free(fold_program(&program, &file));
+					source_file_free(file);
+				}
+				for (uint64_t j = 0; j < sizeof(STRATEGIES) / sizeof(STRATEGIES[0]); j++) {
+					if (STRATEGIES[j].fold == fold) {
+						CodegenOptions options = {
+							.strategy = STRATEGIES[j].strategy,
+							.peephole = STRATEGIES[j].peephole,
+							.ir = {
+								.sccp = STRATEGIES[j].irPasses,
+								.gvn = STRATEGIES[j].irPasses,
+								.dce = STRATEGIES[j].irPasses,
+							},
+							.regalloc = STRATEGIES[j].regalloc,
+						};
+						(void)count_program(program, options, &counts[j]);
+						time_program(program, options, &counts[j]);
+					}
+				}
+			}
+			program_free(program);
+		} else {
+			str_free(result.get.error);
+		}
+		str_free(source.get.value);
+		str_free(test.path);
+	}
+	BUF_FREE(tests);
+
+	for (uint64_t j = 0; j < sizeof(STRATEGIES) / sizeof(STRATEGIES[0]); j++) {
+		BENCH_REPORT(
+		        state,
+		        "%-9s %4" PRIu64 " programs: %6" PRIu64 " instructions, %6" PRIu64 " memory operations, %4" PRIu64 " run in %7.1f ns",
+		        STRATEGIES[j].name,
+		        programs,
+		        counts[j].instructions,
+		        counts[j].memory,
+		        counts[j].ran,
+		        (double)counts[j].runNs / RUN_REPS
+		);
+	}
+}
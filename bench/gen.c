@@ -0,0 +1,89 @@
+#include "dragon/bench/gen.h"
+
+#include <string.h>
+
+#include "dragon/core/buf.h"
+
+typedef BUF(char) CharBuf;
+
+static void push_chars(CharBuf* buf, const char* s)
+{
+	for (; *s != '\0'; s++) {
+		BUF_PUSH(buf, *s);
+	}
+}
+
+static void gen_balanced_expr(CharBuf* buf, uint64_t leaves, uint64_t* tokens)
+{
+	if (leaves <= 1) {
+		push_chars(buf, "1");
+		*tokens += 1;
+		return;
+	}
+	push_chars(buf, "(");
+	gen_balanced_expr(buf, leaves / 2, tokens);
+	push_chars(buf, " + ");
+	gen_balanced_expr(buf, leaves - leaves / 2, tokens);
+	push_chars(buf, ")");
+	*tokens += 3;
+}
+
+str gen_commented_program(uint64_t leaves)
+{
+	CharBuf buf = BUF_NEW;
+	push_chars(&buf, "int main() {\n    return 0\n");
+	for (uint64_t i = 0; i < leaves; i++) {
+		push_chars(&buf, "\t\t\t\t\t\t\t\t        + 1");
+		if (i % 4 == 0) {
+			push_chars(&buf, "    /* generated from rule 1 of the input grammar */");
+		}
+		push_chars(&buf, "\n\t\t\t\t\t\t\t\t        // keep the sum balanced\n");
+	}
+	push_chars(&buf, "    ;\n}\n");
+	uint64_t len = buf.len;
+	BUF_PUSH(&buf, '\0');
+	return str_acquire(buf.ptr, len);
+}
+
+str gen_operator_program(uint64_t leaves, uint64_t* tokens)
+{
+	static const char* const BINARY_OPS[] = {
+		" + ", " - ", " * ", " / ", " % ", " << ", " >> ", " < ", " > ",
+		" <= ", " >= ", " == ", " != ", " & ", " ^ ", " | ", " && ", " || ",
+	};
+	static const char* const UNARY_OPS[] = { "", "", "-", "~", "!" };
+	CharBuf buf = BUF_NEW;
+	*tokens = 0;
+	uint32_t seed = 12345;
+	push_chars(&buf, "int main() {\n    return ");
+	for (uint64_t i = 0; i < leaves; i++) {
+		seed = seed * 1103515245U + 12345U;
+		if (i > 0) {
+			push_chars(&buf, BINARY_OPS[(seed >> 16U) % (sizeof(BINARY_OPS) / sizeof(BINARY_OPS[0]))]);
+			*tokens += 1;
+		}
+		const char* unary = UNARY_OPS[(seed >> 8U) % (sizeof(UNARY_OPS) / sizeof(UNARY_OPS[0]))];
+		push_chars(&buf, unary);
+		push_chars(&buf, "7");
+		*tokens += *unary == '\0' ? 1 : 2;
+	}
+	push_chars(&buf, ";\n}\n");
+	*tokens += 8;
+	uint64_t len = buf.len;
+	BUF_PUSH(&buf, '\0');
+	return str_acquire(buf.ptr, len);
+}
+
+str gen_balanced_program(uint64_t leaves, uint64_t* tokens)
+{
+	CharBuf buf = BUF_NEW;
+	*tokens = 0;
+	push_chars(&buf, "int main() {\n    return ");
+	gen_balanced_expr(&buf, leaves, tokens);
+	push_chars(&buf, ";\n}\n");
+	// int main ( ) { return ; }
+	*tokens += 8;
+	uint64_t len = buf.len;
+	BUF_PUSH(&buf, '\0');
+	return str_acquire(buf.ptr, len);
+}
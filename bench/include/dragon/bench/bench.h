@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "dragon/core/str.h"
+
+typedef struct {
+	FILE* out;
+	uint64_t ran;
+} BenchState;
+
+static inline uint64_t bench_now_ns(void)
+{
+	struct timespec ts;
+	(void)clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * UINT64_C(1000000000) + (uint64_t)ts.tv_nsec;
+}
+
+#define RUN_BENCH_SUITE(state, name, displayname) \
+	do { \
+		(void)fprintf((state)->out, "SUITE " STR_FMT "\n", STR_ARG(displayname)); \
+		str_free(displayname); \
+		name##_bench_suite(state); \
+		++(state)->ran; \
+	} while (false)
+
+#define BENCH_SUITE_FUNC(state, name) \
+	void name##_bench_suite(BenchState* state)
+
+#define BENCH_REPORT(state, ...) \
+	do { \
+		(void)fprintf((state)->out, "BENCH "); \
+		(void)fprintf((state)->out, __VA_ARGS__); \
+		(void)fprintf((state)->out, "\n"); \
+	} while (false)
@@ -0,0 +1,5 @@
+#pragma once
+
+#include "dragon/bench/bench.h"
+
+BENCH_SUITE_FUNC(state, codegen);
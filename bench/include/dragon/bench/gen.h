@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "dragon/core/str.h"
+
+// Generates `int main() { return <expr>; }` where <expr> is a fully
+// parenthesized, balanced sum of `leaves` constants. The number of tokens in
+// the result is stored in `tokens`.
+str gen_balanced_program(uint64_t leaves, uint64_t* tokens);
+
+// Like gen_balanced_program, but the constants are joined without parentheses
+// by a pseudo-random mix of every binary operator, some with unary operators
+// in front, so precedence decides the shape of the tree.
+str gen_operator_program(uint64_t leaves, uint64_t* tokens);
+
+// Generates a program returning a sum of `leaves` constants, one per line,
+// deeply indented and interleaved with line and block comments, like typical
+// generated code.
+str gen_commented_program(uint64_t leaves);
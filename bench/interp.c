@@ -0,0 +1,189 @@
+#include "dragon/bench/interp.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "dragon/ast.h"
+#include "dragon/bench/gen.h"
+#include "dragon/bytecode.h"
+#include "dragon/codegen.h"
+#include "dragon/core/buf.h"
+#include "dragon/core/file.h"
+#include "dragon/core/str.h"
+#include "dragon/interp.h"
+#include "dragon/jit.h"
+#include "dragon/object.h"
+#include "dragon/parser.h"
+#include "dragon/regalloc.h"
+#include "dragon/test/info.h"
+#include "dragon/test/list.h"
+
+// Corpus programs take microseconds, so each one is run many times.
+#define CORPUS_REPS 100
+
+static const uint64_t LEAF_COUNTS[] = {
+	1U << 8U,
+	1U << 12U,
+	1U << 16U,
+};
+
+typedef struct {
+	uint64_t compileNs;
+	uint64_t runNs;
+	// whether the program stopped with an error
+	bool trapped;
+	int64_t value;
+} Timing;
+
+static void time_interp(Program program, Timing* timing)
+{
+	uint64_t start = bench_now_ns();
+	BytecodeResult code = bytecode_compile(program.function);
+	timing->compileNs += bench_now_ns() - start;
+	if (!code.ok) {
+		str_free(code.get.error);
+		timing->trapped = true;
+		return;
+	}
+	start = bench_now_ns();
+	InterpResult result = interp_run(&code.get.value, stdin, stdout);
+	timing->runNs += bench_now_ns() - start;
+	bytecode_free(code.get.value);
+	timing->trapped = !result.ok;
+	if (result.ok) {
+		timing->value = result.get.value;
+	} else {
+		str_free(result.get.error);
+	}
+}
+
+// Generates the code --run would, so running includes mapping it.
+static void time_native(Program program, Timing* timing)
+{
+	CodegenOptions options = {
+		.strategy = CODEGEN_STRATEGY_REGISTER,
+		.peephole = true,
+		.regalloc = REGALLOC_STRATEGY_LINEAR,
+	};
+	uint64_t start = bench_now_ns();
+	Object object = object_new();
+	codegen_program_object(program, &object, options);
+	timing->compileNs += bench_now_ns() - start;
+	start = bench_now_ns();
+	JitResult result = jit_call(&object, str_lit("main"));
+	timing->runNs += bench_now_ns() - start;
+	object_free(object);
+	timing->trapped = !result.ok;
+	if (result.ok) {
+		timing->value = result.get.value;
+	} else {
+		str_free(result.get.error);
+	}
+}
+
+static bool timings_agree(const Timing* interp, const Timing* native)
+{
+	return interp->trapped == native->trapped && (interp->trapped || interp->value == native->value);
+}
+
+// Reports the times per run, averaged over `reps` runs.
+static void report(
+        BenchState* state,
+        const char* name,
+        uint64_t count,
+        const char* unit,
+        const Timing* interp,
+        const Timing* native,
+        uint64_t reps,
+        bool agree
+)
+{
+	double scale = 1e3 * (double)reps;
+	BENCH_REPORT(
+	        state,
+	        "%-9s %6" PRIu64 " %-8s interpret %9.2f us (compile %9.2f, run %9.2f), native %9.2f us (compile %9.2f, run %9.2f)%s",
+	        name,
+	        count,
+	        unit,
+	        (double)(interp->compileNs + interp->runNs) / scale,
+	        (double)interp->compileNs / scale,
+	        (double)interp->runNs / scale,
+	        (double)(native->compileNs + native->runNs) / scale,
+	        (double)native->compileNs / scale,
+	        (double)native->runNs / scale,
+	        agree ? "" : ", results differ"
+	);
+}
+
+static void bench_generated(BenchState* state, const char* shape, str source, uint64_t leaves)
+{
+	Parser parser = parser_new(source, str_lit("<bench>"));
+	ProgramResult result = parser_parse(&parser);
+	parser_free(parser);
+	if (!result.ok) {
+		str_free(result.get.error);
+		return;
+	}
+	Timing interp = {0};
+	Timing native = {0};
+	time_interp(result.get.value, &interp);
+	time_native(result.get.value, &native);
+	program_free(result.get.value);
+	report(state, shape, leaves, "leaves:", &interp, &native, 1, timings_agree(&interp, &native));
+}
+
+// Compares the time from a parsed program to its result when it's interpreted
+// as bytecode with --interpret and when it's compiled to native code and run
+// in-process with --run. Programs aren't folded, so both evaluate every
+// operator: on the valid cases in the test corpus, averaged per program, and
+// on generated expressions.
+BENCH_SUITE_FUNC(state, interp)
+{
+	Timing interp = {0};
+	Timing native = {0};
+	uint64_t programs = 0;
+	bool agree = true;
+	TestCaseBuf tests = get_tests(IMPLEMENTED_STAGES);
+	for (uint64_t i = 0; i < tests.len; i++) {
+		TestCase test = tests.ptr[i];
+		SlurpFileResult source = slurp_file(test.path);
+		if (!source.ok) {
+			str_free(source.get.error);
+			str_free(test.path);
+			continue;
+		}
+		Parser parser = parser_new(source.get.value, test.path);
+		ProgramResult result = parser_parse(&parser);
+		parser_free(parser);
+		if (result.ok) {
+			programs++;
+			for (uint64_t rep = 0; rep < CORPUS_REPS; rep++) {
+				time_interp(result.get.value, &interp);
+				time_native(result.get.value, &native);
+				agree = agree && timings_agree(&interp, &native);
+			}
+			program_free(result.get.value);
+		} else {
+			str_free(result.get.error);
+		}
+		str_free(source.get.value);
+		str_free(test.path);
+	}
+	BUF_FREE(tests);
+	report(state, "corpus", programs, "programs:", &interp, &native, CORPUS_REPS * programs, agree);
+
+	for (uint64_t i = 0; i < sizeof(LEAF_COUNTS) / sizeof(LEAF_COUNTS[0]); i++) {
+		uint64_t tokens;
+		str source = gen_balanced_program(LEAF_COUNTS[i], &tokens);
+		bench_generated(state, "balanced", source, LEAF_COUNTS[i]);
+		str_free(source);
+	}
+	for (uint64_t i = 0; i < sizeof(LEAF_COUNTS) / sizeof(LEAF_COUNTS[0]); i++) {
+		uint64_t tokens;
+		str source = gen_operator_program(LEAF_COUNTS[i], &tokens);
+		bench_generated(state, "operators", source, LEAF_COUNTS[i]);
+		str_free(source);
+	}
+}
@@ -0,0 +1,112 @@
+#include "dragon/bench/lexer.h"
+
+#include <inttypes.h>
+#include <stdint.h>
+
+#include "dragon/bench/gen.h"
+#include "dragon/core/buf.h"
+#include "dragon/core/scan.h"
+#include "dragon/core/str.h"
+#include "dragon/lexer.h"
+#include "dragon/token.h"
+#include "dragon/token_stream.h"
+
+typedef BUF(Token) TokenBuf;
+
+static const uint64_t LEAF_COUNTS[] = {
+	1U << 12U,
+	1U << 16U,
+	1U << 20U,
+};
+
+static void bench_token_buf(BenchState* state, str source, uint64_t tokens)
+{
+	Interner symbols = interner_new();
+	uint64_t start = bench_now_ns();
+	TokenBuf buf = BUF_NEW;
+	Lexer lexer = lexer_new(source, &symbols);
+	for (Token tok = lexer_first(&lexer);; tok = lexer_next(&lexer)) {
+		BUF_PUSH(&buf, tok);
+		if (tok.type == TT_EOF) {
+			break;
+		}
+	}
+	uint64_t elapsed = bench_now_ns() - start;
+	uint64_t bytes = buf.len * sizeof(Token);
+	BUF_FREE(buf);
+	interner_free(symbols);
+
+	BENCH_REPORT(
+	        state,
+	        "Token[]     %9" PRIu64 " tokens: %8.2f ns/token, %6.2f bytes/token",
+	        tokens,
+	        (double)elapsed / (double)tokens,
+	        (double)bytes / (double)tokens
+	);
+}
+
+static void bench_token_stream(BenchState* state, str source, uint64_t tokens)
+{
+	Interner symbols = interner_new();
+	uint64_t start = bench_now_ns();
+	TokenStream stream = token_stream_new(source, str_lit("<bench>"), &symbols);
+	uint64_t elapsed = bench_now_ns() - start;
+	uint64_t bytes = token_stream_bytes(&stream);
+	token_stream_free(stream);
+	interner_free(symbols);
+
+	BENCH_REPORT(
+	        state,
+	        "TokenStream %9" PRIu64 " tokens: %8.2f ns/token, %6.2f bytes/token",
+	        tokens,
+	        (double)elapsed / (double)tokens,
+	        (double)bytes / (double)tokens
+	);
+}
+
+static void bench_scan_impl(BenchState* state, str source, ScanImpl impl)
+{
+	if (!scan_impl_supported(impl)) {
+		return;
+	}
+	scan_use_impl(impl);
+
+	uint64_t best = UINT64_MAX;
+	for (int rep = 0; rep < 5; rep++) {
+		Interner symbols = interner_new();
+		uint64_t start = bench_now_ns();
+		TokenStream stream = token_stream_new(source, str_lit("<bench>"), &symbols);
+		uint64_t elapsed = bench_now_ns() - start;
+		token_stream_free(stream);
+		interner_free(symbols);
+		if (elapsed < best) {
+			best = elapsed;
+		}
+	}
+
+	BENCH_REPORT(
+	        state,
+	        "lex commented source %6.2f MB with %-6s: %8.2f MB/s",
+	        (double)str_len(source) / 1e6,
+	        scan_impl_name(impl),
+	        (double)str_len(source) / 1e6 / ((double)best / 1e9)
+	);
+}
+
+BENCH_SUITE_FUNC(state, lexer)
+{
+	str commented = gen_commented_program(1U << 18U);
+	bench_scan_impl(state, commented, SCAN_IMPL_SCALAR);
+	bench_scan_impl(state, commented, SCAN_IMPL_SSE2);
+	bench_scan_impl(state, commented, SCAN_IMPL_AVX2);
+	scan_use_impl(scan_best_impl());
+	str_free(commented);
+
+	for (uint64_t i = 0; i < sizeof(LEAF_COUNTS) / sizeof(LEAF_COUNTS[0]); i++) {
+		uint64_t tokens;
+		str source = gen_balanced_program(LEAF_COUNTS[i], &tokens);
+		bench_token_buf(state, source, tokens);
+		bench_token_stream(state, source, tokens);
+		str_free(source);
+	}
+}
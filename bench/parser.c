@@ -0,0 +1,63 @@
+#include "dragon/bench/parser.h"
+
+#include <inttypes.h>
+#include <stdint.h>
+
+#include "dragon/ast.h"
+#include "dragon/bench/gen.h"
+#include "dragon/core/str.h"
+#include "dragon/parser.h"
+
+static const uint64_t LEAF_COUNTS[] = {
+	1U << 8U,
+	1U << 12U,
+	1U << 16U,
+	1U << 18U,
+	1U << 20U,
+};
+
+static void bench_parse(BenchState* state, const char* shape, str source, uint64_t tokens)
+{
+	uint64_t start = bench_now_ns();
+	Parser parser = parser_new(source, str_lit("<bench>"));
+	uint64_t parseStart = bench_now_ns();
+	ProgramResult result = parser_parse(&parser);
+	uint64_t parseElapsed = bench_now_ns() - parseStart;
+	parser_free(parser);
+	uint64_t elapsed = bench_now_ns() - start;
+
+	uint64_t freeStart = bench_now_ns();
+	if (result.ok) {
+		program_free(result.get.value);
+	} else {
+		str_free(result.get.error);
+	}
+	uint64_t freeElapsed = bench_now_ns() - freeStart;
+
+	BENCH_REPORT(
+	        state,
+	        "parse %-9s %9" PRIu64 " tokens: %10.3f ms, %7.2f ns/token (%6.2f without lexing), free %8.3f ms",
+	        shape,
+	        tokens,
+	        (double)elapsed / 1e6,
+	        (double)elapsed / (double)tokens,
+	        (double)parseElapsed / (double)tokens,
+	        (double)freeElapsed / 1e6
+	);
+}
+
+BENCH_SUITE_FUNC(state, parser)
+{
+	for (uint64_t i = 0; i < sizeof(LEAF_COUNTS) / sizeof(LEAF_COUNTS[0]); i++) {
+		uint64_t tokens;
+		str source = gen_balanced_program(LEAF_COUNTS[i], &tokens);
+		bench_parse(state, "balanced", source, tokens);
+		str_free(source);
+	}
+	for (uint64_t i = 0; i < sizeof(LEAF_COUNTS) / sizeof(LEAF_COUNTS[0]); i++) {
+		uint64_t tokens;
+		str source = gen_operator_program(LEAF_COUNTS[i], &tokens);
+		bench_parse(state, "operators", source, tokens);
+		str_free(source);
+	}
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "dragon/core/buf.h"
+#include "dragon/core/intern.h"
+
+typedef enum {
+#define X(name, mnemonic) OPCODE_##name,
+#include "dragon/opcodes.def"
+#undef X
+	// not an instruction: marks the position of operands[0]'s label
+	OPCODE_LABEL,
+	OPCODE_COUNT,
+} Opcode;
+
+// In encoding order, so the 64-bit registers' values are their register
+// numbers. AL and CL are the low bytes of RAX and RCX.
+typedef enum {
+#define X(name, text) MREG_##name,
+#include "dragon/machine_registers.def"
+#undef X
+	MREG_COUNT,
+} MachineRegister;
+
+typedef enum {
+	OPERAND_NONE,
+	OPERAND_REGISTER,
+	OPERAND_IMMEDIATE,
+	OPERAND_LABEL,
+	// the qword at an offset from rbp
+	OPERAND_FRAME,
+	// a function, by its SymbolId
+	OPERAND_SYMBOL,
+} OperandKind;
+
+typedef struct {
+	OperandKind kind;
+	// the MachineRegister, immediate, label number, offset or SymbolId
+	int64_t value;
+} Operand;
+
+#define ASM_MAX_OPERANDS 3
+
+// One x86-64 instruction in Intel operand order, destination first.
+typedef struct {
+	Opcode opcode;
+	Operand operands[ASM_MAX_OPERANDS];
+} Instruction;
+
+typedef BUF(Instruction) InstructionBuf;
+
+static inline Operand asm_reg(MachineRegister reg)
+{
+	return (Operand) { .kind = OPERAND_REGISTER, .value = reg };
+}
+
+static inline Operand asm_imm(int64_t value)
+{
+	return (Operand) { .kind = OPERAND_IMMEDIATE, .value = value };
+}
+
+static inline Operand asm_label(uint32_t label)
+{
+	return (Operand) { .kind = OPERAND_LABEL, .value = label };
+}
+
+static inline Operand asm_frame(int64_t offset)
+{
+	return (Operand) { .kind = OPERAND_FRAME, .value = offset };
+}
+
+static inline Operand asm_symbol(SymbolId symbol)
+{
+	return (Operand) { .kind = OPERAND_SYMBOL, .value = symbol };
+}
+
+static inline bool operand_eq(Operand a, Operand b)
+{
+	return a.kind == b.kind && a.value == b.value;
+}
+
+static inline bool operand_is_reg(Operand operand, MachineRegister reg)
+{
+	return operand.kind == OPERAND_REGISTER && operand.value == reg;
+}
+
+void asm_emit0(InstructionBuf* code, Opcode opcode);
+void asm_emit1(InstructionBuf* code, Opcode opcode, Operand a);
+void asm_emit2(InstructionBuf* code, Opcode opcode, Operand a, Operand b);
+void asm_emit3(InstructionBuf* code, Opcode opcode, Operand a, Operand b, Operand c);
+void asm_emit_label(InstructionBuf* code, uint32_t label);
+
+// The 64-bit register that `reg` is part of.
+MachineRegister machine_register_full(MachineRegister reg);
+const char* machine_register_name(MachineRegister reg);
+const char* opcode_mnemonic(Opcode opcode);
+
+// Writes NASM syntax, one instruction per line. Symbol operands are named
+// from `symbols`.
+void asm_write(const InstructionBuf* code, const Interner* symbols, FILE* fp);
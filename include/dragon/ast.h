@@ -2,6 +2,8 @@
 
 #include <stdint.h>
 
+#include "dragon/core/arena.h"
+#include "dragon/core/intern.h"
 #include "dragon/core/str.h"
 
 typedef enum {
@@ -23,6 +25,8 @@ typedef enum {
 typedef struct {
 	Expression base;
 	UnaryOpKind kind;
+	// source offset of the operator, for diagnostics
+	uint32_t offset;
 	Expression* operand;
 } UnaryOpExpression;
 
@@ -36,6 +40,8 @@ typedef struct {
 	Expression base;
 	Expression* left;
 	BinaryOpKind kind;
+	// source offset of the operator, for diagnostics
+	uint32_t offset;
 	Expression* right;
 } BinaryOpExpression;
 
@@ -49,14 +55,24 @@ typedef struct {
 } Statement;
 
 typedef struct {
-	str name;
+	SymbolId name;
 	Statement statement;
 } Function;
 
+// Large enough that typical programs fit in a single block.
+#define AST_ARENA_BLOCK_SIZE ((uint64_t)64 * 1024)
+
+// The SymbolId of "main", which the entry point calls whether or not the
+// program defines it.
+#define PROGRAM_MAIN ((SymbolId)0)
+
+// Identifiers in the tree are SymbolIds into `symbols`. Every node is
+// allocated from `nodes`, so the tree is released all at once.
 typedef struct {
+	Interner symbols;
+	Arena nodes;
 	Function function;
 } Program;
 
 str program_to_str(Program program);
 void program_free(Program program);
-void expression_free(Expression* expression);
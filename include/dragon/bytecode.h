@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "dragon/ast.h"
+#include "dragon/core/buf.h"
+#include "dragon/core/str.h"
+#include "dragon/core/sum.h"
+
+typedef enum {
+#define X(name, mnemonic) BC_OP_##name,
+#include "dragon/bytecode_ops.def"
+#undef X
+	BC_OP_COUNT,
+} BcOpcode;
+
+// Functions of the host the interpreter runs in, which bytecode calls instead
+// of linking against libc.
+typedef enum {
+#define X(name, cname, arity) HOST_FUNCTION_##name,
+#include "dragon/host_functions.def"
+#undef X
+	HOST_FUNCTION_COUNT,
+} HostFunction;
+
+// Index of a register in the interpreter's frame.
+typedef uint16_t BcRegister;
+
+#define BC_REGISTER_MAX UINT16_MAX
+
+// A register-based instruction, packed into 8 bytes:
+//   load      dst = the 32-bit immediate in a and b
+//   loadk     dst = constants[the 32-bit index in a and b]
+//   unary     dst = op a
+//   binary    dst = a op b
+//   immediate dst = a op b, where b is a signed 16-bit immediate
+//   jump      continue at the 32-bit index in a and b
+//   jz, jnz   continue there if dst is zero, or nonzero
+//   call      dst = the host function a, passed the registers from b on
+//   ret       return a
+typedef struct {
+	uint16_t opcode;
+	BcRegister dst;
+	uint16_t a;
+	uint16_t b;
+} BcInstruction;
+
+typedef BUF(BcInstruction) BcInstructionBuf;
+typedef BUF(int64_t) BcConstantBuf;
+
+typedef struct {
+	BcInstructionBuf code;
+	// the constants that don't fit in 32 bits
+	BcConstantBuf constants;
+	uint32_t registerCount;
+} Bytecode;
+
+typedef RESULT(Bytecode, str) BytecodeResult;
+
+static inline uint32_t bc_wide(BcInstruction insn)
+{
+	return (uint32_t)insn.a | (uint32_t)insn.b << 16U;
+}
+
+// Compiles the function into bytecode evaluating its expression. Values live
+// in the register of their depth in the expression, so deep right operands
+// can run out of registers.
+BytecodeResult bytecode_compile(Function func);
+str bytecode_to_str(const Bytecode* code);
+void bytecode_free(Bytecode code);
+
+typedef MAYBE(HostFunction) HostFunctionFindResult;
+
+HostFunctionFindResult host_function_find(str name);
+uint32_t host_function_arity(HostFunction function);
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "dragon/ir.h"
+
+// Records the predecessors of every block, in block order.
+void ir_compute_predecessors(IrFunction* func);
+
+// Drops `pred` from the predecessors of `block`, along with the phi operands
+// for it, once `pred` no longer continues there.
+void ir_remove_predecessor(IrFunction* func, IrBlockId block, IrBlockId pred);
+
+// Keeps the blocks in `order`, in that order, and drops the others, which
+// mustn't continue at kept blocks. Predecessors are renumbered too.
+void ir_reorder_blocks(IrFunction* func, const IrBlockIdBuf* order);
+
+// Removes the blocks that can't be reached from the entry, returning how
+// many there were. Predecessors must be up to date.
+uint64_t ir_remove_unreachable_blocks(IrFunction* func);
+
+// The blocks immediately dominated by `b` are
+// children.ptr[childStart.ptr[b]] to children.ptr[childStart.ptr[b + 1] - 1].
+typedef struct {
+	// the entry is its own immediate dominator
+	IrBlockIdBuf idom;
+	IrBlockIdBuf childStart;
+	IrBlockIdBuf children;
+} IrDominatorTree;
+
+// Every block must be reachable, and predecessors up to date.
+IrDominatorTree ir_dominator_tree_new(const IrFunction* func);
+void ir_dominator_tree_free(IrDominatorTree tree);
@@ -1,6 +1,56 @@
 #pragma once
 
+#include <stdbool.h>
+#include <stdio.h>
+
 #include "dragon/ast.h"
 #include "dragon/core/str.h"
+#include "dragon/core/sum.h"
+#include "dragon/ir_opt.h"
+#include "dragon/object.h"
+#include "dragon/peephole.h"
+#include "dragon/regalloc.h"
+
+typedef enum {
+	// evaluate expressions into registers, spilling only when they run out
+	CODEGEN_STRATEGY_REGISTER,
+	// evaluate expressions on the machine stack
+	CODEGEN_STRATEGY_STACK,
+	// lower to the IR, optimize it, and allocate registers for its values
+	CODEGEN_STRATEGY_IR,
+} CodegenStrategy;
+
+typedef enum {
+	// NASM source
+	CODEGEN_OUTPUT_ASSEMBLY,
+	// an ELF64 relocatable object, assembled in-process
+	CODEGEN_OUTPUT_OBJECT,
+} CodegenOutput;
+
+typedef struct {
+	CodegenStrategy strategy;
+	CodegenOutput output;
+	// run the peephole optimizer over the generated instructions
+	bool peephole;
+	// the IR passes to run, for the IR strategy
+	IrOptOptions ir;
+	// where the IR strategy keeps values
+	RegallocStrategy regalloc;
+} CodegenOptions;
+
+typedef struct {
+	PeepholeStats peephole;
+	IrOptStats ir;
+	RegallocStats regalloc;
+} CodegenStats;
+
+typedef MAYBE(CodegenStats) CodegenWriteResult;
 
-void codegen_program(Program program, str outPath);
+// Both return what the optimizations that ran did, or nothing, with errno set,
+// if the output couldn't be written. codegen_program_file leaves flushing and
+// closing `fp` to the caller.
+CodegenWriteResult codegen_program(Program program, str outPath, CodegenOptions options);
+CodegenWriteResult codegen_program_file(Program program, FILE* fp, CodegenOptions options);
+// Assembles the program, entry point included, into `object`, which is left
+// finished; `options.output` is ignored.
+CodegenStats codegen_program_object(Program program, Object* object, CodegenOptions options);
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdalign.h>
+#include <stdint.h>
+
+#include "dragon/core/str.h"
+
+typedef struct ArenaBlock ArenaBlock;
+
+// Bump allocator. Everything allocated from an arena is released at once by
+// arena_free.
+typedef struct {
+	ArenaBlock* blocks;
+	char* cur;
+	char* end;
+	uint64_t blockSize;
+} Arena;
+
+Arena arena_new(uint64_t blockSize);
+void* arena_alloc(Arena* arena, uint64_t size, uint64_t align);
+// Copies s into the arena, NUL terminated. The result is a reference.
+str arena_str_copy(Arena* arena, str s);
+// Bytes reserved from the system, for statistics.
+uint64_t arena_bytes(const Arena* arena);
+void arena_free(Arena arena);
+
+#define ARENA_NEW(arena, T) ((T*)arena_alloc((arena), sizeof(T), alignof(T)))
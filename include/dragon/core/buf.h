@@ -44,6 +44,14 @@
 		(buf)->ptr[(buf)->len++] = (val); \
 	} while (false)
 
+#define BUF_RESERVE(buf, n) \
+	do { \
+		if ((buf)->cap < (n)) { \
+			(buf)->cap = (n); \
+			(buf)->ptr = realloc((buf)->ptr, (buf)->cap * sizeof(*(buf)->ptr)); \
+		} \
+	} while (false)
+
 #define BUF_POP_FIRST(buf) \
 	do { \
 		if ((buf)->len > 0) { \
@@ -1,8 +1,29 @@
 #pragma once
 
+#include <stdint.h>
+
 #include "dragon/core/str.h"
 #include "dragon/core/sum.h"
 
+// Number of zero bytes that slurp_file and map_file guarantee to be readable
+// directly after the file contents.
+#define FILE_PADDING 64
+
 typedef RESULT(str, str) SlurpFileResult;
 
 SlurpFileResult slurp_file(str filename);
+
+typedef struct {
+	str contents;
+	// the memory mapping backing contents, or NULL if contents is on the heap
+	void* mapping;
+	uint64_t mappingLen;
+} MappedFile;
+
+typedef RESULT(MappedFile, str) MapFileResult;
+
+// Maps a file read-only, followed by FILE_PADDING zero bytes. Falls back to
+// reading the file when it can't be mapped (pipes, terminals, ...). A filename
+// of "-" reads standard input.
+MapFileResult map_file(str filename);
+void mapped_file_free(MappedFile file);
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "dragon/core/arena.h"
+#include "dragon/core/buf.h"
+#include "dragon/core/str.h"
+
+// Interned strings are identified by a dense index, so equal names can be
+// compared and hashed as integers.
+typedef uint32_t SymbolId;
+
+typedef BUF(str) SymbolTextBuf;
+typedef BUF(uint32_t) SymbolHashBuf;
+
+typedef struct {
+	Arena text;
+	SymbolTextBuf symbols;
+	SymbolHashBuf hashes;
+	// open addressing, each slot holds a SymbolId + 1 or 0 if empty
+	uint32_t* slots;
+	uint64_t slotCount;
+} Interner;
+
+Interner interner_new(void);
+SymbolId interner_intern(Interner* interner, str text);
+str interner_get(const Interner* interner, SymbolId id);
+void interner_free(Interner interner);
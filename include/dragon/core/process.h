@@ -5,6 +5,7 @@
 #include <sys/types.h>
 
 #include "dragon/core/buf.h"
+#include "dragon/core/str.h"
 #include "dragon/core/sum.h"
 
 typedef struct {
@@ -38,3 +39,17 @@ ProcessJoinResult process_join(Process* process);
 void process_destroy(Process* process);
 
 ProcessCreateResult process_run(ProcessCStrBuf commandLine, ProcessOption options);
+
+// An anonymous file in memory. Processes spawned while it's open inherit the
+// descriptor, so they can open it by its path like a regular file.
+typedef struct {
+	int fd;
+	// /proc/self/fd/<fd>
+	str path;
+} MemoryFile;
+
+typedef MAYBE(MemoryFile) MemoryFileCreateResult;
+
+// `name` only shows up in /proc, for debugging.
+MemoryFileCreateResult memory_file_create(const char* name);
+void memory_file_free(MemoryFile file);
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdbool.h>
+
+typedef enum {
+	SCAN_IMPL_SCALAR,
+	SCAN_IMPL_SSE2,
+	SCAN_IMPL_AVX2,
+} ScanImpl;
+
+// The fastest implementation supported by the running CPU.
+ScanImpl scan_best_impl(void);
+bool scan_impl_supported(ScanImpl impl);
+// Selects the implementation used by the scan functions. Defaults to
+// scan_best_impl(). Mainly useful for tests and benchmarks.
+void scan_use_impl(ScanImpl impl);
+const char* scan_impl_name(ScanImpl impl);
+
+// Returns the first byte in [p, end) that isn't ' ', '\t', '\r' or '\n', or
+// end if there is none.
+const char* scan_skip_space(const char* p, const char* end);
+// Returns the first occurrence of c in [p, end), or end if there is none.
+const char* scan_find_char(const char* p, const char* end, char c);
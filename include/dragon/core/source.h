@@ -0,0 +1,30 @@
+#pragma once
+
+#include <inttypes.h>
+#include <stdint.h>
+
+#include "dragon/core/buf.h"
+#include "dragon/core/str.h"
+
+typedef struct {
+	str filename;
+	uint64_t line;
+	uint64_t column;
+} SourceLocation;
+
+#define SOURCE_LOCATION_FMT "%s:%" PRIu64 ":%" PRIu64
+#define SOURCE_LOCATION_ARG(loc) (loc).filename.ptr, (loc).line, (loc).column
+
+typedef BUF(uint32_t) LineOffsetBuf;
+
+// A source file's contents plus a table of line start offsets. The table is
+// only built the first time a location is resolved.
+typedef struct {
+	str filename;
+	str text;
+	LineOffsetBuf lines;
+} SourceFile;
+
+SourceFile source_file_new(str filename, str text);
+void source_file_free(SourceFile file);
+SourceLocation source_file_location(SourceFile* file, uint32_t offset);
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "dragon/object.h"
+
+// Writes `object`, which must be finished, as an ELF64 relocatable object for
+// x86-64 with sections .text, .symtab, .strtab and, if there are calls to
+// resolve, .rela.text. Returns false, with errno set, if it couldn't be
+// written.
+bool elf_write(const Object* object, FILE* fp);
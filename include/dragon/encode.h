@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "dragon/asm.h"
+#include "dragon/core/intern.h"
+#include "dragon/core/str.h"
+#include "dragon/object.h"
+
+// Appends the machine code for `code` to the object's text section as the
+// function `name`. Jumps get the shortest encoding that reaches their label
+// and every other instruction the encoding NASM picks, so the bytes match
+// what `nasm -f elf64` makes of asm_write's output. Symbol operands are
+// named from `symbols`.
+void encode_function(Object* object, str name, bool global, const InstructionBuf* code, const Interner* symbols);
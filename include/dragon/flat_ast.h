@@ -0,0 +1,85 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "dragon/ast.h"
+#include "dragon/core/buf.h"
+#include "dragon/core/str.h"
+
+// Index of a node in a FlatExpression.
+typedef uint32_t FlatNode;
+
+#define FLAT_NODE_NONE UINT32_MAX
+
+typedef BUF(uint8_t) FlatKindBuf;
+typedef BUF(FlatNode) FlatNodeBuf;
+typedef BUF(int64_t) FlatConstantBuf;
+
+// An expression tree stored in post-order, so every node comes after its
+// children and the root is the last node. Node i is described by the entries
+// at index i of the parallel arrays:
+//   types - its ExpressionType
+//   ops   - its UnaryOpKind or BinaryOpKind
+//   args  - the left child of a binary node, or the index into `constants`
+//           of a constant
+// The operand of a unary node and the right child of a binary node are always
+// the node right before it, so they aren't stored.
+typedef struct {
+	FlatKindBuf types;
+	FlatKindBuf ops;
+	FlatNodeBuf args;
+	FlatConstantBuf constants;
+} FlatExpression;
+
+FlatExpression flat_expression_new(const Expression* root);
+str flat_expression_to_str(const FlatExpression* expr);
+void flat_expression_free(FlatExpression expr);
+
+static inline uint32_t flat_expression_len(const FlatExpression* expr)
+{
+	return (uint32_t)expr->types.len;
+}
+
+static inline FlatNode flat_expression_root(const FlatExpression* expr)
+{
+	return flat_expression_len(expr) - 1;
+}
+
+static inline ExpressionType flat_type(const FlatExpression* expr, FlatNode node)
+{
+	return (ExpressionType)expr->types.ptr[node];
+}
+
+static inline UnaryOpKind flat_unary_op(const FlatExpression* expr, FlatNode node)
+{
+	return (UnaryOpKind)expr->ops.ptr[node];
+}
+
+static inline BinaryOpKind flat_binary_op(const FlatExpression* expr, FlatNode node)
+{
+	return (BinaryOpKind)expr->ops.ptr[node];
+}
+
+static inline FlatNode flat_operand(FlatNode node)
+{
+	return node - 1;
+}
+
+static inline FlatNode flat_left(const FlatExpression* expr, FlatNode node)
+{
+	return expr->args.ptr[node];
+}
+
+static inline FlatNode flat_right(FlatNode node)
+{
+	return node - 1;
+}
+
+static inline int64_t flat_constant(const FlatExpression* expr, FlatNode node)
+{
+	return expr->constants.ptr[expr->args.ptr[node]];
+}
+
+// Whether the node's value is always 0 or 1.
+bool flat_is_boolean(const FlatExpression* expr, FlatNode node);
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "dragon/ast.h"
+#include "dragon/core/source.h"
+#include "dragon/core/str.h"
+#include "dragon/core/sum.h"
+
+typedef struct {
+	// operators replaced by their value
+	uint64_t folded;
+	StrBuf warnings;
+} FoldResult;
+
+// Replaces operators whose operands are constants by their value, following
+// what the generated code would compute at run time. Division by a constant
+// zero is reported and left for run time. Other operations C leaves
+// undefined, signed overflow and shifts out of range, are reported but still
+// folded. `file` is only used to locate warnings. New nodes are allocated
+// from the program's arena.
+FoldResult fold_program(Program* program, SourceFile* file);
+void fold_result_free(FoldResult result);
+
+typedef MAYBE(int64_t) FoldValue;
+
+// Evaluate an operator the way the generated code would: arithmetic wraps
+// and shift counts are masked to 6 bits. Nothing is returned if the
+// operation would trap. && and || aren't operators here.
+int64_t fold_unary_op(UnaryOpKind kind, int64_t value);
+FoldValue fold_binary_op(BinaryOpKind kind, int64_t left, int64_t right);
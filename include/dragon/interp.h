@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "dragon/bytecode.h"
+#include "dragon/core/str.h"
+#include "dragon/core/sum.h"
+
+typedef RESULT(int64_t, str) InterpResult;
+
+// Runs `code` and returns what it returns. Host functions read from `in` and
+// write to `out`. Operations the generated code would trap on, like division
+// by zero, stop the program with an error instead.
+InterpResult interp_run(const Bytecode* code, FILE* in, FILE* out);
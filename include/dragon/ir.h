@@ -0,0 +1,116 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "dragon/ast.h"
+#include "dragon/core/buf.h"
+#include "dragon/core/intern.h"
+#include "dragon/core/str.h"
+
+// A virtual register. There are as many as a function needs, and the backend
+// decides where each one lives.
+typedef uint32_t IrValue;
+
+// Index of a basic block in its function.
+typedef uint32_t IrBlockId;
+
+#define IR_VALUE_NONE UINT32_MAX
+
+typedef enum {
+	IR_OPERAND_NONE,
+	IR_OPERAND_VALUE,
+	IR_OPERAND_CONSTANT,
+} IrOperandKind;
+
+typedef struct {
+	IrOperandKind kind;
+	// the IrValue or constant
+	int64_t value;
+} IrOperand;
+
+typedef enum {
+	// dst = args[0]
+	IR_OP_COPY,
+	// dst = op args[0]
+	IR_OP_UNARY,
+	// dst = args[0] op args[1], never && or ||
+	IR_OP_BINARY,
+	// continue at targets[0]
+	IR_OP_JUMP,
+	// continue at targets[0] if args[0] is nonzero, at targets[1] otherwise
+	IR_OP_BRANCH,
+	// return args[0] from the function
+	IR_OP_RETURN,
+} IrOpcode;
+
+// A three-address instruction. Values may be assigned more than once, as in
+// the result of && and ||, which is set on both paths.
+typedef struct {
+	IrOpcode opcode;
+	// the UnaryOpKind or BinaryOpKind
+	uint8_t op;
+	IrValue dst;
+	IrOperand args[2];
+	IrBlockId targets[2];
+} IrInstruction;
+
+typedef BUF(IrInstruction) IrInstructionBuf;
+typedef BUF(IrOperand) IrOperandBuf;
+typedef BUF(IrBlockId) IrBlockIdBuf;
+
+// In SSA form, selects the operand for the predecessor control came from.
+typedef struct {
+	IrValue dst;
+	// one per predecessor, in the same order
+	IrOperandBuf args;
+} IrPhi;
+
+typedef BUF(IrPhi) IrPhiBuf;
+
+// Straight-line code ending in the only jump, branch or return. Phis only
+// exist in SSA form, and `preds` is only kept up to date there.
+typedef struct {
+	IrPhiBuf phis;
+	IrInstructionBuf instructions;
+	IrBlockIdBuf preds;
+} IrBlock;
+
+typedef BUF(IrBlock) IrBlockBuf;
+
+// The entry is the first block, and blocks are laid out so that falling
+// through to the next one is the common case.
+typedef struct {
+	SymbolId name;
+	IrBlockBuf blocks;
+	uint32_t valueCount;
+} IrFunction;
+
+static inline IrOperand ir_value(IrValue value)
+{
+	return (IrOperand) { .kind = IR_OPERAND_VALUE, .value = value };
+}
+
+static inline IrOperand ir_constant(int64_t value)
+{
+	return (IrOperand) { .kind = IR_OPERAND_CONSTANT, .value = value };
+}
+
+static inline bool ir_is_terminator(IrOpcode opcode)
+{
+	return opcode == IR_OP_JUMP || opcode == IR_OP_BRANCH || opcode == IR_OP_RETURN;
+}
+
+// The last instruction of `block`.
+static inline const IrInstruction* ir_block_terminator(const IrBlock* block)
+{
+	return &block->instructions.ptr[block->instructions.len - 1];
+}
+
+// The blocks `block` may continue at, returning how many there are.
+uint32_t ir_successors(const IrBlock* block, IrBlockId succs[2]);
+
+IrFunction ir_lower_function(Function func);
+str ir_function_to_str(const IrFunction* func, const Interner* symbols);
+void ir_block_free(IrBlock block);
+void ir_function_free(IrFunction func);
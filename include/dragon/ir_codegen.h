@@ -0,0 +1,9 @@
+#pragma once
+
+#include "dragon/asm.h"
+#include "dragon/ir.h"
+#include "dragon/regalloc.h"
+
+// Translates `func`, which must be out of SSA form, to x86-64, including its
+// prologue and epilogue. Values live where `allocation` puts them.
+void ir_codegen_function(const IrFunction* func, const RegisterAllocation* allocation, InstructionBuf* code);
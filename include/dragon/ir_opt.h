@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "dragon/ir.h"
+
+typedef enum {
+#define X(name, pass, description) IR_OPT_COUNTER_##name,
+#include "dragon/ir_opt_counters.def"
+#undef X
+	IR_OPT_COUNTER_COUNT
+} IrOptCounter;
+
+typedef struct {
+	// how much each pass removed
+	uint64_t counts[IR_OPT_COUNTER_COUNT];
+} IrOptStats;
+
+typedef struct {
+	// sparse conditional constant propagation
+	bool sccp;
+	// global value numbering
+	bool gvn;
+	// dead code elimination
+	bool dce;
+} IrOptOptions;
+
+// Converts `func` to SSA form and runs the enabled passes over it, in the
+// order above. The function is left in SSA form, with the remaining values
+// numbered from 0 again.
+IrOptStats ir_optimize(IrFunction* func, IrOptOptions options);
+
+// The passes themselves, which take and keep SSA form with up to date
+// predecessors, adding to `stats`.
+
+// Wegman and Zadeck's sparse conditional constant propagation: finds the
+// values that are constant on every path that can run, replaces their uses
+// by the constant, turns branches on constants into jumps and removes the
+// blocks that can't run anymore.
+void ir_sccp(IrFunction* func, IrOptStats* stats);
+
+// Dominator-based value numbering: an instruction computing what a
+// dominating one already did is removed, and its uses read the earlier
+// value. So are phis choosing between equal operands.
+void ir_gvn(IrFunction* func, IrOptStats* stats);
+
+// Removes the instructions and phis whose values are never used, keeping
+// divisions that may trap.
+void ir_dce(IrFunction* func, IrOptStats* stats);
+
+// Where a pass replaces a value by an operand, `replacements.ptr[v]` is
+// that operand, and IR_OPERAND_NONE where `v` stays.
+typedef struct {
+	IrOperandBuf replacements;
+} IrValueMap;
+
+IrValueMap ir_value_map_new(const IrFunction* func);
+// The operand `operand` ends up as, following replacements of replacements.
+IrOperand ir_value_map_get(const IrValueMap* map, IrOperand operand);
+// Rewrites every use in `func`.
+void ir_value_map_apply(const IrValueMap* map, IrFunction* func);
+void ir_value_map_free(IrValueMap map);
+
+const char* ir_opt_counter_pass(IrOptCounter counter);
+const char* ir_opt_counter_description(IrOptCounter counter);
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "dragon/core/str.h"
+#include "dragon/core/sum.h"
+#include "dragon/object.h"
+
+typedef int64_t (*JitFunc)(void);
+
+// Code copied into executable memory by jit_load.
+typedef struct {
+	void* memory;
+	uint64_t len;
+	// the entry point, which can be called directly once jit_run has shown
+	// that it doesn't trap
+	JitFunc func;
+} JitCode;
+
+typedef RESULT(JitCode, str) JitCodeResult;
+typedef RESULT(int64_t, str) JitResult;
+
+// Copies the text of `object`, which must be finished, into executable memory
+// and finds `entry` there. Fails if the object calls symbols it doesn't define.
+JitCodeResult jit_load(const Object* object, str entry);
+
+// Calls the entry point of `code` as a function without arguments, returning
+// what it returns. A signal that kills the code is caught and reported instead.
+JitResult jit_run(const JitCode* code);
+
+void jit_unload(JitCode code);
+
+// Loads `object`, runs `entry` and unloads it again.
+JitResult jit_call(const Object* object, str entry);
@@ -3,23 +3,24 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#include "dragon/core/intern.h"
 #include "dragon/core/str.h"
 #include "dragon/core/sum.h"
 #include "dragon/token.h"
 
 typedef struct {
 	str source;
-	SourceLocation tokenStartLoc;
+	Interner* interner;
 	uint64_t tokenStart;
 	uint64_t pos;
-	str filename;
-	uint64_t line;
-	uint64_t column;
 	Token lookahead;
 	bool canLexHeaderName;
 } Lexer;
 
-Lexer lexer_new(str source, str filename);
+// The source must be followed by a NUL byte, as string literals and the
+// contents returned by map_file and slurp_file are. Identifiers are interned
+// into `interner`.
+Lexer lexer_new(str source, Interner* interner);
 
 typedef MAYBE(Token) MaybeToken;
 
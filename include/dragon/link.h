@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "dragon/core/str.h"
+#include "dragon/core/sum.h"
+#include "dragon/object.h"
+
+// The address the executable's only segment is loaded at, the same as ld's
+// default for x86-64.
+#define LINK_BASE_ADDRESS UINT64_C(0x400000)
+
+typedef MAYBE(str) LinkError;
+
+// Links the finished `objects` into a static x86-64 ELF executable that
+// starts at `_start`, appending it to `image`. The objects' text sections are
+// laid out in order, 16-byte aligned, in a single read-only executable
+// segment; the objects have no data yet. Fails on undefined or duplicate
+// global symbols.
+LinkError link_executable(const Object* objects, uint64_t count, ByteBuf* image);
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdint.h>
+
+// The constants for dividing by a divisor d with a multiplication instead of
+// idiv (Granlund and Montgomery, as derived in Hacker's Delight 10-4):
+//   q = high 64 bits of n * multiplier
+//   q += n    if d > 0 and multiplier < 0
+//   q -= n    if d < 0 and multiplier > 0
+//   q >>= shift (arithmetic)
+//   q += 1    if q < 0
+// leaves q = n / d, rounded toward zero.
+typedef struct {
+	int64_t multiplier;
+	uint8_t shift;
+} DivisionMagic;
+
+// `divisor` must not be -1, 0, 1 or INT64_MIN.
+DivisionMagic division_magic(int64_t divisor);
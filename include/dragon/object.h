@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "dragon/core/buf.h"
+#include "dragon/core/str.h"
+
+typedef BUF(uint8_t) ByteBuf;
+
+typedef struct {
+	str name;
+	// offset into the text section, if defined
+	uint64_t offset;
+	bool defined;
+	bool global;
+} ObjectSymbol;
+
+typedef BUF(ObjectSymbol) ObjectSymbolBuf;
+
+// A call's 32-bit displacement, relative to the end of the call.
+typedef struct {
+	// where the displacement is in the text section
+	uint64_t offset;
+	uint32_t symbol;
+} ObjectFixup;
+
+typedef BUF(ObjectFixup) ObjectFixupBuf;
+
+// The machine code of one translation unit, with a single text section.
+typedef struct {
+	ByteBuf text;
+	ObjectSymbolBuf symbols;
+	// calls not yet resolved, until object_finish
+	ObjectFixupBuf fixups;
+	// calls to symbols the object doesn't define, which the linker resolves
+	ObjectFixupBuf relocations;
+} Object;
+
+Object object_new(void);
+// The index of the symbol called `name`, added undefined if it's new.
+uint32_t object_symbol(Object* object, str name);
+// Defines `name` at the end of the text section.
+void object_define(Object* object, str name, bool global);
+// Appends the displacement of a call to `name`, to be resolved by
+// object_finish.
+void object_call(Object* object, str name);
+// Resolves calls to the symbols the object defines and leaves the rest as
+// relocations. Undefined symbols become global.
+void object_finish(Object* object);
+void object_free(Object object);
+
+void bytes_push8(ByteBuf* bytes, uint8_t value);
+void bytes_push16(ByteBuf* bytes, uint16_t value);
+void bytes_push32(ByteBuf* bytes, uint32_t value);
+void bytes_push64(ByteBuf* bytes, uint64_t value);
+// Overwrites the little-endian 32-bit value at `offset`.
+void bytes_patch32(ByteBuf* bytes, uint64_t offset, uint32_t value);
@@ -1,17 +1,22 @@
 #pragma once
 
+#include <stdint.h>
+
 #include "dragon/ast.h"
+#include "dragon/core/arena.h"
 #include "dragon/core/buf.h"
+#include "dragon/core/intern.h"
 #include "dragon/core/str.h"
 #include "dragon/core/sum.h"
-#include "dragon/lexer.h"
-#include "dragon/token.h"
-
-typedef BUF(Token) TokenBuf;
+#include "dragon/token_stream.h"
 
 typedef struct {
-	Lexer lexer;
-	TokenBuf buffer;
+	TokenStream tokens;
+	// Moved into the Program by parser_parse. If parsing fails, whatever was
+	// built so far is released by parser_free.
+	Interner symbols;
+	Arena nodes;
+	uint32_t pos;
 } Parser;
 
 Parser parser_new(str source, str filename);
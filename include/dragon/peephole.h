@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "dragon/asm.h"
+
+typedef enum {
+#define X(name, func, description) PEEPHOLE_RULE_##name,
+#include "dragon/peephole_rules.def"
+#undef X
+	PEEPHOLE_RULE_COUNT
+} PeepholeRule;
+
+typedef struct {
+	// how often each rule was applied
+	uint64_t hits[PEEPHOLE_RULE_COUNT];
+} PeepholeStats;
+
+// Rewrites short windows of instructions into cheaper equivalents: push/pop
+// pairs become moves, tests of flags that are already set are dropped and so
+// are jumps to the next instruction. The rules only look inside straight-line
+// code, so labels act as barriers.
+PeepholeStats peephole_optimize(InstructionBuf* code);
+const char* peephole_rule_description(PeepholeRule rule);
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "dragon/asm.h"
+#include "dragon/core/buf.h"
+#include "dragon/ir.h"
+
+typedef enum {
+	// every value gets a stack slot of its own
+	REGALLOC_STRATEGY_NONE,
+	// linear scan over live intervals, spilling what doesn't fit to the stack
+	REGALLOC_STRATEGY_LINEAR,
+} RegallocStrategy;
+
+typedef struct {
+	// values kept in a register, and values kept in a stack slot
+	uint64_t registers;
+	uint64_t spilled;
+} RegallocStats;
+
+typedef BUF(Operand) OperandBuf;
+typedef BUF(MachineRegister) MachineRegisterBuf;
+
+typedef struct {
+	// where each value lives, a register or a frame slot
+	OperandBuf locations;
+	// the callee-saved registers holding values, which the function has to
+	// restore before it returns, each saved in the frame slot at its index
+	MachineRegisterBuf saved;
+	// frame slots in use, the saved registers' included
+	uint32_t frameSlots;
+	RegallocStats stats;
+} RegisterAllocation;
+
+// Decides where the values of `func`, which must be out of SSA form, live.
+// rax, rcx and rdx are left for the backend's own use, and so are rsp and
+// rbp. There are no calls, so values go in caller-saved registers first.
+RegisterAllocation regalloc_function(const IrFunction* func, RegallocStrategy strategy);
+void register_allocation_free(RegisterAllocation allocation);
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "dragon/ast.h"
+#include "dragon/core/arena.h"
+#include "dragon/core/buf.h"
+
+typedef BUF(Expression**) ExpressionSlotBuf;
+
+// Every pointer to an expression in the tree rooted at `*root`, children
+// before their parents, so replacing them in order rewrites the tree bottom
+// up.
+ExpressionSlotBuf expression_post_order_slots(Expression** root);
+
+// Returns the replacement for `expr`, or NULL if the rule doesn't apply. The
+// children of `expr` have already been rewritten. New nodes are allocated
+// from `nodes`.
+typedef Expression* (*RewriteFunc)(Arena* nodes, Expression* expr);
+
+// A rewrite of the nodes of one operator.
+typedef struct {
+	ExpressionType type;
+	// the UnaryOpKind or BinaryOpKind matched
+	uint8_t op;
+	RewriteFunc apply;
+} RewriteRule;
+
+// Applies `rules` to every node of the tree rooted at `*root`, bottom up.
+// Whenever a rule applies, the rules are tried again on its result, so rules
+// must make the tree simpler. Nodes built by a rule below the node it returns
+// aren't revisited. `hits[i]` is incremented whenever `rules[i]` applies.
+void rewrite_expression(
+        Expression** root,
+        Arena* nodes,
+        const RewriteRule* rules,
+        uint64_t ruleCount,
+        uint64_t* hits
+);
+
+Expression* expression_new_constant(Arena* nodes, int64_t number);
+Expression* expression_new_unary(Arena* nodes, UnaryOpKind kind, uint32_t offset, Expression* operand);
+Expression* expression_new_binary(
+        Arena* nodes,
+        BinaryOpKind kind,
+        uint32_t offset,
+        Expression* left,
+        Expression* right
+);
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "dragon/ast.h"
+
+typedef enum {
+#define X(name, func, type, op, description) SIMPLIFY_RULE_##name,
+#include "dragon/simplify_rules.def"
+#undef X
+	SIMPLIFY_RULE_COUNT
+} SimplifyRule;
+
+typedef struct {
+	// how often each rule was applied
+	uint64_t hits[SIMPLIFY_RULE_COUNT];
+} SimplifyStats;
+
+// Replaces operators with one constant operand by cheaper equivalents:
+// identities are removed and multiplication, division and modulus by powers
+// of two become shifts and masks. Constant folding should run first. New
+// nodes are allocated from the program's arena.
+SimplifyStats simplify_program(Program* program);
+const char* simplify_rule_description(SimplifyRule rule);
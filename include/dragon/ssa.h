@@ -0,0 +1,13 @@
+#pragma once
+
+#include "dragon/ir.h"
+
+// Renames the function's values so each is assigned exactly once, inserting
+// phis where differently assigned values meet. Copies are folded away, so
+// their uses refer to the copied operand directly. Reading a value before any
+// assignment reads 0.
+void ssa_construct(IrFunction* func);
+
+// Replaces the phis with copies at the end of each predecessor, splitting the
+// edges that would otherwise run the copies on the wrong path.
+void ssa_destruct(IrFunction* func);
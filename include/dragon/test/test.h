@@ -64,7 +64,7 @@ typedef struct {
 #define RUN_TEST(state, name, displayname, ...) \
 	do { \
 		(void)fprintf(stderr, "TEST  " STR_FMT "\n", STR_ARG(displayname)); \
-		TestResult result = name##_test(state, __VA_ARGS__); \
+		TestResult result = name##_test(state, ##__VA_ARGS__); \
 		switch (result.type) { \
 		case TEST_RESULT_FAIL: \
 			++(state)->failed; \
@@ -4,6 +4,7 @@
 #include <stdint.h>
 #include <stdio.h>
 
+#include "dragon/core/intern.h"
 #include "dragon/core/str.h"
 
 typedef enum {
@@ -13,18 +14,20 @@ typedef enum {
 #undef X
 } TokenType;
 
-extern const char* TOKEN_STRINGS[];
+enum {
+	TOKEN_TYPE_COUNT = 0
+#define X(x) + 1
+#include "dragon/token_type.def"
+#undef X
+};
 
-typedef struct {
-	str filename;
-	uint64_t line;
-	uint64_t column;
-} SourceLocation;
+extern const char* TOKEN_STRINGS[];
 
 typedef enum {
 	TK_NONE,
 	TK_STR,
 	TK_NUM,
+	TK_SYM,
 } TokenValueKind;
 
 typedef struct {
@@ -32,23 +35,24 @@ typedef struct {
 	union {
 		str str;
 		int64_t num;
+		SymbolId sym;
 	} get;
 } TokenValue;
 
 #define TOKEN_VALUE_NONE ((TokenValue) { .kind = TK_NONE })
 #define TOKEN_VALUE_STR(s) ((TokenValue) { .kind = TK_STR, .get.str = s })
 #define TOKEN_VALUE_NUM(n) ((TokenValue) { .kind = TK_NUM, .get.num = n })
+#define TOKEN_VALUE_SYM(s) ((TokenValue) { .kind = TK_SYM, .get.sym = s })
 
+// Tokens borrow their text and string values from the lexer's source, which
+// must outlive them. Use a SourceFile to turn the offset into a location.
 typedef struct {
 	TokenType type;
-	SourceLocation location;
+	uint32_t offset;
 	str text;
 	TokenValue value;
 } Token;
 
 void token_free(Token tok);
 
-#define SOURCE_LOCATION_FMT "%s:%" PRIu64 ":%" PRIu64
-#define SOURCE_LOCATION_ARG(loc) (loc).filename.ptr, (loc).line, (loc).column
-
 void token_value_show(TokenValue val, FILE* fp);
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "dragon/core/buf.h"
+#include "dragon/core/intern.h"
+#include "dragon/core/source.h"
+#include "dragon/core/str.h"
+#include "dragon/token.h"
+
+// Sources at least this large can't be addressed by 32-bit token offsets.
+#define TOKEN_STREAM_MAX_SOURCE ((uint64_t)UINT32_MAX)
+
+typedef BUF(uint8_t) TokenKindBuf;
+typedef BUF(uint32_t) TokenOffsetBuf;
+
+typedef struct {
+	uint32_t token;
+	int64_t value;
+} TokenLiteral;
+
+typedef BUF(TokenLiteral) TokenLiteralBuf;
+
+// All tokens of a source file, stored as parallel arrays. The last token is
+// always TT_EOF. Number values and identifier symbols live in a side table
+// sorted by token index.
+typedef struct {
+	SourceFile file;
+	TokenKindBuf kinds;
+	TokenOffsetBuf offsets;
+	TokenOffsetBuf lengths;
+	TokenLiteralBuf literals;
+} TokenStream;
+
+// Identifiers are interned into `interner`, which is only used during the call.
+TokenStream token_stream_new(str source, str filename, Interner* interner);
+void token_stream_free(TokenStream stream);
+
+static inline uint32_t token_stream_len(const TokenStream* stream)
+{
+	return (uint32_t)stream->kinds.len;
+}
+
+static inline TokenType token_stream_kind(const TokenStream* stream, uint32_t index)
+{
+	return (TokenType)stream->kinds.ptr[index];
+}
+
+str token_stream_text(const TokenStream* stream, uint32_t index);
+int64_t token_stream_num(const TokenStream* stream, uint32_t index);
+SymbolId token_stream_sym(const TokenStream* stream, uint32_t index);
+SourceLocation token_stream_location(TokenStream* stream, uint32_t index);
+uint64_t token_stream_bytes(const TokenStream* stream);
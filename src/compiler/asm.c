@@ -0,0 +1,109 @@
+#include "dragon/asm.h"
+
+#include <inttypes.h>
+
+static const char* const OPCODE_MNEMONICS[] = {
+#define X(name, mnemonic) [OPCODE_##name] = mnemonic,
+#include "dragon/opcodes.def"
+#undef X
+};
+
+static const char* const MACHINE_REGISTER_NAMES[] = {
+#define X(name, text) [MREG_##name] = text,
+#include "dragon/machine_registers.def"
+#undef X
+};
+
+void asm_emit0(InstructionBuf* code, Opcode opcode)
+{
+	BUF_PUSH(code, ((Instruction) { .opcode = opcode }));
+}
+
+void asm_emit1(InstructionBuf* code, Opcode opcode, Operand a)
+{
+	BUF_PUSH(code, ((Instruction) { .opcode = opcode, .operands = { a } }));
+}
+
+void asm_emit2(InstructionBuf* code, Opcode opcode, Operand a, Operand b)
+{
+	BUF_PUSH(code, ((Instruction) { .opcode = opcode, .operands = { a, b } }));
+}
+
+void asm_emit3(InstructionBuf* code, Opcode opcode, Operand a, Operand b, Operand c)
+{
+	BUF_PUSH(code, ((Instruction) { .opcode = opcode, .operands = { a, b, c } }));
+}
+
+void asm_emit_label(InstructionBuf* code, uint32_t label)
+{
+	asm_emit1(code, OPCODE_LABEL, asm_label(label));
+}
+
+MachineRegister machine_register_full(MachineRegister reg)
+{
+	switch (reg) {
+	case MREG_AL:
+		return MREG_RAX;
+	case MREG_CL:
+		return MREG_RCX;
+	default:
+		return reg;
+	}
+}
+
+const char* machine_register_name(MachineRegister reg)
+{
+	return MACHINE_REGISTER_NAMES[reg];
+}
+
+const char* opcode_mnemonic(Opcode opcode)
+{
+	return OPCODE_MNEMONICS[opcode];
+}
+
+static void write_operand(Operand operand, const Interner* symbols, FILE* fp)
+{
+	switch (operand.kind) {
+	case OPERAND_NONE:
+		break;
+	case OPERAND_REGISTER:
+		(void)fputs(MACHINE_REGISTER_NAMES[operand.value], fp);
+		break;
+	case OPERAND_IMMEDIATE:
+		(void)fprintf(fp, "%" PRId64, operand.value);
+		break;
+	case OPERAND_LABEL:
+		(void)fprintf(fp, ".L%" PRId64, operand.value);
+		break;
+	case OPERAND_FRAME:
+		if (operand.value < 0) {
+			(void)fprintf(fp, "qword [rbp - %" PRId64 "]", -operand.value);
+		} else {
+			(void)fprintf(fp, "qword [rbp + %" PRId64 "]", operand.value);
+		}
+		break;
+	case OPERAND_SYMBOL: {
+		str name = interner_get(symbols, (SymbolId)operand.value);
+		(void)fprintf(fp, STR_FMT, STR_ARG(name));
+		break;
+	}
+	}
+}
+
+void asm_write(const InstructionBuf* code, const Interner* symbols, FILE* fp)
+{
+	for (uint64_t i = 0; i < code->len; i++) {
+		const Instruction* insn = &code->ptr[i];
+		if (insn->opcode == OPCODE_LABEL) {
+			write_operand(insn->operands[0], symbols, fp);
+			(void)fputs(":\n", fp);
+			continue;
+		}
+		(void)fprintf(fp, "    %s", OPCODE_MNEMONICS[insn->opcode]);
+		for (uint64_t j = 0; j < ASM_MAX_OPERANDS && insn->operands[j].kind != OPERAND_NONE; j++) {
+			(void)fputs(j == 0 ? " " : ", ", fp);
+			write_operand(insn->operands[j], symbols, fp);
+		}
+		(void)fputc('\n', fp);
+	}
+}
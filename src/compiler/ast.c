@@ -1,27 +1,12 @@
 #include "dragon/ast.h"
 
-#include <inttypes.h>
-#include <stdlib.h>
+#include "dragon/flat_ast.h"
 
 typedef struct {
 	uint64_t indent;
 	str indentStr;
 } AstEmitter;
 
-static const char* UNARY_OP_KIND_STRINGS[] = {
-#define X(x) #x,
-#include "dragon/unary_op_kinds.def"
-
-#undef X
-};
-
-static const char* BINARY_OP_KIND_STRINGS[] = {
-#define X(x) #x,
-#include "dragon/binary_op_kinds.def"
-
-#undef X
-};
-
 static void emitter_indent(AstEmitter* em)
 {
 	em->indent++;
@@ -41,37 +26,18 @@ static str emit_line(AstEmitter* em, str line)
 	return str_cat(str_ref(em->indentStr), line, str_lit("\n"));
 }
 
-static str expr_to_str(Expression* expr)
-{
-	switch (expr->type) {
-	case EXPRESSION_TYPE_CONSTANT:
-		return str_fmt("%" PRId64, ((ConstantExpression*)expr)->number);
-	case EXPRESSION_TYPE_UNARY_OP: {
-		UnaryOpExpression* unary = (UnaryOpExpression*)expr;
-		str s = str_fmt("%s ", UNARY_OP_KIND_STRINGS[unary->kind]);
-		s = str_cat(s, expr_to_str(unary->operand));
-		return s;
-	}
-	case EXPRESSION_TYPE_BINARY_OP: {
-		BinaryOpExpression* binary = (BinaryOpExpression*)expr;
-		str s = str_cat(str_lit("("), expr_to_str(binary->left));
-		s = str_fmt(" %s ", BINARY_OP_KIND_STRINGS[binary->kind]);
-		s = str_cat(s, expr_to_str(binary->right), str_lit(")"));
-		return s;
-	}
-	}
-}
-
 static str stmt_to_str(Statement stmt)
 {
 	str s = str_empty;
-	s = str_cat(s, str_lit("RETURN INT "), expr_to_str(stmt.expression));
+	FlatExpression expr = flat_expression_new(stmt.expression);
+	s = str_cat(s, str_lit("RETURN INT "), flat_expression_to_str(&expr));
+	flat_expression_free(expr);
 	return s;
 }
 
-static str func_to_str(AstEmitter* em, Function func)
+static str func_to_str(AstEmitter* em, const Interner* symbols, Function func)
 {
-	str name = str_ref(func.name);
+	str name = interner_get(symbols, func.name);
 	str s = str_empty;
 	s = str_cat(s, emit_line(em, str_fmt("FUN INT " STR_FMT, STR_ARG(name))));
 	emitter_indent(em);
@@ -84,33 +50,13 @@ str program_to_str(Program program)
 {
 	str s = str_empty;
 	AstEmitter em = {0};
-	s = str_cat(s, func_to_str(&em, program.function));
+	s = str_cat(s, func_to_str(&em, &program.symbols, program.function));
 	str_free(em.indentStr);
 	return s;
 }
 
-void expression_free(Expression* expression)
-{
-	switch (expression->type) {
-	case EXPRESSION_TYPE_CONSTANT:
-		break;
-	case EXPRESSION_TYPE_UNARY_OP: {
-		UnaryOpExpression* unary = (UnaryOpExpression*)expression;
-		expression_free(unary->operand);
-		break;
-	}
-	case EXPRESSION_TYPE_BINARY_OP: {
-		BinaryOpExpression* binary = (BinaryOpExpression*)expression;
-		expression_free(binary->left);
-		expression_free(binary->right);
-		break;
-	}
-	}
-	free(expression);
-}
-
 void program_free(Program program)
 {
-	str_free(program.function.name);
-	expression_free(program.function.statement.expression);
+	arena_free(program.nodes);
+	interner_free(program.symbols);
 }
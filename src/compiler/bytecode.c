@@ -0,0 +1,337 @@
+#include "dragon/bytecode.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#include "dragon/core/macro.h"
+#include "dragon/flat_ast.h"
+
+static const char* const OPCODE_NAMES[] = {
+#define X(name, mnemonic) mnemonic,
+#include "dragon/bytecode_ops.def"
+#undef X
+};
+
+static const char* const HOST_FUNCTION_NAMES[] = {
+#define X(name, cname, arity) cname,
+#include "dragon/host_functions.def"
+#undef X
+};
+
+static const uint32_t HOST_FUNCTION_ARITIES[] = {
+#define X(name, cname, arity) arity,
+#include "dragon/host_functions.def"
+#undef X
+};
+
+static const BcOpcode BINARY_OPCODES[] = {
+	[BINARY_OP_KIND_ADDITION] = BC_OP_ADD,
+	[BINARY_OP_KIND_SUBTRACTION] = BC_OP_SUB,
+	[BINARY_OP_KIND_MULTIPLICATION] = BC_OP_MUL,
+	[BINARY_OP_KIND_DIVISION] = BC_OP_DIV,
+	[BINARY_OP_KIND_MODULUS] = BC_OP_MOD,
+	[BINARY_OP_KIND_BITWISE_SHIFT_LEFT] = BC_OP_SHL,
+	[BINARY_OP_KIND_BITWISE_SHIFT_RIGHT] = BC_OP_SAR,
+	[BINARY_OP_KIND_LESS] = BC_OP_LT,
+	[BINARY_OP_KIND_LESS_EQUAL] = BC_OP_LE,
+	[BINARY_OP_KIND_GREATER] = BC_OP_GT,
+	[BINARY_OP_KIND_GREATER_EQUAL] = BC_OP_GE,
+	[BINARY_OP_KIND_EQUALITY] = BC_OP_EQ,
+	[BINARY_OP_KIND_INEQUALITY] = BC_OP_NE,
+	[BINARY_OP_KIND_BITWISE_AND] = BC_OP_AND,
+	[BINARY_OP_KIND_BITWISE_XOR] = BC_OP_XOR,
+	[BINARY_OP_KIND_BITWISE_OR] = BC_OP_OR,
+};
+
+static const BcOpcode UNARY_OPCODES[] = {
+	[UNARY_OP_KIND_ARITHMETIC_NEGATION] = BC_OP_NEG,
+	[UNARY_OP_KIND_BITWISE_NEGATION] = BC_OP_NOT,
+	[UNARY_OP_KIND_LOGICAL_NEGATION] = BC_OP_LOGICAL_NOT,
+};
+
+// A value on the evaluation stack. Its register is its index in the stack, and
+// constants are only loaded into it when an instruction can't take them as an
+// immediate.
+typedef struct {
+	bool isConstant;
+	int64_t value;
+} StackSlot;
+
+typedef BUF(StackSlot) StackSlotBuf;
+typedef BUF(uint32_t) JumpBuf;
+
+typedef struct {
+	Bytecode code;
+	StackSlotBuf stack;
+	// the jz or jnz after the left operand of each && or || being compiled
+	JumpBuf pending;
+	bool tooDeep;
+} Compiler;
+
+static void emit(Compiler* compiler, BcOpcode opcode, uint32_t dst, uint32_t a, uint32_t b)
+{
+	BUF_PUSH(&compiler->code.code, ((BcInstruction) {
+		.opcode = (uint16_t)opcode,
+		.dst = (BcRegister)dst,
+		.a = (uint16_t)a,
+		.b = (uint16_t)b,
+	}));
+}
+
+static void emit_wide(Compiler* compiler, BcOpcode opcode, uint32_t dst, uint32_t wide)
+{
+	emit(compiler, opcode, dst, wide & UINT16_MAX, wide >> 16U);
+}
+
+static void push(Compiler* compiler, StackSlot slot)
+{
+	BUF_PUSH(&compiler->stack, slot);
+	if (compiler->stack.len > (uint64_t)BC_REGISTER_MAX + 1) {
+		compiler->tooDeep = true;
+	}
+	if (compiler->stack.len > compiler->code.registerCount) {
+		compiler->code.registerCount = (uint32_t)compiler->stack.len;
+	}
+}
+
+// Loads the slot into its register if it's a constant, returning the register.
+static uint32_t materialize(Compiler* compiler, uint32_t reg)
+{
+	StackSlot* slot = &compiler->stack.ptr[reg];
+	if (!slot->isConstant) {
+		return reg;
+	}
+	slot->isConstant = false;
+	if (slot->value >= INT32_MIN && slot->value <= INT32_MAX) {
+		emit_wide(compiler, BC_OP_LOAD, reg, (uint32_t)(int32_t)slot->value);
+	} else {
+		uint32_t index = (uint32_t)compiler->code.constants.len;
+		BUF_PUSH(&compiler->code.constants, slot->value);
+		emit_wide(compiler, BC_OP_LOAD_CONSTANT, reg, index);
+	}
+	return reg;
+}
+
+static uint32_t top(const Compiler* compiler)
+{
+	return (uint32_t)compiler->stack.len - 1;
+}
+
+static bool is_logical_op(BinaryOpKind kind)
+{
+	return kind == BINARY_OP_KIND_LOGICAL_AND || kind == BINARY_OP_KIND_LOGICAL_OR;
+}
+
+static void compile_binary(Compiler* compiler, BinaryOpKind kind)
+{
+	uint32_t right = top(compiler);
+	uint32_t left = materialize(compiler, right - 1);
+	StackSlot rightSlot = compiler->stack.ptr[right];
+	if (rightSlot.isConstant && rightSlot.value >= INT16_MIN && rightSlot.value <= INT16_MAX) {
+		BcOpcode opcode = BINARY_OPCODES[kind] - BC_OP_ADD + BC_OP_ADD_IMM;
+		emit(compiler, opcode, left, left, (uint16_t)(int16_t)rightSlot.value);
+	} else {
+		emit(compiler, BINARY_OPCODES[kind], left, left, materialize(compiler, right));
+	}
+	compiler->stack.len--;
+}
+
+// Once the left operand of && or || is in its register, the rest is skipped
+// if it decides the result. || needs it as 0 or 1 to be the result.
+static void compile_short_circuit(Compiler* compiler, const FlatExpression* expr, FlatNode left, BinaryOpKind kind)
+{
+	uint32_t reg = materialize(compiler, top(compiler));
+	bool isAnd = kind == BINARY_OP_KIND_LOGICAL_AND;
+	if (!isAnd && !flat_is_boolean(expr, left)) {
+		emit(compiler, BC_OP_BOOL, reg, reg, 0);
+	}
+	BUF_PUSH(&compiler->pending, (uint32_t)compiler->code.code.len);
+	emit(compiler, isAnd ? BC_OP_JUMP_IF_ZERO : BC_OP_JUMP_IF_NONZERO, reg, 0, 0);
+	// the right operand goes in the same register
+	compiler->stack.len--;
+}
+
+static void compile_logical(Compiler* compiler, const FlatExpression* expr, FlatNode right)
+{
+	uint32_t reg = materialize(compiler, top(compiler));
+	if (!flat_is_boolean(expr, right)) {
+		emit(compiler, BC_OP_BOOL, reg, reg, 0);
+	}
+	uint32_t jump = compiler->pending.ptr[--compiler->pending.len];
+	uint32_t end = (uint32_t)compiler->code.code.len;
+	compiler->code.code.ptr[jump].a = (uint16_t)(end & UINT16_MAX);
+	compiler->code.code.ptr[jump].b = (uint16_t)(end >> 16U);
+}
+
+// Compiles the expression from its post-order form, so deep trees don't need
+// recursion, like ir_lower_function.
+BytecodeResult bytecode_compile(Function func)
+{
+	Compiler compiler = {
+		.code = { .code = BUF_NEW, .constants = BUF_NEW, .registerCount = 0 },
+		.stack = BUF_NEW,
+		.pending = BUF_NEW,
+		.tooDeep = false,
+	};
+
+	FlatExpression expr = flat_expression_new(func.statement.expression);
+	uint32_t len = flat_expression_len(&expr);
+	// For each node that is the left operand of && or ||, the operator node.
+	FlatNodeBuf shortCircuits = BUF_NEW;
+	BUF_RESERVE(&shortCircuits, len);
+	shortCircuits.len = len;
+	for (FlatNode node = 0; node < len; node++) {
+		shortCircuits.ptr[node] = FLAT_NODE_NONE;
+	}
+	for (FlatNode node = 0; node < len; node++) {
+		if (flat_type(&expr, node) == EXPRESSION_TYPE_BINARY_OP && is_logical_op(flat_binary_op(&expr, node))) {
+			shortCircuits.ptr[flat_left(&expr, node)] = node;
+		}
+	}
+
+	for (FlatNode node = 0; node < len && !compiler.tooDeep; node++) {
+		switch (flat_type(&expr, node)) {
+		case EXPRESSION_TYPE_CONSTANT:
+			push(&compiler, (StackSlot) { .isConstant = true, .value = flat_constant(&expr, node) });
+			break;
+		case EXPRESSION_TYPE_UNARY_OP: {
+			uint32_t reg = materialize(&compiler, top(&compiler));
+			emit(&compiler, UNARY_OPCODES[flat_unary_op(&expr, node)], reg, reg, 0);
+			break;
+		}
+		case EXPRESSION_TYPE_BINARY_OP: {
+			BinaryOpKind kind = flat_binary_op(&expr, node);
+			if (is_logical_op(kind)) {
+				compile_logical(&compiler, &expr, flat_right(node));
+			} else {
+				compile_binary(&compiler, kind);
+			}
+			break;
+		}
+		}
+		FlatNode parent = shortCircuits.ptr[node];
+		if (parent != FLAT_NODE_NONE) {
+			compile_short_circuit(&compiler, &expr, node, flat_binary_op(&expr, parent));
+		}
+	}
+	if (!compiler.tooDeep) {
+		emit(&compiler, BC_OP_RETURN, 0, materialize(&compiler, top(&compiler)), 0);
+	}
+
+	BUF_FREE(shortCircuits);
+	BUF_FREE(compiler.pending);
+	BUF_FREE(compiler.stack);
+	flat_expression_free(expr);
+
+	if (compiler.tooDeep) {
+		bytecode_free(compiler.code);
+		return (BytecodeResult)ERR(str_fmt("expression nested deeper than %d operands", BC_REGISTER_MAX + 1));
+	}
+	return (BytecodeResult)OK(compiler.code);
+}
+
+static str instruction_to_str(const Bytecode* code, BcInstruction insn)
+{
+	const char* name = OPCODE_NAMES[insn.opcode];
+	switch ((BcOpcode)insn.opcode) {
+	case BC_OP_LOAD:
+		return str_fmt("%-6s r%" PRIu16 ", %" PRId32, name, insn.dst, (int32_t)bc_wide(insn));
+	case BC_OP_LOAD_CONSTANT:
+		return str_fmt("%-6s r%" PRIu16 ", %" PRId64, name, insn.dst, code->constants.ptr[bc_wide(insn)]);
+	case BC_OP_NEG:
+	case BC_OP_NOT:
+	case BC_OP_LOGICAL_NOT:
+	case BC_OP_BOOL:
+		return str_fmt("%-6s r%" PRIu16 ", r%" PRIu16, name, insn.dst, insn.a);
+	case BC_OP_ADD:
+	case BC_OP_SUB:
+	case BC_OP_MUL:
+	case BC_OP_DIV:
+	case BC_OP_MOD:
+	case BC_OP_SHL:
+	case BC_OP_SAR:
+	case BC_OP_LT:
+	case BC_OP_LE:
+	case BC_OP_GT:
+	case BC_OP_GE:
+	case BC_OP_EQ:
+	case BC_OP_NE:
+	case BC_OP_AND:
+	case BC_OP_XOR:
+	case BC_OP_OR:
+		return str_fmt("%-6s r%" PRIu16 ", r%" PRIu16 ", r%" PRIu16, name, insn.dst, insn.a, insn.b);
+	case BC_OP_ADD_IMM:
+	case BC_OP_SUB_IMM:
+	case BC_OP_MUL_IMM:
+	case BC_OP_DIV_IMM:
+	case BC_OP_MOD_IMM:
+	case BC_OP_SHL_IMM:
+	case BC_OP_SAR_IMM:
+	case BC_OP_LT_IMM:
+	case BC_OP_LE_IMM:
+	case BC_OP_GT_IMM:
+	case BC_OP_GE_IMM:
+	case BC_OP_EQ_IMM:
+	case BC_OP_NE_IMM:
+	case BC_OP_AND_IMM:
+	case BC_OP_XOR_IMM:
+	case BC_OP_OR_IMM:
+		return str_fmt("%-6s r%" PRIu16 ", r%" PRIu16 ", %" PRId16, name, insn.dst, insn.a, (int16_t)insn.b);
+	case BC_OP_JUMP:
+		return str_fmt("%-6s %" PRIu32, name, bc_wide(insn));
+	case BC_OP_JUMP_IF_ZERO:
+	case BC_OP_JUMP_IF_NONZERO:
+		return str_fmt("%-6s r%" PRIu16 ", %" PRIu32, name, insn.dst, bc_wide(insn));
+	case BC_OP_CALL:
+		return str_fmt(
+		               "%-6s r%" PRIu16 ", %s, r%" PRIu16,
+		               name,
+		               insn.dst,
+		               insn.a < HOST_FUNCTION_COUNT ? HOST_FUNCTION_NAMES[insn.a] : "?",
+		               insn.b
+		       );
+	case BC_OP_RETURN:
+		return str_fmt("%-6s r%" PRIu16, name, insn.a);
+	case BC_OP_COUNT:
+		break;
+	}
+	UNREACHABLE();
+}
+
+str bytecode_to_str(const Bytecode* code)
+{
+	StrBuf lines = BUF_NEW;
+	BUF_PUSH(&lines, str_fmt("registers %" PRIu32, code->registerCount));
+	for (uint64_t i = 0; i < code->code.len; i++) {
+		BUF_PUSH(
+		        &lines,
+		        str_cat(str_fmt("%4" PRIu64 ": ", i), instruction_to_str(code, code->code.ptr[i]))
+		);
+	}
+	// end with a newline
+	BUF_PUSH(&lines, str_empty);
+	str s = str_join(str_lit("\n"), lines);
+	BUF_FREE(lines);
+	return s;
+}
+
+void bytecode_free(Bytecode code)
+{
+	BUF_FREE(code.code);
+	BUF_FREE(code.constants);
+}
+
+HostFunctionFindResult host_function_find(str name)
+{
+	for (HostFunction function = 0; function < HOST_FUNCTION_COUNT; function++) {
+		if (str_eq(name, str_ref(HOST_FUNCTION_NAMES[function]))) {
+			return (HostFunctionFindResult)JUST(function);
+		}
+	}
+	return (HostFunctionFindResult)NOTHING;
+}
+
+uint32_t host_function_arity(HostFunction function)
+{
+	return HOST_FUNCTION_ARITIES[function];
+}
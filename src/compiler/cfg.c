@@ -0,0 +1,248 @@
+#include "dragon/cfg.h"
+
+#include <stdbool.h>
+
+#include "dragon/core/buf.h"
+
+#define UNDEFINED UINT32_MAX
+
+typedef BUF(bool) VisitedBuf;
+
+static void fill(IrBlockIdBuf* buf, uint64_t len, IrBlockId value)
+{
+	BUF_RESERVE(buf, len);
+	buf->len = len;
+	for (uint64_t i = 0; i < len; i++) {
+		buf->ptr[i] = value;
+	}
+}
+
+void ir_compute_predecessors(IrFunction* func)
+{
+	for (IrBlockId id = 0; id < func->blocks.len; id++) {
+		func->blocks.ptr[id].preds.len = 0;
+	}
+	for (IrBlockId id = 0; id < func->blocks.len; id++) {
+		IrBlockId succs[2];
+		uint32_t count = ir_successors(&func->blocks.ptr[id], succs);
+		for (uint32_t i = 0; i < count; i++) {
+			BUF_PUSH(&func->blocks.ptr[succs[i]].preds, id);
+		}
+	}
+}
+
+void ir_remove_predecessor(IrFunction* func, IrBlockId block, IrBlockId pred)
+{
+	IrBlock* b = &func->blocks.ptr[block];
+	uint64_t index = 0;
+	while (b->preds.ptr[index] != pred) {
+		index++;
+	}
+	b->preds.len--;
+	memmove(&b->preds.ptr[index], &b->preds.ptr[index + 1], (b->preds.len - index) * sizeof(IrBlockId));
+	for (uint64_t i = 0; i < b->phis.len; i++) {
+		IrOperandBuf* args = &b->phis.ptr[i].args;
+		args->len--;
+		memmove(&args->ptr[index], &args->ptr[index + 1], (args->len - index) * sizeof(IrOperand));
+	}
+}
+
+void ir_reorder_blocks(IrFunction* func, const IrBlockIdBuf* order)
+{
+	IrBlockBuf* blocks = &func->blocks;
+	IrBlockIdBuf positions = BUF_NEW;
+	fill(&positions, blocks->len, UNDEFINED);
+	for (uint64_t i = 0; i < order->len; i++) {
+		positions.ptr[order->ptr[i]] = (IrBlockId)i;
+	}
+	IrBlockBuf reordered = BUF_NEW;
+	BUF_RESERVE(&reordered, order->len);
+	for (uint64_t i = 0; i < order->len; i++) {
+		IrBlock block = blocks->ptr[order->ptr[i]];
+		IrInstruction* last = &block.instructions.ptr[block.instructions.len - 1];
+		uint64_t targets = last->opcode == IR_OP_BRANCH ? 2 : last->opcode == IR_OP_JUMP ? 1 : 0;
+		for (uint64_t j = 0; j < targets; j++) {
+			last->targets[j] = positions.ptr[last->targets[j]];
+		}
+		for (uint64_t j = 0; j < block.preds.len; j++) {
+			block.preds.ptr[j] = positions.ptr[block.preds.ptr[j]];
+		}
+		BUF_PUSH(&reordered, block);
+	}
+	for (IrBlockId id = 0; id < blocks->len; id++) {
+		if (positions.ptr[id] == UNDEFINED) {
+			ir_block_free(blocks->ptr[id]);
+		}
+	}
+	BUF_FREE(*blocks);
+	*blocks = reordered;
+	BUF_FREE(positions);
+}
+
+uint64_t ir_remove_unreachable_blocks(IrFunction* func)
+{
+	uint64_t len = func->blocks.len;
+	VisitedBuf reachable = BUF_NEW;
+	BUF_RESERVE(&reachable, len);
+	reachable.len = len;
+	for (uint64_t i = 0; i < len; i++) {
+		reachable.ptr[i] = false;
+	}
+	IrBlockIdBuf worklist = BUF_NEW;
+	reachable.ptr[0] = true;
+	BUF_PUSH(&worklist, 0);
+	while (worklist.len > 0) {
+		IrBlockId id = worklist.ptr[--worklist.len];
+		IrBlockId succs[2];
+		uint32_t count = ir_successors(&func->blocks.ptr[id], succs);
+		for (uint32_t i = 0; i < count; i++) {
+			if (!reachable.ptr[succs[i]]) {
+				reachable.ptr[succs[i]] = true;
+				BUF_PUSH(&worklist, succs[i]);
+			}
+		}
+	}
+
+	IrBlockIdBuf kept = BUF_NEW;
+	for (IrBlockId id = 0; id < len; id++) {
+		if (reachable.ptr[id]) {
+			BUF_PUSH(&kept, id);
+			continue;
+		}
+		IrBlockId succs[2];
+		uint32_t count = ir_successors(&func->blocks.ptr[id], succs);
+		for (uint32_t i = 0; i < count; i++) {
+			if (reachable.ptr[succs[i]]) {
+				ir_remove_predecessor(func, succs[i], id);
+			}
+		}
+	}
+	uint64_t removed = len - kept.len;
+	if (removed > 0) {
+		ir_reorder_blocks(func, &kept);
+	}
+	BUF_FREE(kept);
+	BUF_FREE(worklist);
+	BUF_FREE(reachable);
+	return removed;
+}
+
+typedef struct {
+	IrBlockId block;
+	uint32_t nextSucc;
+} DfsFrame;
+
+typedef BUF(DfsFrame) DfsFrameBuf;
+
+// The blocks in postorder of a depth-first walk from the entry.
+static IrBlockIdBuf postorder(const IrFunction* func)
+{
+	VisitedBuf visited = BUF_NEW;
+	BUF_RESERVE(&visited, func->blocks.len);
+	visited.len = func->blocks.len;
+	for (uint64_t i = 0; i < visited.len; i++) {
+		visited.ptr[i] = false;
+	}
+	IrBlockIdBuf order = BUF_NEW;
+	DfsFrameBuf frames = BUF_NEW;
+	visited.ptr[0] = true;
+	BUF_PUSH(&frames, ((DfsFrame) { .block = 0, .nextSucc = 0 }));
+	while (frames.len > 0) {
+		DfsFrame* frame = &frames.ptr[frames.len - 1];
+		IrBlockId succs[2];
+		uint32_t count = ir_successors(&func->blocks.ptr[frame->block], succs);
+		if (frame->nextSucc == count) {
+			BUF_PUSH(&order, frame->block);
+			frames.len--;
+			continue;
+		}
+		IrBlockId succ = succs[frame->nextSucc++];
+		if (!visited.ptr[succ]) {
+			visited.ptr[succ] = true;
+			BUF_PUSH(&frames, ((DfsFrame) { .block = succ, .nextSucc = 0 }));
+		}
+	}
+	BUF_FREE(frames);
+	BUF_FREE(visited);
+	return order;
+}
+
+// Cooper, Harvey and Kennedy's "A Simple, Fast Dominance Algorithm":
+// iterate over the blocks in reverse postorder, intersecting the dominators
+// of each block's processed predecessors, until nothing changes.
+IrDominatorTree ir_dominator_tree_new(const IrFunction* func)
+{
+	uint64_t len = func->blocks.len;
+	IrBlockIdBuf order = postorder(func);
+	IrBlockIdBuf number = BUF_NEW;
+	fill(&number, len, 0);
+	for (uint64_t i = 0; i < order.len; i++) {
+		number.ptr[order.ptr[i]] = (IrBlockId)i;
+	}
+
+	IrDominatorTree tree = { .idom = BUF_NEW, .childStart = BUF_NEW, .children = BUF_NEW };
+	fill(&tree.idom, len, UNDEFINED);
+	tree.idom.ptr[0] = 0;
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		for (uint64_t i = order.len - 1; i-- > 0;) {
+			IrBlockId block = order.ptr[i];
+			const IrBlockIdBuf* preds = &func->blocks.ptr[block].preds;
+			IrBlockId idom = UNDEFINED;
+			for (uint64_t j = 0; j < preds->len; j++) {
+				IrBlockId pred = preds->ptr[j];
+				if (tree.idom.ptr[pred] == UNDEFINED) {
+					continue;
+				}
+				if (idom == UNDEFINED) {
+					idom = pred;
+					continue;
+				}
+				IrBlockId a = pred;
+				IrBlockId b = idom;
+				while (a != b) {
+					while (number.ptr[a] < number.ptr[b]) {
+						a = tree.idom.ptr[a];
+					}
+					while (number.ptr[b] < number.ptr[a]) {
+						b = tree.idom.ptr[b];
+					}
+				}
+				idom = a;
+			}
+			if (tree.idom.ptr[block] != idom) {
+				tree.idom.ptr[block] = idom;
+				changed = true;
+			}
+		}
+	}
+
+	// count the children of each block, then place them
+	fill(&tree.childStart, len + 1, 0);
+	for (IrBlockId id = 1; id < len; id++) {
+		tree.childStart.ptr[tree.idom.ptr[id] + 1]++;
+	}
+	for (uint64_t i = 0; i < len; i++) {
+		tree.childStart.ptr[i + 1] += tree.childStart.ptr[i];
+	}
+	fill(&tree.children, len > 0 ? len - 1 : 0, 0);
+	IrBlockIdBuf next = BUF_NEW;
+	fill(&next, len, 0);
+	for (IrBlockId id = 1; id < len; id++) {
+		IrBlockId parent = tree.idom.ptr[id];
+		tree.children.ptr[tree.childStart.ptr[parent] + next.ptr[parent]++] = id;
+	}
+
+	BUF_FREE(next);
+	BUF_FREE(number);
+	BUF_FREE(order);
+	return tree;
+}
+
+void ir_dominator_tree_free(IrDominatorTree tree)
+{
+	BUF_FREE(tree.idom);
+	BUF_FREE(tree.childStart);
+	BUF_FREE(tree.children);
+}
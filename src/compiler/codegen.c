@@ -1,278 +1,1116 @@
 #include "dragon/codegen.h"
 
 #include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 
+#include "dragon/asm.h"
+#include "dragon/core/buf.h"
+#include "dragon/core/macro.h"
+#include "dragon/elf.h"
+#include "dragon/encode.h"
+#include "dragon/flat_ast.h"
+#include "dragon/ir.h"
+#include "dragon/ir_codegen.h"
+#include "dragon/ir_opt.h"
+#include "dragon/magic.h"
+#include "dragon/object.h"
+#include "dragon/peephole.h"
+#include "dragon/regalloc.h"
+#include "dragon/ssa.h"
+
 #include "embedded/header.nasm.h"
 
 typedef struct {
-	FILE* fp;
-	uint64_t labelCount;
+	InstructionBuf* code;
+	CodegenOptions options;
+	uint32_t labelCount;
 } Compiler;
 
-static str get_label(Compiler* compiler)
+#define LABEL_NONE UINT32_MAX
+
+#define RAX asm_reg(MREG_RAX)
+#define RCX asm_reg(MREG_RCX)
+#define RDX asm_reg(MREG_RDX)
+#define RDI asm_reg(MREG_RDI)
+#define AL asm_reg(MREG_AL)
+#define CL asm_reg(MREG_CL)
+
+static uint32_t get_label(Compiler* compiler)
 {
-	return str_fmt(".L%" PRIu64, compiler->labelCount++);
+	return compiler->labelCount++;
 }
 
-static void codegen_constant_expr(Compiler* compiler, ConstantExpression* expr)
+static bool is_imm32(int64_t value)
 {
-	(void)fprintf(compiler->fp, "    push %" PRId64 "\n", expr->number);
+	return value >= INT32_MIN && value <= INT32_MAX;
 }
 
-static void codegen_expr(Compiler* compiler, Expression* expr);
+typedef BUF(uint32_t) LabelBuf;
 
-static void codegen_unary_op_expr(Compiler* compiler, UnaryOpExpression* expr)
+static void codegen_unary_op(Compiler* compiler, UnaryOpKind kind)
 {
-	FILE* fp = compiler->fp;
-	codegen_expr(compiler, expr->operand);
-	switch (expr->kind) {
+	InstructionBuf* code = compiler->code;
+	switch (kind) {
 	case UNARY_OP_KIND_ARITHMETIC_NEGATION:
-		(void)fprintf(fp, "    pop rax\n");
-		(void)fprintf(fp, "    neg rax\n");
-		(void)fprintf(fp, "    push rax\n");
+		asm_emit1(code, OPCODE_POP, RAX);
+		asm_emit1(code, OPCODE_NEG, RAX);
+		asm_emit1(code, OPCODE_PUSH, RAX);
 		break;
 	case UNARY_OP_KIND_BITWISE_NEGATION:
-		(void)fprintf(fp, "    pop rax\n");
-		(void)fprintf(fp, "    not rax\n");
-		(void)fprintf(fp, "    push rax\n");
+		asm_emit1(code, OPCODE_POP, RAX);
+		asm_emit1(code, OPCODE_NOT, RAX);
+		asm_emit1(code, OPCODE_PUSH, RAX);
 		break;
 	case UNARY_OP_KIND_LOGICAL_NEGATION:
-		(void)fprintf(fp, "    pop rax\n");
-		(void)fprintf(fp, "    cmp rax, 0\n");
-		(void)fprintf(fp, "    sete al\n");
-		(void)fprintf(fp, "    movzx rax, al\n");
-		(void)fprintf(fp, "    push rax\n");
+		asm_emit1(code, OPCODE_POP, RAX);
+		asm_emit2(code, OPCODE_CMP, RAX, asm_imm(0));
+		asm_emit1(code, OPCODE_SETE, AL);
+		asm_emit2(code, OPCODE_MOVZX, RAX, AL);
+		asm_emit1(code, OPCODE_PUSH, RAX);
 		break;
 	}
 }
 
-static void codegen_binary_op_expr(Compiler* compiler, BinaryOpExpression* expr)
+static bool is_logical_op(BinaryOpKind kind)
+{
+	return kind == BINARY_OP_KIND_LOGICAL_AND || kind == BINARY_OP_KIND_LOGICAL_OR;
+}
+
+// Emitted between the operands of && and ||, which only evaluate the right one
+// if the left one doesn't decide the result. The label that ends the
+// expression is pushed onto `ends`.
+static void codegen_short_circuit(Compiler* compiler, BinaryOpKind kind, LabelBuf* ends)
+{
+	InstructionBuf* code = compiler->code;
+	asm_emit1(code, OPCODE_POP, RAX);
+	asm_emit2(code, OPCODE_CMP, RAX, asm_imm(0));
+	uint32_t rightLabel = get_label(compiler);
+	if (kind == BINARY_OP_KIND_LOGICAL_AND) {
+		asm_emit1(code, OPCODE_JNE, asm_label(rightLabel));
+	} else {
+		asm_emit1(code, OPCODE_JE, asm_label(rightLabel));
+		asm_emit2(code, OPCODE_MOV, RAX, asm_imm(1));
+	}
+	uint32_t endLabel = get_label(compiler);
+	asm_emit1(code, OPCODE_JMP, asm_label(endLabel));
+	asm_emit_label(code, rightLabel);
+	BUF_PUSH(ends, endLabel);
+}
+
+static void codegen_logical_op(Compiler* compiler, LabelBuf* ends)
+{
+	InstructionBuf* code = compiler->code;
+	uint32_t endLabel = ends->ptr[--ends->len];
+	asm_emit1(code, OPCODE_POP, RAX);
+	asm_emit2(code, OPCODE_CMP, RAX, asm_imm(0));
+	asm_emit1(code, OPCODE_SETNE, AL);
+	asm_emit2(code, OPCODE_MOVZX, RAX, AL);
+	asm_emit_label(code, endLabel);
+	asm_emit1(code, OPCODE_PUSH, RAX);
+}
+
+static Opcode compare_set_instruction(BinaryOpKind kind)
 {
-	FILE* fp = compiler->fp;
-	switch (expr->kind) {
+	switch (kind) {
+	case BINARY_OP_KIND_LESS:
+		return OPCODE_SETL;
+	case BINARY_OP_KIND_LESS_EQUAL:
+		return OPCODE_SETLE;
+	case BINARY_OP_KIND_GREATER:
+		return OPCODE_SETG;
+	case BINARY_OP_KIND_GREATER_EQUAL:
+		return OPCODE_SETGE;
+	case BINARY_OP_KIND_EQUALITY:
+		return OPCODE_SETE;
+	case BINARY_OP_KIND_INEQUALITY:
+		return OPCODE_SETNE;
+	default:
+		UNREACHABLE();
+	}
+}
+
+static void codegen_binary_op(Compiler* compiler, BinaryOpKind kind)
+{
+	InstructionBuf* code = compiler->code;
+	if (kind == BINARY_OP_KIND_BITWISE_SHIFT_LEFT || kind == BINARY_OP_KIND_BITWISE_SHIFT_RIGHT) {
+		asm_emit1(code, OPCODE_POP, RCX);
+		asm_emit1(code, OPCODE_POP, RAX);
+		asm_emit2(code, kind == BINARY_OP_KIND_BITWISE_SHIFT_LEFT ? OPCODE_SHL : OPCODE_SAR, RAX, CL);
+		asm_emit1(code, OPCODE_PUSH, RAX);
+		return;
+	}
+	asm_emit1(code, OPCODE_POP, RDI);
+	asm_emit1(code, OPCODE_POP, RAX);
+	switch (kind) {
 	case BINARY_OP_KIND_ADDITION:
-		codegen_expr(compiler, expr->left);
-		codegen_expr(compiler, expr->right);
-		(void)fprintf(fp, "    pop rdi\n");
-		(void)fprintf(fp, "    pop rax\n");
-		(void)fprintf(fp, "    add rax, rdi\n");
-		(void)fprintf(fp, "    push rax\n");
+		asm_emit2(code, OPCODE_ADD, RAX, RDI);
 		break;
 	case BINARY_OP_KIND_SUBTRACTION:
-		codegen_expr(compiler, expr->left);
-		codegen_expr(compiler, expr->right);
-		(void)fprintf(fp, "    pop rdi\n");
-		(void)fprintf(fp, "    pop rax\n");
-		(void)fprintf(fp, "    sub rax, rdi\n");
-		(void)fprintf(fp, "    push rax\n");
+		asm_emit2(code, OPCODE_SUB, RAX, RDI);
 		break;
 	case BINARY_OP_KIND_MULTIPLICATION:
-		codegen_expr(compiler, expr->left);
-		codegen_expr(compiler, expr->right);
-		(void)fprintf(fp, "    pop rdi\n");
-		(void)fprintf(fp, "    pop rax\n");
-		(void)fprintf(fp, "    imul rax, rdi\n");
-		(void)fprintf(fp, "    push rax\n");
+		asm_emit2(code, OPCODE_IMUL, RAX, RDI);
 		break;
 	case BINARY_OP_KIND_DIVISION:
-		codegen_expr(compiler, expr->left);
-		codegen_expr(compiler, expr->right);
-		(void)fprintf(fp, "    pop rdi\n");
-		(void)fprintf(fp, "    pop rax\n");
-		(void)fprintf(fp, "    cqo\n");
-		(void)fprintf(fp, "    idiv rdi\n");
-		(void)fprintf(fp, "    push rax\n");
+		asm_emit0(code, OPCODE_CQO);
+		asm_emit1(code, OPCODE_IDIV, RDI);
 		break;
 	case BINARY_OP_KIND_MODULUS:
-		codegen_expr(compiler, expr->left);
-		codegen_expr(compiler, expr->right);
-		(void)fprintf(fp, "    pop rdi\n");
-		(void)fprintf(fp, "    pop rax\n");
-		(void)fprintf(fp, "    cqo\n");
-		(void)fprintf(fp, "    idiv rdi\n");
-		(void)fprintf(fp, "    push rdx\n");
+		asm_emit0(code, OPCODE_CQO);
+		asm_emit1(code, OPCODE_IDIV, RDI);
+		asm_emit1(code, OPCODE_PUSH, RDX);
+		return;
+	case BINARY_OP_KIND_LESS:
+	case BINARY_OP_KIND_LESS_EQUAL:
+	case BINARY_OP_KIND_GREATER:
+	case BINARY_OP_KIND_GREATER_EQUAL:
+	case BINARY_OP_KIND_EQUALITY:
+	case BINARY_OP_KIND_INEQUALITY:
+		asm_emit2(code, OPCODE_CMP, RAX, RDI);
+		asm_emit1(code, compare_set_instruction(kind), AL);
+		asm_emit2(code, OPCODE_MOVZX, RAX, AL);
 		break;
-	case BINARY_OP_KIND_LOGICAL_AND: {
-		codegen_expr(compiler, expr->left);
-		(void)fprintf(fp, "    pop rax\n");
-		(void)fprintf(fp, "    cmp rax, 0\n");
-		str trueLabel = get_label(compiler);
-		(void)fprintf(fp, "    jne " STR_FMT "\n", STR_ARG(trueLabel));
-		str endLabel = get_label(compiler);
-		(void)fprintf(fp, "    jmp " STR_FMT "\n", STR_ARG(endLabel));
-		(void)fprintf(fp, STR_FMT ":\n", STR_ARG(trueLabel));
-		codegen_expr(compiler, expr->right);
-		(void)fprintf(fp, "    pop rax\n");
-		(void)fprintf(fp, "    cmp rax, 0\n");
-		(void)fprintf(fp, "    setne al\n");
-		(void)fprintf(fp, "    movzx rax, al\n");
-		(void)fprintf(fp, STR_FMT ":\n", STR_ARG(endLabel));
-		(void)fprintf(fp, "    push rax\n");
-		str_free(trueLabel);
-		str_free(endLabel);
+	case BINARY_OP_KIND_BITWISE_AND:
+		asm_emit2(code, OPCODE_AND, RAX, RDI);
 		break;
-	}
-	case BINARY_OP_KIND_LOGICAL_OR: {
-		codegen_expr(compiler, expr->left);
-		(void)fprintf(fp, "    pop rax\n");
-		(void)fprintf(fp, "    cmp rax, 0\n");
-		str falseLabel = get_label(compiler);
-		(void)fprintf(fp, "    je " STR_FMT "\n", STR_ARG(falseLabel));
-		(void)fprintf(fp, "    mov rax, 1\n");
-		str endLabel = get_label(compiler);
-		(void)fprintf(fp, "    jmp " STR_FMT "\n", STR_ARG(endLabel));
-		(void)fprintf(fp, STR_FMT ":\n", STR_ARG(falseLabel));
-		codegen_expr(compiler, expr->right);
-		(void)fprintf(fp, "    pop rax\n");
-		(void)fprintf(fp, "    cmp rax, 0\n");
-		(void)fprintf(fp, "    setne al\n");
-		(void)fprintf(fp, "    movzx rax, al\n");
-		(void)fprintf(fp, STR_FMT ":\n", STR_ARG(endLabel));
-		(void)fprintf(fp, "    push rax\n");
-		str_free(falseLabel);
-		str_free(endLabel);
+	case BINARY_OP_KIND_BITWISE_XOR:
+		asm_emit2(code, OPCODE_XOR, RAX, RDI);
+		break;
+	case BINARY_OP_KIND_BITWISE_OR:
+		asm_emit2(code, OPCODE_OR, RAX, RDI);
 		break;
+	case BINARY_OP_KIND_LOGICAL_AND:
+	case BINARY_OP_KIND_LOGICAL_OR:
+	case BINARY_OP_KIND_BITWISE_SHIFT_LEFT:
+	case BINARY_OP_KIND_BITWISE_SHIFT_RIGHT:
+		UNREACHABLE();
 	}
+	asm_emit1(code, OPCODE_PUSH, RAX);
+}
+
+// The nodes are already in evaluation order, so the stack machine code is
+// emitted in a single pass over them. The result is left on the stack.
+static void codegen_stack_expr(Compiler* compiler, const FlatExpression* expr)
+{
+	uint32_t len = flat_expression_len(expr);
+	// For each node that is the left operand of && or ||, the operator node.
+	FlatNodeBuf shortCircuits = BUF_NEW;
+	BUF_RESERVE(&shortCircuits, len);
+	shortCircuits.len = len;
+	for (FlatNode node = 0; node < len; node++) {
+		shortCircuits.ptr[node] = FLAT_NODE_NONE;
+	}
+	for (FlatNode node = 0; node < len; node++) {
+		if (flat_type(expr, node) == EXPRESSION_TYPE_BINARY_OP && is_logical_op(flat_binary_op(expr, node))) {
+			shortCircuits.ptr[flat_left(expr, node)] = node;
+		}
+	}
+
+	LabelBuf ends = BUF_NEW;
+	for (FlatNode node = 0; node < len; node++) {
+		switch (flat_type(expr, node)) {
+		case EXPRESSION_TYPE_CONSTANT: {
+			int64_t value = flat_constant(expr, node);
+			if (is_imm32(value)) {
+				asm_emit1(compiler->code, OPCODE_PUSH, asm_imm(value));
+			} else {
+				// push only takes a sign-extended 32-bit immediate
+				asm_emit2(compiler->code, OPCODE_MOV, RAX, asm_imm(value));
+				asm_emit1(compiler->code, OPCODE_PUSH, RAX);
+			}
+			break;
+		}
+		case EXPRESSION_TYPE_UNARY_OP:
+			codegen_unary_op(compiler, flat_unary_op(expr, node));
+			break;
+		case EXPRESSION_TYPE_BINARY_OP: {
+			BinaryOpKind kind = flat_binary_op(expr, node);
+			if (is_logical_op(kind)) {
+				codegen_logical_op(compiler, &ends);
+			} else {
+				codegen_binary_op(compiler, kind);
+			}
+			break;
+		}
+		}
+		FlatNode parent = shortCircuits.ptr[node];
+		if (parent != FLAT_NODE_NONE) {
+			codegen_short_circuit(compiler, flat_binary_op(expr, parent), &ends);
+		}
+	}
+	BUF_FREE(ends);
+	BUF_FREE(shortCircuits);
+}
+
+// Registers the register strategy evaluates into. rax, rcx and rdx are left
+// out because idiv and the shifts need them, so they never hold a live value
+// and can be clobbered freely.
+typedef enum {
+	REG_RSI,
+	REG_RDI,
+	REG_R8,
+	REG_R9,
+	REG_R10,
+	REG_R11,
+	REG_COUNT,
+} Register;
+
+static const MachineRegister POOL_REGISTERS[] = {
+	[REG_RSI] = MREG_RSI,
+	[REG_RDI] = MREG_RDI,
+	[REG_R8] = MREG_R8,
+	[REG_R9] = MREG_R9,
+	[REG_R10] = MREG_R10,
+	[REG_R11] = MREG_R11,
+};
+
+static Operand pool_reg(Register reg)
+{
+	return asm_reg(POOL_REGISTERS[reg]);
+}
+
+// How the operands of a binary node are encoded. A constant operand doesn't
+// take a register from the pool: it becomes an immediate, or goes through rcx
+// if the instruction has no immediate form or it doesn't fit in one.
+typedef enum {
+	OPERANDS_REGISTERS,
+	OPERANDS_RIGHT_CONSTANT,
+	// the left operand is constant, and the operator has been swapped so it
+	// can go on the right
+	OPERANDS_LEFT_CONSTANT,
+} OperandSelection;
+
+// The operator computing the same result with its operands swapped, if any.
+static bool swap_operands(BinaryOpKind kind, BinaryOpKind* swapped)
+{
+	switch (kind) {
+	case BINARY_OP_KIND_ADDITION:
+	case BINARY_OP_KIND_MULTIPLICATION:
+	case BINARY_OP_KIND_BITWISE_AND:
+	case BINARY_OP_KIND_BITWISE_OR:
+	case BINARY_OP_KIND_BITWISE_XOR:
+	case BINARY_OP_KIND_EQUALITY:
+	case BINARY_OP_KIND_INEQUALITY:
+		*swapped = kind;
+		return true;
 	case BINARY_OP_KIND_LESS:
-		codegen_expr(compiler, expr->left);
-		codegen_expr(compiler, expr->right);
-		(void)fprintf(fp, "    pop rdi\n");
-		(void)fprintf(fp, "    pop rax\n");
-		(void)fprintf(fp, "    cmp rax, rdi\n");
-		(void)fprintf(fp, "    setl al\n");
-		(void)fprintf(fp, "    movzx rax, al\n");
-		(void)fprintf(fp, "    push rax\n");
-		break;
+		*swapped = BINARY_OP_KIND_GREATER;
+		return true;
 	case BINARY_OP_KIND_LESS_EQUAL:
-		codegen_expr(compiler, expr->left);
-		codegen_expr(compiler, expr->right);
-		(void)fprintf(fp, "    pop rdi\n");
-		(void)fprintf(fp, "    pop rax\n");
-		(void)fprintf(fp, "    cmp rax, rdi\n");
-		(void)fprintf(fp, "    setle al\n");
-		(void)fprintf(fp, "    movzx rax, al\n");
-		(void)fprintf(fp, "    push rax\n");
-		break;
+		*swapped = BINARY_OP_KIND_GREATER_EQUAL;
+		return true;
 	case BINARY_OP_KIND_GREATER:
-		codegen_expr(compiler, expr->left);
-		codegen_expr(compiler, expr->right);
-		(void)fprintf(fp, "    pop rdi\n");
-		(void)fprintf(fp, "    pop rax\n");
-		(void)fprintf(fp, "    cmp rax, rdi\n");
-		(void)fprintf(fp, "    setg al\n");
-		(void)fprintf(fp, "    movzx rax, al\n");
-		(void)fprintf(fp, "    push rax\n");
-		break;
+		*swapped = BINARY_OP_KIND_LESS;
+		return true;
 	case BINARY_OP_KIND_GREATER_EQUAL:
-		codegen_expr(compiler, expr->left);
-		codegen_expr(compiler, expr->right);
-		(void)fprintf(fp, "    pop rdi\n");
-		(void)fprintf(fp, "    pop rax\n");
-		(void)fprintf(fp, "    cmp rax, rdi\n");
-		(void)fprintf(fp, "    setge al\n");
-		(void)fprintf(fp, "    movzx rax, al\n");
-		(void)fprintf(fp, "    push rax\n");
+		*swapped = BINARY_OP_KIND_LESS_EQUAL;
+		return true;
+	default:
+		return false;
+	}
+}
+
+static OperandSelection select_operands(const FlatExpression* expr, FlatNode node)
+{
+	BinaryOpKind kind = flat_binary_op(expr, node);
+	BinaryOpKind swapped;
+	if (flat_type(expr, flat_right(node)) == EXPRESSION_TYPE_CONSTANT) {
+		return OPERANDS_RIGHT_CONSTANT;
+	}
+	if (flat_type(expr, flat_left(expr, node)) == EXPRESSION_TYPE_CONSTANT && swap_operands(kind, &swapped)) {
+		return OPERANDS_LEFT_CONSTANT;
+	}
+	return OPERANDS_REGISTERS;
+}
+
+typedef BUF(uint32_t) NeedBuf;
+
+// Sethi-Ullman numbering: the number of registers needed to evaluate each
+// node without spilling. The children of a node come before it, so one pass
+// suffices.
+static NeedBuf register_needs(const FlatExpression* expr)
+{
+	uint32_t len = flat_expression_len(expr);
+	NeedBuf needs = BUF_NEW;
+	BUF_RESERVE(&needs, len);
+	needs.len = len;
+	for (FlatNode node = 0; node < len; node++) {
+		uint32_t need = 1;
+		switch (flat_type(expr, node)) {
+		case EXPRESSION_TYPE_CONSTANT:
+			break;
+		case EXPRESSION_TYPE_UNARY_OP:
+			need = needs.ptr[flat_operand(node)];
+			break;
+		case EXPRESSION_TYPE_BINARY_OP: {
+			uint32_t left = needs.ptr[flat_left(expr, node)];
+			uint32_t right = needs.ptr[flat_right(node)];
+			if (is_logical_op(flat_binary_op(expr, node))) {
+				// the left value is dead once the right side runs
+				need = left > right ? left : right;
+			} else if (select_operands(expr, node) == OPERANDS_RIGHT_CONSTANT) {
+				need = left;
+			} else if (select_operands(expr, node) == OPERANDS_LEFT_CONSTANT) {
+				need = right;
+			} else if (left == right) {
+				need = left + 1;
+			} else {
+				need = left > right ? left : right;
+			}
+			break;
+		}
+		}
+		needs.ptr[node] = need;
+	}
+	return needs;
+}
+
+static void codegen_reg_unary_op(Compiler* compiler, UnaryOpKind kind, Register reg)
+{
+	InstructionBuf* code = compiler->code;
+	Operand r = pool_reg(reg);
+	switch (kind) {
+	case UNARY_OP_KIND_ARITHMETIC_NEGATION:
+		asm_emit1(code, OPCODE_NEG, r);
 		break;
-	case BINARY_OP_KIND_EQUALITY:
-		codegen_expr(compiler, expr->left);
-		codegen_expr(compiler, expr->right);
-		(void)fprintf(fp, "    pop rdi\n");
-		(void)fprintf(fp, "    pop rax\n");
-		(void)fprintf(fp, "    cmp rax, rdi\n");
-		(void)fprintf(fp, "    sete al\n");
-		(void)fprintf(fp, "    movzx rax, al\n");
-		(void)fprintf(fp, "    push rax\n");
+	case UNARY_OP_KIND_BITWISE_NEGATION:
+		asm_emit1(code, OPCODE_NOT, r);
+		break;
+	case UNARY_OP_KIND_LOGICAL_NEGATION:
+		asm_emit2(code, OPCODE_TEST, r, r);
+		asm_emit1(code, OPCODE_SETE, AL);
+		asm_emit2(code, OPCODE_MOVZX, r, AL);
 		break;
+	}
+}
+
+static bool is_comparison(BinaryOpKind kind)
+{
+	switch (kind) {
+	case BINARY_OP_KIND_LESS:
+	case BINARY_OP_KIND_LESS_EQUAL:
+	case BINARY_OP_KIND_GREATER:
+	case BINARY_OP_KIND_GREATER_EQUAL:
+	case BINARY_OP_KIND_EQUALITY:
 	case BINARY_OP_KIND_INEQUALITY:
-		codegen_expr(compiler, expr->left);
-		codegen_expr(compiler, expr->right);
-		(void)fprintf(fp, "    pop rdi\n");
-		(void)fprintf(fp, "    pop rax\n");
-		(void)fprintf(fp, "    cmp rax, rdi\n");
-		(void)fprintf(fp, "    setne al\n");
-		(void)fprintf(fp, "    movzx rax, al\n");
-		(void)fprintf(fp, "    push rax\n");
+		return true;
+	default:
+		return false;
+	}
+}
+
+// The comparison that holds exactly when `kind` doesn't.
+static BinaryOpKind negate_comparison(BinaryOpKind kind)
+{
+	switch (kind) {
+	case BINARY_OP_KIND_LESS:
+		return BINARY_OP_KIND_GREATER_EQUAL;
+	case BINARY_OP_KIND_LESS_EQUAL:
+		return BINARY_OP_KIND_GREATER;
+	case BINARY_OP_KIND_GREATER:
+		return BINARY_OP_KIND_LESS_EQUAL;
+	case BINARY_OP_KIND_GREATER_EQUAL:
+		return BINARY_OP_KIND_LESS;
+	case BINARY_OP_KIND_EQUALITY:
+		return BINARY_OP_KIND_INEQUALITY;
+	case BINARY_OP_KIND_INEQUALITY:
+		return BINARY_OP_KIND_EQUALITY;
+	default:
+		UNREACHABLE();
+	}
+}
+
+static Opcode compare_jump_instruction(BinaryOpKind kind)
+{
+	switch (kind) {
+	case BINARY_OP_KIND_LESS:
+		return OPCODE_JL;
+	case BINARY_OP_KIND_LESS_EQUAL:
+		return OPCODE_JLE;
+	case BINARY_OP_KIND_GREATER:
+		return OPCODE_JG;
+	case BINARY_OP_KIND_GREATER_EQUAL:
+		return OPCODE_JGE;
+	case BINARY_OP_KIND_EQUALITY:
+		return OPCODE_JE;
+	case BINARY_OP_KIND_INEQUALITY:
+		return OPCODE_JNE;
+	default:
+		UNREACHABLE();
+	}
+}
+
+// Sets the flags for comparing `dst` with `imm`.
+static void codegen_reg_compare_imm(Compiler* compiler, Register dst, int64_t imm)
+{
+	InstructionBuf* code = compiler->code;
+	Operand d = pool_reg(dst);
+	if (imm == 0) {
+		asm_emit2(code, OPCODE_TEST, d, d);
+	} else if (is_imm32(imm)) {
+		asm_emit2(code, OPCODE_CMP, d, asm_imm(imm));
+	} else {
+		asm_emit2(code, OPCODE_MOV, RCX, asm_imm(imm));
+		asm_emit2(code, OPCODE_CMP, d, RCX);
+	}
+}
+
+// Computes `rdx = dst / imm` rounded toward zero, for 2 <= |imm| < 2^63 that
+// isn't a power of two.
+static void codegen_divide_magic(Compiler* compiler, Register dst, int64_t imm)
+{
+	InstructionBuf* code = compiler->code;
+	Operand d = pool_reg(dst);
+	DivisionMagic magic = division_magic(imm);
+	asm_emit2(code, OPCODE_MOV, RAX, asm_imm(magic.multiplier));
+	asm_emit1(code, OPCODE_IMUL, d);
+	if (imm > 0 && magic.multiplier < 0) {
+		asm_emit2(code, OPCODE_ADD, RDX, d);
+	} else if (imm < 0 && magic.multiplier > 0) {
+		asm_emit2(code, OPCODE_SUB, RDX, d);
+	}
+	if (magic.shift > 0) {
+		asm_emit2(code, OPCODE_SAR, RDX, asm_imm(magic.shift));
+	}
+	// round toward zero by adding 1 to negative quotients
+	asm_emit2(code, OPCODE_MOV, RAX, RDX);
+	asm_emit2(code, OPCODE_SHR, RAX, asm_imm(63));
+	asm_emit2(code, OPCODE_ADD, RDX, RAX);
+}
+
+// Computes `dst = dst / imm` or `dst = dst % imm` without idiv, which takes
+// tens of cycles. Returns false for the divisors that still need it.
+static bool codegen_divide_imm(Compiler* compiler, BinaryOpKind kind, Register dst, int64_t imm)
+{
+	InstructionBuf* code = compiler->code;
+	Operand d = pool_reg(dst);
+	bool isDivision = kind == BINARY_OP_KIND_DIVISION;
+	// 0 traps, INT64_MIN has no positive counterpart and idiv traps on
+	// INT64_MIN / -1 and INT64_MIN % -1, as every other path does
+	if (imm == 0 || imm == INT64_MIN || imm == -1) {
+		return false;
+	}
+	if (imm == 1) {
+		if (!isDivision) {
+			asm_emit2(code, OPCODE_XOR, d, d);
+		}
+		return true;
+	}
+	uint64_t magnitude = imm < 0 ? 0 - (uint64_t)imm : (uint64_t)imm;
+	if ((magnitude & (magnitude - 1)) == 0) {
+		// Shifting right rounds toward negative infinity, so first add
+		// 2^k - 1 to negative dividends.
+		int k = __builtin_ctzll(magnitude);
+		asm_emit2(code, OPCODE_MOV, RAX, d);
+		asm_emit2(code, OPCODE_SAR, RAX, asm_imm(63));
+		asm_emit2(code, OPCODE_SHR, RAX, asm_imm(64 - k));
+		asm_emit2(code, OPCODE_ADD, RAX, d);
+		if (isDivision) {
+			asm_emit2(code, OPCODE_SAR, RAX, asm_imm(k));
+			if (imm < 0) {
+				asm_emit1(code, OPCODE_NEG, RAX);
+			}
+			asm_emit2(code, OPCODE_MOV, d, RAX);
+		} else {
+			// the remainder is what the rounded-down multiple of 2^k leaves
+			int64_t mask = -(int64_t)magnitude;
+			if (is_imm32(mask)) {
+				asm_emit2(code, OPCODE_AND, RAX, asm_imm(mask));
+			} else {
+				asm_emit2(code, OPCODE_MOV, RCX, asm_imm(mask));
+				asm_emit2(code, OPCODE_AND, RAX, RCX);
+			}
+			asm_emit2(code, OPCODE_SUB, d, RAX);
+		}
+		return true;
+	}
+	codegen_divide_magic(compiler, dst, imm);
+	if (isDivision) {
+		asm_emit2(code, OPCODE_MOV, d, RDX);
+		return true;
+	}
+	// n % d = n - n / d * d
+	if (is_imm32(imm)) {
+		asm_emit3(code, OPCODE_IMUL, RDX, RDX, asm_imm(imm));
+	} else {
+		asm_emit2(code, OPCODE_MOV, RCX, asm_imm(imm));
+		asm_emit2(code, OPCODE_IMUL, RDX, RCX);
+	}
+	asm_emit2(code, OPCODE_SUB, d, RDX);
+	return true;
+}
+
+// Computes `dst = dst op imm`.
+static void codegen_reg_binary_imm(Compiler* compiler, BinaryOpKind kind, Register dst, int64_t imm)
+{
+	InstructionBuf* code = compiler->code;
+	Operand d = pool_reg(dst);
+	Opcode alu = OPCODE_COUNT;
+	switch (kind) {
+	case BINARY_OP_KIND_ADDITION:
+		alu = OPCODE_ADD;
+		break;
+	case BINARY_OP_KIND_SUBTRACTION:
+		alu = OPCODE_SUB;
 		break;
 	case BINARY_OP_KIND_BITWISE_AND:
-		codegen_expr(compiler, expr->left);
-		codegen_expr(compiler, expr->right);
-		(void)fprintf(fp, "    pop rdi\n");
-		(void)fprintf(fp, "    pop rax\n");
-		(void)fprintf(fp, "    and rax, rdi\n");
-		(void)fprintf(fp, "    push rax\n");
+		alu = OPCODE_AND;
+		break;
+	case BINARY_OP_KIND_BITWISE_OR:
+		alu = OPCODE_OR;
 		break;
 	case BINARY_OP_KIND_BITWISE_XOR:
-		codegen_expr(compiler, expr->left);
-		codegen_expr(compiler, expr->right);
-		(void)fprintf(fp, "    pop rdi\n");
-		(void)fprintf(fp, "    pop rax\n");
-		(void)fprintf(fp, "    xor rax, rdi\n");
-		(void)fprintf(fp, "    push rax\n");
+		alu = OPCODE_XOR;
 		break;
+	case BINARY_OP_KIND_MULTIPLICATION:
+		if (is_imm32(imm)) {
+			asm_emit3(code, OPCODE_IMUL, d, d, asm_imm(imm));
+		} else {
+			asm_emit2(code, OPCODE_MOV, RCX, asm_imm(imm));
+			asm_emit2(code, OPCODE_IMUL, d, RCX);
+		}
+		return;
+	case BINARY_OP_KIND_DIVISION:
+	case BINARY_OP_KIND_MODULUS:
+		if (codegen_divide_imm(compiler, kind, dst, imm)) {
+			return;
+		}
+		// idiv has no immediate form
+		asm_emit2(code, OPCODE_MOV, RCX, asm_imm(imm));
+		asm_emit2(code, OPCODE_MOV, RAX, d);
+		asm_emit0(code, OPCODE_CQO);
+		asm_emit1(code, OPCODE_IDIV, RCX);
+		asm_emit2(code, OPCODE_MOV, d, kind == BINARY_OP_KIND_DIVISION ? RAX : RDX);
+		return;
+	case BINARY_OP_KIND_BITWISE_SHIFT_LEFT:
+	case BINARY_OP_KIND_BITWISE_SHIFT_RIGHT:
+		// the CPU masks shift counts to 6 bits, the same as it would in cl
+		asm_emit2(
+		        code,
+		        kind == BINARY_OP_KIND_BITWISE_SHIFT_LEFT ? OPCODE_SHL : OPCODE_SAR,
+		        d,
+		        asm_imm(imm & 63)
+		);
+		return;
+	case BINARY_OP_KIND_LESS:
+	case BINARY_OP_KIND_LESS_EQUAL:
+	case BINARY_OP_KIND_GREATER:
+	case BINARY_OP_KIND_GREATER_EQUAL:
+	case BINARY_OP_KIND_EQUALITY:
+	case BINARY_OP_KIND_INEQUALITY:
+		codegen_reg_compare_imm(compiler, dst, imm);
+		asm_emit1(code, compare_set_instruction(kind), AL);
+		asm_emit2(code, OPCODE_MOVZX, d, AL);
+		return;
+	case BINARY_OP_KIND_LOGICAL_AND:
+	case BINARY_OP_KIND_LOGICAL_OR:
+		UNREACHABLE();
+	}
+	if (is_imm32(imm)) {
+		asm_emit2(code, alu, d, asm_imm(imm));
+	} else {
+		// only mov takes a 64-bit immediate
+		asm_emit2(code, OPCODE_MOV, RCX, asm_imm(imm));
+		asm_emit2(code, alu, d, RCX);
+	}
+}
+
+// Computes `dst = dst op src`.
+static void codegen_reg_binary_op(Compiler* compiler, BinaryOpKind kind, Register dst, Register src)
+{
+	InstructionBuf* code = compiler->code;
+	Operand d = pool_reg(dst);
+	Operand s = pool_reg(src);
+	switch (kind) {
+	case BINARY_OP_KIND_ADDITION:
+		asm_emit2(code, OPCODE_ADD, d, s);
+		return;
+	case BINARY_OP_KIND_SUBTRACTION:
+		asm_emit2(code, OPCODE_SUB, d, s);
+		return;
+	case BINARY_OP_KIND_MULTIPLICATION:
+		asm_emit2(code, OPCODE_IMUL, d, s);
+		return;
+	case BINARY_OP_KIND_DIVISION:
+	case BINARY_OP_KIND_MODULUS:
+		// idiv divides rdx:rax, leaving the quotient in rax and the
+		// remainder in rdx
+		asm_emit2(code, OPCODE_MOV, RAX, d);
+		asm_emit0(code, OPCODE_CQO);
+		asm_emit1(code, OPCODE_IDIV, s);
+		asm_emit2(code, OPCODE_MOV, d, kind == BINARY_OP_KIND_DIVISION ? RAX : RDX);
+		return;
+	case BINARY_OP_KIND_BITWISE_AND:
+		asm_emit2(code, OPCODE_AND, d, s);
+		return;
+	case BINARY_OP_KIND_BITWISE_XOR:
+		asm_emit2(code, OPCODE_XOR, d, s);
+		return;
 	case BINARY_OP_KIND_BITWISE_OR:
-		codegen_expr(compiler, expr->left);
-		codegen_expr(compiler, expr->right);
-		(void)fprintf(fp, "    pop rdi\n");
-		(void)fprintf(fp, "    pop rax\n");
-		(void)fprintf(fp, "    or rax, rdi\n");
-		(void)fprintf(fp, "    push rax\n");
-		break;
+		asm_emit2(code, OPCODE_OR, d, s);
+		return;
 	case BINARY_OP_KIND_BITWISE_SHIFT_LEFT:
-		codegen_expr(compiler, expr->left);
-		codegen_expr(compiler, expr->right);
-		(void)fprintf(fp, "    pop rcx\n");
-		(void)fprintf(fp, "    pop rax\n");
-		(void)fprintf(fp, "    shl rax, cl\n");
-		(void)fprintf(fp, "    push rax\n");
-		break;
 	case BINARY_OP_KIND_BITWISE_SHIFT_RIGHT:
-		codegen_expr(compiler, expr->left);
-		codegen_expr(compiler, expr->right);
-		(void)fprintf(fp, "    pop rcx\n");
-		(void)fprintf(fp, "    pop rax\n");
-		(void)fprintf(fp, "    sar rax, cl\n");
-		(void)fprintf(fp, "    push rax\n");
-		break;
+		// variable shift counts must be in cl
+		asm_emit2(code, OPCODE_MOV, RCX, s);
+		asm_emit2(code, kind == BINARY_OP_KIND_BITWISE_SHIFT_LEFT ? OPCODE_SHL : OPCODE_SAR, d, CL);
+		return;
+	case BINARY_OP_KIND_LESS:
+	case BINARY_OP_KIND_LESS_EQUAL:
+	case BINARY_OP_KIND_GREATER:
+	case BINARY_OP_KIND_GREATER_EQUAL:
+	case BINARY_OP_KIND_EQUALITY:
+	case BINARY_OP_KIND_INEQUALITY:
+		asm_emit2(code, OPCODE_CMP, d, s);
+		asm_emit1(code, compare_set_instruction(kind), AL);
+		asm_emit2(code, OPCODE_MOVZX, d, AL);
+		return;
+	case BINARY_OP_KIND_LOGICAL_AND:
+	case BINARY_OP_KIND_LOGICAL_OR:
+		UNREACHABLE();
 	}
 }
 
-static void codegen_expr(Compiler* compiler, Expression* expr)
+typedef struct {
+	FlatNode node;
+	uint8_t phase;
+	// Evaluated for control flow instead of its value: the code jumps to
+	// `target` if the node's truth value is `sense`, and falls through
+	// otherwise.
+	bool isCondition;
+	bool sense;
+	// the register holding the operand evaluated first
+	Register reg;
+	uint32_t label;
+	uint32_t target;
+} RegFrame;
+
+typedef BUF(RegFrame) RegFrameBuf;
+
+typedef struct {
+	Register ptr[REG_COUNT];
+	uint64_t len;
+} RegisterStack;
+
+static Register regs_top(const RegisterStack* regs)
+{
+	return regs->ptr[regs->len - 1];
+}
+
+static void regs_swap(RegisterStack* regs)
+{
+	Register tmp = regs->ptr[regs->len - 1];
+	regs->ptr[regs->len - 1] = regs->ptr[regs->len - 2];
+	regs->ptr[regs->len - 2] = tmp;
+}
+
+static void push_frame(RegFrameBuf* frames, FlatNode node)
+{
+	BUF_PUSH(
+	        frames,
+	        ((RegFrame) {
+		.node = node,
+		.phase = 0,
+		.reg = REG_COUNT,
+		.label = LABEL_NONE,
+		.target = LABEL_NONE,
+	})
+	);
+}
+
+static void push_condition_frame(RegFrameBuf* frames, FlatNode node, bool sense, uint32_t target)
 {
-	switch (expr->type) {
+	push_frame(frames, node);
+	RegFrame* frame = &frames->ptr[frames->len - 1];
+	frame->isCondition = true;
+	frame->sense = sense;
+	frame->target = target;
+}
+
+// Ends a comparison evaluated as a condition, once the flags are set.
+static void codegen_condition_jump(Compiler* compiler, const RegFrame* frame, BinaryOpKind kind)
+{
+	if (!frame->sense) {
+		kind = negate_comparison(kind);
+	}
+	asm_emit1(compiler->code, compare_jump_instruction(kind), asm_label(frame->target));
+}
+
+// Computes `dst = dst op src`, or jumps on `dst op src` for a condition.
+static void codegen_reg_binary_result(
+        Compiler* compiler,
+        const RegFrame* frame,
+        BinaryOpKind kind,
+        Register dst,
+        Register src
+)
+{
+	if (!frame->isCondition) {
+		codegen_reg_binary_op(compiler, kind, dst, src);
+		return;
+	}
+	asm_emit2(compiler->code, OPCODE_CMP, pool_reg(dst), pool_reg(src));
+	codegen_condition_jump(compiler, frame, kind);
+}
+
+// Emits the code for a binary node that isn't && or ||, or for a comparison
+// evaluated as a condition. Operands that need fewer registers than are free
+// are evaluated heavier side first, so the lighter side can use the registers
+// the heavier one released. If both sides need every register, the right side
+// is computed first and spilled to the stack while the left side runs.
+static void codegen_reg_binary(
+        Compiler* compiler,
+        const FlatExpression* expr,
+        const NeedBuf* needs,
+        RegisterStack* regs,
+        RegFrameBuf* frames
+)
+{
+	InstructionBuf* code = compiler->code;
+	RegFrame* frame = &frames->ptr[frames->len - 1];
+	FlatNode node = frame->node;
+	FlatNode left = flat_left(expr, node);
+	FlatNode right = flat_right(node);
+	uint32_t leftNeed = needs->ptr[left];
+	uint32_t rightNeed = needs->ptr[right];
+	BinaryOpKind kind = flat_binary_op(expr, node);
+
+	OperandSelection selection = select_operands(expr, node);
+	if (selection != OPERANDS_REGISTERS) {
+		bool rightConstant = selection == OPERANDS_RIGHT_CONSTANT;
+		if (frame->phase++ == 0) {
+			push_frame(frames, rightConstant ? left : right);
+			return;
+		}
+		if (!rightConstant) {
+			(void)swap_operands(kind, &kind);
+		}
+		int64_t imm = flat_constant(expr, rightConstant ? right : left);
+		if (frame->isCondition) {
+			codegen_reg_compare_imm(compiler, regs_top(regs), imm);
+			codegen_condition_jump(compiler, frame, kind);
+		} else {
+			codegen_reg_binary_imm(compiler, kind, regs_top(regs), imm);
+		}
+		frames->len--;
+		return;
+	}
+
+	if (rightNeed >= REG_COUNT && leftNeed >= REG_COUNT) {
+		switch (frame->phase++) {
+		case 0:
+			push_frame(frames, right);
+			return;
+		case 1:
+			asm_emit1(code, OPCODE_PUSH, pool_reg(regs_top(regs)));
+			push_frame(frames, left);
+			return;
+		default: {
+			Register spilled = regs->ptr[regs->len - 2];
+			asm_emit1(code, OPCODE_POP, pool_reg(spilled));
+			codegen_reg_binary_result(compiler, frame, kind, regs_top(regs), spilled);
+			frames->len--;
+			return;
+		}
+		}
+	}
+
+	bool leftFirst = leftNeed >= rightNeed;
+	switch (frame->phase++) {
+	case 0:
+		if (!leftFirst) {
+			regs_swap(regs);
+		}
+		push_frame(frames, leftFirst ? left : right);
+		return;
+	case 1:
+		frame->reg = regs->ptr[--regs->len];
+		push_frame(frames, leftFirst ? right : left);
+		return;
+	default:
+		if (leftFirst) {
+			codegen_reg_binary_result(compiler, frame, kind, frame->reg, regs_top(regs));
+			regs->ptr[regs->len++] = frame->reg;
+		} else {
+			codegen_reg_binary_result(compiler, frame, kind, regs_top(regs), frame->reg);
+			regs->ptr[regs->len++] = frame->reg;
+			regs_swap(regs);
+		}
+		frames->len--;
+		return;
+	}
+}
+
+// Emits jumping code for a node evaluated as a condition: comparisons become
+// cmp and a conditional jump, ! swaps the sense of the jump, and && and ||
+// become pure control flow. Anything else is evaluated as a value and tested.
+static void codegen_reg_condition(
+        Compiler* compiler,
+        const FlatExpression* expr,
+        const NeedBuf* needs,
+        RegisterStack* regs,
+        RegFrameBuf* frames
+)
+{
+	InstructionBuf* code = compiler->code;
+	RegFrame* frame = &frames->ptr[frames->len - 1];
+	FlatNode node = frame->node;
+	switch (flat_type(expr, node)) {
 	case EXPRESSION_TYPE_CONSTANT:
-		codegen_constant_expr(compiler, (ConstantExpression*)expr);
-		break;
+		if ((flat_constant(expr, node) != 0) == frame->sense) {
+			asm_emit1(code, OPCODE_JMP, asm_label(frame->target));
+		}
+		frames->len--;
+		return;
 	case EXPRESSION_TYPE_UNARY_OP:
-		codegen_unary_op_expr(compiler, (UnaryOpExpression*)expr);
-		break;
-	case EXPRESSION_TYPE_BINARY_OP:
-		codegen_binary_op_expr(compiler, (BinaryOpExpression*)expr);
+		if (flat_unary_op(expr, node) == UNARY_OP_KIND_LOGICAL_NEGATION) {
+			frame->node = flat_operand(node);
+			frame->sense = !frame->sense;
+			return;
+		}
 		break;
+	case EXPRESSION_TYPE_BINARY_OP: {
+		BinaryOpKind kind = flat_binary_op(expr, node);
+		if (is_comparison(kind)) {
+			codegen_reg_binary(compiler, expr, needs, regs, frames);
+			return;
+		}
+		if (!is_logical_op(kind)) {
+			break;
+		}
+		// The left side decides the result if it's false for && and true
+		// for ||. If that's the sense we jump on, both sides can jump
+		// straight to the target. Otherwise the left side skips the right
+		// one.
+		bool decidingSense = kind == BINARY_OP_KIND_LOGICAL_OR;
+		FlatNode left = flat_left(expr, node);
+		FlatNode right = flat_right(node);
+		switch (frame->phase++) {
+		case 0:
+			if (frame->sense == decidingSense) {
+				push_condition_frame(frames, left, decidingSense, frame->target);
+			} else {
+				frame->label = get_label(compiler);
+				push_condition_frame(frames, left, decidingSense, frame->label);
+			}
+			return;
+		case 1:
+			push_condition_frame(frames, right, frame->sense, frame->target);
+			return;
+		default:
+			if (frame->label != LABEL_NONE) {
+				asm_emit_label(code, frame->label);
+			}
+			frames->len--;
+			return;
+		}
+	}
+	}
+	if (frame->phase++ == 0) {
+		push_frame(frames, node);
+		return;
+	}
+	Operand top = pool_reg(regs_top(regs));
+	asm_emit2(code, OPCODE_TEST, top, top);
+	asm_emit1(code, frame->sense ? OPCODE_JNE : OPCODE_JE, asm_label(frame->target));
+	frames->len--;
+}
+
+// Evaluates the expression into registers, following Sethi-Ullman order, and
+// leaves the result in rax. The tree is walked with an explicit stack, as it
+// can be arbitrarily deep.
+static void codegen_reg_expr(Compiler* compiler, const FlatExpression* expr)
+{
+	InstructionBuf* code = compiler->code;
+	FlatNode root = flat_expression_root(expr);
+	if (flat_type(expr, root) == EXPRESSION_TYPE_CONSTANT) {
+		asm_emit2(code, OPCODE_MOV, RAX, asm_imm(flat_constant(expr, root)));
+		return;
+	}
+	NeedBuf needs = register_needs(expr);
+	RegisterStack regs = { .len = REG_COUNT };
+	// the last register is used first
+	for (uint64_t i = 0; i < REG_COUNT; i++) {
+		regs.ptr[i] = (Register)(REG_COUNT - 1 - i);
+	}
+
+	RegFrameBuf frames = BUF_NEW;
+	push_frame(&frames, root);
+	while (frames.len > 0) {
+		RegFrame* frame = &frames.ptr[frames.len - 1];
+		FlatNode node = frame->node;
+		Operand top = pool_reg(regs_top(&regs));
+		if (frame->isCondition) {
+			codegen_reg_condition(compiler, expr, &needs, &regs, &frames);
+			continue;
+		}
+		switch (flat_type(expr, node)) {
+		case EXPRESSION_TYPE_CONSTANT:
+			asm_emit2(code, OPCODE_MOV, top, asm_imm(flat_constant(expr, node)));
+			frames.len--;
+			break;
+		case EXPRESSION_TYPE_UNARY_OP:
+			if (frame->phase++ == 0) {
+				push_frame(&frames, flat_operand(node));
+				break;
+			}
+			codegen_reg_unary_op(compiler, flat_unary_op(expr, node), regs_top(&regs));
+			frames.len--;
+			break;
+		case EXPRESSION_TYPE_BINARY_OP: {
+			BinaryOpKind kind = flat_binary_op(expr, node);
+			if (!is_logical_op(kind)) {
+				codegen_reg_binary(compiler, expr, &needs, &regs, &frames);
+				break;
+			}
+			// The value of && or || is only materialized once, after
+			// jumping code for the whole condition.
+			if (frame->phase++ == 0) {
+				frame->label = get_label(compiler);
+				push_condition_frame(&frames, node, false, frame->label);
+				break;
+			}
+			uint32_t end = get_label(compiler);
+			asm_emit2(code, OPCODE_MOV, top, asm_imm(1));
+			asm_emit1(code, OPCODE_JMP, asm_label(end));
+			asm_emit_label(code, frame->label);
+			asm_emit2(code, OPCODE_XOR, top, top);
+			asm_emit_label(code, end);
+			frames.len--;
+			break;
+		}
+		}
 	}
+	asm_emit2(code, OPCODE_MOV, RAX, pool_reg(regs_top(&regs)));
+
+	BUF_FREE(frames);
+	BUF_FREE(needs);
 }
 
 static void codegen_stmt(Compiler* compiler, Statement stmt)
 {
-	codegen_expr(compiler, stmt.expression);
-	(void)fprintf(compiler->fp, "    pop rax\n");
+	FlatExpression expr = flat_expression_new(stmt.expression);
+	switch (compiler->options.strategy) {
+	case CODEGEN_STRATEGY_STACK:
+		codegen_stack_expr(compiler, &expr);
+		asm_emit1(compiler->code, OPCODE_POP, RAX);
+		break;
+	case CODEGEN_STRATEGY_REGISTER:
+		codegen_reg_expr(compiler, &expr);
+		break;
+	case CODEGEN_STRATEGY_IR:
+		UNREACHABLE();
+	}
+	flat_expression_free(expr);
+}
+
+// The entry point: calls main and exits with its result.
+static void codegen_start(InstructionBuf* code)
+{
+	asm_emit1(code, OPCODE_CALL, asm_symbol(PROGRAM_MAIN));
+	asm_emit2(code, OPCODE_MOV, RDI, RAX);
+	// exit
+	asm_emit2(code, OPCODE_MOV, RAX, asm_imm(60));
+	asm_emit0(code, OPCODE_SYSCALL);
+}
+
+static CodegenStats codegen_func(Compiler* compiler, Function func, InstructionBuf* code)
+{
+	CodegenStats stats = {0};
+	compiler->code = code;
+	if (compiler->options.strategy == CODEGEN_STRATEGY_IR) {
+		IrFunction ir = ir_lower_function(func);
+		stats.ir = ir_optimize(&ir, compiler->options.ir);
+		ssa_destruct(&ir);
+		RegisterAllocation allocation = regalloc_function(&ir, compiler->options.regalloc);
+		stats.regalloc = allocation.stats;
+		ir_codegen_function(&ir, &allocation, code);
+		register_allocation_free(allocation);
+		ir_function_free(ir);
+	} else {
+		codegen_stmt(compiler, func.statement);
+		asm_emit0(code, OPCODE_RET);
+	}
+	if (compiler->options.peephole) {
+		stats.peephole = peephole_optimize(code);
+	}
+	return stats;
+}
+
+// Generates the entry point into `start` and `func` into `code`.
+static CodegenStats codegen_all(Program program, CodegenOptions options, InstructionBuf* start, InstructionBuf* code)
+{
+	Compiler compiler = { .code = NULL, .options = options };
+	codegen_start(start);
+	return codegen_func(&compiler, program.function, code);
 }
 
-static void codegen_func(Compiler* compiler, Function func)
+static void encode_all(Program program, const InstructionBuf* start, const InstructionBuf* code, Object* object)
 {
-	FILE* fp = compiler->fp;
-	(void)fprintf(fp, STR_FMT ":\n", STR_ARG(func.name));
-	codegen_stmt(compiler, func.statement);
-	(void)fprintf(fp, "    ret\n");
+	str name = interner_get(&program.symbols, program.function.name);
+	encode_function(object, str_lit("_start"), true, start, &program.symbols);
+	encode_function(object, name, false, code, &program.symbols);
+	object_finish(object);
 }
 
-void codegen_program(Program program, str outPath)
+CodegenStats codegen_program_object(Program program, Object* object, CodegenOptions options)
 {
-	FILE* fp = fopen(outPath.ptr, "w");
-	Compiler compiler = { .fp = fp };
-	(void)fwrite(HEADER_NASM, 1, sizeof(HEADER_NASM), fp);
+	InstructionBuf start = BUF_NEW;
+	InstructionBuf code = BUF_NEW;
+	CodegenStats stats = codegen_all(program, options, &start, &code);
+	encode_all(program, &start, &code, object);
+	BUF_FREE(start);
+	BUF_FREE(code);
+	return stats;
+}
 
-	codegen_func(&compiler, program.function);
+CodegenWriteResult codegen_program_file(Program program, FILE* fp, CodegenOptions options)
+{
+	InstructionBuf start = BUF_NEW;
+	InstructionBuf code = BUF_NEW;
+	CodegenStats stats = codegen_all(program, options, &start, &code);
+	bool written = true;
 
-	(void)fclose(fp);
+	switch (options.output) {
+	case CODEGEN_OUTPUT_ASSEMBLY: {
+		str name = interner_get(&program.symbols, program.function.name);
+		(void)fwrite(HEADER_NASM, 1, sizeof(HEADER_NASM), fp);
+		(void)fputs("_start:\n", fp);
+		asm_write(&start, &program.symbols, fp);
+		(void)fprintf(fp, STR_FMT ":\n", STR_ARG(name));
+		asm_write(&code, &program.symbols, fp);
+		written = ferror(fp) == 0;
+		break;
+	}
+	case CODEGEN_OUTPUT_OBJECT: {
+		Object object = object_new();
+		encode_all(program, &start, &code, &object);
+		written = elf_write(&object, fp);
+		object_free(object);
+		break;
+	}
+	}
+
+	BUF_FREE(start);
+	BUF_FREE(code);
+	if (!written) {
+		return (CodegenWriteResult)NOTHING;
+	}
+	return (CodegenWriteResult)JUST(stats);
+}
+
+CodegenWriteResult codegen_program(Program program, str outPath, CodegenOptions options)
+{
+	FILE* fp = fopen(outPath.ptr, options.output == CODEGEN_OUTPUT_OBJECT ? "wb" : "w");
+	if (fp == NULL) {
+		return (CodegenWriteResult)NOTHING;
+	}
+	CodegenWriteResult result = codegen_program_file(program, fp, options);
+	// buffered output is only written out here
+	if (fclose(fp) != 0) {
+		return (CodegenWriteResult)NOTHING;
+	}
+	return result;
 }
@@ -0,0 +1,126 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "dragon/ast.h"
+#include "dragon/core/buf.h"
+#include "dragon/ir_opt.h"
+
+typedef BUF(bool) LiveBuf;
+typedef BUF(IrValue) IrValueBuf;
+
+// Where each value is assigned: phi `index` of `block` if `phi` is set,
+// instruction `index` otherwise.
+typedef struct {
+	IrBlockId block;
+	uint32_t index;
+	bool phi;
+} Def;
+
+typedef BUF(Def) DefBuf;
+
+typedef struct {
+	DefBuf defs;
+	LiveBuf live;
+	IrValueBuf worklist;
+} Marker;
+
+// Whether removing `insn` could remove a trap. Division traps for a zero
+// divisor, and for -1 when it overflows.
+static bool may_trap(const IrInstruction* insn)
+{
+	if (insn->opcode != IR_OP_BINARY) {
+		return false;
+	}
+	BinaryOpKind kind = (BinaryOpKind)insn->op;
+	if (kind != BINARY_OP_KIND_DIVISION && kind != BINARY_OP_KIND_MODULUS) {
+		return false;
+	}
+	IrOperand divisor = insn->args[1];
+	return divisor.kind != IR_OPERAND_CONSTANT || divisor.value == 0 || divisor.value == -1;
+}
+
+static void mark(Marker* marker, IrOperand operand)
+{
+	if (operand.kind == IR_OPERAND_VALUE && !marker->live.ptr[operand.value]) {
+		marker->live.ptr[operand.value] = true;
+		BUF_PUSH(&marker->worklist, (IrValue)operand.value);
+	}
+}
+
+static void mark_instruction(Marker* marker, const IrInstruction* insn)
+{
+	mark(marker, insn->args[0]);
+	mark(marker, insn->args[1]);
+}
+
+void ir_dce(IrFunction* func, IrOptStats* stats)
+{
+	Marker marker = { .defs = BUF_NEW, .live = BUF_NEW, .worklist = BUF_NEW };
+	BUF_RESERVE(&marker.defs, func->valueCount);
+	marker.defs.len = func->valueCount;
+	BUF_RESERVE(&marker.live, func->valueCount);
+	marker.live.len = func->valueCount;
+	for (uint32_t v = 0; v < func->valueCount; v++) {
+		marker.live.ptr[v] = false;
+	}
+
+	// Everything the terminators and possible traps read is live, and so is
+	// what live values are computed from.
+	for (IrBlockId b = 0; b < func->blocks.len; b++) {
+		const IrBlock* block = &func->blocks.ptr[b];
+		for (uint32_t i = 0; i < block->phis.len; i++) {
+			marker.defs.ptr[block->phis.ptr[i].dst] = (Def) { .block = b, .index = i, .phi = true };
+		}
+		for (uint32_t i = 0; i < block->instructions.len; i++) {
+			const IrInstruction* insn = &block->instructions.ptr[i];
+			if (insn->dst != IR_VALUE_NONE) {
+				marker.defs.ptr[insn->dst] = (Def) { .block = b, .index = i, .phi = false };
+			}
+			if (insn->dst == IR_VALUE_NONE || may_trap(insn)) {
+				mark_instruction(&marker, insn);
+			}
+		}
+	}
+	while (marker.worklist.len > 0) {
+		Def def = marker.defs.ptr[marker.worklist.ptr[--marker.worklist.len]];
+		const IrBlock* block = &func->blocks.ptr[def.block];
+		if (def.phi) {
+			const IrOperandBuf* args = &block->phis.ptr[def.index].args;
+			for (uint64_t i = 0; i < args->len; i++) {
+				mark(&marker, args->ptr[i]);
+			}
+		} else {
+			mark_instruction(&marker, &block->instructions.ptr[def.index]);
+		}
+	}
+
+	for (IrBlockId b = 0; b < func->blocks.len; b++) {
+		IrBlock* block = &func->blocks.ptr[b];
+		uint64_t kept = 0;
+		for (uint64_t i = 0; i < block->phis.len; i++) {
+			IrPhi phi = block->phis.ptr[i];
+			if (!marker.live.ptr[phi.dst]) {
+				stats->counts[IR_OPT_COUNTER_DEAD_INSTRUCTIONS]++;
+				BUF_FREE(phi.args);
+				continue;
+			}
+			block->phis.ptr[kept++] = phi;
+		}
+		block->phis.len = kept;
+
+		kept = 0;
+		for (uint64_t i = 0; i < block->instructions.len; i++) {
+			IrInstruction insn = block->instructions.ptr[i];
+			if (insn.dst != IR_VALUE_NONE && !marker.live.ptr[insn.dst] && !may_trap(&insn)) {
+				stats->counts[IR_OPT_COUNTER_DEAD_INSTRUCTIONS]++;
+				continue;
+			}
+			block->instructions.ptr[kept++] = insn;
+		}
+		block->instructions.len = kept;
+	}
+
+	BUF_FREE(marker.worklist);
+	BUF_FREE(marker.live);
+	BUF_FREE(marker.defs);
+}
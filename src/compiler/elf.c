@@ -0,0 +1,218 @@
+#include "dragon/elf.h"
+
+#include <elf.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+typedef struct {
+	// offset of the name in .shstrtab
+	uint32_t name;
+	uint32_t type;
+	uint64_t flags;
+	const ByteBuf* contents;
+	uint32_t link;
+	uint32_t info;
+	uint64_t align;
+	uint64_t entsize;
+	// where the contents go in the file
+	uint64_t offset;
+} Section;
+
+#define SECTION_TEXT 1
+#define SECTION_SYMTAB 2
+#define SECTION_STRTAB 3
+#define MAX_SECTIONS 6
+
+static uint32_t push_string(ByteBuf* table, str s)
+{
+	uint32_t offset = (uint32_t)table->len;
+	for (uint64_t i = 0; i < str_len(s); i++) {
+		bytes_push8(table, (uint8_t)s.ptr[i]);
+	}
+	bytes_push8(table, 0);
+	return offset;
+}
+
+static void push_symbol(ByteBuf* symtab, uint32_t name, uint8_t info, uint16_t section, uint64_t value)
+{
+	bytes_push32(symtab, name);
+	bytes_push8(symtab, info);
+	bytes_push8(symtab, STV_DEFAULT);
+	bytes_push16(symtab, section);
+	bytes_push64(symtab, value);
+	// size
+	bytes_push64(symtab, 0);
+}
+
+static void push_object_symbol(ByteBuf* symtab, ByteBuf* strtab, const ObjectSymbol* symbol)
+{
+	uint8_t bind = symbol->global ? STB_GLOBAL : STB_LOCAL;
+	push_symbol(
+	        symtab,
+	        push_string(strtab, symbol->name),
+	        ELF64_ST_INFO(bind, STT_NOTYPE),
+	        symbol->defined ? SECTION_TEXT : SHN_UNDEF,
+	        symbol->offset
+	);
+}
+
+static uint64_t align_to(uint64_t offset, uint64_t align)
+{
+	return (offset + align - 1) / align * align;
+}
+
+bool elf_write(const Object* object, FILE* fp)
+{
+	// ELF wants the local symbols first, so they're numbered in two passes
+	uint64_t* indices = calloc(object->symbols.len, sizeof(uint64_t));
+	if (indices == NULL && object->symbols.len > 0) {
+		return false;
+	}
+	ByteBuf symtab = BUF_NEW;
+	ByteBuf strtab = BUF_NEW;
+	ByteBuf rela = BUF_NEW;
+	ByteBuf shstrtab = BUF_NEW;
+	(void)push_string(&strtab, str_empty);
+	(void)push_string(&shstrtab, str_empty);
+
+	push_symbol(&symtab, 0, 0, SHN_UNDEF, 0);
+	push_symbol(&symtab, 0, ELF64_ST_INFO(STB_LOCAL, STT_SECTION), SECTION_TEXT, 0);
+	uint32_t symbolCount = 2;
+	uint32_t firstGlobal = 0;
+	for (int pass = 0; pass < 2; pass++) {
+		for (uint64_t i = 0; i < object->symbols.len; i++) {
+			const ObjectSymbol* symbol = &object->symbols.ptr[i];
+			if (symbol->global == (pass == 0)) {
+				continue;
+			}
+			indices[i] = symbolCount++;
+			push_object_symbol(&symtab, &strtab, symbol);
+		}
+		if (pass == 0) {
+			firstGlobal = symbolCount;
+		}
+	}
+
+	for (uint64_t i = 0; i < object->relocations.len; i++) {
+		ObjectFixup relocation = object->relocations.ptr[i];
+		bytes_push64(&rela, relocation.offset);
+		// the displacement is relative to its own end, which is what NASM
+		// emits for a plain call
+		bytes_push64(&rela, ELF64_R_INFO(indices[relocation.symbol], R_X86_64_PC32));
+		bytes_push64(&rela, (uint64_t)INT64_C(-4));
+	}
+	free(indices);
+
+	Section sections[MAX_SECTIONS] = {0};
+	uint32_t sectionCount = 1;
+	sections[sectionCount++] = (Section) {
+		.name = push_string(&shstrtab, str_lit(".text")),
+		.type = SHT_PROGBITS,
+		.flags = SHF_ALLOC | SHF_EXECINSTR,
+		.contents = &object->text,
+		.align = 16,
+	};
+	sections[sectionCount++] = (Section) {
+		.name = push_string(&shstrtab, str_lit(".symtab")),
+		.type = SHT_SYMTAB,
+		.contents = &symtab,
+		.link = SECTION_STRTAB,
+		.info = firstGlobal,
+		.align = 8,
+		.entsize = sizeof(Elf64_Sym),
+	};
+	sections[sectionCount++] = (Section) {
+		.name = push_string(&shstrtab, str_lit(".strtab")),
+		.type = SHT_STRTAB,
+		.contents = &strtab,
+		.align = 1,
+	};
+	if (rela.len > 0) {
+		sections[sectionCount++] = (Section) {
+			.name = push_string(&shstrtab, str_lit(".rela.text")),
+			.type = SHT_RELA,
+			.flags = SHF_INFO_LINK,
+			.contents = &rela,
+			.link = SECTION_SYMTAB,
+			.info = SECTION_TEXT,
+			.align = 8,
+			.entsize = sizeof(Elf64_Rela),
+		};
+	}
+	uint32_t shstrtabIndex = sectionCount;
+	sections[sectionCount++] = (Section) {
+		.name = push_string(&shstrtab, str_lit(".shstrtab")),
+		.type = SHT_STRTAB,
+		.contents = &shstrtab,
+		.align = 1,
+	};
+
+	uint64_t offset = sizeof(Elf64_Ehdr);
+	for (uint32_t i = 1; i < sectionCount; i++) {
+		offset = align_to(offset, sections[i].align);
+		sections[i].offset = offset;
+		offset += sections[i].contents->len;
+	}
+	uint64_t headersOffset = align_to(offset, 8);
+
+	ByteBuf file = BUF_NEW;
+	BUF_RESERVE(&file, headersOffset + sectionCount * sizeof(Elf64_Shdr));
+	const uint8_t ident[EI_NIDENT] = {
+		ELFMAG0, ELFMAG1, ELFMAG2, ELFMAG3, ELFCLASS64, ELFDATA2LSB, EV_CURRENT, ELFOSABI_SYSV,
+	};
+	for (uint64_t i = 0; i < EI_NIDENT; i++) {
+		bytes_push8(&file, ident[i]);
+	}
+	bytes_push16(&file, ET_REL);
+	bytes_push16(&file, EM_X86_64);
+	bytes_push32(&file, EV_CURRENT);
+	// entry point, program and section header offsets
+	bytes_push64(&file, 0);
+	bytes_push64(&file, 0);
+	bytes_push64(&file, headersOffset);
+	// flags
+	bytes_push32(&file, 0);
+	bytes_push16(&file, sizeof(Elf64_Ehdr));
+	// program header size and count
+	bytes_push16(&file, 0);
+	bytes_push16(&file, 0);
+	bytes_push16(&file, sizeof(Elf64_Shdr));
+	bytes_push16(&file, (uint16_t)sectionCount);
+	bytes_push16(&file, (uint16_t)shstrtabIndex);
+
+	for (uint32_t i = 1; i < sectionCount; i++) {
+		while (file.len < sections[i].offset) {
+			bytes_push8(&file, 0);
+		}
+		const ByteBuf* contents = sections[i].contents;
+		for (uint64_t j = 0; j < contents->len; j++) {
+			bytes_push8(&file, contents->ptr[j]);
+		}
+	}
+	while (file.len < headersOffset) {
+		bytes_push8(&file, 0);
+	}
+	for (uint32_t i = 0; i < sectionCount; i++) {
+		const Section* section = &sections[i];
+		bytes_push32(&file, section->name);
+		bytes_push32(&file, section->type);
+		bytes_push64(&file, section->flags);
+		// address
+		bytes_push64(&file, 0);
+		bytes_push64(&file, section->offset);
+		bytes_push64(&file, section->contents != NULL ? section->contents->len : 0);
+		bytes_push32(&file, section->link);
+		bytes_push32(&file, section->info);
+		bytes_push64(&file, section->align);
+		bytes_push64(&file, section->entsize);
+	}
+	bool written = fwrite(file.ptr, 1, file.len, fp) == file.len;
+
+	BUF_FREE(file);
+	BUF_FREE(symtab);
+	BUF_FREE(strtab);
+	BUF_FREE(rela);
+	BUF_FREE(shstrtab);
+	return written;
+}
@@ -0,0 +1,483 @@
+#include "dragon/encode.h"
+
+#include <assert.h>
+#include <stdint.h>
+
+#include "dragon/core/macro.h"
+
+#define NO_OFFSET UINT64_MAX
+
+// A jump's displacement, relative to the end of the jump.
+typedef struct {
+	// where the displacement is in the text section
+	uint64_t offset;
+	uint32_t label;
+	// 1 or 4 bytes
+	uint8_t size;
+	// the jump's index in the function
+	uint64_t insn;
+} JumpFixup;
+
+typedef BUF(JumpFixup) JumpFixupBuf;
+typedef BUF(uint64_t) OffsetBuf;
+typedef BUF(bool) FlagBuf;
+
+typedef struct {
+	Object* object;
+	ByteBuf* text;
+	const Interner* symbols;
+	// the offset of each label, by number
+	OffsetBuf labels;
+	JumpFixupBuf jumps;
+	// for each instruction, whether it's a jump that needs a 32-bit
+	// displacement
+	FlagBuf nearJumps;
+} Encoder;
+
+#define REX_W 0x08
+#define REX_R 0x04
+#define REX_B 0x01
+
+static bool is_imm8(int64_t value)
+{
+	return value >= INT8_MIN && value <= INT8_MAX;
+}
+
+static bool is_imm32(int64_t value)
+{
+	return value >= INT32_MIN && value <= INT32_MAX;
+}
+
+static uint8_t register_number(Operand operand)
+{
+	return (uint8_t)machine_register_full((MachineRegister)operand.value);
+}
+
+static void emit8(Encoder* encoder, uint8_t value)
+{
+	bytes_push8(encoder->text, value);
+}
+
+static void emit32(Encoder* encoder, int64_t value)
+{
+	bytes_push32(encoder->text, (uint32_t)value);
+}
+
+static void emit_opcode(Encoder* encoder, uint16_t opcode)
+{
+	if (opcode > 0xff) {
+		emit8(encoder, (uint8_t)(opcode >> 8));
+	}
+	emit8(encoder, (uint8_t)opcode);
+}
+
+// Emits an instruction with a ModRM byte: `reg` goes in its reg field, which
+// is either a register number or an opcode extension, and `rm` is the
+// register or frame slot it addresses. `wide` selects 64-bit operands.
+static void emit_modrm(Encoder* encoder, bool wide, uint16_t opcode, uint8_t reg, Operand rm)
+{
+	uint8_t rex = wide ? REX_W : 0;
+	if (reg >= 8) {
+		rex |= REX_R;
+	}
+	if (rm.kind == OPERAND_REGISTER && register_number(rm) >= 8) {
+		rex |= REX_B;
+	}
+	if (rex != 0) {
+		emit8(encoder, 0x40 | rex);
+	}
+	emit_opcode(encoder, opcode);
+	uint8_t regField = (uint8_t)((reg & 7) << 3);
+	if (rm.kind == OPERAND_REGISTER) {
+		emit8(encoder, 0xc0 | regField | (register_number(rm) & 7));
+		return;
+	}
+	assert(rm.kind == OPERAND_FRAME);
+	// rbp as a base always takes a displacement, a zero one included
+	if (is_imm8(rm.value)) {
+		emit8(encoder, 0x40 | regField | MREG_RBP);
+		emit8(encoder, (uint8_t)rm.value);
+	} else {
+		assert(is_imm32(rm.value));
+		emit8(encoder, 0x80 | regField | MREG_RBP);
+		emit32(encoder, rm.value);
+	}
+}
+
+// Emits an instruction that encodes its register operand in the opcode.
+static void emit_short_register(Encoder* encoder, bool wide, uint8_t opcode, Operand reg)
+{
+	uint8_t rex = wide ? REX_W : 0;
+	if (register_number(reg) >= 8) {
+		rex |= REX_B;
+	}
+	if (rex != 0) {
+		emit8(encoder, 0x40 | rex);
+	}
+	emit8(encoder, opcode + (register_number(reg) & 7));
+}
+
+static void encode_mov(Encoder* encoder, Operand dst, Operand src)
+{
+	switch (src.kind) {
+	case OPERAND_REGISTER:
+		emit_modrm(encoder, true, 0x89, register_number(src), dst);
+		return;
+	case OPERAND_FRAME:
+		emit_modrm(encoder, true, 0x8b, register_number(dst), src);
+		return;
+	case OPERAND_IMMEDIATE:
+		if (dst.kind == OPERAND_FRAME) {
+			emit_modrm(encoder, true, 0xc7, 0, dst);
+			emit32(encoder, src.value);
+		} else if (src.value >= 0 && src.value <= UINT32_MAX) {
+			// writing the low half zeroes the upper one, which is how NASM
+			// shortens the move
+			emit_short_register(encoder, false, 0xb8, dst);
+			emit32(encoder, src.value);
+		} else if (is_imm32(src.value)) {
+			emit_modrm(encoder, true, 0xc7, 0, dst);
+			emit32(encoder, src.value);
+		} else {
+			emit_short_register(encoder, true, 0xb8, dst);
+			bytes_push64(encoder->text, (uint64_t)src.value);
+		}
+		return;
+	default:
+		UNREACHABLE();
+	}
+}
+
+// add, or, and, sub, xor and cmp share their encodings, told apart by
+// `extension`.
+static void encode_alu(Encoder* encoder, uint8_t extension, Operand dst, Operand src)
+{
+	uint8_t base = (uint8_t)(extension << 3);
+	switch (src.kind) {
+	case OPERAND_REGISTER:
+		emit_modrm(encoder, true, base + 0x01, register_number(src), dst);
+		return;
+	case OPERAND_FRAME:
+		emit_modrm(encoder, true, base + 0x03, register_number(dst), src);
+		return;
+	case OPERAND_IMMEDIATE:
+		if (is_imm8(src.value)) {
+			emit_modrm(encoder, true, 0x83, extension, dst);
+			emit8(encoder, (uint8_t)src.value);
+			return;
+		}
+		assert(is_imm32(src.value));
+		if (operand_is_reg(dst, MREG_RAX)) {
+			emit8(encoder, 0x40 | REX_W);
+			emit8(encoder, base + 0x05);
+		} else {
+			emit_modrm(encoder, true, 0x81, extension, dst);
+		}
+		emit32(encoder, src.value);
+		return;
+	default:
+		UNREACHABLE();
+	}
+}
+
+static void encode_test(Encoder* encoder, Operand dst, Operand src)
+{
+	if (src.kind == OPERAND_REGISTER) {
+		emit_modrm(encoder, true, 0x85, register_number(src), dst);
+		return;
+	}
+	assert(src.kind == OPERAND_IMMEDIATE && is_imm32(src.value));
+	if (operand_is_reg(dst, MREG_RAX)) {
+		emit8(encoder, 0x40 | REX_W);
+		emit8(encoder, 0xa9);
+	} else {
+		emit_modrm(encoder, true, 0xf7, 0, dst);
+	}
+	emit32(encoder, src.value);
+}
+
+static void encode_imul(Encoder* encoder, const Instruction* insn)
+{
+	Operand dst = insn->operands[0];
+	Operand src = insn->operands[1];
+	Operand imm = insn->operands[2];
+	if (src.kind == OPERAND_NONE) {
+		emit_modrm(encoder, true, 0xf7, 5, dst);
+		return;
+	}
+	// imul r, imm is imul r, r, imm
+	if (src.kind == OPERAND_IMMEDIATE) {
+		imm = src;
+		src = dst;
+	}
+	if (imm.kind == OPERAND_NONE) {
+		emit_modrm(encoder, true, 0x0faf, register_number(dst), src);
+	} else if (is_imm8(imm.value)) {
+		emit_modrm(encoder, true, 0x6b, register_number(dst), src);
+		emit8(encoder, (uint8_t)imm.value);
+	} else {
+		assert(is_imm32(imm.value));
+		emit_modrm(encoder, true, 0x69, register_number(dst), src);
+		emit32(encoder, imm.value);
+	}
+}
+
+static void encode_shift(Encoder* encoder, uint8_t extension, Operand dst, Operand count)
+{
+	if (count.kind == OPERAND_REGISTER) {
+		assert(operand_is_reg(count, MREG_CL));
+		emit_modrm(encoder, true, 0xd3, extension, dst);
+	} else if (count.value == 1) {
+		emit_modrm(encoder, true, 0xd1, extension, dst);
+	} else {
+		emit_modrm(encoder, true, 0xc1, extension, dst);
+		emit8(encoder, (uint8_t)count.value);
+	}
+}
+
+static void encode_push(Encoder* encoder, Opcode opcode, Operand operand)
+{
+	bool push = opcode == OPCODE_PUSH;
+	switch (operand.kind) {
+	case OPERAND_REGISTER:
+		emit_short_register(encoder, false, push ? 0x50 : 0x58, operand);
+		return;
+	case OPERAND_FRAME:
+		emit_modrm(encoder, false, push ? 0xff : 0x8f, push ? 6 : 0, operand);
+		return;
+	case OPERAND_IMMEDIATE:
+		assert(push);
+		if (is_imm8(operand.value)) {
+			emit8(encoder, 0x6a);
+			emit8(encoder, (uint8_t)operand.value);
+		} else {
+			assert(is_imm32(operand.value));
+			emit8(encoder, 0x68);
+			emit32(encoder, operand.value);
+		}
+		return;
+	default:
+		UNREACHABLE();
+	}
+}
+
+// The condition code shared by jcc and setcc.
+static uint8_t condition(Opcode opcode)
+{
+	switch (opcode) {
+	case OPCODE_JE:
+	case OPCODE_SETE:
+		return 0x4;
+	case OPCODE_JNE:
+	case OPCODE_SETNE:
+		return 0x5;
+	case OPCODE_JL:
+	case OPCODE_SETL:
+		return 0xc;
+	case OPCODE_JGE:
+	case OPCODE_SETGE:
+		return 0xd;
+	case OPCODE_JLE:
+	case OPCODE_SETLE:
+		return 0xe;
+	case OPCODE_JG:
+	case OPCODE_SETG:
+		return 0xf;
+	default:
+		UNREACHABLE();
+	}
+}
+
+static void encode_jump(Encoder* encoder, uint64_t index, const Instruction* insn)
+{
+	bool near = encoder->nearJumps.ptr[index];
+	if (insn->opcode == OPCODE_JMP) {
+		emit8(encoder, near ? 0xe9 : 0xeb);
+	} else if (near) {
+		emit8(encoder, 0x0f);
+		emit8(encoder, 0x80 | condition(insn->opcode));
+	} else {
+		emit8(encoder, 0x70 | condition(insn->opcode));
+	}
+	BUF_PUSH(&encoder->jumps, ((JumpFixup) {
+		.offset = encoder->text->len,
+		.label = (uint32_t)insn->operands[0].value,
+		.size = near ? 4 : 1,
+		.insn = index,
+	}));
+	if (near) {
+		emit32(encoder, 0);
+	} else {
+		emit8(encoder, 0);
+	}
+}
+
+static void encode_instruction(Encoder* encoder, uint64_t index, const Instruction* insn)
+{
+	Operand a = insn->operands[0];
+	Operand b = insn->operands[1];
+	switch (insn->opcode) {
+	case OPCODE_LABEL:
+		encoder->labels.ptr[a.value] = encoder->text->len;
+		return;
+	case OPCODE_MOV:
+		encode_mov(encoder, a, b);
+		return;
+	case OPCODE_MOVZX:
+		emit_modrm(encoder, true, 0x0fb6, register_number(a), b);
+		return;
+	case OPCODE_PUSH:
+	case OPCODE_POP:
+		encode_push(encoder, insn->opcode, a);
+		return;
+	case OPCODE_ADD:
+		encode_alu(encoder, 0, a, b);
+		return;
+	case OPCODE_OR:
+		encode_alu(encoder, 1, a, b);
+		return;
+	case OPCODE_AND:
+		encode_alu(encoder, 4, a, b);
+		return;
+	case OPCODE_SUB:
+		encode_alu(encoder, 5, a, b);
+		return;
+	case OPCODE_XOR:
+		encode_alu(encoder, 6, a, b);
+		return;
+	case OPCODE_CMP:
+		encode_alu(encoder, 7, a, b);
+		return;
+	case OPCODE_TEST:
+		encode_test(encoder, a, b);
+		return;
+	case OPCODE_IMUL:
+		encode_imul(encoder, insn);
+		return;
+	case OPCODE_IDIV:
+		emit_modrm(encoder, true, 0xf7, 7, a);
+		return;
+	case OPCODE_NEG:
+		emit_modrm(encoder, true, 0xf7, 3, a);
+		return;
+	case OPCODE_NOT:
+		emit_modrm(encoder, true, 0xf7, 2, a);
+		return;
+	case OPCODE_CQO:
+		emit8(encoder, 0x40 | REX_W);
+		emit8(encoder, 0x99);
+		return;
+	case OPCODE_SHL:
+		encode_shift(encoder, 4, a, b);
+		return;
+	case OPCODE_SHR:
+		encode_shift(encoder, 5, a, b);
+		return;
+	case OPCODE_SAR:
+		encode_shift(encoder, 7, a, b);
+		return;
+	case OPCODE_SETL:
+	case OPCODE_SETLE:
+	case OPCODE_SETG:
+	case OPCODE_SETGE:
+	case OPCODE_SETE:
+	case OPCODE_SETNE:
+		emit_modrm(encoder, false, 0x0f90 | condition(insn->opcode), 0, a);
+		return;
+	case OPCODE_JMP:
+	case OPCODE_JL:
+	case OPCODE_JLE:
+	case OPCODE_JG:
+	case OPCODE_JGE:
+	case OPCODE_JE:
+	case OPCODE_JNE:
+		encode_jump(encoder, index, insn);
+		return;
+	case OPCODE_CALL:
+		assert(a.kind == OPERAND_SYMBOL);
+		emit8(encoder, 0xe8);
+		object_call(encoder->object, interner_get(encoder->symbols, (SymbolId)a.value));
+		return;
+	case OPCODE_RET:
+		emit8(encoder, 0xc3);
+		return;
+	case OPCODE_SYSCALL:
+		emit8(encoder, 0x0f);
+		emit8(encoder, 0x05);
+		return;
+	case OPCODE_COUNT:
+		break;
+	}
+	UNREACHABLE();
+}
+
+static int64_t displacement(const Encoder* encoder, const JumpFixup* jump)
+{
+	return (int64_t)encoder->labels.ptr[jump->label] - (int64_t)(jump->offset + jump->size);
+}
+
+void encode_function(Object* object, str name, bool global, const InstructionBuf* code, const Interner* symbols)
+{
+	Encoder encoder = {
+		.object = object,
+		.text = &object->text,
+		.symbols = symbols,
+		.labels = BUF_NEW,
+		.jumps = BUF_NEW,
+		.nearJumps = BUF_NEW,
+	};
+	uint64_t labelCount = 0;
+	for (uint64_t i = 0; i < code->len; i++) {
+		if (code->ptr[i].opcode == OPCODE_LABEL && (uint64_t)code->ptr[i].operands[0].value >= labelCount) {
+			labelCount = (uint64_t)code->ptr[i].operands[0].value + 1;
+		}
+	}
+	BUF_RESERVE(&encoder.labels, labelCount);
+	encoder.labels.len = labelCount;
+	BUF_RESERVE(&encoder.nearJumps, code->len);
+	encoder.nearJumps.len = code->len;
+	for (uint64_t i = 0; i < code->len; i++) {
+		encoder.nearJumps.ptr[i] = false;
+	}
+
+	object_define(object, name, global);
+	uint64_t start = object->text.len;
+	uint64_t fixupStart = object->fixups.len;
+	// Every jump starts out short, and the ones whose label turns out to be
+	// out of reach are made near and the function encoded again. Jumps only
+	// ever grow, so this stops.
+	bool grew = true;
+	while (grew) {
+		object->text.len = start;
+		object->fixups.len = fixupStart;
+		encoder.jumps.len = 0;
+		for (uint64_t i = 0; i < labelCount; i++) {
+			encoder.labels.ptr[i] = NO_OFFSET;
+		}
+		for (uint64_t i = 0; i < code->len; i++) {
+			encode_instruction(&encoder, i, &code->ptr[i]);
+		}
+		grew = false;
+		for (uint64_t i = 0; i < encoder.jumps.len; i++) {
+			JumpFixup* jump = &encoder.jumps.ptr[i];
+			assert(encoder.labels.ptr[jump->label] != NO_OFFSET);
+			if (jump->size == 1 && !is_imm8(displacement(&encoder, jump))) {
+				encoder.nearJumps.ptr[jump->insn] = true;
+				grew = true;
+			}
+		}
+	}
+	for (uint64_t i = 0; i < encoder.jumps.len; i++) {
+		JumpFixup* jump = &encoder.jumps.ptr[i];
+		int64_t offset = displacement(&encoder, jump);
+		if (jump->size == 1) {
+			object->text.ptr[jump->offset] = (uint8_t)offset;
+		} else {
+			bytes_patch32(&object->text, jump->offset, (uint32_t)offset);
+		}
+	}
+
+	BUF_FREE(encoder.labels);
+	BUF_FREE(encoder.jumps);
+	BUF_FREE(encoder.nearJumps);
+}
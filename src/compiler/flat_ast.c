@@ -0,0 +1,167 @@
+#include "dragon/flat_ast.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdbool.h>
+
+#include "dragon/core/macro.h"
+
+_Static_assert(EXPRESSION_TYPE_BINARY_OP <= UINT8_MAX, "expression types must fit in a byte");
+_Static_assert(BINARY_OP_KIND_MODULUS <= UINT8_MAX, "binary operators must fit in a byte");
+
+static const char* UNARY_OP_KIND_STRINGS[] = {
+#define X(x) #x,
+#include "dragon/unary_op_kinds.def"
+
+#undef X
+};
+
+static const char* BINARY_OP_KIND_STRINGS[] = {
+#define X(x) #x,
+#include "dragon/binary_op_kinds.def"
+
+#undef X
+};
+
+typedef struct {
+	const Expression* expr;
+	// number of children already flattened
+	uint8_t visited;
+} FlattenFrame;
+
+typedef BUF(FlattenFrame) FlattenFrameBuf;
+
+static FlatNode flat_push(FlatExpression* flat, ExpressionType type, uint8_t op, FlatNode arg)
+{
+	FlatNode node = flat_expression_len(flat);
+	BUF_PUSH(&flat->types, (uint8_t)type);
+	BUF_PUSH(&flat->ops, op);
+	BUF_PUSH(&flat->args, arg);
+	return node;
+}
+
+FlatExpression flat_expression_new(const Expression* root)
+{
+	FlatExpression flat = {
+		.types = BUF_NEW,
+		.ops = BUF_NEW,
+		.args = BUF_NEW,
+		.constants = BUF_NEW,
+	};
+	// The pointer tree can be arbitrarily deep, so walk it with explicit
+	// stacks. `results` holds the flattened nodes whose parent hasn't been
+	// emitted yet.
+	FlattenFrameBuf frames = BUF_NEW;
+	FlatNodeBuf results = BUF_NEW;
+	BUF_PUSH(&frames, ((FlattenFrame) { .expr = root, .visited = 0 }));
+	while (frames.len > 0) {
+		FlattenFrame* frame = &frames.ptr[frames.len - 1];
+		const Expression* expr = frame->expr;
+		switch (expr->type) {
+		case EXPRESSION_TYPE_CONSTANT: {
+			const ConstantExpression* constant = (const ConstantExpression*)expr;
+			FlatNode index = (FlatNode)flat.constants.len;
+			BUF_PUSH(&flat.constants, constant->number);
+			BUF_PUSH(&results, flat_push(&flat, expr->type, 0, index));
+			frames.len--;
+			break;
+		}
+		case EXPRESSION_TYPE_UNARY_OP: {
+			const UnaryOpExpression* unary = (const UnaryOpExpression*)expr;
+			if (frame->visited == 0) {
+				frame->visited = 1;
+				BUF_PUSH(&frames, ((FlattenFrame) { .expr = unary->operand, .visited = 0 }));
+				break;
+			}
+			results.len--;
+			FlatNode node = flat_push(&flat, expr->type, (uint8_t)unary->kind, FLAT_NODE_NONE);
+			results.ptr[results.len++] = node;
+			frames.len--;
+			break;
+		}
+		case EXPRESSION_TYPE_BINARY_OP: {
+			const BinaryOpExpression* binary = (const BinaryOpExpression*)expr;
+			if (frame->visited < 2) {
+				const Expression* child = frame->visited == 0 ? binary->left : binary->right;
+				frame->visited++;
+				BUF_PUSH(&frames, ((FlattenFrame) { .expr = child, .visited = 0 }));
+				break;
+			}
+			results.len -= 2;
+			FlatNode left = results.ptr[results.len];
+			FlatNode node = flat_push(&flat, expr->type, (uint8_t)binary->kind, left);
+			results.ptr[results.len++] = node;
+			frames.len--;
+			break;
+		}
+		}
+	}
+	assert(results.len == 1);
+	BUF_FREE(frames);
+	BUF_FREE(results);
+	return flat;
+}
+
+str flat_expression_to_str(const FlatExpression* expr)
+{
+	StrBuf parts = BUF_NEW;
+	for (FlatNode node = 0; node < flat_expression_len(expr); node++) {
+		switch (flat_type(expr, node)) {
+		case EXPRESSION_TYPE_CONSTANT:
+			BUF_PUSH(&parts, str_fmt("%" PRId64, flat_constant(expr, node)));
+			break;
+		case EXPRESSION_TYPE_UNARY_OP: {
+			str* operand = &parts.ptr[parts.len - 1];
+			str op = str_fmt("%s ", UNARY_OP_KIND_STRINGS[flat_unary_op(expr, node)]);
+			*operand = str_cat(op, *operand);
+			break;
+		}
+		case EXPRESSION_TYPE_BINARY_OP: {
+			str right = parts.ptr[--parts.len];
+			str* left = &parts.ptr[parts.len - 1];
+			str op = str_fmt(" %s ", BINARY_OP_KIND_STRINGS[flat_binary_op(expr, node)]);
+			*left = str_cat(str_lit("("), *left, op, right, str_lit(")"));
+			break;
+		}
+		}
+	}
+	assert(parts.len == 1);
+	str s = parts.ptr[0];
+	BUF_FREE(parts);
+	return s;
+}
+
+bool flat_is_boolean(const FlatExpression* expr, FlatNode node)
+{
+	switch (flat_type(expr, node)) {
+	case EXPRESSION_TYPE_CONSTANT: {
+		int64_t value = flat_constant(expr, node);
+		return value == 0 || value == 1;
+	}
+	case EXPRESSION_TYPE_UNARY_OP:
+		return flat_unary_op(expr, node) == UNARY_OP_KIND_LOGICAL_NEGATION;
+	case EXPRESSION_TYPE_BINARY_OP:
+		switch (flat_binary_op(expr, node)) {
+		case BINARY_OP_KIND_LOGICAL_OR:
+		case BINARY_OP_KIND_LOGICAL_AND:
+		case BINARY_OP_KIND_EQUALITY:
+		case BINARY_OP_KIND_INEQUALITY:
+		case BINARY_OP_KIND_GREATER:
+		case BINARY_OP_KIND_LESS:
+		case BINARY_OP_KIND_GREATER_EQUAL:
+		case BINARY_OP_KIND_LESS_EQUAL:
+			return true;
+		default:
+			return false;
+		}
+	}
+	return false;
+}
+
+void flat_expression_free(FlatExpression expr)
+{
+	BUF_FREE(expr.types);
+	BUF_FREE(expr.ops);
+	BUF_FREE(expr.args);
+	BUF_FREE(expr.constants);
+}
@@ -0,0 +1,215 @@
+#include "dragon/fold.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "dragon/core/arena.h"
+#include "dragon/core/buf.h"
+#include "dragon/core/macro.h"
+#include "dragon/core/sum.h"
+#include "dragon/rewrite.h"
+
+typedef struct {
+	Arena* nodes;
+	SourceFile* file;
+	FoldResult result;
+} Folder;
+
+static bool is_constant(const Expression* expr, int64_t* value)
+{
+	if (expr->type != EXPRESSION_TYPE_CONSTANT) {
+		return false;
+	}
+	*value = ((const ConstantExpression*)expr)->number;
+	return true;
+}
+
+static Expression* new_constant(Folder* folder, int64_t value)
+{
+	folder->result.folded++;
+	return expression_new_constant(folder->nodes, value);
+}
+
+static void warn(Folder* folder, uint32_t offset, const char* message)
+{
+	SourceLocation loc = source_file_location(folder->file, offset);
+	BUF_PUSH(
+	        &folder->result.warnings,
+	        str_fmt(SOURCE_LOCATION_FMT ": %s", SOURCE_LOCATION_ARG(loc), message)
+	);
+}
+
+int64_t fold_unary_op(UnaryOpKind kind, int64_t value)
+{
+	switch (kind) {
+	case UNARY_OP_KIND_ARITHMETIC_NEGATION:
+		// wraps like neg does
+		return (int64_t)(0 - (uint64_t)value);
+	case UNARY_OP_KIND_BITWISE_NEGATION:
+		return ~value;
+	case UNARY_OP_KIND_LOGICAL_NEGATION:
+		return value == 0;
+	}
+	return 0;
+}
+
+FoldValue fold_binary_op(BinaryOpKind kind, int64_t left, int64_t right)
+{
+	uint64_t l = (uint64_t)left;
+	uint64_t r = (uint64_t)right;
+	switch (kind) {
+	case BINARY_OP_KIND_ADDITION:
+		return (FoldValue)JUST((int64_t)(l + r));
+	case BINARY_OP_KIND_SUBTRACTION:
+		return (FoldValue)JUST((int64_t)(l - r));
+	case BINARY_OP_KIND_MULTIPLICATION:
+		return (FoldValue)JUST((int64_t)(l * r));
+	case BINARY_OP_KIND_DIVISION:
+	case BINARY_OP_KIND_MODULUS:
+		if (right == 0 || (left == INT64_MIN && right == -1)) {
+			return (FoldValue)NOTHING;
+		}
+		// C rounds toward zero, like idiv
+		return (FoldValue)JUST(kind == BINARY_OP_KIND_DIVISION ? left / right : left % right);
+	case BINARY_OP_KIND_BITWISE_SHIFT_LEFT:
+		return (FoldValue)JUST((int64_t)(l << (r & 63)));
+	case BINARY_OP_KIND_BITWISE_SHIFT_RIGHT:
+		// arithmetic, like sar
+		return (FoldValue)JUST(left >> (r & 63));
+	case BINARY_OP_KIND_LESS:
+		return (FoldValue)JUST(left < right);
+	case BINARY_OP_KIND_LESS_EQUAL:
+		return (FoldValue)JUST(left <= right);
+	case BINARY_OP_KIND_GREATER:
+		return (FoldValue)JUST(left > right);
+	case BINARY_OP_KIND_GREATER_EQUAL:
+		return (FoldValue)JUST(left >= right);
+	case BINARY_OP_KIND_EQUALITY:
+		return (FoldValue)JUST(left == right);
+	case BINARY_OP_KIND_INEQUALITY:
+		return (FoldValue)JUST(left != right);
+	case BINARY_OP_KIND_BITWISE_AND:
+		return (FoldValue)JUST(left & right);
+	case BINARY_OP_KIND_BITWISE_XOR:
+		return (FoldValue)JUST(left ^ right);
+	case BINARY_OP_KIND_BITWISE_OR:
+		return (FoldValue)JUST(left | right);
+	case BINARY_OP_KIND_LOGICAL_AND:
+	case BINARY_OP_KIND_LOGICAL_OR:
+		UNREACHABLE();
+	}
+	return (FoldValue)NOTHING;
+}
+
+// What makes the operation undefined in C, even though the generated code
+// gives it a value, or NULL if it's defined.
+static const char* undefined_behavior(BinaryOpKind kind, int64_t left, int64_t right)
+{
+	int64_t result;
+	switch (kind) {
+	case BINARY_OP_KIND_ADDITION:
+		return __builtin_add_overflow(left, right, &result) ? "addition overflows" : NULL;
+	case BINARY_OP_KIND_SUBTRACTION:
+		return __builtin_sub_overflow(left, right, &result) ? "subtraction overflows" : NULL;
+	case BINARY_OP_KIND_MULTIPLICATION:
+		return __builtin_mul_overflow(left, right, &result) ? "multiplication overflows" : NULL;
+	case BINARY_OP_KIND_BITWISE_SHIFT_LEFT:
+	case BINARY_OP_KIND_BITWISE_SHIFT_RIGHT:
+		if (right < 0 || right >= 64) {
+			return "shift count out of range";
+		}
+		// shifting a negative value left, or a bit into the sign, is
+		// undefined too
+		if (kind == BINARY_OP_KIND_BITWISE_SHIFT_LEFT && (left < 0 || left > INT64_MAX >> right)) {
+			return "left shift overflows";
+		}
+		return NULL;
+	default:
+		return NULL;
+	}
+}
+
+// && and || only evaluate their right operand if the left one doesn't decide
+// the result, so a constant left operand is enough to fold them.
+static Expression* fold_logical(Folder* folder, BinaryOpExpression* binary, int64_t left)
+{
+	bool isAnd = binary->kind == BINARY_OP_KIND_LOGICAL_AND;
+	if (isAnd ? left == 0 : left != 0) {
+		return new_constant(folder, !isAnd);
+	}
+	int64_t right;
+	if (is_constant(binary->right, &right)) {
+		return new_constant(folder, right != 0);
+	}
+	// the result is the truth value of the right operand, and creating the
+	// zero counts as folding the && or ||
+	Expression* zero = new_constant(folder, 0);
+	return expression_new_binary(folder->nodes, BINARY_OP_KIND_INEQUALITY, binary->offset, binary->right, zero);
+}
+
+static Expression* fold_expression(Folder* folder, Expression* expr)
+{
+	int64_t left;
+	int64_t right;
+	switch (expr->type) {
+	case EXPRESSION_TYPE_CONSTANT:
+		return expr;
+	case EXPRESSION_TYPE_UNARY_OP: {
+		UnaryOpExpression* unary = (UnaryOpExpression*)expr;
+		if (!is_constant(unary->operand, &right)) {
+			return expr;
+		}
+		if (unary->kind == UNARY_OP_KIND_ARITHMETIC_NEGATION && right == INT64_MIN) {
+			warn(folder, unary->offset, "negation overflows");
+		}
+		return new_constant(folder, fold_unary_op(unary->kind, right));
+	}
+	case EXPRESSION_TYPE_BINARY_OP: {
+		BinaryOpExpression* binary = (BinaryOpExpression*)expr;
+		if (!is_constant(binary->left, &left)) {
+			return expr;
+		}
+		if (binary->kind == BINARY_OP_KIND_LOGICAL_AND || binary->kind == BINARY_OP_KIND_LOGICAL_OR) {
+			return fold_logical(folder, binary, left);
+		}
+		if (!is_constant(binary->right, &right)) {
+			return expr;
+		}
+		FoldValue value = fold_binary_op(binary->kind, left, right);
+		if (!value.present) {
+			warn(folder, binary->offset, right == 0 ? "division by zero" : "division overflows");
+			return expr;
+		}
+		// folded all the same, to the value the generated code computes
+		const char* undefined = undefined_behavior(binary->kind, left, right);
+		if (undefined != NULL) {
+			warn(folder, binary->offset, undefined);
+		}
+		return new_constant(folder, value.value);
+	}
+	}
+	return expr;
+}
+
+FoldResult fold_program(Program* program, SourceFile* file)
+{
+	Folder folder = {
+		.nodes = &program->nodes,
+		.file = file,
+		.result = { .folded = 0, .warnings = BUF_NEW },
+	};
+	ExpressionSlotBuf slots = expression_post_order_slots(&program->function.statement.expression);
+	for (uint64_t i = 0; i < slots.len; i++) {
+		*slots.ptr[i] = fold_expression(&folder, *slots.ptr[i]);
+	}
+	BUF_FREE(slots);
+	return folder.result;
+}
+
+void fold_result_free(FoldResult result)
+{
+	for (uint64_t i = 0; i < result.warnings.len; i++) {
+		str_free(result.warnings.ptr[i]);
+	}
+	BUF_FREE(result.warnings);
+}
@@ -0,0 +1,245 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "dragon/ast.h"
+#include "dragon/cfg.h"
+#include "dragon/core/buf.h"
+#include "dragon/ir_opt.h"
+
+#define NO_ENTRY UINT32_MAX
+
+// An instruction that has been numbered, and the value it computes.
+typedef struct {
+	IrOpcode opcode;
+	uint8_t op;
+	IrOperand args[2];
+	IrValue value;
+	// the entry with the same hash that was added before this one
+	uint32_t next;
+} Entry;
+
+typedef BUF(Entry) EntryBuf;
+typedef BUF(uint32_t) BucketBuf;
+
+// A hash table of the instructions in the dominators of the current block.
+// Entries are only added and removed at the end, so leaving a block in the
+// dominator tree drops the entries it added.
+typedef struct {
+	EntryBuf entries;
+	BucketBuf buckets;
+} ValueTable;
+
+typedef struct {
+	IrBlockId block;
+	uint32_t nextChild;
+	uint64_t entries;
+} GvnFrame;
+
+typedef BUF(GvnFrame) GvnFrameBuf;
+
+static bool is_commutative(BinaryOpKind kind)
+{
+	switch (kind) {
+	case BINARY_OP_KIND_ADDITION:
+	case BINARY_OP_KIND_MULTIPLICATION:
+	case BINARY_OP_KIND_EQUALITY:
+	case BINARY_OP_KIND_INEQUALITY:
+	case BINARY_OP_KIND_BITWISE_OR:
+	case BINARY_OP_KIND_BITWISE_XOR:
+	case BINARY_OP_KIND_BITWISE_AND:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static bool operand_eq(IrOperand a, IrOperand b)
+{
+	return a.kind == b.kind && a.value == b.value;
+}
+
+// Orders the operands of commutative operators, so `a + b` and `b + a` are
+// numbered the same: constants go last, and lower values first.
+static void canonicalize(IrInstruction* insn)
+{
+	if (insn->opcode != IR_OP_BINARY || !is_commutative((BinaryOpKind)insn->op)) {
+		return;
+	}
+	IrOperand a = insn->args[0];
+	IrOperand b = insn->args[1];
+	bool swap = a.kind == IR_OPERAND_VALUE && b.kind == IR_OPERAND_VALUE ? a.value > b.value
+	            : a.kind == IR_OPERAND_CONSTANT && b.kind == IR_OPERAND_VALUE;
+	if (swap) {
+		insn->args[0] = b;
+		insn->args[1] = a;
+	}
+}
+
+static uint64_t hash_operand(uint64_t hash, IrOperand operand)
+{
+	hash = (hash ^ (uint64_t)operand.kind) * 0x100000001b3;
+	return (hash ^ (uint64_t)operand.value) * 0x100000001b3;
+}
+
+static uint32_t bucket_of(const ValueTable* table, const IrInstruction* insn)
+{
+	uint64_t hash = 0xcbf29ce484222325;
+	hash = (hash ^ (uint64_t)insn->opcode) * 0x100000001b3;
+	hash = (hash ^ insn->op) * 0x100000001b3;
+	hash = hash_operand(hash, insn->args[0]);
+	hash = hash_operand(hash, insn->args[1]);
+	return (uint32_t)((hash ^ (hash >> 32)) & (table->buckets.len - 1));
+}
+
+// The value of an earlier instruction computing the same as `insn`, or
+// IR_VALUE_NONE after adding `insn` to the table.
+static IrValue find_or_add(ValueTable* table, const IrInstruction* insn)
+{
+	uint32_t bucket = bucket_of(table, insn);
+	for (uint32_t i = table->buckets.ptr[bucket]; i != NO_ENTRY; i = table->entries.ptr[i].next) {
+		const Entry* entry = &table->entries.ptr[i];
+		if (entry->opcode == insn->opcode && entry->op == insn->op && operand_eq(entry->args[0], insn->args[0])
+		                && operand_eq(entry->args[1], insn->args[1])) {
+			return entry->value;
+		}
+	}
+	BUF_PUSH(&table->entries, ((Entry) {
+		.opcode = insn->opcode,
+		.op = insn->op,
+		.args = { insn->args[0], insn->args[1] },
+		.value = insn->dst,
+		.next = table->buckets.ptr[bucket],
+	}));
+	table->buckets.ptr[bucket] = (uint32_t)(table->entries.len - 1);
+	return IR_VALUE_NONE;
+}
+
+static void truncate_table(ValueTable* table, uint64_t len)
+{
+	while (table->entries.len > len) {
+		const Entry* entry = &table->entries.ptr[--table->entries.len];
+		IrInstruction insn = { .opcode = entry->opcode, .op = entry->op, .args = { entry->args[0], entry->args[1] } };
+		table->buckets.ptr[bucket_of(table, &insn)] = entry->next;
+	}
+}
+
+// The operand every argument of `phi` is, apart from the phi itself, if there
+// is one.
+static bool phi_operand(const IrPhi* phi, IrOperand* operand)
+{
+	bool found = false;
+	for (uint64_t i = 0; i < phi->args.len; i++) {
+		IrOperand arg = phi->args.ptr[i];
+		if (arg.kind == IR_OPERAND_VALUE && arg.value == phi->dst) {
+			continue;
+		}
+		if (found && !operand_eq(arg, *operand)) {
+			return false;
+		}
+		*operand = arg;
+		found = true;
+	}
+	return found;
+}
+
+static bool phis_eq(const IrPhi* a, const IrPhi* b)
+{
+	for (uint64_t i = 0; i < a->args.len; i++) {
+		if (!operand_eq(a->args.ptr[i], b->args.ptr[i])) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static void number_block(IrBlock* block, ValueTable* table, IrValueMap* map, IrOptStats* stats)
+{
+	uint64_t kept = 0;
+	for (uint64_t i = 0; i < block->phis.len; i++) {
+		IrPhi phi = block->phis.ptr[i];
+		for (uint64_t j = 0; j < phi.args.len; j++) {
+			phi.args.ptr[j] = ir_value_map_get(map, phi.args.ptr[j]);
+		}
+		IrOperand replacement;
+		bool redundant = phi_operand(&phi, &replacement);
+		for (uint64_t j = 0; !redundant && j < kept; j++) {
+			if (phis_eq(&phi, &block->phis.ptr[j])) {
+				replacement = ir_value(block->phis.ptr[j].dst);
+				redundant = true;
+			}
+		}
+		if (redundant) {
+			map->replacements.ptr[phi.dst] = replacement;
+			stats->counts[IR_OPT_COUNTER_REDUNDANT_VALUES]++;
+			BUF_FREE(phi.args);
+			continue;
+		}
+		block->phis.ptr[kept++] = phi;
+	}
+	block->phis.len = kept;
+
+	kept = 0;
+	for (uint64_t i = 0; i < block->instructions.len; i++) {
+		IrInstruction insn = block->instructions.ptr[i];
+		for (uint64_t j = 0; j < 2; j++) {
+			insn.args[j] = ir_value_map_get(map, insn.args[j]);
+		}
+		if (insn.opcode == IR_OP_UNARY || insn.opcode == IR_OP_BINARY) {
+			canonicalize(&insn);
+			IrValue earlier = find_or_add(table, &insn);
+			if (earlier != IR_VALUE_NONE) {
+				map->replacements.ptr[insn.dst] = ir_value(earlier);
+				stats->counts[IR_OPT_COUNTER_REDUNDANT_VALUES]++;
+				continue;
+			}
+		}
+		block->instructions.ptr[kept++] = insn;
+	}
+	block->instructions.len = kept;
+}
+
+void ir_gvn(IrFunction* func, IrOptStats* stats)
+{
+	uint64_t instructions = 0;
+	for (uint64_t i = 0; i < func->blocks.len; i++) {
+		instructions += func->blocks.ptr[i].instructions.len;
+	}
+	uint64_t bucketCount = 16;
+	while (bucketCount < 2 * instructions) {
+		bucketCount *= 2;
+	}
+	ValueTable table = { .entries = BUF_NEW, .buckets = BUF_NEW };
+	BUF_RESERVE(&table.buckets, bucketCount);
+	table.buckets.len = bucketCount;
+	for (uint64_t i = 0; i < bucketCount; i++) {
+		table.buckets.ptr[i] = NO_ENTRY;
+	}
+	IrValueMap map = ir_value_map_new(func);
+
+	// An instruction can only be replaced by one that runs before it on every
+	// path, so walk the dominator tree.
+	IrDominatorTree tree = ir_dominator_tree_new(func);
+	GvnFrameBuf frames = BUF_NEW;
+	BUF_PUSH(&frames, ((GvnFrame) { .block = 0, .nextChild = 0, .entries = 0 }));
+	number_block(&func->blocks.ptr[0], &table, &map, stats);
+	while (frames.len > 0) {
+		GvnFrame* frame = &frames.ptr[frames.len - 1];
+		uint32_t child = tree.childStart.ptr[frame->block] + frame->nextChild;
+		if (child == tree.childStart.ptr[frame->block + 1]) {
+			truncate_table(&table, frame->entries);
+			frames.len--;
+			continue;
+		}
+		frame->nextChild++;
+		IrBlockId block = tree.children.ptr[child];
+		BUF_PUSH(&frames, ((GvnFrame) { .block = block, .nextChild = 0, .entries = table.entries.len }));
+		number_block(&func->blocks.ptr[block], &table, &map, stats);
+	}
+	ir_value_map_apply(&map, func);
+
+	BUF_FREE(frames);
+	ir_dominator_tree_free(tree);
+	ir_value_map_free(map);
+	BUF_FREE(table.buckets);
+	BUF_FREE(table.entries);
+}
@@ -0,0 +1,171 @@
+#include "dragon/interp.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+typedef int64_t (*HostImpl)(FILE* in, FILE* out, const int64_t* args);
+
+static int64_t host_putchar(FILE* in, FILE* out, const int64_t* args)
+{
+	(void)in;
+	return fputc((unsigned char)args[0], out);
+}
+
+static int64_t host_getchar(FILE* in, FILE* out, const int64_t* args)
+{
+	(void)out;
+	(void)args;
+	return fgetc(in);
+}
+
+static const HostImpl HOST_IMPLS[] = {
+	[HOST_FUNCTION_PUTCHAR] = host_putchar,
+	[HOST_FUNCTION_GETCHAR] = host_getchar,
+};
+
+_Static_assert(
+        sizeof(HOST_IMPLS) / sizeof(HOST_IMPLS[0]) == HOST_FUNCTION_COUNT,
+        "every host function needs an implementation"
+);
+
+// Whether `insn` calls a host function that exists, with its result and
+// arguments inside the frame. Nothing compiles to calls yet, so they only come
+// from bytecode built by hand, and are checked once before running instead of
+// on every call.
+static bool host_call_valid(const Bytecode* code, BcInstruction insn)
+{
+	return insn.a < HOST_FUNCTION_COUNT && insn.dst < code->registerCount
+	       && (uint64_t)insn.b + host_function_arity((HostFunction)insn.a) <= code->registerCount;
+}
+
+// Both forms of a binary operator, running `body` with the operands in l and
+// r.
+#define BINARY_OP(name, body) \
+	op_##name: { \
+		int64_t l = regs[insn.a]; \
+		int64_t r = regs[insn.b]; \
+		body; \
+		DISPATCH(); \
+	} \
+	op_##name##_IMM: { \
+		int64_t l = regs[insn.a]; \
+		int64_t r = (int16_t)insn.b; \
+		body; \
+		DISPATCH(); \
+	}
+
+// Arithmetic wraps and shift counts are masked to 6 bits, like fold_binary_op
+// and the generated code.
+#define BINARY_EXPR(name, expr) BINARY_OP(name, regs[insn.dst] = (expr))
+
+// idiv traps on both, so the program stops too.
+#define DIVISION_OP(name, op) \
+	BINARY_OP( \
+	        name, \
+	        if (r == 0) { \
+	                error = str_lit("division by zero"); \
+	                goto done; \
+	        } \
+	        if (l == INT64_MIN && r == -1) { \
+	                error = str_lit("division overflow"); \
+	                goto done; \
+	        } \
+	        regs[insn.dst] = l op r \
+	)
+
+// Dispatches with a jump table of label addresses, so every handler ends in an
+// indirect jump of its own that the branch predictor can learn separately.
+InterpResult interp_run(const Bytecode* code, FILE* in, FILE* out)
+{
+	static const void* const LABELS[] = {
+#define X(name, mnemonic) &&op_##name,
+#include "dragon/bytecode_ops.def"
+#undef X
+	};
+
+	for (uint64_t i = 0; i < code->code.len; i++) {
+		BcInstruction call = code->code.ptr[i];
+		if (call.opcode == BC_OP_CALL && !host_call_valid(code, call)) {
+			return (InterpResult)ERR(str_fmt("invalid host function call at %" PRIu64, i));
+		}
+	}
+
+	int64_t* regs = calloc(code->registerCount + 1, sizeof(int64_t));
+	const BcInstruction* ip = code->code.ptr;
+	BcInstruction insn;
+	// set when the program traps
+	str error = str_empty;
+	int64_t result = 0;
+
+#define DISPATCH() \
+	do { \
+		insn = *ip++; \
+		goto *LABELS[insn.opcode]; \
+	} while (false)
+
+	DISPATCH();
+
+op_LOAD:
+	regs[insn.dst] = (int32_t)bc_wide(insn);
+	DISPATCH();
+op_LOAD_CONSTANT:
+	regs[insn.dst] = code->constants.ptr[bc_wide(insn)];
+	DISPATCH();
+op_NEG:
+	regs[insn.dst] = (int64_t)(0 - (uint64_t)regs[insn.a]);
+	DISPATCH();
+op_NOT:
+	regs[insn.dst] = ~regs[insn.a];
+	DISPATCH();
+op_LOGICAL_NOT:
+	regs[insn.dst] = regs[insn.a] == 0;
+	DISPATCH();
+op_BOOL:
+	regs[insn.dst] = regs[insn.a] != 0;
+	DISPATCH();
+
+	BINARY_EXPR(ADD, (int64_t)((uint64_t)l + (uint64_t)r))
+	BINARY_EXPR(SUB, (int64_t)((uint64_t)l - (uint64_t)r))
+	BINARY_EXPR(MUL, (int64_t)((uint64_t)l * (uint64_t)r))
+	DIVISION_OP(DIV, /)
+	DIVISION_OP(MOD, %)
+	BINARY_EXPR(SHL, (int64_t)((uint64_t)l << ((uint64_t)r & 63U)))
+	BINARY_EXPR(SAR, l >> ((uint64_t)r & 63U))
+	BINARY_EXPR(LT, l < r)
+	BINARY_EXPR(LE, l <= r)
+	BINARY_EXPR(GT, l > r)
+	BINARY_EXPR(GE, l >= r)
+	BINARY_EXPR(EQ, l == r)
+	BINARY_EXPR(NE, l != r)
+	BINARY_EXPR(AND, l & r)
+	BINARY_EXPR(XOR, l ^ r)
+	BINARY_EXPR(OR, l | r)
+
+op_JUMP:
+	ip = code->code.ptr + bc_wide(insn);
+	DISPATCH();
+op_JUMP_IF_ZERO:
+	if (regs[insn.dst] == 0) {
+		ip = code->code.ptr + bc_wide(insn);
+	}
+	DISPATCH();
+op_JUMP_IF_NONZERO:
+	if (regs[insn.dst] != 0) {
+		ip = code->code.ptr + bc_wide(insn);
+	}
+	DISPATCH();
+op_CALL:
+	regs[insn.dst] = HOST_IMPLS[insn.a](in, out, &regs[insn.b]);
+	DISPATCH();
+op_RETURN:
+	result = regs[insn.a];
+
+done:
+#undef DISPATCH
+	free(regs);
+	if (str_len(error) > 0) {
+		return (InterpResult)ERR(error);
+	}
+	return (InterpResult)OK(result);
+}
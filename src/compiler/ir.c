@@ -0,0 +1,335 @@
+#include "dragon/ir.h"
+
+#include <inttypes.h>
+
+#include "dragon/cfg.h"
+#include "dragon/core/macro.h"
+#include "dragon/flat_ast.h"
+
+static const char* const UNARY_OP_NAMES[] = {
+	[UNARY_OP_KIND_ARITHMETIC_NEGATION] = "neg",
+	[UNARY_OP_KIND_BITWISE_NEGATION] = "not",
+	[UNARY_OP_KIND_LOGICAL_NEGATION] = "lnot",
+};
+
+static const char* const BINARY_OP_NAMES[] = {
+	[BINARY_OP_KIND_ADDITION] = "add",
+	[BINARY_OP_KIND_SUBTRACTION] = "sub",
+	[BINARY_OP_KIND_MULTIPLICATION] = "mul",
+	[BINARY_OP_KIND_DIVISION] = "div",
+	[BINARY_OP_KIND_MODULUS] = "mod",
+	[BINARY_OP_KIND_LOGICAL_OR] = "lor",
+	[BINARY_OP_KIND_LOGICAL_AND] = "land",
+	[BINARY_OP_KIND_EQUALITY] = "eq",
+	[BINARY_OP_KIND_INEQUALITY] = "ne",
+	[BINARY_OP_KIND_GREATER] = "gt",
+	[BINARY_OP_KIND_LESS] = "lt",
+	[BINARY_OP_KIND_GREATER_EQUAL] = "ge",
+	[BINARY_OP_KIND_LESS_EQUAL] = "le",
+	[BINARY_OP_KIND_BITWISE_OR] = "or",
+	[BINARY_OP_KIND_BITWISE_XOR] = "xor",
+	[BINARY_OP_KIND_BITWISE_AND] = "and",
+	[BINARY_OP_KIND_BITWISE_SHIFT_LEFT] = "shl",
+	[BINARY_OP_KIND_BITWISE_SHIFT_RIGHT] = "sar",
+};
+
+// An && or || whose left operand has been lowered.
+typedef struct {
+	IrValue result;
+	IrBlockId end;
+} PendingLogical;
+
+typedef BUF(PendingLogical) PendingLogicalBuf;
+
+typedef struct {
+	IrFunction func;
+	IrBlockId current;
+	// blocks in the order they were started, which is how they're laid out
+	IrBlockIdBuf order;
+} Lowerer;
+
+static IrValue new_value(Lowerer* lowerer)
+{
+	return lowerer->func.valueCount++;
+}
+
+static IrBlockId new_block(Lowerer* lowerer)
+{
+	IrBlockId block = (IrBlockId)lowerer->func.blocks.len;
+	BUF_PUSH(
+	        &lowerer->func.blocks,
+	        ((IrBlock) { .phis = BUF_NEW, .instructions = BUF_NEW, .preds = BUF_NEW })
+	);
+	return block;
+}
+
+static void start_block(Lowerer* lowerer, IrBlockId block)
+{
+	lowerer->current = block;
+	BUF_PUSH(&lowerer->order, block);
+}
+
+static void emit(Lowerer* lowerer, IrInstruction insn)
+{
+	BUF_PUSH(&lowerer->func.blocks.ptr[lowerer->current].instructions, insn);
+}
+
+static bool is_logical_op(BinaryOpKind kind)
+{
+	return kind == BINARY_OP_KIND_LOGICAL_AND || kind == BINARY_OP_KIND_LOGICAL_OR;
+}
+
+// Once the left operand of && or || is known, the right one is only
+// evaluated, in a block of its own, if the left one doesn't decide the
+// result. The result is preset to the deciding value.
+static void lower_short_circuit(
+        Lowerer* lowerer,
+        BinaryOpKind kind,
+        IrOperand left,
+        PendingLogicalBuf* pending
+)
+{
+	bool isAnd = kind == BINARY_OP_KIND_LOGICAL_AND;
+	IrValue result = new_value(lowerer);
+	IrBlockId right = new_block(lowerer);
+	IrBlockId end = new_block(lowerer);
+	emit(lowerer, (IrInstruction) {
+		.opcode = IR_OP_COPY,
+		.dst = result,
+		.args = { ir_constant(isAnd ? 0 : 1) },
+	});
+	emit(lowerer, (IrInstruction) {
+		.opcode = IR_OP_BRANCH,
+		.dst = IR_VALUE_NONE,
+		.args = { left },
+		.targets = { isAnd ? right : end, isAnd ? end : right },
+	});
+	start_block(lowerer, right);
+	BUF_PUSH(pending, ((PendingLogical) { .result = result, .end = end }));
+}
+
+// Sets the result of && or || from its right operand, and continues after it.
+static IrOperand lower_logical(
+        Lowerer* lowerer,
+        const FlatExpression* expr,
+        FlatNode right,
+        IrOperand value,
+        PendingLogicalBuf* pending
+)
+{
+	PendingLogical logical = pending->ptr[--pending->len];
+	if (flat_is_boolean(expr, right)) {
+		emit(lowerer, (IrInstruction) {
+			.opcode = IR_OP_COPY,
+			.dst = logical.result,
+			.args = { value },
+		});
+	} else {
+		emit(lowerer, (IrInstruction) {
+			.opcode = IR_OP_BINARY,
+			.op = BINARY_OP_KIND_INEQUALITY,
+			.dst = logical.result,
+			.args = { value, ir_constant(0) },
+		});
+	}
+	emit(lowerer, (IrInstruction) {
+		.opcode = IR_OP_JUMP,
+		.dst = IR_VALUE_NONE,
+		.targets = { logical.end },
+	});
+	start_block(lowerer, logical.end);
+	return ir_value(logical.result);
+}
+
+// Lowers the expression of every statement from its post-order form, so deep
+// trees don't need recursion.
+IrFunction ir_lower_function(Function func)
+{
+	Lowerer lowerer = {
+		.func = { .name = func.name, .blocks = BUF_NEW, .valueCount = 0 },
+		.order = BUF_NEW,
+	};
+	start_block(&lowerer, new_block(&lowerer));
+
+	FlatExpression expr = flat_expression_new(func.statement.expression);
+	uint32_t len = flat_expression_len(&expr);
+	// For each node that is the left operand of && or ||, the operator node.
+	FlatNodeBuf shortCircuits = BUF_NEW;
+	BUF_RESERVE(&shortCircuits, len);
+	shortCircuits.len = len;
+	for (FlatNode node = 0; node < len; node++) {
+		shortCircuits.ptr[node] = FLAT_NODE_NONE;
+	}
+	for (FlatNode node = 0; node < len; node++) {
+		if (flat_type(&expr, node) == EXPRESSION_TYPE_BINARY_OP && is_logical_op(flat_binary_op(&expr, node))) {
+			shortCircuits.ptr[flat_left(&expr, node)] = node;
+		}
+	}
+
+	IrOperandBuf operands = BUF_NEW;
+	BUF_RESERVE(&operands, len);
+	operands.len = len;
+	PendingLogicalBuf pending = BUF_NEW;
+	for (FlatNode node = 0; node < len; node++) {
+		switch (flat_type(&expr, node)) {
+		case EXPRESSION_TYPE_CONSTANT:
+			operands.ptr[node] = ir_constant(flat_constant(&expr, node));
+			break;
+		case EXPRESSION_TYPE_UNARY_OP: {
+			IrValue dst = new_value(&lowerer);
+			emit(&lowerer, (IrInstruction) {
+				.opcode = IR_OP_UNARY,
+				.op = (uint8_t)flat_unary_op(&expr, node),
+				.dst = dst,
+				.args = { operands.ptr[flat_operand(node)] },
+			});
+			operands.ptr[node] = ir_value(dst);
+			break;
+		}
+		case EXPRESSION_TYPE_BINARY_OP: {
+			BinaryOpKind kind = flat_binary_op(&expr, node);
+			FlatNode right = flat_right(node);
+			if (is_logical_op(kind)) {
+				operands.ptr[node] = lower_logical(&lowerer, &expr, right, operands.ptr[right], &pending);
+				break;
+			}
+			IrValue dst = new_value(&lowerer);
+			emit(&lowerer, (IrInstruction) {
+				.opcode = IR_OP_BINARY,
+				.op = (uint8_t)kind,
+				.dst = dst,
+				.args = { operands.ptr[flat_left(&expr, node)], operands.ptr[right] },
+			});
+			operands.ptr[node] = ir_value(dst);
+			break;
+		}
+		}
+		FlatNode parent = shortCircuits.ptr[node];
+		if (parent != FLAT_NODE_NONE) {
+			lower_short_circuit(&lowerer, flat_binary_op(&expr, parent), operands.ptr[node], &pending);
+		}
+	}
+	emit(&lowerer, (IrInstruction) {
+		.opcode = IR_OP_RETURN,
+		.dst = IR_VALUE_NONE,
+		.args = { operands.ptr[flat_expression_root(&expr)] },
+	});
+
+	BUF_FREE(pending);
+	BUF_FREE(operands);
+	BUF_FREE(shortCircuits);
+	flat_expression_free(expr);
+
+	// a block's code mostly falls through to the one started after it
+	ir_reorder_blocks(&lowerer.func, &lowerer.order);
+	BUF_FREE(lowerer.order);
+	return lowerer.func;
+}
+
+uint32_t ir_successors(const IrBlock* block, IrBlockId succs[2])
+{
+	const IrInstruction* last = ir_block_terminator(block);
+	switch (last->opcode) {
+	case IR_OP_JUMP:
+		succs[0] = last->targets[0];
+		return 1;
+	case IR_OP_BRANCH:
+		succs[0] = last->targets[0];
+		succs[1] = last->targets[1];
+		return 2;
+	default:
+		return 0;
+	}
+}
+
+static str operand_to_str(IrOperand operand)
+{
+	if (operand.kind == IR_OPERAND_VALUE) {
+		return str_fmt("v%" PRId64, operand.value);
+	}
+	return str_fmt("%" PRId64, operand.value);
+}
+
+static str instruction_to_str(const IrInstruction* insn)
+{
+	switch (insn->opcode) {
+	case IR_OP_COPY:
+		return str_cat(str_fmt("    v%" PRIu32 " = ", insn->dst), operand_to_str(insn->args[0]));
+	case IR_OP_UNARY:
+		return str_cat(
+		               str_fmt("    v%" PRIu32 " = %s ", insn->dst, UNARY_OP_NAMES[insn->op]),
+		               operand_to_str(insn->args[0])
+		       );
+	case IR_OP_BINARY:
+		return str_cat(
+		               str_fmt("    v%" PRIu32 " = %s ", insn->dst, BINARY_OP_NAMES[insn->op]),
+		               operand_to_str(insn->args[0]),
+		               str_lit(", "),
+		               operand_to_str(insn->args[1])
+		       );
+	case IR_OP_JUMP:
+		return str_fmt("    jump b%" PRIu32, insn->targets[0]);
+	case IR_OP_BRANCH:
+		return str_cat(
+		               str_lit("    branch "),
+		               operand_to_str(insn->args[0]),
+		               str_fmt(", b%" PRIu32 ", b%" PRIu32, insn->targets[0], insn->targets[1])
+		       );
+	case IR_OP_RETURN:
+		return str_cat(str_lit("    return "), operand_to_str(insn->args[0]));
+	}
+	UNREACHABLE();
+}
+
+str ir_function_to_str(const IrFunction* func, const Interner* symbols)
+{
+	StrBuf lines = BUF_NEW;
+	BUF_PUSH(&lines, str_fmt("function " STR_FMT, STR_ARG(interner_get(symbols, func->name))));
+	for (uint64_t i = 0; i < func->blocks.len; i++) {
+		const IrBlock* block = &func->blocks.ptr[i];
+		BUF_PUSH(&lines, str_fmt("b%" PRIu64 ":", i));
+		for (uint64_t j = 0; j < block->phis.len; j++) {
+			const IrPhi* phi = &block->phis.ptr[j];
+			StrBuf args = BUF_NEW;
+			for (uint64_t k = 0; k < phi->args.len; k++) {
+				BUF_PUSH(
+				        &args,
+				        str_cat(
+				                str_lit("["),
+				                operand_to_str(phi->args.ptr[k]),
+				                str_fmt(", b%" PRIu32 "]", block->preds.ptr[k])
+				        )
+				);
+			}
+			str joined = str_join(str_lit(", "), args);
+			BUF_PUSH(&lines, str_cat(str_fmt("    v%" PRIu32 " = phi ", phi->dst), joined));
+			BUF_FREE(args);
+		}
+		for (uint64_t j = 0; j < block->instructions.len; j++) {
+			BUF_PUSH(&lines, instruction_to_str(&block->instructions.ptr[j]));
+		}
+	}
+	// end with a newline
+	BUF_PUSH(&lines, str_empty);
+	str s = str_join(str_lit("\n"), lines);
+	BUF_FREE(lines);
+	return s;
+}
+
+void ir_block_free(IrBlock block)
+{
+	for (uint64_t i = 0; i < block.phis.len; i++) {
+		BUF_FREE(block.phis.ptr[i].args);
+	}
+	BUF_FREE(block.phis);
+	BUF_FREE(block.instructions);
+	BUF_FREE(block.preds);
+}
+
+void ir_function_free(IrFunction func)
+{
+	for (uint64_t i = 0; i < func.blocks.len; i++) {
+		ir_block_free(func.blocks.ptr[i]);
+	}
+	BUF_FREE(func.blocks);
+}
@@ -0,0 +1,475 @@
+#include "dragon/ir_codegen.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "dragon/core/buf.h"
+#include "dragon/core/macro.h"
+
+#define RAX asm_reg(MREG_RAX)
+#define RCX asm_reg(MREG_RCX)
+#define RDX asm_reg(MREG_RDX)
+#define RSP asm_reg(MREG_RSP)
+#define RBP asm_reg(MREG_RBP)
+#define AL asm_reg(MREG_AL)
+#define CL asm_reg(MREG_CL)
+
+typedef BUF(uint32_t) UseCountBuf;
+typedef BUF(bool) TargetedBuf;
+
+typedef struct {
+	const IrFunction* func;
+	const RegisterAllocation* allocation;
+	InstructionBuf* code;
+	// how many instructions read each value
+	UseCountBuf uses;
+	// whether any jump or branch goes to each block
+	TargetedBuf targeted;
+	bool hasFrame;
+} Backend;
+
+// The setcc and jcc that test each comparison, and the comparison that holds
+// exactly when it doesn't.
+static const struct {
+	Opcode set;
+	Opcode jump;
+	BinaryOpKind negated;
+} COMPARISONS[] = {
+	[BINARY_OP_KIND_LESS] = { OPCODE_SETL, OPCODE_JL, BINARY_OP_KIND_GREATER_EQUAL },
+	[BINARY_OP_KIND_LESS_EQUAL] = { OPCODE_SETLE, OPCODE_JLE, BINARY_OP_KIND_GREATER },
+	[BINARY_OP_KIND_GREATER] = { OPCODE_SETG, OPCODE_JG, BINARY_OP_KIND_LESS_EQUAL },
+	[BINARY_OP_KIND_GREATER_EQUAL] = { OPCODE_SETGE, OPCODE_JGE, BINARY_OP_KIND_LESS },
+	[BINARY_OP_KIND_EQUALITY] = { OPCODE_SETE, OPCODE_JE, BINARY_OP_KIND_INEQUALITY },
+	[BINARY_OP_KIND_INEQUALITY] = { OPCODE_SETNE, OPCODE_JNE, BINARY_OP_KIND_EQUALITY },
+};
+
+static bool is_comparison(BinaryOpKind kind)
+{
+	switch (kind) {
+	case BINARY_OP_KIND_LESS:
+	case BINARY_OP_KIND_LESS_EQUAL:
+	case BINARY_OP_KIND_GREATER:
+	case BINARY_OP_KIND_GREATER_EQUAL:
+	case BINARY_OP_KIND_EQUALITY:
+	case BINARY_OP_KIND_INEQUALITY:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static bool is_imm32(int64_t value)
+{
+	return value >= INT32_MIN && value <= INT32_MAX;
+}
+
+static Operand location(const Backend* backend, IrValue value)
+{
+	return backend->allocation->locations.ptr[value];
+}
+
+// Whether `operand` is a value living in `reg`.
+static bool lives_in(const Backend* backend, IrOperand operand, Operand reg)
+{
+	return operand.kind == IR_OPERAND_VALUE && operand_eq(location(backend, (IrValue)operand.value), reg);
+}
+
+static void load(Backend* backend, Operand reg, IrOperand operand)
+{
+	if (operand.kind == IR_OPERAND_CONSTANT) {
+		asm_emit2(backend->code, OPCODE_MOV, reg, asm_imm(operand.value));
+	} else {
+		asm_emit2(backend->code, OPCODE_MOV, reg, location(backend, (IrValue)operand.value));
+	}
+}
+
+// `operand` in a form ALU instructions take as their source: an immediate if
+// it fits in one, else its register, stack slot or rcx.
+static Operand source(Backend* backend, IrOperand operand)
+{
+	if (operand.kind == IR_OPERAND_VALUE) {
+		return location(backend, (IrValue)operand.value);
+	}
+	if (is_imm32(operand.value)) {
+		return asm_imm(operand.value);
+	}
+	load(backend, RCX, operand);
+	return RCX;
+}
+
+static void codegen_copy(Backend* backend, const IrInstruction* insn)
+{
+	IrOperand value = insn->args[0];
+	Operand dst = location(backend, insn->dst);
+	if (value.kind == IR_OPERAND_CONSTANT && is_imm32(value.value)) {
+		asm_emit2(backend->code, OPCODE_MOV, dst, asm_imm(value.value));
+		return;
+	}
+	// memory to memory moves go through a register
+	if (dst.kind == OPERAND_REGISTER) {
+		load(backend, dst, value);
+		return;
+	}
+	if (value.kind == IR_OPERAND_VALUE && location(backend, (IrValue)value.value).kind == OPERAND_REGISTER) {
+		asm_emit2(backend->code, OPCODE_MOV, dst, location(backend, (IrValue)value.value));
+		return;
+	}
+	load(backend, RAX, value);
+	asm_emit2(backend->code, OPCODE_MOV, dst, RAX);
+}
+
+// The register to compute `insn`'s result in: its own register, unless the
+// right operand lives there and would be overwritten before it's read.
+static Operand work_register(const Backend* backend, const IrInstruction* insn)
+{
+	Operand dst = location(backend, insn->dst);
+	if (dst.kind != OPERAND_REGISTER || lives_in(backend, insn->args[1], dst)) {
+		return RAX;
+	}
+	return dst;
+}
+
+// Moves the result in `reg` to where `insn`'s result lives.
+static void store(Backend* backend, const IrInstruction* insn, Operand reg)
+{
+	Operand dst = location(backend, insn->dst);
+	if (!operand_eq(dst, reg)) {
+		asm_emit2(backend->code, OPCODE_MOV, dst, reg);
+	}
+}
+
+// Writes the flag in al to where `insn`'s result lives, zero-extended.
+static void store_flag(Backend* backend, const IrInstruction* insn)
+{
+	Operand dst = location(backend, insn->dst);
+	if (dst.kind == OPERAND_REGISTER) {
+		asm_emit2(backend->code, OPCODE_MOVZX, dst, AL);
+		return;
+	}
+	asm_emit2(backend->code, OPCODE_MOVZX, RAX, AL);
+	asm_emit2(backend->code, OPCODE_MOV, dst, RAX);
+}
+
+static void codegen_unary(Backend* backend, const IrInstruction* insn)
+{
+	InstructionBuf* code = backend->code;
+	Operand reg = work_register(backend, insn);
+	load(backend, reg, insn->args[0]);
+	switch ((UnaryOpKind)insn->op) {
+	case UNARY_OP_KIND_ARITHMETIC_NEGATION:
+		asm_emit1(code, OPCODE_NEG, reg);
+		break;
+	case UNARY_OP_KIND_BITWISE_NEGATION:
+		asm_emit1(code, OPCODE_NOT, reg);
+		break;
+	case UNARY_OP_KIND_LOGICAL_NEGATION:
+		asm_emit2(code, OPCODE_TEST, reg, reg);
+		asm_emit1(code, OPCODE_SETE, AL);
+		store_flag(backend, insn);
+		return;
+	}
+	store(backend, insn, reg);
+}
+
+// Sets the flags for comparing the operands of `insn`.
+static void codegen_compare(Backend* backend, const IrInstruction* insn)
+{
+	IrOperand left = insn->args[0];
+	Operand reg = RAX;
+	if (left.kind == IR_OPERAND_VALUE && location(backend, (IrValue)left.value).kind == OPERAND_REGISTER) {
+		reg = location(backend, (IrValue)left.value);
+	} else {
+		load(backend, RAX, left);
+	}
+	asm_emit2(backend->code, OPCODE_CMP, reg, source(backend, insn->args[1]));
+}
+
+static void codegen_binary(Backend* backend, const IrInstruction* insn)
+{
+	InstructionBuf* code = backend->code;
+	BinaryOpKind kind = (BinaryOpKind)insn->op;
+	IrOperand right = insn->args[1];
+	if (is_comparison(kind)) {
+		codegen_compare(backend, insn);
+		asm_emit1(code, COMPARISONS[kind].set, AL);
+		store_flag(backend, insn);
+		return;
+	}
+	// idiv divides rdx:rax
+	bool divides = kind == BINARY_OP_KIND_DIVISION || kind == BINARY_OP_KIND_MODULUS;
+	Operand reg = divides ? RAX : work_register(backend, insn);
+	load(backend, reg, insn->args[0]);
+	switch (kind) {
+	case BINARY_OP_KIND_ADDITION:
+		asm_emit2(code, OPCODE_ADD, reg, source(backend, right));
+		break;
+	case BINARY_OP_KIND_SUBTRACTION:
+		asm_emit2(code, OPCODE_SUB, reg, source(backend, right));
+		break;
+	case BINARY_OP_KIND_BITWISE_AND:
+		asm_emit2(code, OPCODE_AND, reg, source(backend, right));
+		break;
+	case BINARY_OP_KIND_BITWISE_OR:
+		asm_emit2(code, OPCODE_OR, reg, source(backend, right));
+		break;
+	case BINARY_OP_KIND_BITWISE_XOR:
+		asm_emit2(code, OPCODE_XOR, reg, source(backend, right));
+		break;
+	case BINARY_OP_KIND_MULTIPLICATION:
+		if (right.kind == IR_OPERAND_CONSTANT && is_imm32(right.value)) {
+			asm_emit3(code, OPCODE_IMUL, reg, reg, asm_imm(right.value));
+		} else {
+			asm_emit2(code, OPCODE_IMUL, reg, source(backend, right));
+		}
+		break;
+	case BINARY_OP_KIND_DIVISION:
+	case BINARY_OP_KIND_MODULUS: {
+		// idiv has no immediate form
+		Operand divisor = source(backend, right);
+		if (divisor.kind == OPERAND_IMMEDIATE) {
+			load(backend, RCX, right);
+			divisor = RCX;
+		}
+		asm_emit0(code, OPCODE_CQO);
+		asm_emit1(code, OPCODE_IDIV, divisor);
+		if (kind == BINARY_OP_KIND_MODULUS) {
+			asm_emit2(code, OPCODE_MOV, RAX, RDX);
+		}
+		break;
+	}
+	case BINARY_OP_KIND_BITWISE_SHIFT_LEFT:
+	case BINARY_OP_KIND_BITWISE_SHIFT_RIGHT: {
+		Opcode shift = kind == BINARY_OP_KIND_BITWISE_SHIFT_LEFT ? OPCODE_SHL : OPCODE_SAR;
+		if (right.kind == IR_OPERAND_CONSTANT) {
+			// the CPU masks shift counts to 6 bits, the same as it would in cl
+			asm_emit2(code, shift, reg, asm_imm(right.value & 63));
+		} else {
+			load(backend, RCX, right);
+			asm_emit2(code, shift, reg, CL);
+		}
+		break;
+	}
+	default:
+		UNREACHABLE();
+	}
+	store(backend, insn, reg);
+}
+
+// Jumps to `taken` if `jump` would, and to `otherwise` if not, falling through
+// to the next block where possible. `inverse` jumps exactly when `jump`
+// doesn't.
+static void codegen_conditional(
+        Backend* backend,
+        Opcode jump,
+        Opcode inverse,
+        IrBlockId taken,
+        IrBlockId otherwise,
+        IrBlockId next
+)
+{
+	if (taken == next) {
+		asm_emit1(backend->code, inverse, asm_label(otherwise));
+		return;
+	}
+	asm_emit1(backend->code, jump, asm_label(taken));
+	if (otherwise != next) {
+		asm_emit1(backend->code, OPCODE_JMP, asm_label(otherwise));
+	}
+}
+
+static void codegen_jump(Backend* backend, IrBlockId target, IrBlockId next)
+{
+	if (target != next) {
+		asm_emit1(backend->code, OPCODE_JMP, asm_label(target));
+	}
+}
+
+static bool reads_value(const IrInstruction* insn, IrValue value)
+{
+	for (uint64_t i = 0; i < 2; i++) {
+		if (insn->args[i].kind == IR_OPERAND_VALUE && insn->args[i].value == value) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// The index of the comparison that the block's branch can jump on directly,
+// or the block's length if there's none. That's a comparison whose only use
+// is the branch, followed by nothing but constant copies that leave its
+// operands alone, as && and || put between them. Those don't touch the
+// flags, so the comparison's stack slot can be skipped.
+static uint64_t fused_comparison(const Backend* backend, const IrBlock* block)
+{
+	uint64_t len = block->instructions.len;
+	const IrInstruction* branch = ir_block_terminator(block);
+	IrOperand condition = branch->args[0];
+	if (branch->opcode != IR_OP_BRANCH || condition.kind != IR_OPERAND_VALUE
+	                || backend->uses.ptr[condition.value] != 1) {
+		return len;
+	}
+	uint64_t i = len - 1;
+	while (i > 0 && block->instructions.ptr[i - 1].opcode == IR_OP_COPY
+	                && block->instructions.ptr[i - 1].args[0].kind == IR_OPERAND_CONSTANT) {
+		i--;
+	}
+	if (i == 0) {
+		return len;
+	}
+	const IrInstruction* comparison = &block->instructions.ptr[i - 1];
+	if (comparison->opcode != IR_OP_BINARY || comparison->dst != condition.value
+	                || !is_comparison((BinaryOpKind)comparison->op)) {
+		return len;
+	}
+	// the copies are emitted before the comparison
+	for (uint64_t j = i; j < len - 1; j++) {
+		IrValue copied = block->instructions.ptr[j].dst;
+		if (copied == condition.value || reads_value(comparison, copied)) {
+			return len;
+		}
+	}
+	return i - 1;
+}
+
+static void codegen_branch(Backend* backend, const IrBlock* block, IrBlockId next)
+{
+	const IrInstruction* branch = ir_block_terminator(block);
+	IrOperand condition = branch->args[0];
+	IrBlockId taken = branch->targets[0];
+	IrBlockId otherwise = branch->targets[1];
+	if (condition.kind == IR_OPERAND_CONSTANT) {
+		codegen_jump(backend, condition.value != 0 ? taken : otherwise, next);
+		return;
+	}
+	uint64_t fused = fused_comparison(backend, block);
+	if (fused < block->instructions.len) {
+		const IrInstruction* comparison = &block->instructions.ptr[fused];
+		BinaryOpKind kind = (BinaryOpKind)comparison->op;
+		codegen_compare(backend, comparison);
+		codegen_conditional(
+		        backend,
+		        COMPARISONS[kind].jump,
+		        COMPARISONS[COMPARISONS[kind].negated].jump,
+		        taken,
+		        otherwise,
+		        next
+		);
+		return;
+	}
+	Operand value = location(backend, (IrValue)condition.value);
+	if (value.kind == OPERAND_REGISTER) {
+		asm_emit2(backend->code, OPCODE_TEST, value, value);
+	} else {
+		asm_emit2(backend->code, OPCODE_CMP, value, asm_imm(0));
+	}
+	codegen_conditional(backend, OPCODE_JNE, OPCODE_JE, taken, otherwise, next);
+}
+
+static void codegen_return(Backend* backend, const IrInstruction* insn)
+{
+	InstructionBuf* code = backend->code;
+	load(backend, RAX, insn->args[0]);
+	const MachineRegisterBuf* saved = &backend->allocation->saved;
+	for (uint32_t i = 0; i < saved->len; i++) {
+		asm_emit2(code, OPCODE_MOV, asm_reg(saved->ptr[i]), asm_frame(-8 * ((int64_t)i + 1)));
+	}
+	if (backend->hasFrame) {
+		asm_emit2(code, OPCODE_MOV, RSP, RBP);
+		asm_emit1(code, OPCODE_POP, RBP);
+	}
+	asm_emit0(code, OPCODE_RET);
+}
+
+static void count_uses(Backend* backend)
+{
+	const IrFunction* func = backend->func;
+	BUF_RESERVE(&backend->uses, func->valueCount);
+	backend->uses.len = func->valueCount;
+	for (uint64_t i = 0; i < func->valueCount; i++) {
+		backend->uses.ptr[i] = 0;
+	}
+	BUF_RESERVE(&backend->targeted, func->blocks.len);
+	backend->targeted.len = func->blocks.len;
+	for (uint64_t i = 0; i < func->blocks.len; i++) {
+		backend->targeted.ptr[i] = false;
+	}
+	for (uint64_t i = 0; i < func->blocks.len; i++) {
+		const IrBlock* block = &func->blocks.ptr[i];
+		for (uint64_t j = 0; j < block->instructions.len; j++) {
+			const IrInstruction* insn = &block->instructions.ptr[j];
+			for (uint64_t k = 0; k < 2; k++) {
+				if (insn->args[k].kind == IR_OPERAND_VALUE) {
+					backend->uses.ptr[insn->args[k].value]++;
+				}
+			}
+			if (insn->opcode == IR_OP_JUMP || insn->opcode == IR_OP_BRANCH) {
+				backend->targeted.ptr[insn->targets[0]] = true;
+			}
+			if (insn->opcode == IR_OP_BRANCH) {
+				backend->targeted.ptr[insn->targets[1]] = true;
+			}
+		}
+	}
+}
+
+void ir_codegen_function(const IrFunction* func, const RegisterAllocation* allocation, InstructionBuf* code)
+{
+	Backend backend = {
+		.func = func,
+		.allocation = allocation,
+		.code = code,
+		.uses = BUF_NEW,
+		.targeted = BUF_NEW,
+		.hasFrame = allocation->frameSlots > 0,
+	};
+	count_uses(&backend);
+
+	if (backend.hasFrame) {
+		// keep rsp 16-byte aligned
+		int64_t frameSize = ((int64_t)allocation->frameSlots * 8 + 15) & ~(int64_t)15;
+		asm_emit1(code, OPCODE_PUSH, RBP);
+		asm_emit2(code, OPCODE_MOV, RBP, RSP);
+		asm_emit2(code, OPCODE_SUB, RSP, asm_imm(frameSize));
+	}
+	// the System V ABI has the caller expect these unchanged
+	for (uint32_t i = 0; i < allocation->saved.len; i++) {
+		asm_emit2(code, OPCODE_MOV, asm_frame(-8 * ((int64_t)i + 1)), asm_reg(allocation->saved.ptr[i]));
+	}
+
+	for (IrBlockId id = 0; id < func->blocks.len; id++) {
+		const IrBlock* block = &func->blocks.ptr[id];
+		IrBlockId next = id + 1;
+		if (backend.targeted.ptr[id]) {
+			asm_emit_label(code, id);
+		}
+		uint64_t fused = fused_comparison(&backend, block);
+		for (uint64_t i = 0; i < block->instructions.len; i++) {
+			const IrInstruction* insn = &block->instructions.ptr[i];
+			switch (insn->opcode) {
+			case IR_OP_COPY:
+				codegen_copy(&backend, insn);
+				break;
+			case IR_OP_UNARY:
+				codegen_unary(&backend, insn);
+				break;
+			case IR_OP_BINARY:
+				if (i != fused) {
+					codegen_binary(&backend, insn);
+				}
+				break;
+			case IR_OP_JUMP:
+				codegen_jump(&backend, insn->targets[0], next);
+				break;
+			case IR_OP_BRANCH:
+				codegen_branch(&backend, block, next);
+				break;
+			case IR_OP_RETURN:
+				codegen_return(&backend, insn);
+				break;
+			}
+		}
+	}
+
+	BUF_FREE(backend.targeted);
+	BUF_FREE(backend.uses);
+}
@@ -0,0 +1,136 @@
+#include "dragon/ir_opt.h"
+
+#include "dragon/core/buf.h"
+#include "dragon/ssa.h"
+
+static const char* const PASSES[] = {
+#define X(name, pass, description) [IR_OPT_COUNTER_##name] = pass,
+#include "dragon/ir_opt_counters.def"
+#undef X
+};
+
+static const char* const DESCRIPTIONS[] = {
+#define X(name, pass, description) [IR_OPT_COUNTER_##name] = description,
+#include "dragon/ir_opt_counters.def"
+#undef X
+};
+
+typedef BUF(IrValue) IrValueBuf;
+
+static void renumber(const IrValueBuf* numbers, IrOperand* operand)
+{
+	if (operand->kind == IR_OPERAND_VALUE) {
+		operand->value = numbers->ptr[operand->value];
+	}
+}
+
+// Numbers the values that are left in the order they're assigned, so the
+// backend doesn't reserve room for removed ones.
+static void renumber_values(IrFunction* func)
+{
+	IrValueBuf numbers = BUF_NEW;
+	BUF_RESERVE(&numbers, func->valueCount);
+	numbers.len = func->valueCount;
+	IrValue next = 0;
+	for (uint64_t b = 0; b < func->blocks.len; b++) {
+		IrBlock* block = &func->blocks.ptr[b];
+		for (uint64_t i = 0; i < block->phis.len; i++) {
+			numbers.ptr[block->phis.ptr[i].dst] = next++;
+		}
+		for (uint64_t i = 0; i < block->instructions.len; i++) {
+			if (block->instructions.ptr[i].dst != IR_VALUE_NONE) {
+				numbers.ptr[block->instructions.ptr[i].dst] = next++;
+			}
+		}
+	}
+	for (uint64_t b = 0; b < func->blocks.len; b++) {
+		IrBlock* block = &func->blocks.ptr[b];
+		for (uint64_t i = 0; i < block->phis.len; i++) {
+			IrPhi* phi = &block->phis.ptr[i];
+			phi->dst = numbers.ptr[phi->dst];
+			for (uint64_t j = 0; j < phi->args.len; j++) {
+				renumber(&numbers, &phi->args.ptr[j]);
+			}
+		}
+		for (uint64_t i = 0; i < block->instructions.len; i++) {
+			IrInstruction* insn = &block->instructions.ptr[i];
+			if (insn->dst != IR_VALUE_NONE) {
+				insn->dst = numbers.ptr[insn->dst];
+			}
+			renumber(&numbers, &insn->args[0]);
+			renumber(&numbers, &insn->args[1]);
+		}
+	}
+	func->valueCount = next;
+	BUF_FREE(numbers);
+}
+
+IrOptStats ir_optimize(IrFunction* func, IrOptOptions options)
+{
+	IrOptStats stats = {0};
+	ssa_construct(func);
+	if (options.sccp) {
+		ir_sccp(func, &stats);
+	}
+	if (options.gvn) {
+		ir_gvn(func, &stats);
+	}
+	if (options.dce) {
+		ir_dce(func, &stats);
+	}
+	renumber_values(func);
+	return stats;
+}
+
+IrValueMap ir_value_map_new(const IrFunction* func)
+{
+	IrValueMap map = { .replacements = BUF_NEW };
+	BUF_RESERVE(&map.replacements, func->valueCount);
+	map.replacements.len = func->valueCount;
+	for (uint32_t i = 0; i < func->valueCount; i++) {
+		map.replacements.ptr[i] = (IrOperand) { .kind = IR_OPERAND_NONE };
+	}
+	return map;
+}
+
+IrOperand ir_value_map_get(const IrValueMap* map, IrOperand operand)
+{
+	while (operand.kind == IR_OPERAND_VALUE && map->replacements.ptr[operand.value].kind != IR_OPERAND_NONE) {
+		operand = map->replacements.ptr[operand.value];
+	}
+	return operand;
+}
+
+void ir_value_map_apply(const IrValueMap* map, IrFunction* func)
+{
+	for (uint64_t b = 0; b < func->blocks.len; b++) {
+		IrBlock* block = &func->blocks.ptr[b];
+		for (uint64_t i = 0; i < block->phis.len; i++) {
+			IrOperandBuf* args = &block->phis.ptr[i].args;
+			for (uint64_t j = 0; j < args->len; j++) {
+				args->ptr[j] = ir_value_map_get(map, args->ptr[j]);
+			}
+		}
+		for (uint64_t i = 0; i < block->instructions.len; i++) {
+			IrInstruction* insn = &block->instructions.ptr[i];
+			for (uint64_t j = 0; j < 2; j++) {
+				insn->args[j] = ir_value_map_get(map, insn->args[j]);
+			}
+		}
+	}
+}
+
+void ir_value_map_free(IrValueMap map)
+{
+	BUF_FREE(map.replacements);
+}
+
+const char* ir_opt_counter_pass(IrOptCounter counter)
+{
+	return PASSES[counter];
+}
+
+const char* ir_opt_counter_description(IrOptCounter counter)
+{
+	return DESCRIPTIONS[counter];
+}
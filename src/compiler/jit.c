@@ -0,0 +1,116 @@
+#include "dragon/jit.h"
+
+#include <setjmp.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/mman.h>
+
+// The signals a miscompiled or trapping program can raise.
+static const int TRAPS[] = { SIGFPE, SIGSEGV, SIGBUS, SIGILL };
+#define TRAP_COUNT (sizeof(TRAPS) / sizeof(TRAPS[0]))
+
+// The size of the stack the trap handler runs on.
+#define TRAP_STACK_SIZE (64 * 1024)
+
+static sigjmp_buf trapEscape;
+
+static void on_trap(int trappedSignal)
+{
+	siglongjmp(trapEscape, trappedSignal);
+}
+
+// Calls `func`, returning the number of the signal that killed it or 0.
+static int call_trapping(JitFunc func, int64_t* result)
+{
+	// a program that overflows the stack leaves no room to run the handler
+	// on, so it gets a stack of its own for the call
+	void* trapStack = mmap(NULL, TRAP_STACK_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	stack_t altStack = { .ss_sp = trapStack, .ss_size = TRAP_STACK_SIZE };
+	stack_t previousStack;
+	bool onAltStack = trapStack != MAP_FAILED && sigaltstack(&altStack, &previousStack) == 0;
+	struct sigaction trap = { .sa_handler = on_trap, .sa_flags = SA_ONSTACK };
+	(void)sigemptyset(&trap.sa_mask);
+	struct sigaction previous[TRAP_COUNT];
+	for (uint64_t i = 0; i < TRAP_COUNT; i++) {
+		(void)sigaction(TRAPS[i], &trap, &previous[i]);
+	}
+	// the mask is saved, so the handler's own signal is unblocked again on
+	// the way out
+	int trappedSignal = sigsetjmp(trapEscape, 1);
+	if (trappedSignal == 0) {
+		*result = func();
+	}
+	for (uint64_t i = 0; i < TRAP_COUNT; i++) {
+		(void)sigaction(TRAPS[i], &previous[i], NULL);
+	}
+	if (onAltStack) {
+		(void)sigaltstack(&previousStack, NULL);
+	}
+	if (trapStack != MAP_FAILED) {
+		(void)munmap(trapStack, TRAP_STACK_SIZE);
+	}
+	return trappedSignal;
+}
+
+JitCodeResult jit_load(const Object* object, str entry)
+{
+	if (object->relocations.len > 0) {
+		str name = object->symbols.ptr[object->relocations.ptr[0].symbol].name;
+		return (JitCodeResult)ERR(str_fmt("undefined symbol '" STR_FMT "'", STR_ARG(name)));
+	}
+	const ObjectSymbol* symbol = NULL;
+	for (uint64_t i = 0; i < object->symbols.len; i++) {
+		if (object->symbols.ptr[i].defined && str_eq(object->symbols.ptr[i].name, entry)) {
+			symbol = &object->symbols.ptr[i];
+		}
+	}
+	if (symbol == NULL) {
+		return (JitCodeResult)ERR(str_fmt("undefined symbol '" STR_FMT "'", STR_ARG(entry)));
+	}
+
+	// written while writable, then made executable, never both at once
+	uint64_t len = object->text.len;
+	void* memory = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (memory == MAP_FAILED) {
+		return (JitCodeResult)ERR(str_fmt("failed to map executable memory: %m"));
+	}
+	memcpy(memory, object->text.ptr, len);
+	if (mprotect(memory, len, PROT_READ | PROT_EXEC) != 0) {
+		(void)munmap(memory, len);
+		return (JitCodeResult)ERR(str_fmt("failed to map executable memory: %m"));
+	}
+
+	JitCode code = { .memory = memory, .len = len };
+	void* address = (uint8_t*)memory + symbol->offset;
+	// converting an object pointer to a function pointer is what dlsym's
+	// users do too
+	memcpy(&code.func, &address, sizeof(code.func));
+	return (JitCodeResult)OK(code);
+}
+
+JitResult jit_run(const JitCode* code)
+{
+	int64_t result = 0;
+	int trappedSignal = call_trapping(code->func, &result);
+	if (trappedSignal != 0) {
+		return (JitResult)ERR(str_fmt("program killed by signal %d (%s)", trappedSignal, strsignal(trappedSignal)));
+	}
+	return (JitResult)OK(result);
+}
+
+void jit_unload(JitCode code)
+{
+	(void)munmap(code.memory, code.len);
+}
+
+JitResult jit_call(const Object* object, str entry)
+{
+	JitCodeResult code = jit_load(object, entry);
+	if (!code.ok) {
+		return (JitResult)ERR(code.get.error);
+	}
+	JitResult result = jit_run(&code.get.value);
+	jit_unload(code.get.value);
+	return result;
+}
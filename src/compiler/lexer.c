@@ -4,37 +4,36 @@
 #include <stdio.h>
 
 #include "dragon/core/macro.h"
+#include "dragon/core/scan.h"
 #include "dragon/core/strtox.h"
 #include "dragon/core/sum.h"
 #include "dragon/gperf/keywords.h"
 #include "dragon/gperf/ppkeywords.h"
 
-typedef MAYBE(char) MaybeChar;
-
-static MaybeChar lexer_peek(Lexer* lexer, uint64_t distance)
+// The source is followed by a NUL byte, so peeking never needs a bounds
+// check. A NUL is only the end of input if it's past the end of the source.
+static char lexer_peek(Lexer* lexer)
 {
-	if (lexer->pos + distance >= str_len(lexer->source)) {
-		return (MaybeChar)NOTHING;
-	}
+	return lexer->source.ptr[lexer->pos];
+}
 
-	return (MaybeChar)JUST(lexer->source.ptr[lexer->pos + distance]);
+static bool lexer_at_end(Lexer* lexer)
+{
+	return lexer->pos >= str_len(lexer->source);
 }
 
-static MaybeChar lexer_advance(Lexer* lexer)
+static void lexer_advance(Lexer* lexer)
 {
-	MaybeChar c = lexer_peek(lexer, 0);
-	if (c.present) {
-		lexer->pos++;
+	lexer->pos++;
+}
 
-		if (c.value == '\n') {
-			lexer->line++;
-			lexer->column = 1;
-		} else {
-			lexer->column++;
-		}
+static bool lexer_match(Lexer* lexer, char c)
+{
+	if (lexer_peek(lexer) == c) {
+		lexer_advance(lexer);
+		return true;
 	}
-
-	return c;
+	return false;
 }
 
 static str lexer_text(Lexer* lexer)
@@ -48,17 +47,12 @@ static Token make_token(Lexer* lexer, TokenType type, TokenValue value)
 {
 	return (Token) {
 		.type = type,
-		.location = lexer->tokenStartLoc,
-		.text = str_copy(lexer_text(lexer)),
+		.offset = (uint32_t)lexer->tokenStart,
+		.text = lexer_text(lexer),
 		.value = value,
 	};
 }
 
-static bool char_is_space(char c)
-{
-	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
-}
-
 static bool char_is_letter(char c)
 {
 	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
@@ -74,44 +68,54 @@ static bool char_is_letter_or_digit(char c)
 	return char_is_letter(c) || char_is_digit(c);
 }
 
-static void skip_whitespace(Lexer* lexer)
+static const char* skip_block_comment(const char* p, const char* end)
 {
-	MaybeChar c = lexer_peek(lexer, 0);
-	while (c.present) {
-		if (char_is_space(c.value)) {
-			lexer_advance(lexer);
-		} else if (c.value == '/') {
-			// possibly a comment?
-			MaybeChar next = lexer_peek(lexer, 1);
-			if (next.present && next.value == '/') {
-				// found a `//` comment
-				lexer_advance(lexer);
-				lexer_advance(lexer);
-				while (true) {
-					c = lexer_peek(lexer, 0);
-					if (!c.present || c.value == '\n') {
-						break;
-					}
-					lexer_advance(lexer);
-				}
-			} else {
-				// nevermind
+	// p is just past the opening `/*`
+	while (true) {
+		p = scan_find_char(p, end, '*');
+		if (end - p < 2) {
+			return NULL;
+		}
+		if (p[1] == '/') {
+			return p + 2;
+		}
+		p++;
+	}
+}
+
+// Returns false if an unterminated block comment was found, leaving the
+// lexer positioned at its start.
+static bool skip_whitespace(Lexer* lexer)
+{
+	const char* begin = str_ptr(lexer->source);
+	const char* end = str_end(lexer->source);
+	const char* p = begin + lexer->pos;
+	bool ok = true;
+	while (true) {
+		p = scan_skip_space(p, end);
+		if (end - p < 2 || p[0] != '/') {
+			break;
+		}
+		if (p[1] == '/') {
+			p = scan_find_char(p + 2, end, '\n');
+		} else if (p[1] == '*') {
+			const char* commentEnd = skip_block_comment(p + 2, end);
+			if (commentEnd == NULL) {
+				ok = false;
 				break;
 			}
+			p = commentEnd;
 		} else {
 			break;
 		}
-		c = lexer_peek(lexer, 0);
 	}
+	lexer->pos = (uint64_t)(p - begin);
+	return ok;
 }
 
 static Token lex_ident_or_kw(Lexer* lexer)
 {
-	while (true) {
-		MaybeChar c = lexer_peek(lexer, 0);
-		if (!c.present || !char_is_letter_or_digit(c.value)) {
-			break;
-		}
+	while (char_is_letter_or_digit(lexer_peek(lexer))) {
 		lexer_advance(lexer);
 	}
 
@@ -120,16 +124,13 @@ static Token lex_ident_or_kw(Lexer* lexer)
 	if (kw != NULL) {
 		return make_token(lexer, kw->type, TOKEN_VALUE_NONE);
 	}
-	return make_token(lexer, TT_IDENT, TOKEN_VALUE_STR(str_copy(text)));
+	SymbolId sym = interner_intern(lexer->interner, text);
+	return make_token(lexer, TT_IDENT, TOKEN_VALUE_SYM(sym));
 }
 
 static Token lex_number(Lexer* lexer)
 {
-	while (true) {
-		MaybeChar c = lexer_peek(lexer, 0);
-		if (!c.present || !char_is_digit(c.value)) {
-			break;
-		}
+	while (char_is_digit(lexer_peek(lexer))) {
 		lexer_advance(lexer);
 	}
 
@@ -142,11 +143,7 @@ static Token lex_number(Lexer* lexer)
 
 static Token lex_pp_keyword(Lexer* lexer)
 {
-	while (true) {
-		MaybeChar c = lexer_peek(lexer, 0);
-		if (!c.present || !char_is_letter(c.value)) {
-			break;
-		}
+	while (char_is_letter(lexer_peek(lexer))) {
 		lexer_advance(lexer);
 	}
 
@@ -177,16 +174,16 @@ static str lex_header_name(Lexer* lexer, char headerStart)
 	uint64_t end;
 	bool hadError = false;
 	while (true) {
-		MaybeChar c = lexer_peek(lexer, 0);
-		if (!c.present) {
+		char c = lexer_peek(lexer);
+		if (c == '\0') {
 			hadError = true;
 			break;
 		}
-		if (is_header_end(c.value, headerStart)) {
+		if (is_header_end(c, headerStart)) {
 			end = lexer->pos;
 			break;
 		}
-		if (c.value == '\n') {
+		if (c == '\n') {
 			hadError = true;
 			// the end was probably forgotten
 			break;
@@ -199,26 +196,26 @@ static str lex_header_name(Lexer* lexer, char headerStart)
 	// skip the last quote
 	lexer_advance(lexer);
 
-	str text = str_ref_chars(&lexer->source.ptr[start], end - start);
-	return str_copy(text);
+	return str_ref_chars(&lexer->source.ptr[start], end - start);
 }
 
 static void lex(Lexer* lexer)
 {
-	skip_whitespace(lexer);
-	lexer->tokenStartLoc = (SourceLocation) {
-		.filename = lexer->filename,
-		.line = lexer->line,
-		.column = lexer->column,
-	};
+	bool commentsOk = skip_whitespace(lexer);
 	lexer->tokenStart = lexer->pos;
-	MaybeChar c = lexer_advance(lexer);
-	if (!c.present) {
+	if (!commentsOk) {
+		lexer->pos = str_len(lexer->source);
+		lexer->lookahead = make_token(lexer, TT_ERROR, TOKEN_VALUE_NONE);
+		return;
+	}
+	char c = lexer_peek(lexer);
+	if (c == '\0' && lexer_at_end(lexer)) {
 		lexer->lookahead = make_token(lexer, TT_EOF, TOKEN_VALUE_NONE);
 		return;
 	}
+	lexer_advance(lexer);
 	bool hadError = false;
-	switch (c.value) {
+	switch (c) {
 	case '{':
 		lexer->lookahead = make_token(lexer, TT_LBRACE, TOKEN_VALUE_NONE);
 		break;
@@ -244,9 +241,7 @@ static void lex(Lexer* lexer)
 		lexer->lookahead = make_token(lexer, TT_TILDE, TOKEN_VALUE_NONE);
 		break;
 	case '!': {
-		MaybeChar c2 = lexer_peek(lexer, 0);
-		if (c2.present && c2.value == '=') {
-			lexer_advance(lexer);
+		if (lexer_match(lexer, '=')) {
 			lexer->lookahead = make_token(lexer, TT_BANG_EQUAL, TOKEN_VALUE_NONE);
 		} else {
 			lexer->lookahead = make_token(lexer, TT_BANG, TOKEN_VALUE_NONE);
@@ -254,9 +249,7 @@ static void lex(Lexer* lexer)
 		break;
 	}
 	case '&': {
-		MaybeChar c2 = lexer_peek(lexer, 0);
-		if (c2.present && c2.value == '&') {
-			lexer_advance(lexer);
+		if (lexer_match(lexer, '&')) {
 			lexer->lookahead = make_token(lexer, TT_AMP_AMP, TOKEN_VALUE_NONE);
 		} else {
 			lexer->lookahead = make_token(lexer, TT_AMP, TOKEN_VALUE_NONE);
@@ -264,9 +257,7 @@ static void lex(Lexer* lexer)
 		break;
 	}
 	case '|': {
-		MaybeChar c2 = lexer_peek(lexer, 0);
-		if (c2.present && c2.value == '|') {
-			lexer_advance(lexer);
+		if (lexer_match(lexer, '|')) {
 			lexer->lookahead = make_token(lexer, TT_PIPE_PIPE, TOKEN_VALUE_NONE);
 		} else {
 			lexer->lookahead = make_token(lexer, TT_PIPE, TOKEN_VALUE_NONE);
@@ -277,9 +268,7 @@ static void lex(Lexer* lexer)
 		lexer->lookahead = make_token(lexer, TT_CARET, TOKEN_VALUE_NONE);
 		break;
 	case '=': {
-		MaybeChar c2 = lexer_peek(lexer, 0);
-		if (c2.present && c2.value == '=') {
-			lexer_advance(lexer);
+		if (lexer_match(lexer, '=')) {
 			lexer->lookahead = make_token(lexer, TT_EQUAL_EQUAL, TOKEN_VALUE_NONE);
 		} else {
 			hadError = true;
@@ -287,12 +276,9 @@ static void lex(Lexer* lexer)
 		break;
 	}
 	case '>': {
-		MaybeChar c2 = lexer_peek(lexer, 0);
-		if (c2.present && c2.value == '=') {
-			lexer_advance(lexer);
+		if (lexer_match(lexer, '=')) {
 			lexer->lookahead = make_token(lexer, TT_RIGHT_EQUAL, TOKEN_VALUE_NONE);
-		} else if (c2.present && c2.value == '>') {
-			lexer_advance(lexer);
+		} else if (lexer_match(lexer, '>')) {
 			lexer->lookahead = make_token(lexer, TT_RIGHT_RIGHT, TOKEN_VALUE_NONE);
 		} else {
 			lexer->lookahead = make_token(lexer, TT_RIGHT, TOKEN_VALUE_NONE);
@@ -314,7 +300,7 @@ static void lex(Lexer* lexer)
 	case '<':
 		if (lexer->canLexHeaderName) {
 			lexer->canLexHeaderName = false;
-			str headerName = lex_header_name(lexer, c.value);
+			str headerName = lex_header_name(lexer, c);
 			if (str_len(headerName) == 0) {
 				hadError = true;
 			} else {
@@ -326,12 +312,9 @@ static void lex(Lexer* lexer)
 				        );
 			}
 		} else  {
-			MaybeChar c2 = lexer_peek(lexer, 0);
-			if (c2.present && c2.value == '=') {
-				lexer_advance(lexer);
+			if (lexer_match(lexer, '=')) {
 				lexer->lookahead = make_token(lexer, TT_LEFT_EQUAL, TOKEN_VALUE_NONE);
-			} else if (c2.present && c2.value == '<') {
-				lexer_advance(lexer);
+			} else if (lexer_match(lexer, '<')) {
 				lexer->lookahead = make_token(lexer, TT_LEFT_LEFT, TOKEN_VALUE_NONE);
 			} else {
 				lexer->lookahead = make_token(lexer, TT_LEFT, TOKEN_VALUE_NONE);
@@ -340,9 +323,9 @@ static void lex(Lexer* lexer)
 		}
 		break;
 	default:
-		if (char_is_letter(c.value)) {
+		if (char_is_letter(c)) {
 			lexer->lookahead = lex_ident_or_kw(lexer);
-		} else if (char_is_digit(c.value)) {
+		} else if (char_is_digit(c)) {
 			lexer->lookahead = lex_number(lexer);
 		} else {
 			hadError = true;
@@ -353,19 +336,17 @@ static void lex(Lexer* lexer)
 	}
 }
 
-Lexer lexer_new(str source, str filename)
+Lexer lexer_new(str source, Interner* interner)
 {
+	if (source.ptr == NULL) {
+		// the empty string still needs its NUL terminator
+		source = (str) {
+			.ptr = str_ptr(source), .info = z_str_ref_info(0)
+		};
+	}
 	Lexer lexer = {
 		.source = source,
-		.filename = filename,
-		.line = 1,
-		.column = 1,
-		.tokenStartLoc = (SourceLocation)
-		{
-			.filename = str_ref(filename),
-			.line = 1,
-			.column = 1,
-		},
+		.interner = interner,
 		.tokenStart = 0,
 		.pos = 0,
 		.canLexHeaderName = false,
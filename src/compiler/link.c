@@ -0,0 +1,141 @@
+#include "dragon/link.h"
+
+#include <elf.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#define TEXT_ALIGN 16
+#define PAGE_SIZE 0x1000
+
+typedef struct {
+	str name;
+	uint64_t address;
+} GlobalSymbol;
+
+typedef BUF(GlobalSymbol) GlobalSymbolBuf;
+
+static const GlobalSymbol* find_global(const GlobalSymbolBuf* globals, str name)
+{
+	for (uint64_t i = 0; i < globals->len; i++) {
+		if (str_eq(globals->ptr[i].name, name)) {
+			return &globals->ptr[i];
+		}
+	}
+	return NULL;
+}
+
+static uint64_t align_to(uint64_t offset, uint64_t align)
+{
+	return (offset + align - 1) / align * align;
+}
+
+static LinkError link_error(str message, str name)
+{
+	return (LinkError)JUST(str_fmt(STR_FMT " '" STR_FMT "'", STR_ARG(message), STR_ARG(name)));
+}
+
+LinkError link_executable(const Object* objects, uint64_t count, ByteBuf* image)
+{
+	uint64_t headersSize = sizeof(Elf64_Ehdr) + sizeof(Elf64_Phdr);
+	uint64_t* starts = calloc(count, sizeof(uint64_t));
+	uint64_t end = headersSize;
+	for (uint64_t i = 0; i < count; i++) {
+		starts[i] = align_to(end, TEXT_ALIGN);
+		end = starts[i] + objects[i].text.len;
+	}
+
+	GlobalSymbolBuf globals = BUF_NEW;
+	LinkError error = NOTHING;
+	for (uint64_t i = 0; i < count && !error.present; i++) {
+		for (uint64_t j = 0; j < objects[i].symbols.len; j++) {
+			const ObjectSymbol* symbol = &objects[i].symbols.ptr[j];
+			if (!symbol->global || !symbol->defined) {
+				continue;
+			}
+			if (find_global(&globals, symbol->name) != NULL) {
+				error = link_error(str_lit("duplicate symbol"), symbol->name);
+				break;
+			}
+			BUF_PUSH(&globals, ((GlobalSymbol) {
+				.name = symbol->name,
+				.address = LINK_BASE_ADDRESS + starts[i] + symbol->offset,
+			}));
+		}
+	}
+	const GlobalSymbol* entry = find_global(&globals, str_lit("_start"));
+	if (!error.present && entry == NULL) {
+		error = link_error(str_lit("undefined symbol"), str_lit("_start"));
+	}
+
+	uint64_t imageStart = image->len;
+	for (uint64_t i = 0; i < end && !error.present; i++) {
+		bytes_push8(image, 0);
+	}
+	for (uint64_t i = 0; i < count && !error.present; i++) {
+		const Object* object = &objects[i];
+		uint8_t* text = image->ptr + imageStart + starts[i];
+		for (uint64_t j = 0; j < object->text.len; j++) {
+			text[j] = object->text.ptr[j];
+		}
+		for (uint64_t j = 0; j < object->relocations.len; j++) {
+			ObjectFixup relocation = object->relocations.ptr[j];
+			str name = object->symbols.ptr[relocation.symbol].name;
+			const GlobalSymbol* target = find_global(&globals, name);
+			if (target == NULL) {
+				error = link_error(str_lit("undefined symbol"), name);
+				break;
+			}
+			// relative to the end of the displacement
+			uint64_t from = LINK_BASE_ADDRESS + starts[i] + relocation.offset + 4;
+			bytes_patch32(image, imageStart + starts[i] + relocation.offset, (uint32_t)(target->address - from));
+		}
+	}
+	if (error.present) {
+		image->len = imageStart;
+		BUF_FREE(globals);
+		free(starts);
+		return error;
+	}
+
+	ByteBuf headers = BUF_NEW;
+	const uint8_t ident[EI_NIDENT] = {
+		ELFMAG0, ELFMAG1, ELFMAG2, ELFMAG3, ELFCLASS64, ELFDATA2LSB, EV_CURRENT, ELFOSABI_SYSV,
+	};
+	for (uint64_t i = 0; i < EI_NIDENT; i++) {
+		bytes_push8(&headers, ident[i]);
+	}
+	bytes_push16(&headers, ET_EXEC);
+	bytes_push16(&headers, EM_X86_64);
+	bytes_push32(&headers, EV_CURRENT);
+	bytes_push64(&headers, entry->address);
+	// program and section header offsets
+	bytes_push64(&headers, sizeof(Elf64_Ehdr));
+	bytes_push64(&headers, 0);
+	// flags
+	bytes_push32(&headers, 0);
+	bytes_push16(&headers, sizeof(Elf64_Ehdr));
+	bytes_push16(&headers, sizeof(Elf64_Phdr));
+	bytes_push16(&headers, 1);
+	// section header size, count and string table index
+	bytes_push16(&headers, sizeof(Elf64_Shdr));
+	bytes_push16(&headers, 0);
+	bytes_push16(&headers, SHN_UNDEF);
+
+	// one segment maps the whole file, headers included
+	bytes_push32(&headers, PT_LOAD);
+	bytes_push32(&headers, PF_R | PF_X);
+	bytes_push64(&headers, 0);
+	bytes_push64(&headers, LINK_BASE_ADDRESS);
+	bytes_push64(&headers, LINK_BASE_ADDRESS);
+	bytes_push64(&headers, end);
+	bytes_push64(&headers, end);
+	bytes_push64(&headers, PAGE_SIZE);
+	for (uint64_t i = 0; i < headers.len; i++) {
+		image->ptr[imageStart + i] = headers.ptr[i];
+	}
+
+	BUF_FREE(headers);
+	BUF_FREE(globals);
+	free(starts);
+	return error;
+}
@@ -0,0 +1,44 @@
+#include "dragon/magic.h"
+
+#include <assert.h>
+
+DivisionMagic division_magic(int64_t divisor)
+{
+	assert(divisor != -1 && divisor != 0 && divisor != 1 && divisor != INT64_MIN);
+	const uint64_t two63 = (uint64_t)1 << 63;
+	uint64_t ad = divisor < 0 ? 0 - (uint64_t)divisor : (uint64_t)divisor;
+	// the largest dividend whose remainder is |d| - 1
+	uint64_t t = two63 + ((uint64_t)divisor >> 63);
+	uint64_t anc = t - 1 - t % ad;
+	// find the smallest p >= 64 for which 2^p > anc * (|d| - 2^p mod |d|)
+	uint64_t p = 63;
+	uint64_t q1 = two63 / anc;
+	uint64_t r1 = two63 - q1 * anc;
+	uint64_t q2 = two63 / ad;
+	uint64_t r2 = two63 - q2 * ad;
+	uint64_t delta = 0;
+	do {
+		p++;
+		q1 *= 2;
+		r1 *= 2;
+		if (r1 >= anc) {
+			q1++;
+			r1 -= anc;
+		}
+		q2 *= 2;
+		r2 *= 2;
+		if (r2 >= ad) {
+			q2++;
+			r2 -= ad;
+		}
+		delta = ad - r2;
+	} while (q1 < delta || (q1 == delta && r1 == 0));
+	uint64_t multiplier = q2 + 1;
+	if (divisor < 0) {
+		multiplier = 0 - multiplier;
+	}
+	return (DivisionMagic) {
+		.multiplier = (int64_t)multiplier,
+		.shift = (uint8_t)(p - 64),
+	};
+}
@@ -0,0 +1,100 @@
+#include "dragon/object.h"
+
+Object object_new(void)
+{
+	return (Object) {
+		.text = BUF_NEW,
+		.symbols = BUF_NEW,
+		.fixups = BUF_NEW,
+		.relocations = BUF_NEW,
+	};
+}
+
+uint32_t object_symbol(Object* object, str name)
+{
+	for (uint32_t i = 0; i < object->symbols.len; i++) {
+		if (str_eq(object->symbols.ptr[i].name, name)) {
+			return i;
+		}
+	}
+	BUF_PUSH(&object->symbols, ((ObjectSymbol) {
+		.name = str_copy(name),
+		.offset = 0,
+		.defined = false,
+		.global = false,
+	}));
+	return (uint32_t)object->symbols.len - 1;
+}
+
+void object_define(Object* object, str name, bool global)
+{
+	uint32_t index = object_symbol(object, name);
+	ObjectSymbol* symbol = &object->symbols.ptr[index];
+	symbol->offset = object->text.len;
+	symbol->defined = true;
+	symbol->global = global;
+}
+
+void object_call(Object* object, str name)
+{
+	uint32_t symbol = object_symbol(object, name);
+	BUF_PUSH(&object->fixups, ((ObjectFixup) { .offset = object->text.len, .symbol = symbol }));
+	bytes_push32(&object->text, 0);
+}
+
+void object_finish(Object* object)
+{
+	for (uint64_t i = 0; i < object->fixups.len; i++) {
+		ObjectFixup fixup = object->fixups.ptr[i];
+		ObjectSymbol* symbol = &object->symbols.ptr[fixup.symbol];
+		if (!symbol->defined) {
+			symbol->global = true;
+			BUF_PUSH(&object->relocations, fixup);
+			continue;
+		}
+		int64_t displacement = (int64_t)symbol->offset - (int64_t)(fixup.offset + 4);
+		bytes_patch32(&object->text, fixup.offset, (uint32_t)displacement);
+	}
+	object->fixups.len = 0;
+}
+
+void object_free(Object object)
+{
+	for (uint64_t i = 0; i < object.symbols.len; i++) {
+		str_free(object.symbols.ptr[i].name);
+	}
+	BUF_FREE(object.text);
+	BUF_FREE(object.symbols);
+	BUF_FREE(object.fixups);
+	BUF_FREE(object.relocations);
+}
+
+void bytes_push8(ByteBuf* bytes, uint8_t value)
+{
+	BUF_PUSH(bytes, value);
+}
+
+void bytes_push16(ByteBuf* bytes, uint16_t value)
+{
+	bytes_push8(bytes, (uint8_t)value);
+	bytes_push8(bytes, (uint8_t)(value >> 8));
+}
+
+void bytes_push32(ByteBuf* bytes, uint32_t value)
+{
+	bytes_push16(bytes, (uint16_t)value);
+	bytes_push16(bytes, (uint16_t)(value >> 16));
+}
+
+void bytes_push64(ByteBuf* bytes, uint64_t value)
+{
+	bytes_push32(bytes, (uint32_t)value);
+	bytes_push32(bytes, (uint32_t)(value >> 32));
+}
+
+void bytes_patch32(ByteBuf* bytes, uint64_t offset, uint32_t value)
+{
+	for (uint64_t i = 0; i < 4; i++) {
+		bytes->ptr[offset + i] = (uint8_t)(value >> (8 * i));
+	}
+}
@@ -1,85 +1,51 @@
 #include "dragon/parser.h"
 
+#include <assert.h>
 #include <stdbool.h>
 #include <stdint.h>
-#include <stdlib.h>
 
+#include "dragon/core/arena.h"
 #include "dragon/core/macro.h"
 #include "dragon/core/sum.h"
 
-static MaybeToken peek(Parser* parser, uint64_t n)
+static uint32_t peek_index(Parser* parser, uint32_t n)
 {
-	while (n >= parser->buffer.len) {
-		if (lexer_done(&parser->lexer)) {
-			return (MaybeToken)NOTHING;
-		}
-		Token token = lexer_next(&parser->lexer);
-		BUF_PUSH(&parser->buffer, token);
-	}
-
-	return (MaybeToken)JUST(parser->buffer.ptr[n]);
+	// the last token is always TT_EOF, which is repeated indefinitely
+	uint32_t last = token_stream_len(&parser->tokens) - 1;
+	uint32_t index = parser->pos + n;
+	return index < last ? index : last;
 }
 
-static MaybeToken advance(Parser* parser)
+static TokenType peek(Parser* parser, uint32_t n)
 {
-	MaybeToken token = peek(parser, 0);
-	if (token.present) {
-		BUF_POP_FIRST(&parser->buffer);
-	}
-	return token;
+	return token_stream_kind(&parser->tokens, peek_index(parser, n));
 }
 
-static bool advance_ignore(Parser* parser)
+static uint32_t advance(Parser* parser)
 {
-	MaybeToken token = advance(parser);
-	if (token.present) {
-		token_free(token.value);
-	}
-	return token.present;
+	uint32_t index = peek_index(parser, 0);
+	parser->pos = peek_index(parser, 1);
+	return index;
 }
 
-typedef RESULT(Token, str) TokenResult;
-
-static TokenResult advance_nonnull(Parser* parser, str expected)
-{
-	MaybeToken token = advance(parser);
-	if (!token.present) {
-		if (str_len(expected) == 0) {
-			return (TokenResult)ERR(str_lit("Unexpected end of file"));
-		}
-		str msg =
-		        str_fmt(
-		                "Unexpected end of file (expected " STR_FMT ")",
-		                STR_ARG(expected)
-		        );
-		return (TokenResult)ERR(msg);
-	}
-	return (TokenResult)OK(token.value);
-}
+typedef RESULT(uint32_t, str) TokenResult;
 
 static TokenResult expect(Parser* parser, TokenType type)
 {
-	Token result;
-	if (parser->buffer.len > 0) {
-		result = parser->buffer.ptr[0];
-		BUF_POP_FIRST(&parser->buffer);
-	} else {
-		TokenResult temp = advance_nonnull(parser, str_ref(TOKEN_STRINGS[type]));
-		if (!temp.ok) {
-			return temp;
-		}
-		result = temp.get.value;
-	}
-	if (result.type != type) {
+	uint32_t index = advance(parser);
+	TokenType actual = token_stream_kind(&parser->tokens, index);
+	if (actual != type) {
+		SourceLocation loc = token_stream_location(&parser->tokens, index);
 		str msg =
 		        str_fmt(
-		                "Unexpected token %s (expected %s)",
-		                TOKEN_STRINGS[result.type],
+		                SOURCE_LOCATION_FMT ": Unexpected token %s (expected %s)",
+		                SOURCE_LOCATION_ARG(loc),
+		                TOKEN_STRINGS[actual],
 		                TOKEN_STRINGS[type]
 		        );
 		return (TokenResult)ERR(msg);
 	}
-	return (TokenResult)OK(result);
+	return (TokenResult)OK(index);
 }
 
 typedef MAYBE(str) ExpectErr;
@@ -90,38 +56,27 @@ static ExpectErr expect_ignore(Parser* parser, TokenType type)
 	if (!result.ok) {
 		return (ExpectErr)JUST(result.get.error);
 	}
-	token_free(result.get.value);
 	return (ExpectErr)NOTHING;
 }
 
 static bool look(Parser* parser, TokenType type)
 {
-	MaybeToken token = peek(parser, 0);
-	return token.present && token.value.type == type;
-}
-
-typedef BUF(const TokenType) TokenTypeBuf;
-
-static MaybeToken match(Parser* parser, TokenTypeBuf types)
-{
-	for (uint64_t i = 0; i < types.len; i++) {
-		if (look(parser, types.ptr[i])) {
-			return advance(parser);
-		}
-	}
-	return (MaybeToken)NOTHING;
+	return peek(parser, 0) == type;
 }
 
-#define MATCH(parser, ...) match(parser, (TokenTypeBuf)BUF_ARRAY(((const TokenType[]) {__VA_ARGS__})))
-
 Parser parser_new(str source, str filename)
 {
-	Parser parser = {
-		.lexer = lexer_new(source, filename),
-		.buffer = BUF_NEW,
+	Interner symbols = interner_new();
+	SymbolId main = interner_intern(&symbols, str_lit("main"));
+	assert(main == PROGRAM_MAIN);
+	(void)main;
+	TokenStream tokens = token_stream_new(source, filename, &symbols);
+	return (Parser) {
+		.tokens = tokens,
+		.symbols = symbols,
+		.nodes = arena_new(AST_ARENA_BLOCK_SIZE),
+		.pos = 0,
 	};
-	BUF_PUSH(&parser.buffer, lexer_first(&parser.lexer));
-	return parser;
 }
 
 typedef RESULT(Expression*, str) ExpressionResult;
@@ -145,14 +100,13 @@ static ExpressionResult parse_expression(Parser* parser);
 static ExpressionResult parse_primary_expression(Parser* parser)
 {
 	if (look(parser, TT_LPAREN)) {
-		advance_ignore(parser);
+		advance(parser);
 		ExpressionResult result = parse_expression(parser);
 		if (!result.ok) {
 			return result;
 		}
 		ExpectErr err = expect_ignore(parser, TT_RPAREN);
 		if (err.present) {
-			expression_free(result.get.value);
 			return (ExpressionResult)ERR(err.value);
 		}
 		return result;
@@ -161,10 +115,8 @@ static ExpressionResult parse_primary_expression(Parser* parser)
 	if (!result.ok) {
 		return (ExpressionResult)ERR(result.get.error);
 	}
-	Token tok = result.get.value;
-	int64_t num = tok.value.get.num;
-	token_free(tok);
-	ConstantExpression* constant = malloc(sizeof(ConstantExpression));
+	int64_t num = token_stream_num(&parser->tokens, result.get.value);
+	ConstantExpression* constant = ARENA_NEW(&parser->nodes, ConstantExpression);
 	constant->base.type = EXPRESSION_TYPE_CONSTANT;
 	constant->number = num;
 	return (ExpressionResult)OK(&constant->base);
@@ -172,24 +124,42 @@ static ExpressionResult parse_primary_expression(Parser* parser)
 
 static ExpressionResult parse_unary_expression(Parser* parser)
 {
-	MaybeToken op;
-	if ((op = MATCH(parser, TT_MINUS, TT_TILDE, TT_BANG)).present) {
+	TokenType type = peek(parser, 0);
+	if (type == TT_MINUS || type == TT_TILDE || type == TT_BANG) {
+		uint32_t opIndex = advance(parser);
 		ExpressionResult right = parse_unary_expression(parser);
 		if (!right.ok) {
 			return right;
 		}
-		UnaryOpExpression* unary = malloc(sizeof(UnaryOpExpression));
+		UnaryOpExpression* unary = ARENA_NEW(&parser->nodes, UnaryOpExpression);
 		unary->base.type = EXPRESSION_TYPE_UNARY_OP;
-		unary->kind = unary_op_kind_from_token_type(op.value.type);
+		unary->kind = unary_op_kind_from_token_type(type);
+		unary->offset = parser->tokens.offsets.ptr[opIndex];
 		unary->operand = right.get.value;
-		token_free(op.value);
 		return (ExpressionResult)OK(&unary->base);
 	}
 
 	return parse_primary_expression(parser);
 }
 
-static ExpressionResult parse_multiplicative_expression(Parser* parser)
+typedef struct {
+	// 0 if the token isn't a binary operator
+	uint8_t power;
+	uint8_t kind;
+} BinaryOperator;
+
+// Binding powers of the binary operators, indexed by token type. A higher
+// power binds tighter.
+static const BinaryOperator BINARY_OPERATORS[TOKEN_TYPE_COUNT] = {
+#define X(token, op, bp) [token] = { .power = (bp), .kind = BINARY_OP_KIND_##op },
+#include "dragon/binary_operators.def"
+#undef X
+};
+
+// Parses operands joined by operators binding tighter than `minPower`. Every
+// binary operator is left associative, so the right operand only takes
+// operators binding tighter than its own.
+static ExpressionResult parse_binary_expression(Parser* parser, uint8_t minPower)
 {
 	ExpressionResult left = parse_unary_expression(parser);
 	if (!left.ok) {
@@ -197,301 +167,18 @@ static ExpressionResult parse_multiplicative_expression(Parser* parser)
 	}
 
 	Expression* result = left.get.value;
-	MaybeToken op;
-
-	while ((op = MATCH(parser, TT_STAR, TT_SLASH, TT_PERCENT)).present) {
-		ExpressionResult right = parse_unary_expression(parser);
-		if (!right.ok) {
-			expression_free(result);
-			return right;
-		}
-		BinaryOpExpression* binary = malloc(sizeof(BinaryOpExpression));
-		binary->base.type = EXPRESSION_TYPE_BINARY_OP;
-		switch (op.value.type) {
-		case TT_STAR:
-			binary->kind = BINARY_OP_KIND_MULTIPLICATION;
-			break;
-		case TT_SLASH:
-			binary->kind = BINARY_OP_KIND_DIVISION;
-			break;
-		case TT_PERCENT:
-			binary->kind = BINARY_OP_KIND_MODULUS;
-			break;
-		default:
-			UNREACHABLE();
-		}
-		binary->left = result;
-		binary->right = right.get.value;
-		result = &binary->base;
-		token_free(op.value);
-	}
-
-	return (ExpressionResult)OK(result);
-}
-
-static ExpressionResult parse_additive_expression(Parser* parser)
-{
-	ExpressionResult left = parse_multiplicative_expression(parser);
-	if (!left.ok) {
-		return left;
-	}
-
-	Expression* result = left.get.value;
-	MaybeToken op;
-
-	while ((op = MATCH(parser, TT_PLUS, TT_MINUS)).present) {
-		ExpressionResult right = parse_multiplicative_expression(parser);
-		if (!right.ok) {
-			expression_free(result);
-			return right;
-		}
-		BinaryOpExpression* binary = malloc(sizeof(BinaryOpExpression));
-		binary->base.type = EXPRESSION_TYPE_BINARY_OP;
-		binary->kind = op.value.type == TT_PLUS
-		               ? BINARY_OP_KIND_ADDITION
-		               : BINARY_OP_KIND_SUBTRACTION;
-		binary->left = result;
-		binary->right = right.get.value;
-		result = &binary->base;
-		token_free(op.value);
-	}
-
-	return (ExpressionResult)OK(result);
-}
-
-static ExpressionResult parse_shift_expression(Parser* parser)
-{
-	ExpressionResult left = parse_additive_expression(parser);
-	if (!left.ok) {
-		return left;
-	}
-
-	Expression* result = left.get.value;
-	MaybeToken op;
-
-	while ((op = MATCH(parser, TT_LEFT_LEFT, TT_RIGHT_RIGHT)).present) {
-		ExpressionResult right = parse_additive_expression(parser);
-		if (!right.ok) {
-			expression_free(result);
-			return right;
-		}
-		BinaryOpExpression* binary = malloc(sizeof(BinaryOpExpression));
-		binary->base.type = EXPRESSION_TYPE_BINARY_OP;
-		binary->kind = op.value.type == TT_LEFT_LEFT
-		               ? BINARY_OP_KIND_BITWISE_SHIFT_LEFT
-		               : BINARY_OP_KIND_BITWISE_SHIFT_RIGHT;
-		binary->left = result;
-		binary->right = right.get.value;
-		result = &binary->base;
-		token_free(op.value);
-	}
-
-	return (ExpressionResult)OK(result);
-}
-
-static ExpressionResult parse_relational_expression(Parser* parser)
-{
-	ExpressionResult left = parse_shift_expression(parser);
-	if (!left.ok) {
-		return left;
-	}
-
-	Expression* result = left.get.value;
-	MaybeToken op;
-
-	while ((op = MATCH(parser, TT_LEFT, TT_RIGHT, TT_LEFT_EQUAL, TT_RIGHT_EQUAL)).present) {
-		ExpressionResult right = parse_shift_expression(parser);
-		if (!right.ok) {
-			expression_free(result);
-			return right;
-		}
-		BinaryOpExpression* binary = malloc(sizeof(BinaryOpExpression));
-		binary->base.type = EXPRESSION_TYPE_BINARY_OP;
-		switch (op.value.type) {
-		case TT_LEFT:
-			binary->kind = BINARY_OP_KIND_LESS;
-			break;
-		case TT_RIGHT:
-			binary->kind = BINARY_OP_KIND_GREATER;
-			break;
-		case TT_LEFT_EQUAL:
-			binary->kind = BINARY_OP_KIND_LESS_EQUAL;
-			break;
-		case TT_RIGHT_EQUAL:
-			binary->kind = BINARY_OP_KIND_GREATER_EQUAL;
-			break;
-		default:
-			UNREACHABLE();
-		}
-		binary->left = result;
-		binary->right = right.get.value;
-		result = &binary->base;
-		token_free(op.value);
-	}
-
-	return (ExpressionResult)OK(result);
-}
-
-static ExpressionResult parse_equality_expression(Parser* parser)
-{
-	ExpressionResult left = parse_relational_expression(parser);
-	if (!left.ok) {
-		return left;
-	}
-
-	Expression* result = left.get.value;
-	MaybeToken op;
-
-	while ((op = MATCH(parser, TT_EQUAL_EQUAL, TT_BANG_EQUAL)).present) {
-		ExpressionResult right = parse_relational_expression(parser);
-		if (!right.ok) {
-			expression_free(result);
-			return right;
-		}
-		BinaryOpExpression* binary = malloc(sizeof(BinaryOpExpression));
-		binary->base.type = EXPRESSION_TYPE_BINARY_OP;
-		binary->kind = op.value.type == TT_EQUAL_EQUAL
-		               ? BINARY_OP_KIND_EQUALITY
-		               : BINARY_OP_KIND_INEQUALITY;
-		binary->left = result;
-		binary->right = right.get.value;
-		result = &binary->base;
-		token_free(op.value);
-	}
-
-	return (ExpressionResult)OK(result);
-}
-
-static ExpressionResult parse_bitwise_and_expression(Parser* parser)
-{
-	ExpressionResult left = parse_equality_expression(parser);
-	if (!left.ok) {
-		return left;
-	}
-
-	Expression* result = left.get.value;
-	MaybeToken op;
-
-	while ((op = MATCH(parser, TT_AMP)).present) {
-		ExpressionResult right = parse_equality_expression(parser);
-		if (!right.ok) {
-			expression_free(result);
-			return right;
-		}
-		BinaryOpExpression* binary = malloc(sizeof(BinaryOpExpression));
-		binary->base.type = EXPRESSION_TYPE_BINARY_OP;
-		binary->kind = BINARY_OP_KIND_BITWISE_AND;
-		binary->left = result;
-		binary->right = right.get.value;
-		result = &binary->base;
-		token_free(op.value);
-	}
-
-	return (ExpressionResult)OK(result);
-}
-
-static ExpressionResult parse_bitwise_xor_expression(Parser* parser)
-{
-	ExpressionResult left = parse_bitwise_and_expression(parser);
-	if (!left.ok) {
-		return left;
-	}
-
-	Expression* result = left.get.value;
-	MaybeToken op;
-
-	while ((op = MATCH(parser, TT_CARET)).present) {
-		ExpressionResult right = parse_bitwise_and_expression(parser);
-		if (!right.ok) {
-			expression_free(result);
-			return right;
-		}
-		BinaryOpExpression* binary = malloc(sizeof(BinaryOpExpression));
-		binary->base.type = EXPRESSION_TYPE_BINARY_OP;
-		binary->kind = BINARY_OP_KIND_BITWISE_XOR;
-		binary->left = result;
-		binary->right = right.get.value;
-		result = &binary->base;
-		token_free(op.value);
-	}
-
-	return (ExpressionResult)OK(result);
-}
-
-static ExpressionResult parse_bitwise_or_expression(Parser* parser)
-{
-	ExpressionResult left = parse_bitwise_xor_expression(parser);
-	if (!left.ok) {
-		return left;
-	}
-
-	Expression* result = left.get.value;
-	MaybeToken op;
-
-	while ((op = MATCH(parser, TT_PIPE)).present) {
-		ExpressionResult right = parse_bitwise_xor_expression(parser);
-		if (!right.ok) {
-			expression_free(result);
-			return right;
-		}
-		BinaryOpExpression* binary = malloc(sizeof(BinaryOpExpression));
-		binary->base.type = EXPRESSION_TYPE_BINARY_OP;
-		binary->kind = BINARY_OP_KIND_BITWISE_OR;
-		binary->left = result;
-		binary->right = right.get.value;
-		result = &binary->base;
-		token_free(op.value);
-	}
-
-	return (ExpressionResult)OK(result);
-}
-
-static ExpressionResult parse_logical_and_expression(Parser* parser)
-{
-	ExpressionResult left = parse_bitwise_or_expression(parser);
-	if (!left.ok) {
-		return left;
-	}
-
-	Expression* result = left.get.value;
-	MaybeToken op;
+	BinaryOperator op;
 
-	while ((op = MATCH(parser, TT_AMP_AMP)).present) {
-		ExpressionResult right = parse_bitwise_or_expression(parser);
+	while ((op = BINARY_OPERATORS[peek(parser, 0)]).power > minPower) {
+		uint32_t opIndex = advance(parser);
+		ExpressionResult right = parse_binary_expression(parser, op.power);
 		if (!right.ok) {
-			expression_free(result);
 			return right;
 		}
-		BinaryOpExpression* binary = malloc(sizeof(BinaryOpExpression));
+		BinaryOpExpression* binary = ARENA_NEW(&parser->nodes, BinaryOpExpression);
 		binary->base.type = EXPRESSION_TYPE_BINARY_OP;
-		binary->kind = BINARY_OP_KIND_LOGICAL_AND;
-		binary->left = result;
-		binary->right = right.get.value;
-		result = &binary->base;
-	}
-
-	return (ExpressionResult)OK(result);
-}
-
-static ExpressionResult parse_logical_or_expression(Parser* parser)
-{
-	ExpressionResult left = parse_logical_and_expression(parser);
-	if (!left.ok) {
-		return left;
-	}
-
-	Expression* result = left.get.value;
-	MaybeToken op;
-
-	while ((op = MATCH(parser, TT_PIPE_PIPE)).present) {
-		ExpressionResult right = parse_logical_and_expression(parser);
-		if (!right.ok) {
-			expression_free(result);
-			return right;
-		}
-		BinaryOpExpression* binary = malloc(sizeof(BinaryOpExpression));
-		binary->base.type = EXPRESSION_TYPE_BINARY_OP;
-		binary->kind = BINARY_OP_KIND_LOGICAL_OR;
+		binary->kind = (BinaryOpKind)op.kind;
+		binary->offset = parser->tokens.offsets.ptr[opIndex];
 		binary->left = result;
 		binary->right = right.get.value;
 		result = &binary->base;
@@ -502,7 +189,7 @@ static ExpressionResult parse_logical_or_expression(Parser* parser)
 
 static ExpressionResult parse_expression(Parser* parser)
 {
-	return parse_logical_or_expression(parser);
+	return parse_binary_expression(parser, 0);
 }
 
 typedef RESULT(Statement, str) StatementResult;
@@ -519,7 +206,6 @@ static StatementResult parse_statement(Parser* parser)
 	}
 	err = expect_ignore(parser, TT_SEMI);
 	if (err.present) {
-		expression_free(expr.get.value);
 		return (StatementResult)ERR(err.value);
 	}
 	return (StatementResult)OK((Statement) { .expression = expr.get.value });
@@ -539,32 +225,25 @@ static FunctionResult parse_function(Parser* parser)
 	}
 	err = expect_ignore(parser, TT_LPAREN);
 	if (err.present) {
-		token_free(id.get.value);
 		return (FunctionResult)ERR(err.value);
 	}
 	err = expect_ignore(parser, TT_RPAREN);
 	if (err.present) {
-		token_free(id.get.value);
 		return (FunctionResult)ERR(err.value);
 	}
 	err = expect_ignore(parser, TT_LBRACE);
 	if (err.present) {
-		token_free(id.get.value);
 		return (FunctionResult)ERR(err.value);
 	}
 	StatementResult stmt = parse_statement(parser);
 	if (!stmt.ok) {
-		token_free(id.get.value);
 		return (FunctionResult)ERR(stmt.get.error);
 	}
 	err = expect_ignore(parser, TT_RBRACE);
 	if (err.present) {
-		expression_free(stmt.get.value.expression);
-		token_free(id.get.value);
 		return (FunctionResult)ERR(err.value);
 	}
-	str name = str_move(&id.get.value.value.get.str);
-	token_free(id.get.value);
+	SymbolId name = token_stream_sym(&parser->tokens, id.get.value);
 	return (FunctionResult)OK(((Function) {
 		.name = name,
 		.statement = stmt.get.value,
@@ -577,15 +256,19 @@ ProgramResult parser_parse(Parser* parser)
 	if (!result.ok) {
 		return (ProgramResult)ERR(result.get.error);
 	}
-	return (ProgramResult)OK(((Program) {
+	Program program = {
+		.symbols = parser->symbols,
+		.nodes = parser->nodes,
 		.function = result.get.value,
-	}));
+	};
+	parser->symbols = (Interner) {0};
+	parser->nodes = (Arena) {0};
+	return (ProgramResult)OK(program);
 }
 
 void parser_free(Parser parser)
 {
-	for (uint64_t i = 0; i < parser.buffer.len; i++) {
-		token_free(parser.buffer.ptr[i]);
-	}
-	BUF_FREE(parser.buffer);
+	token_stream_free(parser.tokens);
+	interner_free(parser.symbols);
+	arena_free(parser.nodes);
 }
@@ -0,0 +1,310 @@
+#include "dragon/peephole.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// The optimized code is written over the input as it's read, so a rule looks
+// at the last instructions written and may only shrink them.
+typedef struct {
+	Instruction* ptr;
+	uint64_t len;
+} Window;
+
+typedef bool (*PeepholeFunc)(Window* out);
+
+// The `n`th instruction from the end of the window, starting at 1.
+static Instruction* tail(Window* out, uint64_t n)
+{
+	return &out->ptr[out->len - n];
+}
+
+static bool is_jump(Opcode opcode)
+{
+	switch (opcode) {
+	case OPCODE_JMP:
+	case OPCODE_JL:
+	case OPCODE_JLE:
+	case OPCODE_JG:
+	case OPCODE_JGE:
+	case OPCODE_JE:
+	case OPCODE_JNE:
+		return true;
+	default:
+		return false;
+	}
+}
+
+// Whether moving `insn` across a push or pop could change what it does. Calls
+// see the stack, so a value still pushed has to stay pushed across them.
+static bool is_barrier(Opcode opcode)
+{
+	switch (opcode) {
+	case OPCODE_PUSH:
+	case OPCODE_POP:
+	case OPCODE_CALL:
+	case OPCODE_SYSCALL:
+	case OPCODE_RET:
+	case OPCODE_LABEL:
+		return true;
+	default:
+		return is_jump(opcode);
+	}
+}
+
+static bool writes_operand(Operand operand, MachineRegister reg)
+{
+	return operand.kind == OPERAND_REGISTER && machine_register_full((MachineRegister)operand.value) == reg;
+}
+
+// Whether `insn` may change the 64-bit register `reg`.
+static bool writes_register(const Instruction* insn, MachineRegister reg)
+{
+	switch (insn->opcode) {
+	case OPCODE_CMP:
+	case OPCODE_TEST:
+		return false;
+	case OPCODE_CQO:
+		return reg == MREG_RDX;
+	case OPCODE_IDIV:
+		return reg == MREG_RAX || reg == MREG_RDX;
+	case OPCODE_IMUL:
+		// the one operand form writes rdx:rax
+		if (insn->operands[1].kind == OPERAND_NONE) {
+			return reg == MREG_RAX || reg == MREG_RDX;
+		}
+		return writes_operand(insn->operands[0], reg);
+	case OPCODE_MOV:
+	case OPCODE_MOVZX:
+	case OPCODE_ADD:
+	case OPCODE_SUB:
+	case OPCODE_AND:
+	case OPCODE_OR:
+	case OPCODE_XOR:
+	case OPCODE_NEG:
+	case OPCODE_NOT:
+	case OPCODE_SHL:
+	case OPCODE_SHR:
+	case OPCODE_SAR:
+	case OPCODE_SETL:
+	case OPCODE_SETLE:
+	case OPCODE_SETG:
+	case OPCODE_SETGE:
+	case OPCODE_SETE:
+	case OPCODE_SETNE:
+		return writes_operand(insn->operands[0], reg);
+	default:
+		return true;
+	}
+}
+
+// Whether `insn` is `test r, r` or `cmp r, 0`, which set the flags the same
+// way.
+static bool is_zero_test(const Instruction* insn)
+{
+	Operand reg = insn->operands[0];
+	if (reg.kind != OPERAND_REGISTER) {
+		return false;
+	}
+	if (insn->opcode == OPCODE_TEST) {
+		return operand_eq(insn->operands[1], reg);
+	}
+	return insn->opcode == OPCODE_CMP && operand_eq(insn->operands[1], asm_imm(0));
+}
+
+static bool peephole_push_pop_same(Window* out)
+{
+	if (out->len < 2) {
+		return false;
+	}
+	Instruction* push = tail(out, 2);
+	Instruction* pop = tail(out, 1);
+	if (push->opcode != OPCODE_PUSH || pop->opcode != OPCODE_POP
+	                || !operand_eq(push->operands[0], pop->operands[0])) {
+		return false;
+	}
+	out->len -= 2;
+	return true;
+}
+
+static bool peephole_push_pop(Window* out)
+{
+	if (out->len < 2) {
+		return false;
+	}
+	Instruction* push = tail(out, 2);
+	Instruction* pop = tail(out, 1);
+	if (push->opcode != OPCODE_PUSH || pop->opcode != OPCODE_POP) {
+		return false;
+	}
+	// push sign-extends its immediate, and so does mov
+	*push = (Instruction) {
+		.opcode = OPCODE_MOV,
+		.operands = { pop->operands[0], push->operands[0] },
+	};
+	out->len--;
+	return true;
+}
+
+// The pop still gets what was pushed if the instruction in between leaves
+// the pushed register alone.
+static bool peephole_push_instruction_pop(Window* out)
+{
+	if (out->len < 3) {
+		return false;
+	}
+	Instruction* push = tail(out, 3);
+	Instruction* middle = tail(out, 2);
+	Instruction* pop = tail(out, 1);
+	if (push->opcode != OPCODE_PUSH || pop->opcode != OPCODE_POP || is_barrier(middle->opcode)) {
+		return false;
+	}
+	// the pop would read a different slot
+	if (writes_register(middle, MREG_RSP)) {
+		return false;
+	}
+	Operand value = push->operands[0];
+	if (value.kind == OPERAND_REGISTER && writes_register(middle, (MachineRegister)value.value)) {
+		return false;
+	}
+	*push = *middle;
+	*middle = (Instruction) {
+		.opcode = OPCODE_MOV,
+		.operands = { pop->operands[0], value },
+	};
+	out->len--;
+	return true;
+}
+
+// Reads the stored register instead of the memory it was just stored to.
+static bool peephole_store_load(Window* out)
+{
+	if (out->len < 2) {
+		return false;
+	}
+	Instruction* store = tail(out, 2);
+	Instruction* load = tail(out, 1);
+	if (store->opcode != OPCODE_MOV || load->opcode != OPCODE_MOV || store->operands[0].kind != OPERAND_FRAME
+	                || store->operands[1].kind != OPERAND_REGISTER
+	                || !operand_eq(store->operands[0], load->operands[1])) {
+		return false;
+	}
+	load->operands[1] = store->operands[1];
+	return true;
+}
+
+static bool peephole_move_self(Window* out)
+{
+	if (out->len < 1) {
+		return false;
+	}
+	Instruction* mov = tail(out, 1);
+	if (mov->opcode != OPCODE_MOV || !operand_eq(mov->operands[0], mov->operands[1])) {
+		return false;
+	}
+	out->len--;
+	return true;
+}
+
+// and, or and xor set the flags from their result exactly like a test does.
+static bool peephole_test_after_logic(Window* out)
+{
+	if (out->len < 2) {
+		return false;
+	}
+	Instruction* op = tail(out, 2);
+	Instruction* test = tail(out, 1);
+	if (op->opcode != OPCODE_AND && op->opcode != OPCODE_OR && op->opcode != OPCODE_XOR) {
+		return false;
+	}
+	if (!is_zero_test(test) || !operand_eq(op->operands[0], test->operands[0])) {
+		return false;
+	}
+	out->len--;
+	return true;
+}
+
+// add, sub and neg set the zero flag from their result, but the carry and
+// overflow flags differ from a test's, so this only applies when the test is
+// read by an instruction that looks at the zero flag alone. Codegen never
+// reads flags past the first instruction that uses them.
+static bool peephole_test_after_arithmetic(Window* out)
+{
+	if (out->len < 3) {
+		return false;
+	}
+	Instruction* op = tail(out, 3);
+	Instruction* test = tail(out, 2);
+	Instruction* use = tail(out, 1);
+	if (op->opcode != OPCODE_ADD && op->opcode != OPCODE_SUB && op->opcode != OPCODE_NEG) {
+		return false;
+	}
+	if (!is_zero_test(test) || !operand_eq(op->operands[0], test->operands[0])) {
+		return false;
+	}
+	switch (use->opcode) {
+	case OPCODE_JE:
+	case OPCODE_JNE:
+	case OPCODE_SETE:
+	case OPCODE_SETNE:
+		break;
+	default:
+		return false;
+	}
+	*test = *use;
+	out->len--;
+	return true;
+}
+
+static bool peephole_jump_to_next(Window* out)
+{
+	if (out->len < 2) {
+		return false;
+	}
+	Instruction* jump = tail(out, 2);
+	Instruction* label = tail(out, 1);
+	if (!is_jump(jump->opcode) || label->opcode != OPCODE_LABEL
+	                || !operand_eq(jump->operands[0], label->operands[0])) {
+		return false;
+	}
+	*jump = *label;
+	out->len--;
+	return true;
+}
+
+static const PeepholeFunc RULES[] = {
+#define X(name, func, description) [PEEPHOLE_RULE_##name] = func,
+#include "dragon/peephole_rules.def"
+#undef X
+};
+
+static const char* const DESCRIPTIONS[] = {
+#define X(name, func, description) [PEEPHOLE_RULE_##name] = description,
+#include "dragon/peephole_rules.def"
+#undef X
+};
+
+PeepholeStats peephole_optimize(InstructionBuf* code)
+{
+	PeepholeStats stats = {0};
+	Window out = { .ptr = code->ptr, .len = 0 };
+	for (uint64_t i = 0; i < code->len; i++) {
+		out.ptr[out.len++] = code->ptr[i];
+		// a rewrite can expose another one further back, so keep going until
+		// none applies
+		for (PeepholeRule rule = 0; rule < PEEPHOLE_RULE_COUNT;) {
+			if (RULES[rule](&out)) {
+				stats.hits[rule]++;
+				rule = 0;
+			} else {
+				rule++;
+			}
+		}
+	}
+	code->len = out.len;
+	return stats;
+}
+
+const char* peephole_rule_description(PeepholeRule rule)
+{
+	return DESCRIPTIONS[rule];
+}
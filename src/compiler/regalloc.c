@@ -0,0 +1,408 @@
+#include "dragon/regalloc.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "dragon/core/buf.h"
+
+#define NO_POSITION UINT32_MAX
+#define NO_REGISTER UINT32_MAX
+
+// Caller-saved first, since nothing is called that could overwrite them.
+static const MachineRegister ALLOCATABLE[] = {
+	MREG_RSI,
+	MREG_RDI,
+	MREG_R8,
+	MREG_R9,
+	MREG_R10,
+	MREG_R11,
+	MREG_RBX,
+	MREG_R12,
+	MREG_R13,
+	MREG_R14,
+	MREG_R15,
+};
+
+#define ALLOCATABLE_COUNT (sizeof(ALLOCATABLE) / sizeof(ALLOCATABLE[0]))
+
+static bool is_callee_saved(MachineRegister reg)
+{
+	return reg == MREG_RBX || (reg >= MREG_R12 && reg <= MREG_R15);
+}
+
+// The positions from the first to the last instruction a value is live at,
+// counting instructions through the blocks in layout order. Instruction `i`
+// reads its operands at position 2i and writes its result at 2i + 1.
+typedef struct {
+	IrValue value;
+	uint32_t start;
+	uint32_t end;
+	// instructions assigning or reading the value
+	uint32_t uses;
+	// the index into ALLOCATABLE, or the spill slot
+	uint32_t location;
+	bool spilled;
+} Interval;
+
+typedef BUF(Interval) IntervalBuf;
+typedef BUF(uint64_t) BitsBuf;
+typedef BUF(uint32_t) IndexBuf;
+
+typedef struct {
+	const IrFunction* func;
+	uint64_t words;
+	// bit sets of values, `words` words per block
+	BitsBuf liveIn;
+	BitsBuf liveOut;
+	IntervalBuf intervals;
+} Liveness;
+
+static uint64_t* bits(BitsBuf* set, uint64_t words, IrBlockId block)
+{
+	return &set->ptr[block * words];
+}
+
+static void set_bit(uint64_t* set, IrValue value)
+{
+	set[value / 64] |= (uint64_t)1 << (value % 64);
+}
+
+static void clear_bit(uint64_t* set, IrValue value)
+{
+	set[value / 64] &= ~((uint64_t)1 << (value % 64));
+}
+
+static void zero_bits(BitsBuf* set, uint64_t len)
+{
+	BUF_RESERVE(set, len);
+	set->len = len;
+	for (uint64_t i = 0; i < len; i++) {
+		set->ptr[i] = 0;
+	}
+}
+
+// The values live on entry to `block`, given those live on exit.
+static void transfer(const IrBlock* block, const uint64_t* out, uint64_t* in, uint64_t words)
+{
+	for (uint64_t i = 0; i < words; i++) {
+		in[i] = out[i];
+	}
+	for (uint64_t i = block->instructions.len; i-- > 0;) {
+		const IrInstruction* insn = &block->instructions.ptr[i];
+		if (insn->dst != IR_VALUE_NONE) {
+			clear_bit(in, insn->dst);
+		}
+		for (uint64_t j = 0; j < 2; j++) {
+			if (insn->args[j].kind == IR_OPERAND_VALUE) {
+				set_bit(in, (IrValue)insn->args[j].value);
+			}
+		}
+	}
+}
+
+// The usual backwards dataflow: a value is live out of a block if it's live
+// into a successor. Blocks are visited last to first, which mostly visits
+// successors first.
+static void compute_liveness(Liveness* liveness)
+{
+	const IrFunction* func = liveness->func;
+	uint64_t words = liveness->words;
+	zero_bits(&liveness->liveIn, words * func->blocks.len);
+	zero_bits(&liveness->liveOut, words * func->blocks.len);
+	BitsBuf next = BUF_NEW;
+	zero_bits(&next, words);
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		for (IrBlockId id = (IrBlockId)func->blocks.len; id-- > 0;) {
+			uint64_t* out = bits(&liveness->liveOut, words, id);
+			IrBlockId succs[2];
+			uint32_t count = ir_successors(&func->blocks.ptr[id], succs);
+			for (uint32_t i = 0; i < count; i++) {
+				const uint64_t* succIn = bits(&liveness->liveIn, words, succs[i]);
+				for (uint64_t w = 0; w < words; w++) {
+					out[w] |= succIn[w];
+				}
+			}
+			uint64_t* in = bits(&liveness->liveIn, words, id);
+			transfer(&func->blocks.ptr[id], out, next.ptr, words);
+			for (uint64_t w = 0; w < words; w++) {
+				if (next.ptr[w] != in[w]) {
+					in[w] = next.ptr[w];
+					changed = true;
+				}
+			}
+		}
+	}
+	BUF_FREE(next);
+}
+
+static void extend(Interval* interval, uint32_t position)
+{
+	if (interval->start == NO_POSITION || position < interval->start) {
+		interval->start = position;
+	}
+	if (interval->end == NO_POSITION || position > interval->end) {
+		interval->end = position;
+	}
+}
+
+static void extend_operand(Liveness* liveness, IrOperand operand, uint32_t position)
+{
+	if (operand.kind == IR_OPERAND_VALUE) {
+		Interval* interval = &liveness->intervals.ptr[operand.value];
+		extend(interval, position);
+		interval->uses++;
+	}
+}
+
+// One interval per value, covering every position it's live at. A value
+// assigned in more than one block, as phis are, gets a single interval over
+// all of them.
+static void build_intervals(Liveness* liveness)
+{
+	const IrFunction* func = liveness->func;
+	for (IrValue value = 0; value < func->valueCount; value++) {
+		BUF_PUSH(&liveness->intervals, ((Interval) {
+			.value = value,
+			.start = NO_POSITION,
+			.end = NO_POSITION,
+			.uses = 0,
+			.location = NO_REGISTER,
+			.spilled = false,
+		}));
+	}
+	uint32_t position = 0;
+	for (IrBlockId id = 0; id < func->blocks.len; id++) {
+		const IrBlock* block = &func->blocks.ptr[id];
+		uint32_t first = 2 * position;
+		uint32_t last = 2 * (position + (uint32_t)block->instructions.len - 1);
+		const uint64_t* in = bits(&liveness->liveIn, liveness->words, id);
+		const uint64_t* out = bits(&liveness->liveOut, liveness->words, id);
+		for (uint64_t w = 0; w < liveness->words; w++) {
+			for (uint64_t word = in[w]; word != 0; word &= word - 1) {
+				extend(&liveness->intervals.ptr[w * 64 + (uint64_t)__builtin_ctzll(word)], first);
+			}
+			for (uint64_t word = out[w]; word != 0; word &= word - 1) {
+				extend(&liveness->intervals.ptr[w * 64 + (uint64_t)__builtin_ctzll(word)], last + 1);
+			}
+		}
+		for (uint64_t i = 0; i < block->instructions.len; i++, position++) {
+			const IrInstruction* insn = &block->instructions.ptr[i];
+			extend_operand(liveness, insn->args[0], 2 * position);
+			extend_operand(liveness, insn->args[1], 2 * position);
+			if (insn->dst != IR_VALUE_NONE) {
+				extend_operand(liveness, ir_value(insn->dst), 2 * position + 1);
+			}
+		}
+		// The backend may evaluate the comparison a branch reads at the
+		// branch itself, after the instructions in between.
+		const IrInstruction* branch = ir_block_terminator(block);
+		IrOperand condition = branch->args[0];
+		for (uint64_t i = 0; branch->opcode == IR_OP_BRANCH && i + 1 < block->instructions.len; i++) {
+			const IrInstruction* insn = &block->instructions.ptr[i];
+			if (condition.kind == IR_OPERAND_VALUE && insn->dst == condition.value) {
+				extend_operand(liveness, insn->args[0], last);
+				extend_operand(liveness, insn->args[1], last);
+			}
+		}
+	}
+}
+
+static int compare_starts(const void* a, const void* b)
+{
+	const Interval* x = a;
+	const Interval* y = b;
+	if (x->start != y->start) {
+		return x->start < y->start ? -1 : 1;
+	}
+	return x->value < y->value ? -1 : x->value > y->value ? 1 : 0;
+}
+
+// Whether keeping `a` in memory costs less than keeping `b` there: it's used
+// less often for how long it holds on to a register.
+static bool cheaper_to_spill(const Interval* a, const Interval* b)
+{
+	uint64_t aLen = (uint64_t)a->end - a->start + 1;
+	uint64_t bLen = (uint64_t)b->end - b->start + 1;
+	return (uint64_t)a->uses * bLen < (uint64_t)b->uses * aLen;
+}
+
+typedef struct {
+	// indices into the sorted intervals holding a register, or a spill slot
+	IndexBuf active;
+	IndexBuf activeSlots;
+	bool freeRegisters[ALLOCATABLE_COUNT];
+	IndexBuf freeSlots;
+	uint32_t slotCount;
+} Scan;
+
+static void spill(Scan* scan, Interval* intervals, uint32_t index)
+{
+	Interval* interval = &intervals[index];
+	interval->spilled = true;
+	if (scan->freeSlots.len > 0) {
+		interval->location = scan->freeSlots.ptr[--scan->freeSlots.len];
+	} else {
+		interval->location = scan->slotCount++;
+	}
+	BUF_PUSH(&scan->activeSlots, index);
+}
+
+// Frees the registers and slots of the intervals that end before `position`.
+static void expire(Scan* scan, const Interval* intervals, uint32_t position)
+{
+	uint64_t kept = 0;
+	for (uint64_t i = 0; i < scan->active.len; i++) {
+		const Interval* interval = &intervals[scan->active.ptr[i]];
+		if (interval->end < position) {
+			scan->freeRegisters[interval->location] = true;
+		} else {
+			scan->active.ptr[kept++] = scan->active.ptr[i];
+		}
+	}
+	scan->active.len = kept;
+	kept = 0;
+	for (uint64_t i = 0; i < scan->activeSlots.len; i++) {
+		const Interval* interval = &intervals[scan->activeSlots.ptr[i]];
+		if (interval->end < position) {
+			BUF_PUSH(&scan->freeSlots, interval->location);
+		} else {
+			scan->activeSlots.ptr[kept++] = scan->activeSlots.ptr[i];
+		}
+	}
+	scan->activeSlots.len = kept;
+}
+
+// Poletto and Sarkar's linear scan, spilling the interval with the fewest
+// uses for its length rather than the one that ends last. Returns how many
+// spill slots it used; the spilled intervals' locations are their slots, and
+// the others' are their index in ALLOCATABLE.
+static uint32_t linear_scan(IntervalBuf* intervals)
+{
+	Scan scan = { .active = BUF_NEW, .activeSlots = BUF_NEW, .freeSlots = BUF_NEW, .slotCount = 0 };
+	for (uint64_t i = 0; i < ALLOCATABLE_COUNT; i++) {
+		scan.freeRegisters[i] = true;
+	}
+	for (uint32_t index = 0; index < intervals->len; index++) {
+		Interval* interval = &intervals->ptr[index];
+		if (interval->start == NO_POSITION) {
+			continue;
+		}
+		expire(&scan, intervals->ptr, interval->start);
+		uint32_t reg = NO_REGISTER;
+		for (uint32_t r = 0; r < ALLOCATABLE_COUNT; r++) {
+			if (scan.freeRegisters[r]) {
+				reg = r;
+				break;
+			}
+		}
+		if (reg != NO_REGISTER) {
+			scan.freeRegisters[reg] = false;
+			interval->location = reg;
+			BUF_PUSH(&scan.active, index);
+			continue;
+		}
+		uint64_t cheapest = 0;
+		for (uint64_t i = 1; i < scan.active.len; i++) {
+			if (cheaper_to_spill(&intervals->ptr[scan.active.ptr[i]], &intervals->ptr[scan.active.ptr[cheapest]])) {
+				cheapest = i;
+			}
+		}
+		uint32_t victim = scan.active.ptr[cheapest];
+		if (cheaper_to_spill(&intervals->ptr[victim], interval)) {
+			interval->location = intervals->ptr[victim].location;
+			scan.active.ptr[cheapest] = index;
+			spill(&scan, intervals->ptr, victim);
+		} else {
+			spill(&scan, intervals->ptr, index);
+		}
+	}
+	BUF_FREE(scan.active);
+	BUF_FREE(scan.activeSlots);
+	BUF_FREE(scan.freeSlots);
+	return scan.slotCount;
+}
+
+static Operand frame_slot(uint32_t slot)
+{
+	return asm_frame(-8 * ((int64_t)slot + 1));
+}
+
+RegisterAllocation regalloc_function(const IrFunction* func, RegallocStrategy strategy)
+{
+	RegisterAllocation allocation = {
+		.locations = BUF_NEW,
+		.saved = BUF_NEW,
+		.frameSlots = 0,
+		.stats = {0},
+	};
+	BUF_RESERVE(&allocation.locations, func->valueCount);
+	allocation.locations.len = func->valueCount;
+	if (strategy == REGALLOC_STRATEGY_NONE) {
+		for (IrValue value = 0; value < func->valueCount; value++) {
+			allocation.locations.ptr[value] = frame_slot(value);
+		}
+		allocation.frameSlots = func->valueCount;
+		allocation.stats.spilled = func->valueCount;
+		return allocation;
+	}
+
+	Liveness liveness = {
+		.func = func,
+		.words = ((uint64_t)func->valueCount + 63) / 64,
+		.liveIn = BUF_NEW,
+		.liveOut = BUF_NEW,
+		.intervals = BUF_NEW,
+	};
+	compute_liveness(&liveness);
+	build_intervals(&liveness);
+	IntervalBuf* intervals = &liveness.intervals;
+	if (intervals->len > 0) {
+		qsort(intervals->ptr, intervals->len, sizeof(Interval), compare_starts);
+	}
+
+	uint32_t spillSlots = linear_scan(intervals);
+
+	bool usedRegisters[ALLOCATABLE_COUNT] = {0};
+	for (uint64_t i = 0; i < intervals->len; i++) {
+		const Interval* interval = &intervals->ptr[i];
+		if (interval->start != NO_POSITION && !interval->spilled) {
+			usedRegisters[interval->location] = true;
+		}
+	}
+	for (uint32_t r = 0; r < ALLOCATABLE_COUNT; r++) {
+		if (usedRegisters[r] && is_callee_saved(ALLOCATABLE[r])) {
+			BUF_PUSH(&allocation.saved, ALLOCATABLE[r]);
+		}
+	}
+	// the saved registers take the first slots
+	uint32_t savedCount = (uint32_t)allocation.saved.len;
+	for (uint64_t i = 0; i < intervals->len; i++) {
+		const Interval* interval = &intervals->ptr[i];
+		Operand* location = &allocation.locations.ptr[interval->value];
+		if (interval->start == NO_POSITION) {
+			// never assigned or read
+			*location = asm_reg(ALLOCATABLE[0]);
+		} else if (interval->spilled) {
+			*location = frame_slot(savedCount + interval->location);
+			allocation.stats.spilled++;
+		} else {
+			*location = asm_reg(ALLOCATABLE[interval->location]);
+			allocation.stats.registers++;
+		}
+	}
+	allocation.frameSlots = savedCount + spillSlots;
+
+	BUF_FREE(liveness.liveIn);
+	BUF_FREE(liveness.liveOut);
+	BUF_FREE(liveness.intervals);
+	return allocation;
+}
+
+void register_allocation_free(RegisterAllocation allocation)
+{
+	BUF_FREE(allocation.locations);
+	BUF_FREE(allocation.saved);
+}
@@ -0,0 +1,116 @@
+#include "dragon/rewrite.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+ExpressionSlotBuf expression_post_order_slots(Expression** root)
+{
+	// Built with an explicit stack, as the tree can be arbitrarily deep.
+	ExpressionSlotBuf pending = BUF_NEW;
+	ExpressionSlotBuf order = BUF_NEW;
+	BUF_PUSH(&pending, root);
+	while (pending.len > 0) {
+		Expression** slot = pending.ptr[--pending.len];
+		BUF_PUSH(&order, slot);
+		Expression* expr = *slot;
+		switch (expr->type) {
+		case EXPRESSION_TYPE_CONSTANT:
+			break;
+		case EXPRESSION_TYPE_UNARY_OP:
+			BUF_PUSH(&pending, &((UnaryOpExpression*)expr)->operand);
+			break;
+		case EXPRESSION_TYPE_BINARY_OP:
+			BUF_PUSH(&pending, &((BinaryOpExpression*)expr)->left);
+			BUF_PUSH(&pending, &((BinaryOpExpression*)expr)->right);
+			break;
+		}
+	}
+	BUF_FREE(pending);
+	// `order` lists parents before their children, so reverse it
+	for (uint64_t i = 0; i < order.len / 2; i++) {
+		Expression** tmp = order.ptr[i];
+		order.ptr[i] = order.ptr[order.len - 1 - i];
+		order.ptr[order.len - 1 - i] = tmp;
+	}
+	return order;
+}
+
+static bool rule_matches(const RewriteRule* rule, const Expression* expr)
+{
+	if (rule->type != expr->type) {
+		return false;
+	}
+	switch (expr->type) {
+	case EXPRESSION_TYPE_CONSTANT:
+		return true;
+	case EXPRESSION_TYPE_UNARY_OP:
+		return rule->op == ((const UnaryOpExpression*)expr)->kind;
+	case EXPRESSION_TYPE_BINARY_OP:
+		return rule->op == ((const BinaryOpExpression*)expr)->kind;
+	}
+	return false;
+}
+
+void rewrite_expression(
+        Expression** root,
+        Arena* nodes,
+        const RewriteRule* rules,
+        uint64_t ruleCount,
+        uint64_t* hits
+)
+{
+	ExpressionSlotBuf slots = expression_post_order_slots(root);
+	for (uint64_t i = 0; i < slots.len; i++) {
+		Expression** slot = slots.ptr[i];
+		uint64_t rule = 0;
+		while (rule < ruleCount) {
+			Expression* replacement = NULL;
+			if (rule_matches(&rules[rule], *slot)) {
+				replacement = rules[rule].apply(nodes, *slot);
+			}
+			if (replacement == NULL) {
+				rule++;
+				continue;
+			}
+			hits[rule]++;
+			*slot = replacement;
+			rule = 0;
+		}
+	}
+	BUF_FREE(slots);
+}
+
+Expression* expression_new_constant(Arena* nodes, int64_t number)
+{
+	ConstantExpression* constant = ARENA_NEW(nodes, ConstantExpression);
+	constant->base.type = EXPRESSION_TYPE_CONSTANT;
+	constant->number = number;
+	return &constant->base;
+}
+
+Expression* expression_new_unary(Arena* nodes, UnaryOpKind kind, uint32_t offset, Expression* operand)
+{
+	UnaryOpExpression* unary = ARENA_NEW(nodes, UnaryOpExpression);
+	unary->base.type = EXPRESSION_TYPE_UNARY_OP;
+	unary->kind = kind;
+	unary->offset = offset;
+	unary->operand = operand;
+	return &unary->base;
+}
+
+Expression* expression_new_binary(
+        Arena* nodes,
+        BinaryOpKind kind,
+        uint32_t offset,
+        Expression* left,
+        Expression* right
+)
+{
+	BinaryOpExpression* binary = ARENA_NEW(nodes, BinaryOpExpression);
+	binary->base.type = EXPRESSION_TYPE_BINARY_OP;
+	binary->kind = kind;
+	binary->offset = offset;
+	binary->left = left;
+	binary->right = right;
+	return &binary->base;
+}
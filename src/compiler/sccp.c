@@ -0,0 +1,441 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "dragon/ast.h"
+#include "dragon/cfg.h"
+#include "dragon/core/buf.h"
+#include "dragon/fold.h"
+#include "dragon/ir_opt.h"
+
+typedef enum {
+	// no path that can run assigns the value yet
+	LATTICE_UNDEFINED,
+	LATTICE_CONSTANT,
+	LATTICE_VARYING,
+} LatticeKind;
+
+typedef struct {
+	LatticeKind kind;
+	int64_t value;
+} Lattice;
+
+typedef BUF(Lattice) LatticeBuf;
+typedef BUF(bool) FlagBuf;
+typedef BUF(uint32_t) IndexBuf;
+
+// Phi `index` of `block` if `phi` is set, instruction `index` otherwise.
+typedef struct {
+	IrBlockId block;
+	uint32_t index;
+	bool phi;
+} Use;
+
+typedef BUF(Use) UseBuf;
+
+// The edge from the `pred`th predecessor of `block`.
+typedef struct {
+	IrBlockId block;
+	uint32_t pred;
+} Edge;
+
+typedef BUF(Edge) EdgeBuf;
+
+typedef struct {
+	IrFunction* func;
+	LatticeBuf values;
+	FlagBuf reachable;
+	// the edges into block `b` start at edgeStart.ptr[b]
+	IndexBuf edgeStart;
+	FlagBuf executable;
+	EdgeBuf edgeWork;
+	IndexBuf valueWork;
+	// the uses of value `v` are uses.ptr[useStart.ptr[v]] to
+	// uses.ptr[useStart.ptr[v + 1] - 1]
+	IndexBuf useStart;
+	UseBuf uses;
+} Solver;
+
+static Lattice constant(int64_t value)
+{
+	return (Lattice) { .kind = LATTICE_CONSTANT, .value = value };
+}
+
+static Lattice lattice_of(const Solver* solver, IrOperand operand)
+{
+	if (operand.kind == IR_OPERAND_CONSTANT) {
+		return constant(operand.value);
+	}
+	return solver->values.ptr[operand.value];
+}
+
+static Lattice meet(Lattice a, Lattice b)
+{
+	if (a.kind == LATTICE_UNDEFINED) {
+		return b;
+	}
+	if (b.kind == LATTICE_UNDEFINED) {
+		return a;
+	}
+	if (a.kind == LATTICE_CONSTANT && b.kind == LATTICE_CONSTANT && a.value == b.value) {
+		return a;
+	}
+	return (Lattice) { .kind = LATTICE_VARYING };
+}
+
+static void set_value(Solver* solver, IrValue value, Lattice lattice)
+{
+	Lattice* old = &solver->values.ptr[value];
+	if (old->kind == lattice.kind && (lattice.kind != LATTICE_CONSTANT || old->value == lattice.value)) {
+		return;
+	}
+	*old = lattice;
+	BUF_PUSH(&solver->valueWork, value);
+}
+
+// Marks the edge to successor `succ` of `block`, as numbered by
+// ir_successors, as executable.
+static void mark_edge(Solver* solver, IrBlockId block, uint32_t succ)
+{
+	const IrInstruction* last = ir_block_terminator(&solver->func->blocks.ptr[block]);
+	IrBlockId target = last->targets[succ];
+	// a branch to the same block twice has an edge for each target, in order
+	uint32_t skip = succ == 1 && last->targets[0] == target ? 1 : 0;
+	const IrBlockIdBuf* preds = &solver->func->blocks.ptr[target].preds;
+	for (uint32_t i = 0; i < preds->len; i++) {
+		if (preds->ptr[i] != block) {
+			continue;
+		}
+		if (skip > 0) {
+			skip--;
+			continue;
+		}
+		bool* executable = &solver->executable.ptr[solver->edgeStart.ptr[target] + i];
+		if (!*executable) {
+			*executable = true;
+			BUF_PUSH(&solver->edgeWork, ((Edge) { .block = target, .pred = i }));
+		}
+		return;
+	}
+}
+
+static void evaluate_phi(Solver* solver, IrBlockId block, uint32_t index)
+{
+	const IrPhi* phi = &solver->func->blocks.ptr[block].phis.ptr[index];
+	Lattice result = { .kind = LATTICE_UNDEFINED };
+	for (uint32_t i = 0; i < phi->args.len; i++) {
+		if (solver->executable.ptr[solver->edgeStart.ptr[block] + i]) {
+			result = meet(result, lattice_of(solver, phi->args.ptr[i]));
+		}
+	}
+	set_value(solver, phi->dst, result);
+}
+
+static bool is_zero(Lattice lattice)
+{
+	return lattice.kind == LATTICE_CONSTANT && lattice.value == 0;
+}
+
+static void evaluate_instruction(Solver* solver, IrBlockId block, uint32_t index)
+{
+	const IrInstruction* insn = &solver->func->blocks.ptr[block].instructions.ptr[index];
+	Lattice a = lattice_of(solver, insn->args[0]);
+	switch (insn->opcode) {
+	case IR_OP_COPY:
+		set_value(solver, insn->dst, a);
+		break;
+	case IR_OP_UNARY:
+		if (a.kind == LATTICE_CONSTANT) {
+			set_value(solver, insn->dst, constant(fold_unary_op((UnaryOpKind)insn->op, a.value)));
+		} else if (a.kind == LATTICE_VARYING) {
+			set_value(solver, insn->dst, a);
+		}
+		break;
+	case IR_OP_BINARY: {
+		Lattice b = lattice_of(solver, insn->args[1]);
+		BinaryOpKind kind = (BinaryOpKind)insn->op;
+		if ((kind == BINARY_OP_KIND_MULTIPLICATION || kind == BINARY_OP_KIND_BITWISE_AND)
+		                && (is_zero(a) || is_zero(b))) {
+			set_value(solver, insn->dst, constant(0));
+		} else if (a.kind == LATTICE_UNDEFINED || b.kind == LATTICE_UNDEFINED) {
+			break;
+		} else if (a.kind == LATTICE_CONSTANT && b.kind == LATTICE_CONSTANT) {
+			FoldValue result = fold_binary_op(kind, a.value, b.value);
+			// a trap happens at run time, every time
+			set_value(solver, insn->dst, result.present ? constant(result.value) : (Lattice) {
+				.kind = LATTICE_VARYING
+			});
+		} else {
+			set_value(solver, insn->dst, (Lattice) { .kind = LATTICE_VARYING });
+		}
+		break;
+	}
+	case IR_OP_JUMP:
+		mark_edge(solver, block, 0);
+		break;
+	case IR_OP_BRANCH:
+		if (a.kind == LATTICE_CONSTANT) {
+			mark_edge(solver, block, a.value != 0 ? 0 : 1);
+		} else if (a.kind == LATTICE_VARYING) {
+			mark_edge(solver, block, 0);
+			mark_edge(solver, block, 1);
+		}
+		break;
+	case IR_OP_RETURN:
+		break;
+	}
+}
+
+static void visit_block(Solver* solver, IrBlockId id)
+{
+	const IrBlock* block = &solver->func->blocks.ptr[id];
+	for (uint32_t i = 0; i < block->phis.len; i++) {
+		evaluate_phi(solver, id, i);
+	}
+	for (uint32_t i = 0; i < block->instructions.len; i++) {
+		evaluate_instruction(solver, id, i);
+	}
+}
+
+static void add_use(Solver* solver, IrOperand operand, Use use, bool count)
+{
+	if (operand.kind != IR_OPERAND_VALUE) {
+		return;
+	}
+	if (count) {
+		solver->useStart.ptr[operand.value + 1]++;
+	} else {
+		solver->uses.ptr[solver->useStart.ptr[operand.value]++] = use;
+	}
+}
+
+// Counts the uses of each value, then places them, reusing useStart as the
+// next free slot of each value and shifting it back at the end.
+static void collect_uses(Solver* solver)
+{
+	const IrFunction* func = solver->func;
+	for (int pass = 0; pass < 2; pass++) {
+		bool count = pass == 0;
+		for (IrBlockId b = 0; b < func->blocks.len; b++) {
+			const IrBlock* block = &func->blocks.ptr[b];
+			for (uint32_t i = 0; i < block->phis.len; i++) {
+				const IrOperandBuf* args = &block->phis.ptr[i].args;
+				for (uint32_t j = 0; j < args->len; j++) {
+					add_use(solver, args->ptr[j], (Use) { .block = b, .index = i, .phi = true }, count);
+				}
+			}
+			for (uint32_t i = 0; i < block->instructions.len; i++) {
+				const IrInstruction* insn = &block->instructions.ptr[i];
+				for (uint32_t j = 0; j < 2; j++) {
+					add_use(solver, insn->args[j], (Use) { .block = b, .index = i, .phi = false }, count);
+				}
+			}
+		}
+		if (count) {
+			for (uint32_t v = 0; v < func->valueCount; v++) {
+				solver->useStart.ptr[v + 1] += solver->useStart.ptr[v];
+			}
+			BUF_RESERVE(&solver->uses, solver->useStart.ptr[func->valueCount]);
+			solver->uses.len = solver->useStart.ptr[func->valueCount];
+		}
+	}
+	for (uint32_t v = func->valueCount; v > 0; v--) {
+		solver->useStart.ptr[v] = solver->useStart.ptr[v - 1];
+	}
+	solver->useStart.ptr[0] = 0;
+}
+
+static void solve(Solver* solver)
+{
+	solver->reachable.ptr[0] = true;
+	visit_block(solver, 0);
+	while (solver->edgeWork.len > 0 || solver->valueWork.len > 0) {
+		if (solver->edgeWork.len > 0) {
+			Edge edge = solver->edgeWork.ptr[--solver->edgeWork.len];
+			if (!solver->reachable.ptr[edge.block]) {
+				solver->reachable.ptr[edge.block] = true;
+				visit_block(solver, edge.block);
+			} else {
+				// only the phis read which edges are executable
+				const IrBlock* block = &solver->func->blocks.ptr[edge.block];
+				for (uint32_t i = 0; i < block->phis.len; i++) {
+					evaluate_phi(solver, edge.block, i);
+				}
+			}
+			continue;
+		}
+		IrValue value = solver->valueWork.ptr[--solver->valueWork.len];
+		for (uint32_t i = solver->useStart.ptr[value]; i < solver->useStart.ptr[value + 1]; i++) {
+			Use use = solver->uses.ptr[i];
+			if (!solver->reachable.ptr[use.block]) {
+				continue;
+			}
+			if (use.phi) {
+				evaluate_phi(solver, use.block, use.index);
+			} else {
+				evaluate_instruction(solver, use.block, use.index);
+			}
+		}
+	}
+}
+
+// Appends each block that is only reached by a jump to the block jumping
+// there. Folding branches leaves many of them behind. The phis of a block
+// with one predecessor just select that operand, so they go into `map`.
+static void merge_blocks(IrFunction* func, IrValueMap* map)
+{
+	IrBlockIdBuf kept = BUF_NEW;
+	FlagBuf merged = BUF_NEW;
+	for (IrBlockId id = 0; id < func->blocks.len; id++) {
+		BUF_PUSH(&merged, false);
+	}
+	for (IrBlockId id = 0; id < func->blocks.len; id++) {
+		if (merged.ptr[id]) {
+			continue;
+		}
+		BUF_PUSH(&kept, id);
+		IrBlock* block = &func->blocks.ptr[id];
+		for (;;) {
+			IrInstruction* last = &block->instructions.ptr[block->instructions.len - 1];
+			IrBlockId next = last->targets[0];
+			if (last->opcode != IR_OP_JUMP || next == 0 || func->blocks.ptr[next].preds.len != 1) {
+				break;
+			}
+			IrBlock* succ = &func->blocks.ptr[next];
+			for (uint64_t i = 0; i < succ->phis.len; i++) {
+				map->replacements.ptr[succ->phis.ptr[i].dst] = succ->phis.ptr[i].args.ptr[0];
+				BUF_FREE(succ->phis.ptr[i].args);
+			}
+			succ->phis.len = 0;
+			block->instructions.len--;
+			for (uint64_t i = 0; i < succ->instructions.len; i++) {
+				BUF_PUSH(&block->instructions, succ->instructions.ptr[i]);
+			}
+			IrBlockId succs[2];
+			uint32_t count = ir_successors(succ, succs);
+			for (uint32_t i = 0; i < count; i++) {
+				IrBlockIdBuf* preds = &func->blocks.ptr[succs[i]].preds;
+				for (uint64_t j = 0; j < preds->len; j++) {
+					if (preds->ptr[j] == next) {
+						preds->ptr[j] = id;
+					}
+				}
+			}
+			succ->instructions.len = 0;
+			succ->preds.len = 0;
+			merged.ptr[next] = true;
+		}
+	}
+	if (kept.len < func->blocks.len) {
+		ir_reorder_blocks(func, &kept);
+	}
+	BUF_FREE(merged);
+	BUF_FREE(kept);
+}
+
+// Replaces the constant values and branches found by the solver.
+static void rewrite(Solver* solver, IrOptStats* stats)
+{
+	IrFunction* func = solver->func;
+	IrValueMap map = ir_value_map_new(func);
+	for (IrBlockId id = 0; id < func->blocks.len; id++) {
+		if (!solver->reachable.ptr[id]) {
+			continue;
+		}
+		IrBlock* block = &func->blocks.ptr[id];
+		uint64_t kept = 0;
+		for (uint64_t i = 0; i < block->phis.len; i++) {
+			IrPhi phi = block->phis.ptr[i];
+			Lattice lattice = solver->values.ptr[phi.dst];
+			if (lattice.kind == LATTICE_CONSTANT) {
+				map.replacements.ptr[phi.dst] = ir_constant(lattice.value);
+				stats->counts[IR_OPT_COUNTER_CONSTANT_VALUES]++;
+				BUF_FREE(phi.args);
+				continue;
+			}
+			block->phis.ptr[kept++] = phi;
+		}
+		block->phis.len = kept;
+
+		kept = 0;
+		for (uint64_t i = 0; i < block->instructions.len; i++) {
+			IrInstruction insn = block->instructions.ptr[i];
+			if (insn.dst != IR_VALUE_NONE && solver->values.ptr[insn.dst].kind == LATTICE_CONSTANT) {
+				map.replacements.ptr[insn.dst] = ir_constant(solver->values.ptr[insn.dst].value);
+				stats->counts[IR_OPT_COUNTER_CONSTANT_VALUES]++;
+				continue;
+			}
+			block->instructions.ptr[kept++] = insn;
+		}
+		block->instructions.len = kept;
+
+		IrInstruction* last = &block->instructions.ptr[block->instructions.len - 1];
+		if (last->opcode != IR_OP_BRANCH) {
+			continue;
+		}
+		Lattice condition = lattice_of(solver, last->args[0]);
+		if (condition.kind == LATTICE_CONSTANT) {
+			IrBlockId taken = last->targets[condition.value != 0 ? 0 : 1];
+			IrBlockId skipped = last->targets[condition.value != 0 ? 1 : 0];
+			*last = (IrInstruction) {
+				.opcode = IR_OP_JUMP,
+				.dst = IR_VALUE_NONE,
+				.targets = { taken },
+			};
+			ir_remove_predecessor(func, skipped, id);
+			stats->counts[IR_OPT_COUNTER_FOLDED_BRANCHES]++;
+		}
+	}
+	stats->counts[IR_OPT_COUNTER_UNREACHABLE_BLOCKS] += ir_remove_unreachable_blocks(func);
+	merge_blocks(func, &map);
+	ir_value_map_apply(&map, func);
+	ir_value_map_free(map);
+}
+
+void ir_sccp(IrFunction* func, IrOptStats* stats)
+{
+	Solver solver = {
+		.func = func,
+		.values = BUF_NEW,
+		.reachable = BUF_NEW,
+		.edgeStart = BUF_NEW,
+		.executable = BUF_NEW,
+		.edgeWork = BUF_NEW,
+		.valueWork = BUF_NEW,
+		.useStart = BUF_NEW,
+		.uses = BUF_NEW,
+	};
+	BUF_RESERVE(&solver.values, func->valueCount);
+	solver.values.len = func->valueCount;
+	for (uint32_t v = 0; v < func->valueCount; v++) {
+		solver.values.ptr[v] = (Lattice) { .kind = LATTICE_UNDEFINED };
+	}
+	BUF_RESERVE(&solver.useStart, func->valueCount + 1);
+	solver.useStart.len = func->valueCount + 1;
+	for (uint32_t v = 0; v <= func->valueCount; v++) {
+		solver.useStart.ptr[v] = 0;
+	}
+	uint32_t edges = 0;
+	for (IrBlockId id = 0; id < func->blocks.len; id++) {
+		BUF_PUSH(&solver.reachable, false);
+		BUF_PUSH(&solver.edgeStart, edges);
+		edges += (uint32_t)func->blocks.ptr[id].preds.len;
+	}
+	BUF_RESERVE(&solver.executable, edges);
+	solver.executable.len = edges;
+	for (uint32_t i = 0; i < edges; i++) {
+		solver.executable.ptr[i] = false;
+	}
+
+	collect_uses(&solver);
+	solve(&solver);
+	rewrite(&solver, stats);
+
+	BUF_FREE(solver.values);
+	BUF_FREE(solver.reachable);
+	BUF_FREE(solver.edgeStart);
+	BUF_FREE(solver.executable);
+	BUF_FREE(solver.edgeWork);
+	BUF_FREE(solver.valueWork);
+	BUF_FREE(solver.useStart);
+	BUF_FREE(solver.uses);
+}
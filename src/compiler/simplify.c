@@ -0,0 +1,264 @@
+#include "dragon/simplify.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "dragon/core/arena.h"
+#include "dragon/rewrite.h"
+
+static bool is_constant(const Expression* expr, int64_t value)
+{
+	return expr->type == EXPRESSION_TYPE_CONSTANT && ((const ConstantExpression*)expr)->number == value;
+}
+
+// k if `expr` is the constant 2^k with 1 <= k <= 62, 0 otherwise.
+static int64_t power_of_two(const Expression* expr)
+{
+	if (expr->type != EXPRESSION_TYPE_CONSTANT) {
+		return 0;
+	}
+	int64_t value = ((const ConstantExpression*)expr)->number;
+	if (value < 2 || (value & (value - 1)) != 0) {
+		return 0;
+	}
+	return __builtin_ctzll((uint64_t)value);
+}
+
+// Whether `expr` is at most one operator applied to leaves, so evaluating it
+// twice costs less than the idiv a rewrite saves.
+static bool is_cheap(const Expression* expr)
+{
+	switch (expr->type) {
+	case EXPRESSION_TYPE_CONSTANT:
+		return true;
+	case EXPRESSION_TYPE_UNARY_OP:
+		return ((const UnaryOpExpression*)expr)->operand->type == EXPRESSION_TYPE_CONSTANT;
+	case EXPRESSION_TYPE_BINARY_OP: {
+		const BinaryOpExpression* binary = (const BinaryOpExpression*)expr;
+		return binary->left->type == EXPRESSION_TYPE_CONSTANT && binary->right->type == EXPRESSION_TYPE_CONSTANT;
+	}
+	}
+	return false;
+}
+
+// Copies a cheap expression, so the tree stays a tree when a rule needs its
+// operand twice. Only recurses once.
+static Expression* copy_cheap(Arena* nodes, const Expression* expr)
+{
+	switch (expr->type) {
+	case EXPRESSION_TYPE_CONSTANT:
+		return expression_new_constant(nodes, ((const ConstantExpression*)expr)->number);
+	case EXPRESSION_TYPE_UNARY_OP: {
+		const UnaryOpExpression* unary = (const UnaryOpExpression*)expr;
+		return expression_new_unary(nodes, unary->kind, unary->offset, copy_cheap(nodes, unary->operand));
+	}
+	case EXPRESSION_TYPE_BINARY_OP: {
+		const BinaryOpExpression* binary = (const BinaryOpExpression*)expr;
+		Expression* left = copy_cheap(nodes, binary->left);
+		Expression* right = copy_cheap(nodes, binary->right);
+		return expression_new_binary(nodes, binary->kind, binary->offset, left, right);
+	}
+	}
+	return NULL;
+}
+
+static bool is_boolean(const Expression* expr)
+{
+	if (expr->type == EXPRESSION_TYPE_UNARY_OP) {
+		return ((const UnaryOpExpression*)expr)->kind == UNARY_OP_KIND_LOGICAL_NEGATION;
+	}
+	if (expr->type != EXPRESSION_TYPE_BINARY_OP) {
+		return false;
+	}
+	switch (((const BinaryOpExpression*)expr)->kind) {
+	case BINARY_OP_KIND_LOGICAL_OR:
+	case BINARY_OP_KIND_LOGICAL_AND:
+	case BINARY_OP_KIND_EQUALITY:
+	case BINARY_OP_KIND_INEQUALITY:
+	case BINARY_OP_KIND_GREATER:
+	case BINARY_OP_KIND_LESS:
+	case BINARY_OP_KIND_GREATER_EQUAL:
+	case BINARY_OP_KIND_LESS_EQUAL:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static Expression* simplify_add_zero(Arena* nodes, Expression* expr)
+{
+	(void)nodes;
+	BinaryOpExpression* binary = (BinaryOpExpression*)expr;
+	if (is_constant(binary->right, 0)) {
+		return binary->left;
+	}
+	if (is_constant(binary->left, 0)) {
+		return binary->right;
+	}
+	return NULL;
+}
+
+static Expression* simplify_subtract_zero(Arena* nodes, Expression* expr)
+{
+	(void)nodes;
+	BinaryOpExpression* binary = (BinaryOpExpression*)expr;
+	return is_constant(binary->right, 0) ? binary->left : NULL;
+}
+
+static Expression* simplify_multiply_one(Arena* nodes, Expression* expr)
+{
+	(void)nodes;
+	BinaryOpExpression* binary = (BinaryOpExpression*)expr;
+	if (is_constant(binary->right, 1)) {
+		return binary->left;
+	}
+	if (is_constant(binary->left, 1)) {
+		return binary->right;
+	}
+	return NULL;
+}
+
+static Expression* simplify_divide_one(Arena* nodes, Expression* expr)
+{
+	(void)nodes;
+	BinaryOpExpression* binary = (BinaryOpExpression*)expr;
+	return is_constant(binary->right, 1) ? binary->left : NULL;
+}
+
+static Expression* simplify_multiply_power_of_two(Arena* nodes, Expression* expr)
+{
+	BinaryOpExpression* binary = (BinaryOpExpression*)expr;
+	Expression* operand = binary->left;
+	int64_t k = power_of_two(binary->right);
+	if (k == 0) {
+		operand = binary->right;
+		k = power_of_two(binary->left);
+	}
+	if (k == 0) {
+		return NULL;
+	}
+	Expression* shift = expression_new_constant(nodes, k);
+	return expression_new_binary(nodes, BINARY_OP_KIND_BITWISE_SHIFT_LEFT, binary->offset, operand, shift);
+}
+
+// (x >> 63) & (2^k - 1): 2^k - 1 if x is negative, 0 otherwise. Adding it to
+// x before shifting right by k makes the shift round toward zero like idiv.
+static Expression* rounding_bias(Arena* nodes, const BinaryOpExpression* binary, int64_t k)
+{
+	Expression* sign =
+	        expression_new_binary(
+	                nodes,
+	                BINARY_OP_KIND_BITWISE_SHIFT_RIGHT,
+	                binary->offset,
+	                copy_cheap(nodes, binary->left),
+	                expression_new_constant(nodes, 63)
+	        );
+	Expression* mask = expression_new_constant(nodes, ((int64_t)1 << k) - 1);
+	return expression_new_binary(nodes, BINARY_OP_KIND_BITWISE_AND, binary->offset, sign, mask);
+}
+
+static Expression* simplify_divide_power_of_two(Arena* nodes, Expression* expr)
+{
+	BinaryOpExpression* binary = (BinaryOpExpression*)expr;
+	int64_t k = power_of_two(binary->right);
+	if (k == 0 || !is_cheap(binary->left)) {
+		return NULL;
+	}
+	// (x + bias) >> k
+	Expression* bias = rounding_bias(nodes, binary, k);
+	Expression* sum = expression_new_binary(nodes, BINARY_OP_KIND_ADDITION, binary->offset, binary->left, bias);
+	Expression* shift = expression_new_constant(nodes, k);
+	return expression_new_binary(nodes, BINARY_OP_KIND_BITWISE_SHIFT_RIGHT, binary->offset, sum, shift);
+}
+
+static Expression* simplify_modulus_power_of_two(Arena* nodes, Expression* expr)
+{
+	BinaryOpExpression* binary = (BinaryOpExpression*)expr;
+	int64_t k = power_of_two(binary->right);
+	if (k == 0 || !is_cheap(binary->left)) {
+		return NULL;
+	}
+	// x - ((x + bias) & -2^k), which keeps the sign of x like idiv
+	Expression* bias = rounding_bias(nodes, binary, k);
+	Expression* sum =
+	        expression_new_binary(
+	                nodes,
+	                BINARY_OP_KIND_ADDITION,
+	                binary->offset,
+	                copy_cheap(nodes, binary->left),
+	                bias
+	        );
+	Expression* mask = expression_new_constant(nodes, -((int64_t)1 << k));
+	Expression* rounded = expression_new_binary(nodes, BINARY_OP_KIND_BITWISE_AND, binary->offset, sum, mask);
+	return expression_new_binary(nodes, BINARY_OP_KIND_SUBTRACTION, binary->offset, binary->left, rounded);
+}
+
+static Expression* simplify_double_logical_negation(Arena* nodes, Expression* expr)
+{
+	Expression* operand = ((UnaryOpExpression*)expr)->operand;
+	if (operand->type != EXPRESSION_TYPE_UNARY_OP
+	        || ((UnaryOpExpression*)operand)->kind != UNARY_OP_KIND_LOGICAL_NEGATION) {
+		return NULL;
+	}
+	Expression* inner = ((UnaryOpExpression*)operand)->operand;
+	if (is_boolean(inner)) {
+		return inner;
+	}
+	// unary operators don't record their offset, and only folding reports
+	// diagnostics anyway
+	Expression* zero = expression_new_constant(nodes, 0);
+	return expression_new_binary(nodes, BINARY_OP_KIND_INEQUALITY, 0, inner, zero);
+}
+
+static Expression* simplify_double_negation(Expression* expr, UnaryOpKind kind)
+{
+	Expression* operand = ((UnaryOpExpression*)expr)->operand;
+	if (operand->type != EXPRESSION_TYPE_UNARY_OP || ((UnaryOpExpression*)operand)->kind != kind) {
+		return NULL;
+	}
+	return ((UnaryOpExpression*)operand)->operand;
+}
+
+static Expression* simplify_double_bitwise_negation(Arena* nodes, Expression* expr)
+{
+	(void)nodes;
+	return simplify_double_negation(expr, UNARY_OP_KIND_BITWISE_NEGATION);
+}
+
+static Expression* simplify_double_arithmetic_negation(Arena* nodes, Expression* expr)
+{
+	(void)nodes;
+	// negation wraps, so this holds for INT64_MIN too
+	return simplify_double_negation(expr, UNARY_OP_KIND_ARITHMETIC_NEGATION);
+}
+
+static const RewriteRule RULES[] = {
+#define X(name, func, type, op, description) { type, op, func },
+#include "dragon/simplify_rules.def"
+#undef X
+};
+
+static const char* const RULE_DESCRIPTIONS[] = {
+#define X(name, func, type, op, description) description,
+#include "dragon/simplify_rules.def"
+#undef X
+};
+
+SimplifyStats simplify_program(Program* program)
+{
+	SimplifyStats stats = {0};
+	rewrite_expression(
+	        &program->function.statement.expression,
+	        &program->nodes,
+	        RULES,
+	        SIMPLIFY_RULE_COUNT,
+	        stats.hits
+	);
+	return stats;
+}
+
+const char* simplify_rule_description(SimplifyRule rule)
+{
+	return RULE_DESCRIPTIONS[rule];
+}
@@ -0,0 +1,429 @@
+#include "dragon/ssa.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "dragon/cfg.h"
+#include "dragon/core/buf.h"
+
+#define UNMARKED UINT32_MAX
+
+typedef BUF(IrBlockIdBuf) FrontierBuf;
+typedef BUF(IrValue) IrValueBuf;
+typedef BUF(IrValueBuf) PhiVarBuf;
+typedef BUF(IrOperandBuf) DefStackBuf;
+typedef BUF(uint32_t) MarkBuf;
+
+static void fill_marks(MarkBuf* marks, uint64_t len)
+{
+	BUF_RESERVE(marks, len);
+	marks->len = len;
+	for (uint64_t i = 0; i < len; i++) {
+		marks->ptr[i] = UNMARKED;
+	}
+}
+
+// The dominance frontier of each block: the blocks where its dominance ends,
+// which is where a value assigned in it meets other assignments.
+static FrontierBuf dominance_frontiers(const IrFunction* func, const IrDominatorTree* tree)
+{
+	FrontierBuf frontiers = BUF_NEW;
+	for (uint64_t i = 0; i < func->blocks.len; i++) {
+		BUF_PUSH(&frontiers, ((IrBlockIdBuf)BUF_NEW));
+	}
+	for (IrBlockId block = 0; block < func->blocks.len; block++) {
+		const IrBlockIdBuf* preds = &func->blocks.ptr[block].preds;
+		if (preds->len < 2) {
+			continue;
+		}
+		for (uint64_t i = 0; i < preds->len; i++) {
+			IrBlockId runner = preds->ptr[i];
+			while (runner != tree->idom.ptr[block]) {
+				IrBlockIdBuf* frontier = &frontiers.ptr[runner];
+				// blocks are only added while visiting their own predecessors
+				if (frontier->len == 0 || frontier->ptr[frontier->len - 1] != block) {
+					BUF_PUSH(frontier, block);
+				}
+				runner = tree->idom.ptr[runner];
+			}
+		}
+	}
+	return frontiers;
+}
+
+// Inserts phis for the values that are live across blocks, at the iterated
+// dominance frontier of the blocks assigning them. This is Briggs et al.'s
+// semi-pruned form: values only used in the block assigning them never need
+// a phi. Each phi's value before renaming goes into `phiVars`.
+static void insert_phis(IrFunction* func, const FrontierBuf* frontiers, PhiVarBuf* phiVars)
+{
+	uint32_t valueCount = func->valueCount;
+	uint64_t blockCount = func->blocks.len;
+	// for each value, the blocks assigning it
+	FrontierBuf defBlocks = BUF_NEW;
+	for (uint32_t i = 0; i < valueCount; i++) {
+		BUF_PUSH(&defBlocks, ((IrBlockIdBuf)BUF_NEW));
+	}
+	// the values read in a block before being assigned there are marked 0
+	MarkBuf isGlobal = BUF_NEW;
+	fill_marks(&isGlobal, valueCount);
+	// the last block that assigned each value
+	MarkBuf assignedIn = BUF_NEW;
+	fill_marks(&assignedIn, valueCount);
+	for (IrBlockId block = 0; block < blockCount; block++) {
+		const IrInstructionBuf* insns = &func->blocks.ptr[block].instructions;
+		for (uint64_t i = 0; i < insns->len; i++) {
+			const IrInstruction* insn = &insns->ptr[i];
+			for (uint64_t j = 0; j < 2; j++) {
+				IrOperand arg = insn->args[j];
+				if (arg.kind == IR_OPERAND_VALUE && assignedIn.ptr[arg.value] != block) {
+					isGlobal.ptr[arg.value] = 0;
+				}
+			}
+			if (insn->dst != IR_VALUE_NONE && assignedIn.ptr[insn->dst] != block) {
+				assignedIn.ptr[insn->dst] = block;
+				BUF_PUSH(&defBlocks.ptr[insn->dst], block);
+			}
+		}
+	}
+
+	MarkBuf hasPhi = BUF_NEW;
+	fill_marks(&hasPhi, blockCount);
+	MarkBuf queued = BUF_NEW;
+	fill_marks(&queued, blockCount);
+	IrBlockIdBuf worklist = BUF_NEW;
+	for (IrValue value = 0; value < valueCount; value++) {
+		if (isGlobal.ptr[value] == UNMARKED) {
+			continue;
+		}
+		const IrBlockIdBuf* defs = &defBlocks.ptr[value];
+		for (uint64_t i = 0; i < defs->len; i++) {
+			queued.ptr[defs->ptr[i]] = value;
+			BUF_PUSH(&worklist, defs->ptr[i]);
+		}
+		while (worklist.len > 0) {
+			IrBlockId block = worklist.ptr[--worklist.len];
+			const IrBlockIdBuf* frontier = &frontiers->ptr[block];
+			for (uint64_t i = 0; i < frontier->len; i++) {
+				IrBlockId join = frontier->ptr[i];
+				if (hasPhi.ptr[join] == value) {
+					continue;
+				}
+				hasPhi.ptr[join] = value;
+				IrBlock* target = &func->blocks.ptr[join];
+				IrPhi phi = { .dst = IR_VALUE_NONE, .args = BUF_NEW };
+				BUF_RESERVE(&phi.args, target->preds.len);
+				phi.args.len = target->preds.len;
+				BUF_PUSH(&target->phis, phi);
+				BUF_PUSH(&phiVars->ptr[join], value);
+				// the phi assigns the value too
+				if (queued.ptr[join] != value) {
+					queued.ptr[join] = value;
+					BUF_PUSH(&worklist, join);
+				}
+			}
+		}
+	}
+
+	BUF_FREE(worklist);
+	BUF_FREE(queued);
+	BUF_FREE(hasPhi);
+	BUF_FREE(assignedIn);
+	BUF_FREE(isGlobal);
+	for (uint32_t i = 0; i < valueCount; i++) {
+		BUF_FREE(defBlocks.ptr[i]);
+	}
+	BUF_FREE(defBlocks);
+}
+
+typedef struct {
+	IrFunction* func;
+	const PhiVarBuf* phiVars;
+	// the operand each original value currently stands for
+	DefStackBuf stacks;
+	// the values pushed onto `stacks`, so they can be popped on the way out
+	IrValueBuf pushed;
+	IrValue nextValue;
+} Renamer;
+
+static void define(Renamer* renamer, IrValue var, IrOperand operand)
+{
+	BUF_PUSH(&renamer->stacks.ptr[var], operand);
+	BUF_PUSH(&renamer->pushed, var);
+}
+
+static IrOperand current(const Renamer* renamer, IrOperand operand)
+{
+	if (operand.kind != IR_OPERAND_VALUE) {
+		return operand;
+	}
+	const IrOperandBuf* stack = &renamer->stacks.ptr[operand.value];
+	if (stack->len == 0) {
+		return ir_constant(0);
+	}
+	return stack->ptr[stack->len - 1];
+}
+
+static void rename_block(Renamer* renamer, IrBlockId id)
+{
+	IrFunction* func = renamer->func;
+	IrBlock* block = &func->blocks.ptr[id];
+	const IrValueBuf* vars = &renamer->phiVars->ptr[id];
+	for (uint64_t i = 0; i < block->phis.len; i++) {
+		IrValue dst = renamer->nextValue++;
+		block->phis.ptr[i].dst = dst;
+		define(renamer, vars->ptr[i], ir_value(dst));
+	}
+	uint64_t kept = 0;
+	for (uint64_t i = 0; i < block->instructions.len; i++) {
+		IrInstruction insn = block->instructions.ptr[i];
+		for (uint64_t j = 0; j < 2; j++) {
+			insn.args[j] = current(renamer, insn.args[j]);
+		}
+		if (insn.opcode == IR_OP_COPY) {
+			define(renamer, insn.dst, insn.args[0]);
+			continue;
+		}
+		if (insn.dst != IR_VALUE_NONE) {
+			IrValue dst = renamer->nextValue++;
+			define(renamer, insn.dst, ir_value(dst));
+			insn.dst = dst;
+		}
+		block->instructions.ptr[kept++] = insn;
+	}
+	block->instructions.len = kept;
+
+	IrBlockId succs[2];
+	uint32_t count = ir_successors(block, succs);
+	for (uint32_t i = 0; i < count; i++) {
+		IrBlock* succ = &func->blocks.ptr[succs[i]];
+		const IrValueBuf* succVars = &renamer->phiVars->ptr[succs[i]];
+		for (uint64_t j = 0; j < succ->preds.len; j++) {
+			if (succ->preds.ptr[j] != id) {
+				continue;
+			}
+			for (uint64_t k = 0; k < succ->phis.len; k++) {
+				succ->phis.ptr[k].args.ptr[j] = current(renamer, ir_value(succVars->ptr[k]));
+			}
+		}
+	}
+}
+
+typedef struct {
+	IrBlockId block;
+	uint32_t nextChild;
+	uint64_t pushed;
+} RenameFrame;
+
+typedef BUF(RenameFrame) RenameFrameBuf;
+
+void ssa_construct(IrFunction* func)
+{
+	ir_compute_predecessors(func);
+	(void)ir_remove_unreachable_blocks(func);
+	IrDominatorTree tree = ir_dominator_tree_new(func);
+	FrontierBuf frontiers = dominance_frontiers(func, &tree);
+	PhiVarBuf phiVars = BUF_NEW;
+	for (uint64_t i = 0; i < func->blocks.len; i++) {
+		BUF_PUSH(&phiVars, ((IrValueBuf)BUF_NEW));
+	}
+	insert_phis(func, &frontiers, &phiVars);
+
+	// Walk the dominator tree, so every use is renamed after the
+	// assignments that reach it.
+	Renamer renamer = {
+		.func = func,
+		.phiVars = &phiVars,
+		.stacks = BUF_NEW,
+		.pushed = BUF_NEW,
+		.nextValue = 0,
+	};
+	for (uint32_t i = 0; i < func->valueCount; i++) {
+		BUF_PUSH(&renamer.stacks, ((IrOperandBuf)BUF_NEW));
+	}
+	RenameFrameBuf frames = BUF_NEW;
+	BUF_PUSH(&frames, ((RenameFrame) { .block = 0, .nextChild = 0, .pushed = 0 }));
+	rename_block(&renamer, 0);
+	while (frames.len > 0) {
+		RenameFrame* frame = &frames.ptr[frames.len - 1];
+		uint32_t child = tree.childStart.ptr[frame->block] + frame->nextChild;
+		if (child == tree.childStart.ptr[frame->block + 1]) {
+			while (renamer.pushed.len > frame->pushed) {
+				renamer.stacks.ptr[renamer.pushed.ptr[--renamer.pushed.len]].len--;
+			}
+			frames.len--;
+			continue;
+		}
+		frame->nextChild++;
+		IrBlockId block = tree.children.ptr[child];
+		BUF_PUSH(&frames, ((RenameFrame) { .block = block, .nextChild = 0, .pushed = renamer.pushed.len }));
+		rename_block(&renamer, block);
+	}
+	func->valueCount = renamer.nextValue;
+
+	BUF_FREE(frames);
+	for (uint64_t i = 0; i < renamer.stacks.len; i++) {
+		BUF_FREE(renamer.stacks.ptr[i]);
+	}
+	BUF_FREE(renamer.stacks);
+	BUF_FREE(renamer.pushed);
+	for (uint64_t i = 0; i < phiVars.len; i++) {
+		BUF_FREE(phiVars.ptr[i]);
+	}
+	BUF_FREE(phiVars);
+	for (uint64_t i = 0; i < frontiers.len; i++) {
+		BUF_FREE(frontiers.ptr[i]);
+	}
+	BUF_FREE(frontiers);
+	ir_dominator_tree_free(tree);
+}
+
+typedef struct {
+	IrValue dst;
+	IrOperand src;
+} Copy;
+
+typedef BUF(Copy) CopyBuf;
+
+static bool is_source(const CopyBuf* copies, IrValue value)
+{
+	for (uint64_t i = 0; i < copies->len; i++) {
+		IrOperand src = copies->ptr[i].src;
+		if (src.kind == IR_OPERAND_VALUE && src.value == value) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// Orders copies that all happen at once, like the phis of a block, so none
+// overwrites a value another still has to read. Cycles are broken with a
+// new value.
+static void sequentialize(IrFunction* func, CopyBuf* copies, IrInstructionBuf* out)
+{
+	while (copies->len > 0) {
+		bool emitted = false;
+		for (uint64_t i = 0; i < copies->len; i++) {
+			Copy copy = copies->ptr[i];
+			if (is_source(copies, copy.dst)) {
+				continue;
+			}
+			if (copy.src.kind != IR_OPERAND_VALUE || copy.src.value != copy.dst) {
+				BUF_PUSH(out, ((IrInstruction) {
+					.opcode = IR_OP_COPY,
+					.dst = copy.dst,
+					.args = { copy.src },
+				}));
+			}
+			copies->ptr[i] = copies->ptr[--copies->len];
+			emitted = true;
+			break;
+		}
+		if (emitted) {
+			continue;
+		}
+		// every destination is still read, so save one of them first
+		IrValue saved = copies->ptr[0].dst;
+		IrValue temp = func->valueCount++;
+		BUF_PUSH(out, ((IrInstruction) {
+			.opcode = IR_OP_COPY,
+			.dst = temp,
+			.args = { ir_value(saved) },
+		}));
+		for (uint64_t i = 0; i < copies->len; i++) {
+			IrOperand* src = &copies->ptr[i].src;
+			if (src->kind == IR_OPERAND_VALUE && src->value == saved) {
+				*src = ir_value(temp);
+			}
+		}
+	}
+}
+
+// Copies from the phis of `block` for its `index`th predecessor.
+static void phi_copies(const IrBlock* block, uint64_t index, CopyBuf* copies)
+{
+	copies->len = 0;
+	for (uint64_t i = 0; i < block->phis.len; i++) {
+		const IrPhi* phi = &block->phis.ptr[i];
+		BUF_PUSH(copies, ((Copy) { .dst = phi->dst, .src = phi->args.ptr[index] }));
+	}
+}
+
+void ssa_destruct(IrFunction* func)
+{
+	// Split the edges from blocks with two successors to blocks with phis,
+	// placing each new block after its predecessor.
+	uint64_t originalLen = func->blocks.len;
+	IrBlockIdBuf order = BUF_NEW;
+	for (IrBlockId id = 0; id < originalLen; id++) {
+		BUF_PUSH(&order, id);
+		IrBlockId succs[2];
+		uint32_t count = ir_successors(&func->blocks.ptr[id], succs);
+		for (uint32_t i = 0; count == 2 && i < count; i++) {
+			IrBlock* succ = &func->blocks.ptr[succs[i]];
+			if (succ->phis.len == 0 || succ->preds.len < 2) {
+				continue;
+			}
+			IrBlockId split = (IrBlockId)func->blocks.len;
+			// a branch to the same block twice has an edge for each target
+			for (uint64_t j = 0; j < succ->preds.len; j++) {
+				if (succ->preds.ptr[j] == id) {
+					succ->preds.ptr[j] = split;
+					break;
+				}
+			}
+			IrBlock block = { .phis = BUF_NEW, .instructions = BUF_NEW, .preds = BUF_NEW };
+			BUF_PUSH(&block.preds, id);
+			BUF_PUSH(&block.instructions, ((IrInstruction) {
+				.opcode = IR_OP_JUMP,
+				.dst = IR_VALUE_NONE,
+				.targets = { succs[i] },
+			}));
+			IrInstruction* branch = &func->blocks.ptr[id].instructions.ptr[func->blocks.ptr[id].instructions.len - 1];
+			branch->targets[i] = split;
+			BUF_PUSH(&func->blocks, block);
+			BUF_PUSH(&order, split);
+		}
+	}
+
+	CopyBuf copies = BUF_NEW;
+	IrInstructionBuf sequence = BUF_NEW;
+	for (IrBlockId id = 0; id < func->blocks.len; id++) {
+		IrBlock* block = &func->blocks.ptr[id];
+		if (block->phis.len == 0) {
+			continue;
+		}
+		if (block->preds.len == 1) {
+			// the copies go at the start of the block itself
+			phi_copies(block, 0, &copies);
+			sequence.len = 0;
+			sequentialize(func, &copies, &sequence);
+			for (uint64_t i = 0; i < block->instructions.len; i++) {
+				BUF_PUSH(&sequence, block->instructions.ptr[i]);
+			}
+			block->instructions.len = 0;
+			for (uint64_t i = 0; i < sequence.len; i++) {
+				BUF_PUSH(&block->instructions, sequence.ptr[i]);
+			}
+		} else {
+			for (uint64_t i = 0; i < block->preds.len; i++) {
+				phi_copies(block, i, &copies);
+				IrInstructionBuf* insns = &func->blocks.ptr[block->preds.ptr[i]].instructions;
+				IrInstruction jump = insns->ptr[--insns->len];
+				sequentialize(func, &copies, insns);
+				BUF_PUSH(insns, jump);
+			}
+		}
+		for (uint64_t i = 0; i < block->phis.len; i++) {
+			BUF_FREE(block->phis.ptr[i].args);
+		}
+		block->phis.len = 0;
+	}
+	BUF_FREE(sequence);
+	BUF_FREE(copies);
+
+	if (func->blocks.len > originalLen) {
+		ir_reorder_blocks(func, &order);
+	}
+	BUF_FREE(order);
+}
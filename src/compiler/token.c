@@ -12,7 +12,6 @@ void token_free(Token tok)
 	if (tok.value.kind == TK_STR) {
 		str_free(tok.value.get.str);
 	}
-	str_free(tok.location.filename);
 }
 
 void token_value_show(TokenValue val, FILE* fp)
@@ -27,5 +26,8 @@ void token_value_show(TokenValue val, FILE* fp)
 	case TK_NUM:
 		(void)fprintf(fp, "num(%" PRId64 ")", val.get.num);
 		break;
+	case TK_SYM:
+		(void)fprintf(fp, "sym(%" PRIu32 ")", val.get.sym);
+		break;
 	}
 }
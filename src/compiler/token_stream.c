@@ -0,0 +1,114 @@
+#include "dragon/token_stream.h"
+
+#include <assert.h>
+
+#include "dragon/lexer.h"
+
+_Static_assert(TOKEN_TYPE_COUNT <= UINT8_MAX + 1, "token types must fit in a byte");
+
+static void push_token(TokenStream* stream, TokenType type, uint32_t offset, uint32_t length)
+{
+	BUF_PUSH(&stream->kinds, (uint8_t)type);
+	BUF_PUSH(&stream->offsets, offset);
+	BUF_PUSH(&stream->lengths, length);
+}
+
+TokenStream token_stream_new(str source, str filename, Interner* interner)
+{
+	TokenStream stream = {
+		.file = source_file_new(filename, source),
+		.kinds = BUF_NEW,
+		.offsets = BUF_NEW,
+		.lengths = BUF_NEW,
+		.literals = BUF_NEW,
+	};
+
+	if (str_len(source) >= TOKEN_STREAM_MAX_SOURCE) {
+		push_token(&stream, TT_ERROR, 0, 0);
+		push_token(&stream, TT_EOF, 0, 0);
+		return stream;
+	}
+
+	Lexer lexer = lexer_new(source, interner);
+	Token tok = lexer_first(&lexer);
+	while (true) {
+		uint32_t index = token_stream_len(&stream);
+		push_token(
+		        &stream,
+		        tok.type,
+		        tok.offset,
+		        (uint32_t)str_len(tok.text)
+		);
+		if (tok.value.kind == TK_NUM) {
+			TokenLiteral literal = { .token = index, .value = tok.value.get.num };
+			BUF_PUSH(&stream.literals, literal);
+		} else if (tok.value.kind == TK_SYM) {
+			TokenLiteral literal = { .token = index, .value = tok.value.get.sym };
+			BUF_PUSH(&stream.literals, literal);
+		}
+		if (tok.type == TT_EOF) {
+			break;
+		}
+		tok = lexer_next(&lexer);
+	}
+
+	return stream;
+}
+
+void token_stream_free(TokenStream stream)
+{
+	source_file_free(stream.file);
+	BUF_FREE(stream.kinds);
+	BUF_FREE(stream.offsets);
+	BUF_FREE(stream.lengths);
+	BUF_FREE(stream.literals);
+}
+
+str token_stream_text(const TokenStream* stream, uint32_t index)
+{
+	return str_ref_chars(
+	               stream->file.text.ptr + stream->offsets.ptr[index],
+	               stream->lengths.ptr[index]
+	       );
+}
+
+static int64_t token_stream_literal(const TokenStream* stream, uint32_t index)
+{
+	uint64_t lo = 0;
+	uint64_t hi = stream->literals.len;
+	while (lo < hi) {
+		uint64_t mid = lo + (hi - lo) / 2;
+		if (stream->literals.ptr[mid].token < index) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	assert(lo < stream->literals.len && stream->literals.ptr[lo].token == index);
+	return stream->literals.ptr[lo].value;
+}
+
+int64_t token_stream_num(const TokenStream* stream, uint32_t index)
+{
+	assert(token_stream_kind(stream, index) == TT_NUM);
+	return token_stream_literal(stream, index);
+}
+
+SymbolId token_stream_sym(const TokenStream* stream, uint32_t index)
+{
+	assert(token_stream_kind(stream, index) == TT_IDENT);
+	return (SymbolId)token_stream_literal(stream, index);
+}
+
+SourceLocation token_stream_location(TokenStream* stream, uint32_t index)
+{
+	return source_file_location(&stream->file, stream->offsets.ptr[index]);
+}
+
+uint64_t token_stream_bytes(const TokenStream* stream)
+{
+	return stream->kinds.len * sizeof(*stream->kinds.ptr)
+	       + stream->offsets.len * sizeof(*stream->offsets.ptr)
+	       + stream->lengths.len * sizeof(*stream->lengths.ptr)
+	       + stream->literals.len * sizeof(*stream->literals.ptr);
+}
@@ -0,0 +1,92 @@
+#include "dragon/core/arena.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct ArenaBlock {
+	ArenaBlock* next;
+	uint64_t size;
+	alignas(max_align_t) char data[];
+};
+
+static bool arena_add_block(Arena* arena, uint64_t minSize)
+{
+	uint64_t size = arena->blockSize;
+	if (size < minSize) {
+		size = minSize;
+	}
+	ArenaBlock* block = malloc(sizeof(ArenaBlock) + size);
+	if (block == NULL) {
+		return false;
+	}
+	block->next = arena->blocks;
+	block->size = size;
+	arena->blocks = block;
+	arena->cur = block->data;
+	arena->end = block->data + size;
+	return true;
+}
+
+Arena arena_new(uint64_t blockSize)
+{
+	Arena arena = {
+		.blocks = NULL,
+		.cur = NULL,
+		.end = NULL,
+		.blockSize = blockSize,
+	};
+	(void)arena_add_block(&arena, blockSize);
+	return arena;
+}
+
+void* arena_alloc(Arena* arena, uint64_t size, uint64_t align)
+{
+	assert(align != 0 && (align & (align - 1)) == 0);
+	uintptr_t cur = (uintptr_t)arena->cur;
+	uintptr_t aligned = (cur + align - 1) & ~(uintptr_t)(align - 1);
+	if (arena->cur == NULL || aligned + size > (uintptr_t)arena->end) {
+		if (!arena_add_block(arena, size + align)) {
+			return NULL;
+		}
+		cur = (uintptr_t)arena->cur;
+		aligned = (cur + align - 1) & ~(uintptr_t)(align - 1);
+	}
+	arena->cur = (char*)(aligned + size);
+	return (void*)aligned;
+}
+
+str arena_str_copy(Arena* arena, str s)
+{
+	if (str_is_empty(s)) {
+		return str_empty;
+	}
+	char* ptr = arena_alloc(arena, str_len(s) + 1, 1);
+	if (ptr == NULL) {
+		return str_empty;
+	}
+	memcpy(ptr, s.ptr, str_len(s));
+	ptr[str_len(s)] = '\0';
+	return str_ref_chars(ptr, str_len(s));
+}
+
+uint64_t arena_bytes(const Arena* arena)
+{
+	uint64_t total = 0;
+	for (ArenaBlock* block = arena->blocks; block != NULL; block = block->next) {
+		total += block->size;
+	}
+	return total;
+}
+
+void arena_free(Arena arena)
+{
+	ArenaBlock* block = arena.blocks;
+	while (block != NULL) {
+		ArenaBlock* next = block->next;
+		free(block);
+		block = next;
+	}
+}
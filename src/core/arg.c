@@ -146,7 +146,8 @@ static ParseResult parse_positional(
 
 static ParseResult parse_arg(ArgParser* parser, str arg, ArgInfo info, PositionalInfo* positionals)
 {
-	if (arg.ptr[0] == '-') {
+	// a lone "-" conventionally names stdin
+	if (arg.ptr[0] == '-' && str_len(arg) > 1) {
 		if (arg.ptr[1] == '-') {
 			arg = str_ref_chars(arg.ptr + 2, str_len(arg) - 2);
 			return parse_single_longopt(parser, arg, info);
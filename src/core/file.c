@@ -1,12 +1,15 @@
 #include "dragon/core/file.h"
 
-#include <stdlib.h>
 #include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
 
 #ifdef _WIN32
 #include <windows.h>
 #else
+#include <errno.h>
 #include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #endif
@@ -18,6 +21,7 @@ typedef struct {
 	int fd;
 #endif
 	bool valid;
+	bool owned;
 } PlatformFile;
 
 static PlatformFile platform_fopen(str path)
@@ -32,19 +36,34 @@ static PlatformFile platform_fopen(str path)
 	                        FILE_ATTRIBUTE_NORMAL,
 	                        NULL
 	                );
-	return (platform_file) {
+	return (PlatformFile) {
 		.handle = handle,
 		.valid = handle != INVALID_HANDLE_VALUE,
+		.owned = true,
 	};
 #else
 	int fd = open(path.ptr, O_RDONLY);
-	return (PlatformFile) {.fd = fd, .valid = fd != -1};
+	return (PlatformFile) {.fd = fd, .valid = fd != -1, .owned = true};
+#endif
+}
+
+static PlatformFile platform_stdin(void)
+{
+#ifdef _WIN32
+	HANDLE handle = GetStdHandle(STD_INPUT_HANDLE);
+	return (PlatformFile) {
+		.handle = handle,
+		.valid = handle != INVALID_HANDLE_VALUE,
+		.owned = false,
+	};
+#else
+	return (PlatformFile) {.fd = STDIN_FILENO, .valid = true, .owned = false};
 #endif
 }
 
 static void platform_fclose(PlatformFile file)
 {
-	if (file.valid) {
+	if (file.valid && file.owned) {
 #ifdef _WIN32
 		CloseHandle(file.handle);
 #else
@@ -53,30 +72,94 @@ static void platform_fclose(PlatformFile file)
 	}
 }
 
-static size_t platform_filelen(PlatformFile f)
+typedef MAYBE(size_t) MaybeFileLen;
+
+// Only regular files have a meaningful length.
+static MaybeFileLen platform_filelen(PlatformFile f)
 {
 #ifdef _WIN32
 	LARGE_INTEGER size;
-	GetFileSizeEx(f.handle, &size);
-	return (size_t)size.QuadPart;
+	if (GetFileType(f.handle) != FILE_TYPE_DISK || !GetFileSizeEx(f.handle, &size)) {
+		return (MaybeFileLen)NOTHING;
+	}
+	return (MaybeFileLen)JUST((size_t)size.QuadPart);
 #else
 	struct stat st;
-	fstat(f.fd, &st);
-	return (size_t)st.st_size;
+	if (fstat(f.fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+		return (MaybeFileLen)NOTHING;
+	}
+	return (MaybeFileLen)JUST((size_t)st.st_size);
 #endif
 }
 
-static size_t platform_fread(PlatformFile f, char* buf, size_t len)
+// Returns the number of bytes read, 0 at end of file or -1 on error.
+static int64_t platform_fread(PlatformFile f, char* buf, size_t len)
 {
 #ifdef _WIN32
 	DWORD read;
-	ReadFile(f.handle, buf, (DWORD)len, &read, NULL);
-	return (size_t)read;
+	if (!ReadFile(f.handle, buf, (DWORD)len, &read, NULL)) {
+		return -1;
+	}
+	return (int64_t)read;
 #else
-	return (size_t)read(f.fd, buf, len);
+	while (true) {
+		ssize_t n = read(f.fd, buf, len);
+		if (n >= 0 || errno != EINTR) {
+			return (int64_t)n;
+		}
+	}
 #endif
 }
 
+static const char EMPTY_PADDED[FILE_PADDING] = {0};
+
+typedef MAYBE(str) ReadAllResult;
+
+// Reads until end of file, which handles short reads and files of unknown
+// length. The result is followed by FILE_PADDING zero bytes.
+static ReadAllResult read_all(PlatformFile f, size_t sizeHint)
+{
+	// room for a byte more than the hint, so a file of exactly that size hits
+	// end of file without growing the buffer
+	size_t cap = sizeHint + 1 + FILE_PADDING;
+	size_t len = 0;
+	char* buf = malloc(cap);
+	if (buf == NULL) {
+		return (ReadAllResult)NOTHING;
+	}
+
+	while (true) {
+		if (cap - len <= FILE_PADDING) {
+			cap *= 2;
+			char* newBuf = realloc(buf, cap);
+			if (newBuf == NULL) {
+				free(buf);
+				return (ReadAllResult)NOTHING;
+			}
+			buf = newBuf;
+		}
+		int64_t n = platform_fread(f, buf + len, cap - len - FILE_PADDING);
+		if (n < 0) {
+			free(buf);
+			return (ReadAllResult)NOTHING;
+		}
+		if (n == 0) {
+			break;
+		}
+		len += (size_t)n;
+	}
+
+	memset(buf + len, 0, FILE_PADDING);
+	if (len == 0) {
+		// str_acquire would free the buffer, and with it the padding
+		free(buf);
+		return (ReadAllResult)JUST(((str) {
+			.ptr = EMPTY_PADDED, .info = z_str_ref_info(0)
+		}));
+	}
+	return (ReadAllResult)JUST(str_acquire(buf, len));
+}
+
 SlurpFileResult slurp_file(str filename)
 {
 	PlatformFile f = platform_fopen(filename);
@@ -89,34 +172,99 @@ SlurpFileResult slurp_file(str filename)
 		return (SlurpFileResult)ERR(msg);
 	}
 
-	size_t len = platform_filelen(f);
-
-	char* buf = malloc(len + 1);
-	if (buf == NULL) {
-		platform_fclose(f);
+	MaybeFileLen len = platform_filelen(f);
+	ReadAllResult contents = read_all(f, len.present ? len.value : 0);
+	platform_fclose(f);
+	if (!contents.present) {
 		str msg =
 		        str_fmt(
-		                "failed to allocate memory for '" STR_FMT "' contents",
+		                "failed to read '" STR_FMT "' contents",
 		                STR_ARG(filename)
 		        );
 		return (SlurpFileResult)ERR(msg);
 	}
 
-	size_t read = platform_fread(f, buf, len);
-	if (read != len) {
-		platform_fclose(f);
-		free(buf);
+	return (SlurpFileResult)OK(contents.value);
+}
+
+#ifndef _WIN32
+static void* map_padded(PlatformFile f, size_t len, size_t* mappingLen)
+{
+	size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+	size_t total = (len + FILE_PADDING + pageSize - 1) / pageSize * pageSize;
+
+	// Reserve zeroed memory for the whole range, then map the file over the
+	// start of it. The tail of the file's last page reads as zeros, and any
+	// pages past that are still the zeroed reservation.
+	void* base = mmap(NULL, total, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (base == MAP_FAILED) {
+		return NULL;
+	}
+	void* mapped = mmap(base, len, PROT_READ, MAP_PRIVATE | MAP_FIXED, f.fd, 0);
+	if (mapped == MAP_FAILED) {
+		munmap(base, total);
+		return NULL;
+	}
+
+	*mappingLen = total;
+	return base;
+}
+#endif
+
+MapFileResult map_file(str filename)
+{
+	bool isStdin = str_eq(filename, str_lit("-"));
+	PlatformFile f = isStdin ? platform_stdin() : platform_fopen(filename);
+	if (!f.valid) {
 		str msg =
 		        str_fmt(
-		                "failed to read '" STR_FMT "' contents",
+		                "failed to open '" STR_FMT "' for reading",
 		                STR_ARG(filename)
 		        );
-		return (SlurpFileResult)ERR(msg);
+		return (MapFileResult)ERR(msg);
 	}
 
-	buf[len] = '\0';
+	MaybeFileLen len = platform_filelen(f);
+#ifndef _WIN32
+	if (len.present && len.value > 0) {
+		size_t mappingLen;
+		void* mapping = map_padded(f, len.value, &mappingLen);
+		if (mapping != NULL) {
+			platform_fclose(f);
+			return (MapFileResult)OK(((MappedFile) {
+				.contents = str_ref_chars(mapping, len.value),
+				.mapping = mapping,
+				.mappingLen = mappingLen,
+			}));
+		}
+	}
+#endif
 
+	ReadAllResult contents = read_all(f, len.present ? len.value : 0);
 	platform_fclose(f);
+	if (!contents.present) {
+		str msg =
+		        str_fmt(
+		                "failed to read '" STR_FMT "' contents",
+		                STR_ARG(filename)
+		        );
+		return (MapFileResult)ERR(msg);
+	}
+
+	return (MapFileResult)OK(((MappedFile) {
+		.contents = contents.value,
+		.mapping = NULL,
+		.mappingLen = 0,
+	}));
+}
 
-	return (SlurpFileResult)OK(str_acquire(buf, len));
+void mapped_file_free(MappedFile file)
+{
+#ifndef _WIN32
+	if (file.mapping != NULL) {
+		munmap(file.mapping, file.mappingLen);
+		return;
+	}
+#endif
+	str_free(file.contents);
 }
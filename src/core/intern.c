@@ -0,0 +1,85 @@
+#include "dragon/core/intern.h"
+
+#include <stdlib.h>
+
+#define INTERNER_INITIAL_SLOTS 256
+#define INTERNER_ARENA_BLOCK 4096
+
+static uint32_t hash_str(str s)
+{
+	// FNV-1a
+	uint32_t hash = 2166136261U;
+	for (uint64_t i = 0; i < str_len(s); i++) {
+		hash ^= (uint8_t)s.ptr[i];
+		hash *= 16777619U;
+	}
+	return hash;
+}
+
+Interner interner_new(void)
+{
+	Interner interner = {
+		.text = arena_new(INTERNER_ARENA_BLOCK),
+		.symbols = BUF_NEW,
+		.hashes = BUF_NEW,
+		.slots = calloc(INTERNER_INITIAL_SLOTS, sizeof(uint32_t)),
+		.slotCount = INTERNER_INITIAL_SLOTS,
+	};
+	// the table is kept at most half full
+	BUF_RESERVE(&interner.symbols, INTERNER_INITIAL_SLOTS / 2);
+	BUF_RESERVE(&interner.hashes, INTERNER_INITIAL_SLOTS / 2);
+	return interner;
+}
+
+static void interner_grow(Interner* interner)
+{
+	uint64_t slotCount = interner->slotCount * 2;
+	uint32_t* slots = calloc(slotCount, sizeof(uint32_t));
+	uint64_t mask = slotCount - 1;
+	for (uint64_t id = 0; id < interner->symbols.len; id++) {
+		uint64_t i = interner->hashes.ptr[id] & mask;
+		while (slots[i] != 0) {
+			i = (i + 1) & mask;
+		}
+		slots[i] = (uint32_t)id + 1;
+	}
+	free(interner->slots);
+	interner->slots = slots;
+	interner->slotCount = slotCount;
+}
+
+SymbolId interner_intern(Interner* interner, str text)
+{
+	uint32_t hash = hash_str(text);
+	uint64_t mask = interner->slotCount - 1;
+	uint64_t i = hash & mask;
+	while (interner->slots[i] != 0) {
+		SymbolId id = interner->slots[i] - 1;
+		if (interner->hashes.ptr[id] == hash && str_eq(interner->symbols.ptr[id], text)) {
+			return id;
+		}
+		i = (i + 1) & mask;
+	}
+
+	SymbolId id = (SymbolId)interner->symbols.len;
+	BUF_PUSH(&interner->symbols, arena_str_copy(&interner->text, text));
+	BUF_PUSH(&interner->hashes, hash);
+	interner->slots[i] = id + 1;
+	if (interner->symbols.len * 2 > interner->slotCount) {
+		interner_grow(interner);
+	}
+	return id;
+}
+
+str interner_get(const Interner* interner, SymbolId id)
+{
+	return interner->symbols.ptr[id];
+}
+
+void interner_free(Interner interner)
+{
+	arena_free(interner.text);
+	BUF_FREE(interner.symbols);
+	BUF_FREE(interner.hashes);
+	free(interner.slots);
+}
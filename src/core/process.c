@@ -1,7 +1,11 @@
+// for memfd_create
+#define _GNU_SOURCE
+
 #include "dragon/core/process.h"
 
 #include <spawn.h>
 #include <stdlib.h>
+#include <sys/mman.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
@@ -271,3 +275,22 @@ ProcessCreateResult process_run(ProcessCStrBuf commandLine, ProcessOption option
 
 	return (ProcessCreateResult)NOTHING;
 }
+
+MemoryFileCreateResult memory_file_create(const char* name)
+{
+	// not MFD_CLOEXEC, so children inherit it
+	int fd = memfd_create(name, 0);
+	if (fd == -1) {
+		return (MemoryFileCreateResult)NOTHING;
+	}
+	return (MemoryFileCreateResult)JUST(((MemoryFile) {
+		.fd = fd,
+		.path = str_fmt("/proc/self/fd/%d", fd),
+	}));
+}
+
+void memory_file_free(MemoryFile file)
+{
+	(void)close(file.fd);
+	str_free(file.path);
+}
@@ -0,0 +1,211 @@
+#include "dragon/core/scan.h"
+
+#include <stdint.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define SCAN_X86 1
+#include <immintrin.h>
+#else
+#define SCAN_X86 0
+#endif
+
+typedef const char* (*SkipSpaceFunc)(const char* p, const char* end);
+typedef const char* (*FindCharFunc)(const char* p, const char* end, char c);
+
+static bool char_is_space(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static const char* skip_space_scalar(const char* p, const char* end)
+{
+	while (p < end && char_is_space(*p)) {
+		p++;
+	}
+	return p;
+}
+
+static const char* find_char_scalar(const char* p, const char* end, char c)
+{
+	while (p < end && *p != c) {
+		p++;
+	}
+	return p;
+}
+
+#if SCAN_X86
+
+static const char* skip_space_sse2(const char* p, const char* end)
+{
+	const __m128i space = _mm_set1_epi8(' ');
+	const __m128i tab = _mm_set1_epi8('\t');
+	const __m128i cr = _mm_set1_epi8('\r');
+	const __m128i lf = _mm_set1_epi8('\n');
+	while (end - p >= 16) {
+		__m128i chunk = _mm_loadu_si128((const __m128i*)p);
+		__m128i ws = _mm_or_si128(
+		                     _mm_or_si128(_mm_cmpeq_epi8(chunk, space), _mm_cmpeq_epi8(chunk, tab)),
+		                     _mm_or_si128(_mm_cmpeq_epi8(chunk, cr), _mm_cmpeq_epi8(chunk, lf))
+		             );
+		uint32_t mask = ~(uint32_t)_mm_movemask_epi8(ws) & 0xFFFFU;
+		if (mask != 0) {
+			return p + __builtin_ctz(mask);
+		}
+		p += 16;
+	}
+	return skip_space_scalar(p, end);
+}
+
+static const char* find_char_sse2(const char* p, const char* end, char c)
+{
+	const __m128i needle = _mm_set1_epi8(c);
+	while (end - p >= 16) {
+		__m128i chunk = _mm_loadu_si128((const __m128i*)p);
+		uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, needle));
+		if (mask != 0) {
+			return p + __builtin_ctz(mask);
+		}
+		p += 16;
+	}
+	return find_char_scalar(p, end, c);
+}
+
+__attribute__((target("avx2")))
+static const char* skip_space_avx2(const char* p, const char* end)
+{
+	const __m256i space = _mm256_set1_epi8(' ');
+	const __m256i tab = _mm256_set1_epi8('\t');
+	const __m256i cr = _mm256_set1_epi8('\r');
+	const __m256i lf = _mm256_set1_epi8('\n');
+	while (end - p >= 32) {
+		__m256i chunk = _mm256_loadu_si256((const __m256i*)p);
+		__m256i ws = _mm256_or_si256(
+		                     _mm256_or_si256(
+		                             _mm256_cmpeq_epi8(chunk, space),
+		                             _mm256_cmpeq_epi8(chunk, tab)
+		                     ),
+		                     _mm256_or_si256(
+		                             _mm256_cmpeq_epi8(chunk, cr),
+		                             _mm256_cmpeq_epi8(chunk, lf)
+		                     )
+		             );
+		uint32_t mask = ~(uint32_t)_mm256_movemask_epi8(ws);
+		if (mask != 0) {
+			return p + __builtin_ctz(mask);
+		}
+		p += 32;
+	}
+	return skip_space_sse2(p, end);
+}
+
+__attribute__((target("avx2")))
+static const char* find_char_avx2(const char* p, const char* end, char c)
+{
+	const __m256i needle = _mm256_set1_epi8(c);
+	while (end - p >= 32) {
+		__m256i chunk = _mm256_loadu_si256((const __m256i*)p);
+		uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, needle));
+		if (mask != 0) {
+			return p + __builtin_ctz(mask);
+		}
+		p += 32;
+	}
+	return find_char_sse2(p, end, c);
+}
+
+#endif
+
+static bool implSelected = false;
+static SkipSpaceFunc skipSpaceFunc = skip_space_scalar;
+static FindCharFunc findCharFunc = find_char_scalar;
+
+bool scan_impl_supported(ScanImpl impl)
+{
+	switch (impl) {
+	case SCAN_IMPL_SCALAR:
+		return true;
+	case SCAN_IMPL_SSE2:
+		return SCAN_X86;
+	case SCAN_IMPL_AVX2:
+#if SCAN_X86
+		return __builtin_cpu_supports("avx2");
+#else
+		return false;
+#endif
+	}
+	return false;
+}
+
+ScanImpl scan_best_impl(void)
+{
+	if (scan_impl_supported(SCAN_IMPL_AVX2)) {
+		return SCAN_IMPL_AVX2;
+	}
+	if (scan_impl_supported(SCAN_IMPL_SSE2)) {
+		return SCAN_IMPL_SSE2;
+	}
+	return SCAN_IMPL_SCALAR;
+}
+
+void scan_use_impl(ScanImpl impl)
+{
+	if (!scan_impl_supported(impl)) {
+		impl = scan_best_impl();
+	}
+	implSelected = true;
+	switch (impl) {
+	case SCAN_IMPL_SCALAR:
+		skipSpaceFunc = skip_space_scalar;
+		findCharFunc = find_char_scalar;
+		break;
+#if SCAN_X86
+	case SCAN_IMPL_SSE2:
+		skipSpaceFunc = skip_space_sse2;
+		findCharFunc = find_char_sse2;
+		break;
+	case SCAN_IMPL_AVX2:
+		skipSpaceFunc = skip_space_avx2;
+		findCharFunc = find_char_avx2;
+		break;
+#else
+	default:
+		break;
+#endif
+	}
+}
+
+const char* scan_impl_name(ScanImpl impl)
+{
+	switch (impl) {
+	case SCAN_IMPL_SCALAR:
+		return "scalar";
+	case SCAN_IMPL_SSE2:
+		return "sse2";
+	case SCAN_IMPL_AVX2:
+		return "avx2";
+	}
+	return "unknown";
+}
+
+static void scan_select(void)
+{
+	if (!implSelected) {
+		scan_use_impl(scan_best_impl());
+	}
+}
+
+const char* scan_skip_space(const char* p, const char* end)
+{
+	// tokens are often not preceded by whitespace at all
+	if (p < end && !char_is_space(*p)) {
+		return p;
+	}
+	scan_select();
+	return skipSpaceFunc(p, end);
+}
+
+const char* scan_find_char(const char* p, const char* end, char c)
+{
+	scan_select();
+	return findCharFunc(p, end, c);
+}
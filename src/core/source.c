@@ -0,0 +1,54 @@
+#include "dragon/core/source.h"
+
+#include <string.h>
+
+SourceFile source_file_new(str filename, str text)
+{
+	return (SourceFile) {
+		.filename = str_ref(filename),
+		.text = str_ref(text),
+		.lines = BUF_NEW,
+	};
+}
+
+void source_file_free(SourceFile file)
+{
+	BUF_FREE(file.lines);
+}
+
+static void build_line_table(SourceFile* file)
+{
+	const char* begin = str_ptr(file->text);
+	const char* end = str_end(file->text);
+	BUF_PUSH(&file->lines, 0);
+	const char* p = begin;
+	while ((p = memchr(p, '\n', (size_t)(end - p))) != NULL) {
+		p++;
+		BUF_PUSH(&file->lines, (uint32_t)(p - begin));
+	}
+}
+
+SourceLocation source_file_location(SourceFile* file, uint32_t offset)
+{
+	if (file->lines.len == 0) {
+		build_line_table(file);
+	}
+
+	// find the last line starting at or before offset
+	uint64_t lo = 0;
+	uint64_t hi = file->lines.len;
+	while (hi - lo > 1) {
+		uint64_t mid = lo + (hi - lo) / 2;
+		if (file->lines.ptr[mid] <= offset) {
+			lo = mid;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return (SourceLocation) {
+		.filename = file->filename,
+		.line = lo + 1,
+		.column = offset - file->lines.ptr[lo] + 1,
+	};
+}
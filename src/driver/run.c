@@ -1,33 +1,117 @@
 #include "dragon/driver/run.h"
 
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
 
 #include "dragon/ast.h"
+#include "dragon/bytecode.h"
 #include "dragon/codegen.h"
 #include "dragon/core/arg.h"
 #include "dragon/core/buf.h"
-#include "dragon/core/dir.h"
 #include "dragon/core/file.h"
 #include "dragon/core/process.h"
+#include "dragon/core/source.h"
 #include "dragon/core/str.h"
+#include "dragon/fold.h"
+#include "dragon/ir.h"
+#include "dragon/interp.h"
+#include "dragon/ir_opt.h"
+#include "dragon/jit.h"
+#include "dragon/link.h"
+#include "dragon/object.h"
 #include "dragon/parser.h"
+#include "dragon/peephole.h"
+#include "dragon/regalloc.h"
+#include "dragon/simplify.h"
+
+// Writes `image` to `path` with the permissions ld would give it.
+static bool write_executable(str path, const ByteBuf* image)
+{
+	int fd = open(path.ptr, O_WRONLY | O_CREAT | O_TRUNC, 0777);
+	if (fd == -1) {
+		return false;
+	}
+	uint64_t written = 0;
+	while (written < image->len) {
+		ssize_t n = write(fd, image->ptr + written, image->len - written);
+		if (n <= 0) {
+			(void)close(fd);
+			return false;
+		}
+		written += (uint64_t)n;
+	}
+	return close(fd) == 0;
+}
+
+// Generates the program into `file`, as `options.output` says.
+static CodegenWriteResult write_memory_file(Program program, MemoryFile file, CodegenOptions options)
+{
+	int fd = dup(file.fd);
+	FILE* fp = fd < 0 ? NULL : fdopen(fd, "wb");
+	if (fp == NULL) {
+		if (fd >= 0) {
+			(void)close(fd);
+		}
+		return (CodegenWriteResult)NOTHING;
+	}
+	CodegenWriteResult result = codegen_program_file(program, fp, options);
+	if (fclose(fp) != 0) {
+		return (CodegenWriteResult)NOTHING;
+	}
+	return result;
+}
 
 int run(CArgBuf args, FILE* out, FILE* err)
 {
 	Arg fileArg =
-	        ARG_POS(str_lit("FILE"), str_lit("The file to compile"));
+	        ARG_POS(str_lit("FILE"), str_lit("The file to compile, or - for stdin"));
 	Arg assemblyArg =
 	        ARG_FLAG(
 	                .shortname = 'S',
 	                .longname = str_lit("assembly"),
 	                .help = str_lit("Output assembly instead of executable")
 	        );
+	Arg objectArg =
+	        ARG_FLAG(
+	                .shortname = 'c',
+	                .longname = str_lit("object"),
+	                .help = str_lit("Output an object file instead of executable, assembled in-process")
+	        );
+	Arg integratedAsArg =
+	        ARG_FLAG(
+	                .longname = str_lit("integrated-as"),
+	                .help = str_lit("Assemble in-process instead of running nasm"),
+	        );
+	Arg linkerArg =
+	        ARG_OPT(
+	                .longname = str_lit("linker"),
+	                .help = str_lit("How to link with --integrated-as: builtin (default) or ld"),
+	        );
+	Arg runArg =
+	        ARG_FLAG(
+	                .longname = str_lit("run"),
+	                .help = str_lit("Run the program in-process and exit with its status, don't write files"),
+	        );
+	Arg interpretArg =
+	        ARG_FLAG(
+	                .longname = str_lit("interpret"),
+	                .help = str_lit("Interpret the program as bytecode and exit with its status, don't generate code"),
+	        );
 	Arg dumpAstArg =
 	        ARG_FLAG(
 	                .longname = str_lit("dump-ast"),
 	                .help = str_lit("Dump the AST to stdout, don't compile"),
 	        );
+	Arg dumpIrArg =
+	        ARG_FLAG(
+	                .longname = str_lit("dump-ir"),
+	                .help = str_lit("Dump the intermediate representation to stdout, don't compile"),
+	        );
 	Arg helpArg =
 	        ARG_FLAG(
 	                .shortname = 'h',
@@ -40,12 +124,72 @@ int run(CArgBuf args, FILE* out, FILE* err)
 	                .longname = str_lit("output"),
 	                .help = str_lit("The output file"),
 	        );
+	Arg codegenArg =
+	        ARG_OPT(
+	                .longname = str_lit("codegen"),
+	                .help = str_lit("How to evaluate expressions: register (default), stack or ir"),
+	        );
+	Arg regallocArg =
+	        ARG_OPT(
+	                .longname = str_lit("regalloc"),
+	                .help = str_lit("Where the ir strategy keeps values: linear (default) or none"),
+	        );
+	Arg noFoldArg =
+	        ARG_FLAG(
+	                .longname = str_lit("no-fold"),
+	                .help = str_lit("Don't evaluate constant expressions at compile time"),
+	        );
+	Arg noSimplifyArg =
+	        ARG_FLAG(
+	                .longname = str_lit("no-simplify"),
+	                .help = str_lit("Don't rewrite operators with a constant operand into cheaper ones"),
+	        );
+	Arg noPeepholeArg =
+	        ARG_FLAG(
+	                .longname = str_lit("no-peephole"),
+	                .help = str_lit("Don't rewrite the generated instructions into cheaper sequences"),
+	        );
+	Arg noSccpArg =
+	        ARG_FLAG(
+	                .longname = str_lit("no-sccp"),
+	                .help = str_lit("Don't propagate constants through the IR"),
+	        );
+	Arg noGvnArg =
+	        ARG_FLAG(
+	                .longname = str_lit("no-gvn"),
+	                .help = str_lit("Don't replace IR values computed twice"),
+	        );
+	Arg noDceArg =
+	        ARG_FLAG(
+	                .longname = str_lit("no-dce"),
+	                .help = str_lit("Don't remove unused IR values"),
+	        );
+	Arg statsArg =
+	        ARG_FLAG(
+	                .longname = str_lit("stats"),
+	                .help = str_lit("Report what the optimizations did to stderr"),
+	        );
 	Arg* acceptedOptions[] = {
 		&fileArg,
 		&assemblyArg,
+		&objectArg,
+		&integratedAsArg,
+		&linkerArg,
+		&runArg,
+		&interpretArg,
 		&dumpAstArg,
+		&dumpIrArg,
 		&helpArg,
 		&outputArg,
+		&codegenArg,
+		&regallocArg,
+		&noFoldArg,
+		&noSimplifyArg,
+		&noPeepholeArg,
+		&noSccpArg,
+		&noGvnArg,
+		&noDceArg,
+		&statsArg,
 	};
 
 	ArgParser parser = argparser_new(
@@ -67,13 +211,58 @@ int run(CArgBuf args, FILE* out, FILE* err)
 		return 1;
 	}
 
-	SlurpFileResult slurpRes = slurp_file(fileArg.value);
-	if (!slurpRes.ok) {
-		(void)fprintf(err, "ERROR: " STR_FMT "\n", STR_ARG(slurpRes.get.error));
-		str_free(slurpRes.get.error);
+	CodegenOptions codegenOptions = {
+		.strategy = CODEGEN_STRATEGY_REGISTER,
+		.peephole = !noPeepholeArg.flagValue,
+		.ir = {
+			.sccp = !noSccpArg.flagValue,
+			.gvn = !noGvnArg.flagValue,
+			.dce = !noDceArg.flagValue,
+		},
+		.regalloc = REGALLOC_STRATEGY_LINEAR,
+	};
+	if (str_eq(codegenArg.value, str_lit("stack"))) {
+		codegenOptions.strategy = CODEGEN_STRATEGY_STACK;
+	} else if (str_eq(codegenArg.value, str_lit("ir"))) {
+		codegenOptions.strategy = CODEGEN_STRATEGY_IR;
+	} else if (str_len(codegenArg.value) > 0 && !str_eq(codegenArg.value, str_lit("register"))) {
+		(void)fprintf(
+		        err,
+		        "ERROR: unknown codegen strategy '" STR_FMT "'\n",
+		        STR_ARG(codegenArg.value)
+		);
+		return 1;
+	}
+	bool builtinLinker = integratedAsArg.flagValue;
+	if (str_eq(linkerArg.value, str_lit("ld"))) {
+		builtinLinker = false;
+	} else if (str_len(linkerArg.value) > 0 && !str_eq(linkerArg.value, str_lit("builtin"))) {
+		(void)fprintf(
+		        err,
+		        "ERROR: unknown linker '" STR_FMT "'\n",
+		        STR_ARG(linkerArg.value)
+		);
+		return 1;
+	}
+	if (str_eq(regallocArg.value, str_lit("none"))) {
+		codegenOptions.regalloc = REGALLOC_STRATEGY_NONE;
+	} else if (str_len(regallocArg.value) > 0 && !str_eq(regallocArg.value, str_lit("linear"))) {
+		(void)fprintf(
+		        err,
+		        "ERROR: unknown register allocator '" STR_FMT "'\n",
+		        STR_ARG(regallocArg.value)
+		);
+		return 1;
+	}
+
+	MapFileResult inputRes = map_file(fileArg.value);
+	if (!inputRes.ok) {
+		(void)fprintf(err, "ERROR: " STR_FMT "\n", STR_ARG(inputRes.get.error));
+		str_free(inputRes.get.error);
 		return 1;
 	}
-	str inputContents = slurpRes.get.value;
+	MappedFile input = inputRes.get.value;
+	str inputContents = input.contents;
 
 	Parser p = parser_new(inputContents, fileArg.value);
 	ProgramResult program_result = parser_parse(&p);
@@ -81,78 +270,239 @@ int run(CArgBuf args, FILE* out, FILE* err)
 	if (!program_result.ok) {
 		(void)fprintf(err, "ERROR: " STR_FMT "\n", STR_ARG(program_result.get.error));
 		str_free(program_result.get.error);
-		str_free(inputContents);
+		mapped_file_free(input);
 		return 1;
 	}
 
 	Program program = program_result.get.value;
 
+	if (!noFoldArg.flagValue && !dumpAstArg.flagValue) {
+		SourceFile file = source_file_new(fileArg.value, inputContents);
+		FoldResult folded = fold_program(&program, &file);
+		for (uint64_t i = 0; i < folded.warnings.len; i++) {
+			(void)fprintf(err, "WARNING: " STR_FMT "\n", STR_ARG(folded.warnings.ptr[i]));
+		}
+		if (statsArg.flagValue) {
+			(void)fprintf(err, "fold: %" PRIu64 " operators\n", folded.folded);
+		}
+		fold_result_free(folded);
+		source_file_free(file);
+	}
+
+	if (!noSimplifyArg.flagValue && !dumpAstArg.flagValue) {
+		SimplifyStats simplified = simplify_program(&program);
+		for (SimplifyRule rule = 0; statsArg.flagValue && rule < SIMPLIFY_RULE_COUNT; rule++) {
+			(void)fprintf(
+			        err,
+			        "simplify: %s: %" PRIu64 "\n",
+			        simplify_rule_description(rule),
+			        simplified.hits[rule]
+			);
+		}
+	}
+
 	str outPath = outputArg.value;
+	CodegenStats codegenStats = {0};
+	int status = 0;
 
 	if (dumpAstArg.flagValue) {
 		str s = program_to_str(program);
 		(void)fprintf(out, STR_FMT, STR_ARG(s));
 		str_free(s);
-	} else if (assemblyArg.flagValue) {
+	} else if (dumpIrArg.flagValue) {
+		IrFunction ir = ir_lower_function(program.function);
+		codegenStats.ir = ir_optimize(&ir, codegenOptions.ir);
+		str s = ir_function_to_str(&ir, &program.symbols);
+		(void)fprintf(out, STR_FMT, STR_ARG(s));
+		str_free(s);
+		ir_function_free(ir);
+	} else if (runArg.flagValue) {
+		Object object = object_new();
+		codegenStats = codegen_program_object(program, &object, codegenOptions);
+		JitResult result = jit_call(&object, str_lit("main"));
+		object_free(object);
+		if (!result.ok) {
+			(void)fprintf(err, "ERROR: " STR_FMT "\n", STR_ARG(result.get.error));
+			str_free(result.get.error);
+			program_free(program);
+			mapped_file_free(input);
+			return 1;
+		}
+		// the status is truncated the way the exit system call would
+		status = (uint8_t)result.get.value;
+	} else if (interpretArg.flagValue) {
+		BytecodeResult codeResult = bytecode_compile(program.function);
+		if (!codeResult.ok) {
+			(void)fprintf(err, "ERROR: " STR_FMT "\n", STR_ARG(codeResult.get.error));
+			str_free(codeResult.get.error);
+			program_free(program);
+			mapped_file_free(input);
+			return 1;
+		}
+		InterpResult result = interp_run(&codeResult.get.value, stdin, out);
+		bytecode_free(codeResult.get.value);
+		if (!result.ok) {
+			(void)fprintf(err, "ERROR: " STR_FMT "\n", STR_ARG(result.get.error));
+			str_free(result.get.error);
+			program_free(program);
+			mapped_file_free(input);
+			return 1;
+		}
+		status = (uint8_t)result.get.value;
+	} else if (assemblyArg.flagValue || objectArg.flagValue) {
+		if (!assemblyArg.flagValue) {
+			codegenOptions.output = CODEGEN_OUTPUT_OBJECT;
+		}
 		if (str_len(outPath) == 0) {
-			outPath = str_lit("a.s");
+			outPath = assemblyArg.flagValue ? str_lit("a.s") : str_lit("a.o");
+		}
+		CodegenWriteResult written = codegen_program(program, outPath, codegenOptions);
+		if (!written.present) {
+			(void)fprintf(err, "ERROR: failed to write " STR_FMT ": %m\n", STR_ARG(outPath));
+			program_free(program);
+			mapped_file_free(input);
+			return 1;
+		}
+		codegenStats = written.value;
+	} else if (builtinLinker) {
+		if (str_len(outPath) == 0) {
+			outPath = str_lit("a.out");
+		}
+		Object object = object_new();
+		codegenStats = codegen_program_object(program, &object, codegenOptions);
+		ByteBuf image = BUF_NEW;
+		LinkError linkError = link_executable(&object, 1, &image);
+		object_free(object);
+		if (linkError.present) {
+			(void)fprintf(err, "ERROR: " STR_FMT "\n", STR_ARG(linkError.value));
+			str_free(linkError.value);
+			program_free(program);
+			mapped_file_free(input);
+			return 1;
+		}
+		bool written = write_executable(outPath, &image);
+		BUF_FREE(image);
+		if (!written) {
+			(void)fprintf(err, "ERROR: failed to write " STR_FMT ": %m\n", STR_ARG(outPath));
+			program_free(program);
+			mapped_file_free(input);
+			return 1;
 		}
-		codegen_program(program, outPath);
 	} else {
 		if (str_len(outPath) == 0) {
 			outPath = str_lit("a.out");
 		}
-		char templ[] = "dragonk-XXXXXX";
-		char* tempDir = mkdtemp(templ);
-		str tempPath = path_join(str_ref(tempDir), str_lit("a.s"));
-		codegen_program(program, tempPath);
-		str objPath = path_join(str_ref(tempDir), str_lit("a.o"));
-		// *INDENT-OFF*
-		ProcessCreateResult nasmProcessResult = process_run(
-			(ProcessCStrBuf)BUF_ARRAY(((const char* []) {
-				"nasm",
-				"-f",
-				"elf64",
-				tempPath.ptr,
-				"-o",
-				objPath.ptr
-			})),
-			PROCESS_OPTION_SEARCH_USER_PATH | PROCESS_OPTION_COMBINED_STDOUT_STDERR
-		);
-		// *INDENT-ON*
-		if (!nasmProcessResult.present || nasmProcessResult.value.returnCode != 0) {
-			(void)fprintf(err, "ERROR: running nasm failed\n");
-			del_dir(str_ref(tempDir));
+		// the intermediate files only ever live in memory
+		MemoryFileCreateResult objResult = memory_file_create("a.o");
+		if (!objResult.present) {
+			(void)fprintf(err, "ERROR: failed to create an in-memory file: %m\n");
+			program_free(program);
+			mapped_file_free(input);
 			return 1;
 		}
-		process_destroy(&nasmProcessResult.value);
-
-		str_free(tempPath);
+		MemoryFile obj = objResult.value;
+		if (integratedAsArg.flagValue) {
+			codegenOptions.output = CODEGEN_OUTPUT_OBJECT;
+			CodegenWriteResult written = write_memory_file(program, obj, codegenOptions);
+			if (!written.present) {
+				(void)fprintf(err, "ERROR: failed to write an in-memory file: %m\n");
+				memory_file_free(obj);
+				program_free(program);
+				mapped_file_free(input);
+				return 1;
+			}
+			codegenStats = written.value;
+		} else {
+			MemoryFileCreateResult asmResult = memory_file_create("a.s");
+			if (!asmResult.present) {
+				(void)fprintf(err, "ERROR: failed to create an in-memory file: %m\n");
+				memory_file_free(obj);
+				program_free(program);
+				mapped_file_free(input);
+				return 1;
+			}
+			MemoryFile assembly = asmResult.value;
+			CodegenWriteResult written = write_memory_file(program, assembly, codegenOptions);
+			if (!written.present) {
+				(void)fprintf(err, "ERROR: failed to write an in-memory file: %m\n");
+				memory_file_free(assembly);
+				memory_file_free(obj);
+				program_free(program);
+				mapped_file_free(input);
+				return 1;
+			}
+			codegenStats = written.value;
+			// nasm reads its input once per pass, so it gets a file it can
+			// reopen rather than a pipe
+			// *INDENT-OFF*
+			ProcessCreateResult nasmProcessResult = process_run(
+				(ProcessCStrBuf)BUF_ARRAY(((const char* []) {
+					"nasm",
+					"-f",
+					"elf64",
+					assembly.path.ptr,
+					"-o",
+					obj.path.ptr
+				})),
+				PROCESS_OPTION_SEARCH_USER_PATH | PROCESS_OPTION_COMBINED_STDOUT_STDERR
+			);
+			// *INDENT-ON*
+			memory_file_free(assembly);
+			if (!nasmProcessResult.present || nasmProcessResult.value.returnCode != 0) {
+				(void)fprintf(err, "ERROR: running nasm failed\n");
+				memory_file_free(obj);
+				return 1;
+			}
+			process_destroy(&nasmProcessResult.value);
+		}
 
 		// *INDENT-OFF*
 		ProcessCreateResult ldProcessResult = process_run(
 		        (ProcessCStrBuf)BUF_ARRAY(((const char* []) {
 		                "ld",
-		                objPath.ptr,
+		                obj.path.ptr,
 		                "-o",
 		                outPath.ptr
 		        })),
 		        PROCESS_OPTION_SEARCH_USER_PATH | PROCESS_OPTION_COMBINED_STDOUT_STDERR
 		);
 		// *INDENT-ON*
+		memory_file_free(obj);
 		if (!ldProcessResult.present || ldProcessResult.value.returnCode != 0) {
 			(void)fprintf(err, "ERROR: running ld failed\n");
-			del_dir(str_ref(tempDir));
-			str_free(inputContents);
+			mapped_file_free(input);
 			return 1;
 		}
 		process_destroy(&ldProcessResult.value);
+	}
 
-		str_free(objPath);
-		del_dir(str_ref(tempDir));
+	bool generated = !dumpAstArg.flagValue && !dumpIrArg.flagValue && !interpretArg.flagValue;
+	bool ranIr = dumpIrArg.flagValue || (codegenOptions.strategy == CODEGEN_STRATEGY_IR && generated);
+	for (IrOptCounter counter = 0; statsArg.flagValue && ranIr && counter < IR_OPT_COUNTER_COUNT; counter++) {
+		(void)fprintf(
+		        err,
+		        "%s: %s: %" PRIu64 "\n",
+		        ir_opt_counter_pass(counter),
+		        ir_opt_counter_description(counter),
+		        codegenStats.ir.counts[counter]
+		);
+	}
+	bool ranRegalloc = codegenOptions.strategy == CODEGEN_STRATEGY_IR && generated;
+	if (statsArg.flagValue && ranRegalloc) {
+		(void)fprintf(err, "regalloc: values in registers: %" PRIu64 "\n", codegenStats.regalloc.registers);
+		(void)fprintf(err, "regalloc: values spilled: %" PRIu64 "\n", codegenStats.regalloc.spilled);
+	}
+	bool ranPeephole = codegenOptions.peephole && generated;
+	for (PeepholeRule rule = 0; statsArg.flagValue && ranPeephole && rule < PEEPHOLE_RULE_COUNT; rule++) {
+		(void)fprintf(
+		        err,
+		        "peephole: %s: %" PRIu64 "\n",
+		        peephole_rule_description(rule),
+		        codegenStats.peephole.hits[rule]
+		);
 	}
 
 	program_free(program);
-	str_free(inputContents);
-	return 0;
+	mapped_file_free(input);
+	return status;
 }
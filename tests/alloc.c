@@ -0,0 +1,32 @@
+#include "dragon/test/alloc.h"
+
+#include <stddef.h>
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+
+static uint64_t allocCount = 0;
+
+void* __wrap_malloc(size_t size)
+{
+	allocCount++;
+	return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size)
+{
+	allocCount++;
+	return __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size)
+{
+	allocCount++;
+	return __real_realloc(ptr, size);
+}
+
+uint64_t test_alloc_count(void)
+{
+	return allocCount;
+}
@@ -0,0 +1,4 @@
+int main()
+{
+	return (5000000000 - 4999999990) * 3 + (1 < 2) + (7 > 2 * 3) - 100 / 7 % 4 + (1 << 3) + (-64 >> 2) + (3 + (4000000000 == 4000000000)) * 2147483648 / 1073741824;
+}
@@ -0,0 +1,4 @@
+int main()
+{
+	return (1 < 2 && !(3 >= 4)) + (!(0 || 0) && 2) * 2 + (5 == 6 || !!7) * 4 + (0 && 1 || 3 && !0) * 8 + (-1 && 2 > 1) * 16 + !(1 && 0) * 32 + ((2 - 2 || 1 > 2) && 1) * 64 + !(4 != 4 || !(1 <= 1)) * 128;
+}
@@ -0,0 +1,4 @@
+int main()
+{
+	return (((((((2 + 3) - (4 + 5)) * ((6 + 7) - (8 + 9))) ^ (((1 + 2) - (3 + 4)) * ((5 + 6) - (7 + 8)))) + ((((9 + 1) - (2 + 3)) * ((4 + 5) - (6 + 7))) ^ (((8 + 9) - (1 + 2)) * ((3 + 4) - (5 + 6))))) - (((((7 + 8) - (9 + 1)) * ((2 + 3) - (4 + 5))) ^ (((6 + 7) - (8 + 9)) * ((1 + 2) - (3 + 4)))) + ((((5 + 6) - (7 + 8)) * ((9 + 1) - (2 + 3))) ^ (((4 + 5) - (6 + 7)) * ((8 + 9) - (1 + 2)))))) | ((((((3 + 4) - (5 + 6)) * ((7 + 8) - (9 + 1))) ^ (((2 + 3) - (4 + 5)) * ((6 + 7) - (8 + 9)))) + ((((1 + 2) - (3 + 4)) * ((5 + 6) - (7 + 8))) ^ (((9 + 1) - (2 + 3)) * ((4 + 5) - (6 + 7))))) - (((((8 + 9) - (1 + 2)) * ((3 + 4) - (5 + 6))) ^ (((7 + 8) - (9 + 1)) * ((2 + 3) - (4 + 5)))) + ((((6 + 7) - (8 + 9)) * ((1 + 2) - (3 + 4))) ^ (((5 + 6) - (7 + 8)) * ((9 + 1) - (2 + 3))))))) % 256;
+}
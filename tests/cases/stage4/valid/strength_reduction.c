@@ -0,0 +1,4 @@
+int main()
+{
+	return (0 - 7) / 4 + (0 - 7) % 4 + (3 + 4) * 8 + 2 * (1 - 5) + !!(2 + 3) + ~~(1 + 1) + -(-(1 + 2)) + (9 - 2) % 8 + (1 - 2) * 1 + 0;
+}
@@ -0,0 +1,96 @@
+#include "dragon/test/codegen.h"
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dragon/ast.h"
+#include "dragon/codegen.h"
+#include "dragon/core/str.h"
+#include "dragon/test/program.h"
+
+typedef struct {
+	uint64_t compares;
+	uint64_t jumps;
+	// setcc and the movzx that widens its result
+	uint64_t sets;
+} ConditionCount;
+
+static ConditionCount count_conditions(const char* text)
+{
+	ConditionCount count = {0};
+	for (const char* line = text; *line != '\0';) {
+		const char* end = strchr(line, '\n');
+		if (end == NULL) {
+			end = line + strlen(line);
+		}
+		// instructions are indented, labels aren't
+		const char* op = line;
+		while (*op == ' ') {
+			op++;
+		}
+		if (op != line) {
+			size_t len = strcspn(op, " \n");
+			if (len == 3 && strncmp(op, "cmp", 3) == 0) {
+				count.compares++;
+			} else if (op[0] == 'j' && !(len == 3 && strncmp(op, "jmp", 3) == 0)) {
+				count.jumps++;
+			} else if (strncmp(op, "set", 3) == 0 || (len == 5 && strncmp(op, "movzx", 5) == 0)) {
+				count.sets++;
+			}
+		}
+		line = *end == '\0' ? end : end + 1;
+	}
+	return count;
+}
+
+// Generates `return <expr>;` with the register strategy, without folding it,
+// and checks that it has `compares` cmp instructions, at least `jumps`
+// conditional jumps, and only `sets` setcc or movzx instructions that
+// materialize a value.
+static TEST_FUNC(state, conditions, str expr, uint64_t compares, uint64_t jumps, uint64_t sets)
+{
+	TEST_PARSE_RETURN(state, program, expr, NO_CLEANUP);
+
+	char* text = NULL;
+	size_t len = 0;
+	FILE* fp = open_memstream(&text, &len);
+	TEST_ASSERT(state, fp != NULL, CLEANUP(program_free(program)), "open_memstream failed");
+	codegen_program_file(program, fp, (CodegenOptions) {
+		.strategy = CODEGEN_STRATEGY_REGISTER,
+	});
+	(void)fclose(fp);
+	program_free(program);
+	ConditionCount count = count_conditions(text);
+	TEST_ASSERT(
+	        state,
+	        count.compares == compares && count.jumps >= jumps && count.sets == sets,
+	        CLEANUP(free(text)),
+	        "got %" PRIu64 " cmp, %" PRIu64 " jcc and %" PRIu64 " setcc or movzx, "
+	        "expected %" PRIu64 ", at least %" PRIu64 " and %" PRIu64 " in\n%s",
+	        count.compares,
+	        count.jumps,
+	        count.sets,
+	        compares,
+	        jumps,
+	        sets,
+	        text
+	);
+	free(text);
+	PASS();
+}
+
+#define CONDITIONS_TEST(state, name, expr, compares, jumps, sets) \
+	RUN_TEST(state, conditions, str_lit(name " " expr), str_lit(expr), compares, jumps, sets)
+
+SUITE_FUNC(state, codegen)
+{
+	CONDITIONS_TEST(state, "comparisons joined by and", "1 < 2 && 3 > 4", 2, 2, 0);
+	CONDITIONS_TEST(state, "comparisons joined by or", "1 <= 2 || 3 >= 4 || 5 != 6", 3, 3, 0);
+	CONDITIONS_TEST(state, "negated and nested conditions", "!(1 == 2) && (3 < 4 || !(5 > 6))", 3, 3, 0);
+	CONDITIONS_TEST(state, "values joined by and and or", "1 + 2 && 3 - 3 || ~4", 0, 3, 0);
+	// the only setcc/movzx pair left is for a comparison whose value is used
+	CONDITIONS_TEST(state, "a comparison used as a value", "(1 < 2) + 3", 1, 0, 2);
+}
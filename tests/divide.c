@@ -0,0 +1,267 @@
+#include "dragon/test/divide.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "dragon/ast.h"
+#include "dragon/bytecode.h"
+#include "dragon/codegen.h"
+#include "dragon/core/buf.h"
+#include "dragon/core/process.h"
+#include "dragon/core/str.h"
+#include "dragon/interp.h"
+#include "dragon/jit.h"
+#include "dragon/magic.h"
+#include "dragon/object.h"
+#include "dragon/rewrite.h"
+#include "dragon/test/program.h"
+
+typedef BUF(int64_t) ValueBuf;
+
+static uint64_t next_random(uint64_t* state)
+{
+	// xorshift64
+	*state ^= *state << 13;
+	*state ^= *state >> 7;
+	*state ^= *state << 17;
+	return *state;
+}
+
+// Values around the edges of the 64-bit range and of `divisor`, plus random
+// ones of every magnitude.
+static ValueBuf interesting_values(int64_t divisor, uint64_t* random, uint64_t randomCount)
+{
+	static const int64_t EDGES[] = {
+		INT64_MIN, INT64_MIN + 1, -4294967297, -4294967296, -2147483649, -2147483648,
+		-1000, -7, -3, -2, -1, 0, 1, 2, 3, 7, 1000, 2147483647, 2147483648,
+		4294967296, 4294967297, INT64_MAX - 1, INT64_MAX,
+	};
+	ValueBuf values = BUF_NEW;
+	for (uint64_t i = 0; i < sizeof(EDGES) / sizeof(EDGES[0]); i++) {
+		BUF_PUSH(&values, EDGES[i]);
+	}
+	for (int64_t delta = -1; delta <= 1; delta++) {
+		BUF_PUSH(&values, (int64_t)((uint64_t)divisor + (uint64_t)delta));
+		BUF_PUSH(&values, (int64_t)(0 - (uint64_t)divisor + (uint64_t)delta));
+	}
+	for (uint64_t i = 0; i < randomCount; i++) {
+		uint64_t bits = next_random(random) % 63;
+		BUF_PUSH(&values, (int64_t)(next_random(random) >> bits));
+		BUF_PUSH(&values, -(int64_t)(next_random(random) >> (bits + 1)));
+	}
+	return values;
+}
+
+static bool is_power_of_two(int64_t value)
+{
+	uint64_t magnitude = value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+	return (magnitude & (magnitude - 1)) == 0;
+}
+
+// Follows the sequence documented in magic.h.
+static int64_t magic_divide(int64_t n, int64_t d, DivisionMagic magic)
+{
+	int64_t q = (int64_t)(((__int128)n * magic.multiplier) >> 64);
+	if (d > 0 && magic.multiplier < 0) {
+		q = (int64_t)((uint64_t)q + (uint64_t)n);
+	} else if (d < 0 && magic.multiplier > 0) {
+		q = (int64_t)((uint64_t)q - (uint64_t)n);
+	}
+	q >>= magic.shift;
+	return q + (int64_t)((uint64_t)q >> 63);
+}
+
+static TEST_FUNC(state, division_magic)
+{
+	uint64_t random = 0x9E3779B97F4A7C15;
+	ValueBuf divisors = interesting_values(3, &random, 1000);
+	for (uint64_t i = 0; i < divisors.len; i++) {
+		int64_t d = divisors.ptr[i];
+		if (d == -1 || d == 0 || d == 1 || d == INT64_MIN || is_power_of_two(d)) {
+			continue;
+		}
+		DivisionMagic magic = division_magic(d);
+		ValueBuf dividends = interesting_values(d, &random, 50);
+		for (uint64_t j = 0; j < dividends.len; j++) {
+			int64_t n = dividends.ptr[j];
+			int64_t q = magic_divide(n, d, magic);
+			TEST_ASSERT(
+			        state,
+			        q == n / d,
+			        CLEANUP(BUF_FREE(dividends); BUF_FREE(divisors)),
+			        "%" PRId64 " / %" PRId64 " gave %" PRId64 " instead of %" PRId64,
+			        n,
+			        d,
+			        q,
+			        n / d
+			);
+		}
+		BUF_FREE(dividends);
+	}
+	BUF_FREE(divisors);
+	PASS();
+}
+
+static Expression* mismatch(Arena* nodes, BinaryOpKind kind, int64_t n, int64_t d, int64_t expected)
+{
+	Expression* left = expression_new_constant(nodes, n);
+	Expression* right = expression_new_constant(nodes, d);
+	Expression* result = expression_new_binary(nodes, kind, 0, left, right);
+	Expression* value = expression_new_constant(nodes, expected);
+	return expression_new_binary(nodes, BINARY_OP_KIND_INEQUALITY, 0, result, value);
+}
+
+typedef RESULT(int, const char*) RunResult;
+
+// Assembles, links and runs `program`, returning its exit status. A program
+// killed by a signal exits with EXIT_FAILURE.
+static RunResult run_program(Program program, CodegenOptions options)
+{
+	if (!codegen_program(program, str_lit("divide.s"), options).present) {
+		return (RunResult)ERR("failed to write divide.s");
+	}
+
+	const char* nasmArgs[] = { "nasm", "-f", "elf64", "divide.s", "-o", "divide.o" };
+	ProcessCreateResult nasm = process_run((ProcessCStrBuf)BUF_ARRAY(nasmArgs), PROCESS_OPTION_SEARCH_USER_PATH);
+	(void)remove("divide.s");
+	bool assembled = nasm.present && nasm.value.returnCode == 0;
+	if (nasm.present) {
+		process_destroy(&nasm.value);
+	}
+	if (!assembled) {
+		return (RunResult)ERR("nasm failed");
+	}
+	const char* ldArgs[] = { "ld", "divide.o", "-o", "divide.out" };
+	ProcessCreateResult ld = process_run((ProcessCStrBuf)BUF_ARRAY(ldArgs), PROCESS_OPTION_SEARCH_USER_PATH);
+	(void)remove("divide.o");
+	bool linked = ld.present && ld.value.returnCode == 0;
+	if (ld.present) {
+		process_destroy(&ld.value);
+	}
+	if (!linked) {
+		return (RunResult)ERR("ld failed");
+	}
+	const char* runArgs[] = { "./divide.out" };
+	ProcessCreateResult run = process_run((ProcessCStrBuf)BUF_ARRAY(runArgs), PROCESS_OPTION_COMBINED_STDOUT_STDERR);
+	(void)remove("divide.out");
+	if (!run.present) {
+		return (RunResult)ERR("program failed to spawn");
+	}
+	int status = run.value.returnCode;
+	process_destroy(&run.value);
+	return (RunResult)OK(status);
+}
+
+// Whether `n op d` stops the program with every code generation strategy,
+// both as an executable and run in-process, and in the interpreter.
+static bool always_traps(Program* program, BinaryOpKind kind, int64_t n, int64_t d)
+{
+	Expression* left = expression_new_constant(&program->nodes, n);
+	Expression* right = expression_new_constant(&program->nodes, d);
+	Expression* result = expression_new_binary(&program->nodes, kind, 0, left, right);
+	Expression* zero = expression_new_constant(&program->nodes, 0);
+	Expression* two = expression_new_constant(&program->nodes, 2);
+	// exits with 2 unless the operator traps
+	result = expression_new_binary(&program->nodes, BINARY_OP_KIND_MULTIPLICATION, 0, result, zero);
+	program->function.statement.expression = expression_new_binary(&program->nodes, BINARY_OP_KIND_ADDITION, 0, result, two);
+	static const CodegenStrategy STRATEGIES[] = {
+		CODEGEN_STRATEGY_REGISTER,
+		CODEGEN_STRATEGY_STACK,
+		CODEGEN_STRATEGY_IR,
+	};
+	bool traps = true;
+	for (uint64_t i = 0; i < sizeof(STRATEGIES) / sizeof(STRATEGIES[0]); i++) {
+		CodegenOptions options = { .strategy = STRATEGIES[i] };
+		RunResult status = run_program(*program, options);
+		traps = traps && status.ok && status.get.value == EXIT_FAILURE;
+		Object object = object_new();
+		codegen_program_object(*program, &object, options);
+		JitResult result = jit_call(&object, str_lit("main"));
+		object_free(object);
+		if (result.ok) {
+			traps = false;
+		} else {
+			str_free(result.get.error);
+		}
+	}
+	BytecodeResult code = bytecode_compile(program->function);
+	if (code.ok) {
+		InterpResult result = interp_run(&code.get.value, stdin, stdout);
+		bytecode_free(code.get.value);
+		traps = traps && !result.ok;
+		if (!result.ok) {
+			str_free(result.get.error);
+		}
+	} else {
+		str_free(code.get.error);
+		traps = false;
+	}
+	return traps;
+}
+
+// Compiles and runs a program summing `n / d != q` and `n % d != r` for the
+// constant divisor `d`, with q and r computed by the host's idiv.
+static TEST_FUNC(state, divide_by_constant, int64_t d, uint64_t* random)
+{
+	TEST_PARSE_RETURN(state, program, str_lit("0"), NO_CLEANUP);
+	Expression* sum = expression_new_constant(&program.nodes, 0);
+	ValueBuf dividends = interesting_values(d, random, 20);
+	bool overflowTraps = true;
+	// the exit status is the number of mismatches, so keep it below 256
+	for (uint64_t i = 0; i < dividends.len && i < 120; i++) {
+		int64_t n = dividends.ptr[i];
+		if (n == INT64_MIN && d == -1) {
+			// undefined, and idiv traps, so it would stop the program
+			overflowTraps = overflowTraps && always_traps(&program, BINARY_OP_KIND_DIVISION, n, d);
+			overflowTraps = overflowTraps && always_traps(&program, BINARY_OP_KIND_MODULUS, n, d);
+			continue;
+		}
+		Expression* quotient = mismatch(&program.nodes, BINARY_OP_KIND_DIVISION, n, d, n / d);
+		Expression* remainder = mismatch(&program.nodes, BINARY_OP_KIND_MODULUS, n, d, n % d);
+		sum = expression_new_binary(&program.nodes, BINARY_OP_KIND_ADDITION, 0, sum, quotient);
+		sum = expression_new_binary(&program.nodes, BINARY_OP_KIND_ADDITION, 0, sum, remainder);
+	}
+	BUF_FREE(dividends);
+	TEST_ASSERT(
+	        state,
+	        overflowTraps,
+	        CLEANUP(program_free(program)),
+	        "INT64_MIN / -1 doesn't trap with every strategy"
+	);
+	program.function.statement.expression = sum;
+	CodegenOptions options = { .strategy = CODEGEN_STRATEGY_REGISTER, .peephole = true };
+	RunResult mismatches = run_program(program, options);
+	program_free(program);
+	TEST_ASSERT(state, mismatches.ok, NO_CLEANUP, "%s", mismatches.get.error);
+	TEST_ASSERT(
+	        state,
+	        mismatches.get.value == 0,
+	        NO_CLEANUP,
+	        "%d results differ from idiv",
+	        mismatches.get.value
+	);
+	PASS();
+}
+
+SUITE_FUNC(state, divide)
+{
+	static const int64_t DIVISORS[] = {
+		INT64_MIN, INT64_MIN + 1, -4294967296, -1000000007, -641, -10, -8, -7,
+		-3, -2, -1, 1, 2, 3, 5, 6, 7, 8, 10, 25, 125, 641, 1000000007,
+		2147483648, 4294967297, 4611686018427387904, INT64_MAX,
+	};
+	RUN_TEST(state, division_magic, str_lit("division magic numbers"));
+	uint64_t random = 0x2545F4914F6CDD1D;
+	for (uint64_t i = 0; i < sizeof(DIVISORS) / sizeof(DIVISORS[0]); i++) {
+		RUN_TEST(
+		        state,
+		        divide_by_constant,
+		        str_fmt("dividing by %" PRId64, DIVISORS[i]),
+		        DIVISORS[i],
+		        &random
+		);
+	}
+}
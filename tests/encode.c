@@ -0,0 +1,254 @@
+#include "dragon/test/encode.h"
+
+#include <elf.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "dragon/asm.h"
+#include "dragon/core/buf.h"
+#include "dragon/core/file.h"
+#include "dragon/core/process.h"
+#include "dragon/core/str.h"
+#include "dragon/driver/run.h"
+#include "dragon/encode.h"
+#include "dragon/object.h"
+#include "dragon/test/info.h"
+#include "dragon/test/list.h"
+
+static str hex(const uint8_t* bytes, uint64_t len)
+{
+	str s = str_empty;
+	for (uint64_t i = 0; i < len; i++) {
+		str next = str_fmt(STR_FMT "%s%02x", STR_ARG(s), i == 0 ? "" : " ", bytes[i]);
+		str_free(s);
+		s = next;
+	}
+	return s;
+}
+
+// Encodes `code` as a function and checks its bytes, written as hex pairs.
+static TEST_FUNC(state, encode, InstructionBuf code, str expected)
+{
+	Object object = object_new();
+	encode_function(&object, str_lit("f"), false, &code, NULL);
+	object_finish(&object);
+	str actual = hex(object.text.ptr, object.text.len);
+	object_free(object);
+	TEST_ASSERT(
+	        state,
+	        str_eq(actual, expected),
+	        CLEANUP(str_free(actual)),
+	        "got " STR_FMT ", expected " STR_FMT,
+	        STR_ARG(actual),
+	        STR_ARG(expected)
+	);
+	str_free(actual);
+	PASS();
+}
+
+// The contents of the .text section of the ELF64 object at `path`.
+static str text_section(str path)
+{
+	MapFileResult result = map_file(path);
+	if (!result.ok) {
+		str_free(result.get.error);
+		return str_empty;
+	}
+	MappedFile file = result.get.value;
+	const char* bytes = file.contents.ptr;
+	Elf64_Ehdr header;
+	memcpy(&header, bytes, sizeof(header));
+	Elf64_Shdr names;
+	memcpy(&names, bytes + header.e_shoff + header.e_shstrndx * sizeof(Elf64_Shdr), sizeof(names));
+	str text = str_empty;
+	for (uint64_t i = 0; i < header.e_shnum; i++) {
+		Elf64_Shdr section;
+		memcpy(&section, bytes + header.e_shoff + i * sizeof(Elf64_Shdr), sizeof(section));
+		if (strcmp(bytes + names.sh_offset + section.sh_name, ".text") == 0) {
+			text = str_copy(str_ref_chars(bytes + section.sh_offset, section.sh_size));
+			break;
+		}
+	}
+	mapped_file_free(file);
+	return text;
+}
+
+static int compile(const char* codegen, const char* mode, const char* outPath, str testPath)
+{
+	char* args[] = { "dragon", (char*)codegen, (char*)mode, "-o", (char*)outPath, (char*)testPath.ptr };
+	FILE* sink = fopen("/dev/null", "w");
+	int res = run((CArgBuf)BUF_ARRAY(args), sink, sink);
+	(void)fclose(sink);
+	return res;
+}
+
+#define ENCODE_FILES CLEANUP((void)remove("encode.s"); (void)remove("encode.o"); (void)remove("nasm.o"))
+
+// Checks that the integrated assembler and nasm make the same machine code of
+// the program at `testPath`. Programs that don't compile are skipped, since
+// the execute suite checks which programs compile.
+static TEST_FUNC(state, encode_file, str testPath, const char* codegen)
+{
+	if (compile(codegen, "-S", "encode.s", testPath) != 0) {
+		(void)remove("encode.s");
+		SKIP();
+	}
+	const char* nasmArgs[] = { "nasm", "-f", "elf64", "encode.s", "-o", "nasm.o" };
+	ProcessCreateResult nasmResult =
+	        process_run(
+	                (ProcessCStrBuf)BUF_ARRAY(nasmArgs),
+	                PROCESS_OPTION_COMBINED_STDOUT_STDERR | PROCESS_OPTION_SEARCH_USER_PATH
+	        );
+	if (!nasmResult.present || nasmResult.value.returnCode != 0) {
+		if (nasmResult.present) {
+			process_destroy(&nasmResult.value);
+		}
+		(void)remove("encode.s");
+		SKIP();
+	}
+	process_destroy(&nasmResult.value);
+	TEST_ASSERT(state, compile(codegen, "-c", "encode.o", testPath) == 0, ENCODE_FILES, "dragon failed to assemble");
+
+	str expected = text_section(str_lit("nasm.o"));
+	str actual = text_section(str_lit("encode.o"));
+	(void)remove("encode.s");
+	(void)remove("encode.o");
+	(void)remove("nasm.o");
+	str expectedHex = hex((const uint8_t*)expected.ptr, str_len(expected));
+	str actualHex = hex((const uint8_t*)actual.ptr, str_len(actual));
+	str_free(expected);
+	str_free(actual);
+	TEST_ASSERT(
+	        state,
+	        str_eq(actualHex, expectedHex),
+	        CLEANUP(str_free(actualHex); str_free(expectedHex)),
+	        "got\n" STR_FMT "\nexpected\n" STR_FMT,
+	        STR_ARG(actualHex),
+	        STR_ARG(expectedHex)
+	);
+	str_free(actualHex);
+	str_free(expectedHex);
+	PASS();
+}
+
+// Checks that an object that can't be written fails the compile, instead of
+// leaving a truncated file behind a zero exit code.
+static TEST_FUNC(state, encode_unwritable)
+{
+	FILE* fp = fopen("unwritable.c", "w");
+	TEST_ASSERT(state, fp != NULL, NO_CLEANUP, "couldn't create unwritable.c");
+	(void)fputs("int main() { return 3; }\n", fp);
+	(void)fclose(fp);
+	int res = compile("--codegen=register", "-c", "/dev/full", str_lit("unwritable.c"));
+	(void)remove("unwritable.c");
+	TEST_ASSERT(state, res != 0, NO_CLEANUP, "writing to /dev/full succeeded");
+	PASS();
+}
+
+#define RAX asm_reg(MREG_RAX)
+#define RCX asm_reg(MREG_RCX)
+#define RBP asm_reg(MREG_RBP)
+#define RSP asm_reg(MREG_RSP)
+#define RSI asm_reg(MREG_RSI)
+#define R8 asm_reg(MREG_R8)
+#define R12 asm_reg(MREG_R12)
+#define AL asm_reg(MREG_AL)
+#define CL asm_reg(MREG_CL)
+
+#define INSN(op, ...) ((Instruction) { .opcode = OPCODE_##op, .operands = { __VA_ARGS__ } })
+
+#define ENCODE_TEST(state, name, expected, ...) \
+	RUN_TEST( \
+	        state, \
+	        encode, \
+	        str_lit(name), \
+	        (InstructionBuf)BUF_ARRAY(((Instruction[]) { __VA_ARGS__ })), \
+	        str_lit(expected) \
+	)
+
+// The configurations whose code differs the most.
+static const char* const CODEGEN_STRATEGIES[] = {
+	"--codegen=register",
+	"--codegen=stack",
+	"--codegen=ir",
+	"--no-fold",
+};
+
+SUITE_FUNC(state, encode)
+{
+	ENCODE_TEST(state, "register to register", "48 89 c8", INSN(MOV, RAX, RCX));
+	ENCODE_TEST(state, "extended registers", "4d 89 c4", INSN(MOV, R12, R8));
+	ENCODE_TEST(state, "load from a frame slot", "48 8b 45 f8", INSN(MOV, RAX, asm_frame(-8)));
+	ENCODE_TEST(state, "store to a far frame slot", "4c 89 85 00 ff ff ff", INSN(MOV, asm_frame(-256), R8));
+	ENCODE_TEST(state, "small immediate", "b8 3c 00 00 00", INSN(MOV, RAX, asm_imm(60)));
+	ENCODE_TEST(state, "negative immediate", "48 c7 c6 ff ff ff ff", INSN(MOV, RSI, asm_imm(-1)));
+	ENCODE_TEST(
+	        state,
+	        "64-bit immediate",
+	        "49 b8 00 00 00 00 01 00 00 00",
+	        INSN(MOV, R8, asm_imm(INT64_C(0x100000000)))
+	);
+	ENCODE_TEST(state, "immediate byte", "48 83 c6 05", INSN(ADD, RSI, asm_imm(5)));
+	ENCODE_TEST(state, "accumulator immediate", "48 25 ff 00 00 00", INSN(AND, RAX, asm_imm(255)));
+	ENCODE_TEST(state, "compare with a frame slot", "48 3b 45 f0", INSN(CMP, RAX, asm_frame(-16)));
+	ENCODE_TEST(state, "three operand multiply", "48 6b c1 07", INSN(IMUL, RAX, RCX, asm_imm(7)));
+	ENCODE_TEST(state, "shift by one", "48 d1 e0", INSN(SHL, RAX, asm_imm(1)));
+	ENCODE_TEST(state, "shift by cl", "49 d3 f8", INSN(SAR, R8, CL));
+	ENCODE_TEST(state, "set and extend", "0f 9c c0 48 0f b6 f0", INSN(SETL, AL), INSN(MOVZX, RSI, AL));
+	ENCODE_TEST(state, "push and pop", "55 41 54 6a 05 5d", INSN(PUSH, RBP), INSN(PUSH, R12), INSN(PUSH, asm_imm(5)), INSN(POP, RBP));
+	ENCODE_TEST(state, "frame setup", "48 89 e5 48 83 ec 10", INSN(MOV, RBP, RSP), INSN(SUB, RSP, asm_imm(16)));
+	ENCODE_TEST(
+	        state,
+	        "short jumps",
+	        "74 02 eb 00 c3",
+	        INSN(JE, asm_label(0)),
+	        INSN(JMP, asm_label(0)),
+	        INSN(LABEL, asm_label(0)),
+	        INSN(RET)
+	);
+
+	// a jump over 47 three byte instructions needs a 32-bit displacement
+#define MOVS3 INSN(MOV, RAX, RCX), INSN(MOV, RAX, RCX), INSN(MOV, RAX, RCX)
+#define MOVS9 MOVS3, MOVS3, MOVS3
+#define MOVS \
+	"48 89 c8 48 89 c8 48 89 c8 48 89 c8 48 89 c8 48 89 c8 48 89 c8 48 89 c8 48 89 c8 "
+	ENCODE_TEST(
+	        state,
+	        "near jump",
+	        "0f 85 8d 00 00 00 " MOVS MOVS MOVS MOVS MOVS "48 89 c8 48 89 c8 c3",
+	        INSN(JNE, asm_label(0)),
+	        MOVS9,
+	        MOVS9,
+	        MOVS9,
+	        MOVS9,
+	        MOVS9,
+	        INSN(MOV, RAX, RCX),
+	        INSN(MOV, RAX, RCX),
+	        INSN(LABEL, asm_label(0)),
+	        INSN(RET)
+	);
+#undef MOVS
+#undef MOVS9
+#undef MOVS3
+
+	RUN_TEST(state, encode_unwritable, str_lit("object to a full device"));
+
+	TestCaseBuf tests = get_tests(IMPLEMENTED_STAGES);
+	for (uint64_t i = 0; i < tests.len; i++) {
+		TestCase test = tests.ptr[i];
+		for (uint64_t j = 0; j < sizeof(CODEGEN_STRATEGIES) / sizeof(CODEGEN_STRATEGIES[0]); j++) {
+			RUN_TEST(
+			        state,
+			        encode_file,
+			        str_fmt("assembling " STR_FMT " with %s", STR_ARG(test.path), CODEGEN_STRATEGIES[j]),
+			        str_ref(test.path),
+			        CODEGEN_STRATEGIES[j]
+			);
+		}
+		str_free(test.path);
+	}
+	BUF_FREE(tests);
+}
@@ -3,6 +3,8 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #include "dragon/core/buf.h"
@@ -12,24 +14,68 @@
 #include "dragon/test/info.h"
 #include "dragon/test/list.h"
 
-static TEST_FUNC(state, execute, str testPath, bool isValid, bool skipOnFailure)
+// Whether every strategy runs its programs in-process with --run instead of
+// executing them, so no child process is spawned for dragonk's programs.
+#ifndef TEST_EXECUTE_JIT
+#define TEST_EXECUTE_JIT 0
+#endif
+
+// Whether `errIn`, dragonk's error output, reports an error.
+static bool reported_error(FILE* errIn)
 {
-	char* args[] = { "dragon", "-o", "dragon.out", (char*)testPath.ptr };
+	bool error = false;
+	char* line = NULL;
+	size_t len = 0;
+	while (getline(&line, &len, errIn) != -1) {
+		error = error || strncmp(line, "ERROR:", strlen("ERROR:")) == 0;
+	}
+	free(line);
+	return error;
+}
+
+// Compiles and runs the program, or with `inProcess`, such as --run or
+// --interpret, has dragonk run it itself.
+static TEST_FUNC(
+        state,
+        execute,
+        str testPath,
+        const char* codegen,
+        bool isValid,
+        bool skipOnFailure,
+        const char* inProcess
+)
+{
+	bool ranInProcess = inProcess != NULL;
+	char* compileArgs[] = { "dragon", (char*)codegen, "-o", "dragon.out", (char*)testPath.ptr };
+	char* inProcessArgs[] = { "dragon", (char*)codegen, (char*)inProcess, (char*)testPath.ptr };
+	CArgBuf args = ranInProcess ? (CArgBuf)BUF_ARRAY(inProcessArgs) : (CArgBuf)BUF_ARRAY(compileArgs);
 	int outpipe[2];
 	int errpipe[2];
 	TEST_ASSERT(state, pipe(outpipe) == 0, NO_CLEANUP, "failed to create pipe: %m");
 	TEST_ASSERT(state, pipe(errpipe) == 0, NO_CLEANUP, "failed to create pipe: %m");
 	FILE* out = fdopen(outpipe[1], "w");
 	FILE* err = fdopen(errpipe[1], "w");
-	int res = run((CArgBuf)BUF_ARRAY(args), out, err);
+	int res = run(args, out, err);
 	(void)fclose(out);
 	(void)fclose(err);
+	// run's result is the program's status when it runs the program, so
+	// only the error output tells whether compiling failed
+	bool failed = res != 0;
+	if (ranInProcess) {
+		FILE* errIn = fdopen(errpipe[0], "r");
+		failed = reported_error(errIn);
+		(void)fclose(errIn);
+		(void)close(outpipe[0]);
+	}
 	if (isValid) {
-		if (res != 0) {
+		if (failed) {
 			if (skipOnFailure) {
 				(void)remove("dragon.out");
 				SKIP();
 			}
+			if (ranInProcess) {
+				FAIL(state, NO_CLEANUP, "dragon failed to compile or run");
+			}
 			FILE* errIn = fdopen(errpipe[0], "r");
 			char* line = NULL;
 			size_t len = 0;
@@ -46,7 +92,7 @@ static TEST_FUNC(state, execute, str testPath, bool isValid, bool skipOnFailure)
 	} else {
 		TEST_ASSERT(
 		        state,
-		        res != 0,
+		        failed,
 		        CLEANUP((void)remove("dragon.out")),
 		        "dragon compiled invalid test " STR_FMT,
 		        STR_ARG(testPath)
@@ -54,22 +100,25 @@ static TEST_FUNC(state, execute, str testPath, bool isValid, bool skipOnFailure)
 		PASS();
 	}
 
-	const char* runArgs[] = { "./dragon.out" };
-	ProcessCreateResult dragonResult =
-	        process_run(
-	                (ProcessCStrBuf)BUF_ARRAY(runArgs),
-	                PROCESS_OPTION_COMBINED_STDOUT_STDERR
-	        );
-	TEST_ASSERT(
-	        state,
-	        dragonResult.present,
-	        CLEANUP((void)remove("dragon.out")),
-	        "dragon program failed to spawn"
-	);
+	int dragonCode = res;
+	if (!ranInProcess) {
+		const char* runArgs[] = { "./dragon.out" };
+		ProcessCreateResult dragonResult =
+		        process_run(
+		                (ProcessCStrBuf)BUF_ARRAY(runArgs),
+		                PROCESS_OPTION_COMBINED_STDOUT_STDERR
+		        );
+		TEST_ASSERT(
+		        state,
+		        dragonResult.present,
+		        CLEANUP((void)remove("dragon.out")),
+		        "dragon program failed to spawn"
+		);
 
-	int dragonCode = dragonResult.value.returnCode;
-	process_destroy(&dragonResult.value);
-	(void)remove("dragon.out");
+		dragonCode = dragonResult.value.returnCode;
+		process_destroy(&dragonResult.value);
+		(void)remove("dragon.out");
+	}
 
 	const char* gccArgs[] = { "gcc", testPath.ptr, "-o", "gcc.out" };
 	ProcessCreateResult gccResult =
@@ -115,18 +164,57 @@ static TEST_FUNC(state, execute, str testPath, bool isValid, bool skipOnFailure)
 	PASS();
 }
 
+static const char* const CODEGEN_STRATEGIES[] = {
+	"--codegen=register",
+	"--codegen=stack",
+	"--codegen=ir",
+	// the default strategy on expressions that still contain constant operators
+	"--no-fold",
+	// the instructions exactly as the default strategy generates them
+	"--no-peephole",
+	// assembled and linked in-process instead of by nasm and ld
+	"--integrated-as",
+};
+
 SUITE_FUNC(state, execute)
 {
 	TestCaseBuf tests = get_tests(IMPLEMENTED_STAGES);
 	for (uint64_t i = 0; i < tests.len; i++) {
 		TestCase test = tests.ptr[i];
+		for (uint64_t j = 0; j < sizeof(CODEGEN_STRATEGIES) / sizeof(CODEGEN_STRATEGIES[0]); j++) {
+			RUN_TEST(
+			        state,
+			        execute,
+			        str_fmt("executing " STR_FMT " with %s", STR_ARG(test.path), CODEGEN_STRATEGIES[j]),
+			        str_ref(test.path),
+			        CODEGEN_STRATEGIES[j],
+			        test.isValid,
+			        test.skipOnFailure,
+			        TEST_EXECUTE_JIT ? "--run" : NULL
+			);
+		}
+		if (!TEST_EXECUTE_JIT) {
+			RUN_TEST(
+			        state,
+			        execute,
+			        str_fmt("executing " STR_FMT " with --run", STR_ARG(test.path)),
+			        str_ref(test.path),
+			        "--codegen=register",
+			        test.isValid,
+			        test.skipOnFailure,
+			        "--run"
+			);
+		}
+		// unfolded, so the interpreter evaluates every operator
 		RUN_TEST(
 		        state,
 		        execute,
-		        str_fmt("executing " STR_FMT, STR_ARG(test.path)),
+		        str_fmt("executing " STR_FMT " with --interpret", STR_ARG(test.path)),
 		        str_ref(test.path),
+		        "--no-fold",
 		        test.isValid,
-		        test.skipOnFailure
+		        test.skipOnFailure,
+		        "--interpret"
 		);
 		str_free(test.path);
 	}
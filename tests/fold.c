@@ -0,0 +1,94 @@
+#include "dragon/test/fold.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "dragon/ast.h"
+#include "dragon/core/source.h"
+#include "dragon/core/str.h"
+#include "dragon/fold.h"
+#include "dragon/test/program.h"
+
+// Folds `return <expr>;` and checks that it became `expected`, or that it
+// stayed an operator if `folds` is false. Undefined operations are checked
+// with `checkValue` false, since C gives them no value to expect.
+static TEST_FUNC(state, fold, str expr, bool folds, bool checkValue, int64_t expected, uint64_t warnings)
+{
+	TEST_PARSE_RETURN(state, program, expr, NO_CLEANUP);
+	str source = return_source(expr);
+	SourceFile file = source_file_new(str_lit("<fold>"), source);
+	FoldResult folded = fold_program(&program, &file);
+	source_file_free(file);
+
+	const Expression* root = program.function.statement.expression;
+	bool isConstant = root->type == EXPRESSION_TYPE_CONSTANT;
+	int64_t value = isConstant ? ((const ConstantExpression*)root)->number : 0;
+	uint64_t warningCount = folded.warnings.len;
+	fold_result_free(folded);
+	program_free(program);
+	str_free(source);
+
+	TEST_ASSERT(
+	        state,
+	        isConstant == folds,
+	        NO_CLEANUP,
+	        folds ? "wasn't folded" : "was folded to %" PRId64,
+	        value
+	);
+	TEST_ASSERT(
+	        state,
+	        !folds || !checkValue || value == expected,
+	        NO_CLEANUP,
+	        "folded to %" PRId64 ", expected %" PRId64,
+	        value,
+	        expected
+	);
+	TEST_ASSERT(
+	        state,
+	        warningCount == warnings,
+	        NO_CLEANUP,
+	        "%" PRIu64 " warnings, expected %" PRIu64,
+	        warningCount,
+	        warnings
+	);
+	PASS();
+}
+
+#define FOLD_TEST(state, expr, folds, expected, warnings) \
+	RUN_TEST(state, fold, str_lit("folding " expr), str_lit(expr), folds, true, expected, warnings)
+
+#define FOLD_UNDEFINED_TEST(state, expr) \
+	RUN_TEST(state, fold, str_lit("folding " expr), str_lit(expr), true, false, 0, 1)
+
+SUITE_FUNC(state, fold)
+{
+	FOLD_TEST(state, "1 + 2 * 3", true, 7, 0);
+	FOLD_TEST(state, "-7 / 2", true, -3, 0);
+	FOLD_TEST(state, "-7 % 2", true, -1, 0);
+	FOLD_TEST(state, "7 % -2", true, 1, 0);
+	FOLD_TEST(state, "-8 >> 1", true, -4, 0);
+	FOLD_TEST(state, "1 << 62", true, INT64_C(1) << 62, 0);
+	FOLD_TEST(state, "-9223372036854775807 - 1", true, INT64_MIN, 0);
+	// still folded, but reported like division by zero
+	FOLD_UNDEFINED_TEST(state, "1 << 65");
+	FOLD_UNDEFINED_TEST(state, "1 >> -1");
+	FOLD_UNDEFINED_TEST(state, "1 << 63");
+	FOLD_UNDEFINED_TEST(state, "-1 << 1");
+	FOLD_UNDEFINED_TEST(state, "9223372036854775807 + 1");
+	FOLD_UNDEFINED_TEST(state, "-9223372036854775807 - 2");
+	FOLD_UNDEFINED_TEST(state, "4611686018427387904 * 2");
+	FOLD_UNDEFINED_TEST(state, "-(-9223372036854775807 - 1)");
+	FOLD_TEST(state, "!0 + !5 + ~0", true, 0, 0);
+	FOLD_TEST(state, "(3 < 4) + (4 <= 4) + (5 > 4) + (3 >= 4) + (1 == 1) + (1 != 1)", true, 4, 0);
+	FOLD_TEST(state, "6 & 3 | 8 ^ 1", true, 11, 0);
+	FOLD_TEST(state, "2 && 3", true, 1, 0);
+	FOLD_TEST(state, "0 || 0", true, 0, 0);
+	FOLD_TEST(state, "1 / 0", false, 0, 1);
+	FOLD_TEST(state, "1 % (2 - 2)", false, 0, 1);
+	FOLD_TEST(state, "(-9223372036854775807 - 1) / -1", false, 0, 1);
+	// the right operand is never evaluated
+	FOLD_TEST(state, "0 && 1 / 0", true, 0, 1);
+	FOLD_TEST(state, "1 || 1 / 0", true, 1, 1);
+	FOLD_TEST(state, "1 && 1 / 0", false, 0, 1);
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+#include <stdint.h>
+
+// Number of malloc/calloc/realloc calls made so far by the test binary. The
+// allocator entry points are wrapped at link time (see CMakeLists.txt).
+uint64_t test_alloc_count(void);
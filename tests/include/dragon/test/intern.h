@@ -0,0 +1,5 @@
+#pragma once
+
+#include "dragon/test/test.h"
+
+SUITE_FUNC(state, intern);
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "dragon/ast.h"
+#include "dragon/core/str.h"
+#include "dragon/parser.h"
+#include "dragon/test/test.h"
+
+// The source of `int main() { return <expr>; }`.
+str return_source(str expr);
+// Parses `int main() { return <expr>; }`.
+ProgramResult parse_return(str expr);
+
+// Declares `program`, parsed from `return <expr>;`, failing the test after
+// `cleanup` if it doesn't parse.
+#define TEST_PARSE_RETURN(state, program, expr, cleanup) \
+	ProgramResult program##Parsed = parse_return(expr); \
+	TEST_ASSERT( \
+	        state, \
+	        program##Parsed.ok, \
+	        CLEANUP(str_free(program##Parsed.get.error); cleanup), \
+	        "parse failed: " STR_FMT, \
+	        STR_ARG(program##Parsed.get.error) \
+	); \
+	Program program = program##Parsed.get.value
@@ -0,0 +1,71 @@
+#include "dragon/test/intern.h"
+
+#include <inttypes.h>
+#include <stdint.h>
+
+#include "dragon/core/intern.h"
+#include "dragon/core/str.h"
+
+// Enough names to grow both the slot table and the text arena a few times.
+#define INTERN_TEST_COUNT 5000
+
+static TEST_FUNC(state, intern_many)
+{
+	Interner interner = interner_new();
+	for (uint32_t i = 0; i < INTERN_TEST_COUNT; i++) {
+		str name = str_fmt("name_%" PRIu32, i);
+		SymbolId id = interner_intern(&interner, name);
+		str_free(name);
+		TEST_ASSERT(
+		        state,
+		        id == i,
+		        CLEANUP(interner_free(interner)),
+		        "name_%" PRIu32 " got symbol %" PRIu32,
+		        i,
+		        id
+		);
+	}
+	for (uint32_t i = 0; i < INTERN_TEST_COUNT; i++) {
+		str name = str_fmt("name_%" PRIu32, i);
+		SymbolId id = interner_intern(&interner, name);
+		bool same = str_eq(interner_get(&interner, id), name);
+		str_free(name);
+		TEST_ASSERT(
+		        state,
+		        id == i && same,
+		        CLEANUP(interner_free(interner)),
+		        "name_%" PRIu32 " was interned twice",
+		        i
+		);
+	}
+	interner_free(interner);
+	PASS();
+}
+
+static TEST_FUNC(state, intern_text)
+{
+	Interner interner = interner_new();
+	// Names borrowed from a larger buffer must be copied, not referenced.
+	str source = str_lit("main mainly");
+	SymbolId a = interner_intern(&interner, str_ref_chars(source.ptr, 4));
+	SymbolId b = interner_intern(&interner, str_ref_chars(source.ptr + 5, 6));
+	SymbolId c = interner_intern(&interner, str_lit("main"));
+	str text = interner_get(&interner, a);
+	TEST_ASSERT(
+	        state,
+	        a == c && a != b && text.ptr != source.ptr && text.ptr[str_len(text)] == '\0',
+	        CLEANUP(interner_free(interner)),
+	        "symbols %" PRIu32 ", %" PRIu32 ", %" PRIu32 " are wrong",
+	        a,
+	        b,
+	        c
+	);
+	interner_free(interner);
+	PASS();
+}
+
+SUITE_FUNC(state, intern)
+{
+	RUN_TEST(state, intern_many, str_lit("interning many names"));
+	RUN_TEST(state, intern_text, str_lit("interned text is owned"));
+}
@@ -0,0 +1,230 @@
+#include "dragon/test/interp.h"
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "dragon/ast.h"
+#include "dragon/bytecode.h"
+#include "dragon/core/buf.h"
+#include "dragon/core/str.h"
+#include "dragon/interp.h"
+#include "dragon/test/program.h"
+
+// Compiles `return <expr>;` without folding it. Nothing is returned if it
+// doesn't parse.
+static BytecodeResult compile_expr(str expr)
+{
+	ProgramResult result = parse_return(expr);
+	if (!result.ok) {
+		return (BytecodeResult)ERR(result.get.error);
+	}
+	BytecodeResult code = bytecode_compile(result.get.value.function);
+	program_free(result.get.value);
+	return code;
+}
+
+static TEST_FUNC(state, bytecode, str expr, str expected)
+{
+	BytecodeResult result = compile_expr(expr);
+	TEST_ASSERT(state, result.ok, CLEANUP(str_free(result.get.error)), "compiling failed");
+	str actual = bytecode_to_str(&result.get.value);
+	bytecode_free(result.get.value);
+	TEST_ASSERT(
+	        state,
+	        str_eq(actual, expected),
+	        CLEANUP(str_free(actual)),
+	        "got\n" STR_FMT "expected\n" STR_FMT,
+	        STR_ARG(actual),
+	        STR_ARG(expected)
+	);
+	str_free(actual);
+	PASS();
+}
+
+// Interprets `return <expr>;`, expecting either its value or, if `error` isn't
+// empty, that error.
+static TEST_FUNC(state, interp, str expr, int64_t expected, str error)
+{
+	BytecodeResult code = compile_expr(expr);
+	TEST_ASSERT(state, code.ok, CLEANUP(str_free(code.get.error)), "compiling failed");
+	InterpResult result = interp_run(&code.get.value, stdin, stdout);
+	bytecode_free(code.get.value);
+	if (str_len(error) > 0) {
+		TEST_ASSERT(state, !result.ok, NO_CLEANUP, "returned %" PRId64 " instead of failing", result.get.value);
+		TEST_ASSERT(
+		        state,
+		        str_eq(result.get.error, error),
+		        CLEANUP(str_free(result.get.error)),
+		        "failed with '" STR_FMT "'",
+		        STR_ARG(result.get.error)
+		);
+		str_free(result.get.error);
+		PASS();
+	}
+	TEST_ASSERT(
+	        state,
+	        result.ok,
+	        CLEANUP(str_free(result.get.error)),
+	        "failed with '" STR_FMT "'",
+	        STR_ARG(result.get.error)
+	);
+	TEST_ASSERT(
+	        state,
+	        result.get.value == expected,
+	        NO_CLEANUP,
+	        "returned %" PRId64 " instead of %" PRId64,
+	        result.get.value,
+	        expected
+	);
+	PASS();
+}
+
+// Nothing compiles to calls yet, so the call is assembled by hand.
+static TEST_FUNC(state, interp_host_call)
+{
+	HostFunctionFindResult putcharResult = host_function_find(str_lit("putchar"));
+	TEST_ASSERT(state, putcharResult.present, NO_CLEANUP, "putchar isn't a host function");
+	TEST_ASSERT(state, host_function_arity(putcharResult.value) == 1, NO_CLEANUP, "putchar takes one argument");
+	TEST_ASSERT(state, !host_function_find(str_lit("printf")).present, NO_CLEANUP, "printf is a host function");
+
+	BcInstruction instructions[] = {
+		{ .opcode = BC_OP_LOAD, .dst = 1, .a = 'h' },
+		{ .opcode = BC_OP_CALL, .dst = 0, .a = (uint16_t)putcharResult.value, .b = 1 },
+		{ .opcode = BC_OP_LOAD, .dst = 1, .a = 'i' },
+		{ .opcode = BC_OP_CALL, .dst = 0, .a = (uint16_t)putcharResult.value, .b = 1 },
+		{ .opcode = BC_OP_RETURN, .a = 0 },
+	};
+	Bytecode code = {
+		.code = BUF_ARRAY(instructions),
+		.constants = BUF_NEW,
+		.registerCount = 2,
+	};
+	char* output = NULL;
+	size_t len = 0;
+	FILE* out = open_memstream(&output, &len);
+	TEST_ASSERT(state, out != NULL, NO_CLEANUP, "failed to open a memory stream: %m");
+	InterpResult result = interp_run(&code, stdin, out);
+	(void)fclose(out);
+	TEST_ASSERT(
+	        state,
+	        str_eq(str_ref_chars(output, len), str_lit("hi")),
+	        CLEANUP(free(output)),
+	        "wrote '%s'",
+	        output
+	);
+	free(output);
+	TEST_ASSERT(state, result.ok && result.get.value == 'i', NO_CLEANUP, "putchar didn't return its argument");
+	PASS();
+}
+
+// Calls outside the host functions or the frame are rejected before anything
+// runs, and listing them doesn't read past the host function table either.
+static TEST_FUNC(state, interp_invalid_call, BcInstruction call)
+{
+	BcInstruction instructions[] = {
+		call,
+		{ .opcode = BC_OP_RETURN, .a = 0 },
+	};
+	Bytecode code = {
+		.code = BUF_ARRAY(instructions),
+		.constants = BUF_NEW,
+		.registerCount = 2,
+	};
+	str_free(bytecode_to_str(&code));
+	InterpResult result = interp_run(&code, stdin, stdout);
+	TEST_ASSERT(state, !result.ok, NO_CLEANUP, "the call ran and returned %" PRId64, result.get.value);
+	str_free(result.get.error);
+	PASS();
+}
+
+#define BYTECODE_TEST(state, expr, expected) \
+	RUN_TEST(state, bytecode, str_lit("compiling " expr), str_lit(expr), str_lit(expected))
+
+#define INTERP_TEST(state, expr, expected) \
+	RUN_TEST(state, interp, str_lit("interpreting " expr), str_lit(expr), expected, str_empty)
+
+#define INTERP_ERROR_TEST(state, expr, error) \
+	RUN_TEST(state, interp, str_lit("interpreting " expr), str_lit(expr), 0, str_lit(error))
+
+SUITE_FUNC(state, interp)
+{
+	// constants are only loaded when they can't be an immediate
+	BYTECODE_TEST(
+	        state,
+	        "-(1 + 2) * ~3",
+	        "registers 2\n"
+	        "   0: load   r0, 1\n"
+	        "   1: addi   r0, r0, 2\n"
+	        "   2: neg    r0, r0\n"
+	        "   3: load   r1, 3\n"
+	        "   4: not    r1, r1\n"
+	        "   5: mul    r0, r0, r1\n"
+	        "   6: ret    r0\n"
+	);
+	BYTECODE_TEST(
+	        state,
+	        "5000000000 - 70000",
+	        "registers 2\n"
+	        "   0: loadk  r0, 5000000000\n"
+	        "   1: load   r1, 70000\n"
+	        "   2: sub    r0, r0, r1\n"
+	        "   3: ret    r0\n"
+	);
+	// the right operand runs in the left one's register, which is already
+	// the result if it decides it
+	BYTECODE_TEST(
+	        state,
+	        "1 || 2 > 3",
+	        "registers 2\n"
+	        "   0: load   r0, 1\n"
+	        "   1: jnz    r0, 4\n"
+	        "   2: load   r0, 2\n"
+	        "   3: gti    r0, r0, 3\n"
+	        "   4: ret    r0\n"
+	);
+	BYTECODE_TEST(
+	        state,
+	        "2 && 3",
+	        "registers 1\n"
+	        "   0: load   r0, 2\n"
+	        "   1: jz     r0, 4\n"
+	        "   2: load   r0, 3\n"
+	        "   3: bool   r0, r0\n"
+	        "   4: ret    r0\n"
+	);
+
+	INTERP_TEST(state, "2 + 3 * 4 - 100000", -99986);
+	INTERP_TEST(state, "-7 / 2 + -7 % 2 * 10", -13);
+	// shift counts are masked like the generated code's
+	INTERP_TEST(state, "(1 << 65) + (-16 >> 2)", -2);
+	INTERP_TEST(state, "4611686018427387904 * 2", INT64_MIN);
+	INTERP_TEST(state, "(5 < 7) + (5 <= 4) * 2 + (3 > 3) * 4 + (3 >= 3) * 8 + (1 == 1) * 16 + (1 != 1) * 32", 25);
+	INTERP_TEST(state, "(12 & 10) + (12 ^ 10) * 100 + (12 | 10) * 10000", 140608);
+	INTERP_TEST(state, "!5 + ~0 + !0", 0);
+	INTERP_TEST(state, "0 && 1 / 0", 0);
+	INTERP_TEST(state, "3 || 1 / 0", 1);
+	INTERP_TEST(state, "(2 && 5) + (0 || 0) + (0 || -4)", 2);
+	INTERP_ERROR_TEST(state, "1 / (2 - 2)", "division by zero");
+	INTERP_ERROR_TEST(state, "(-9223372036854775807 - 1) % -1", "division overflow");
+	RUN_TEST(state, interp_host_call, str_lit("calling host functions"));
+	RUN_TEST(
+	        state,
+	        interp_invalid_call,
+	        str_lit("calling an unknown host function"),
+	        (BcInstruction) { .opcode = BC_OP_CALL, .dst = 0, .a = HOST_FUNCTION_COUNT, .b = 1 }
+	);
+	RUN_TEST(
+	        state,
+	        interp_invalid_call,
+	        str_lit("calling with arguments past the frame"),
+	        (BcInstruction) { .opcode = BC_OP_CALL, .dst = 0, .a = HOST_FUNCTION_PUTCHAR, .b = 2 }
+	);
+	RUN_TEST(
+	        state,
+	        interp_invalid_call,
+	        str_lit("calling into a register past the frame"),
+	        (BcInstruction) { .opcode = BC_OP_CALL, .dst = 2, .a = HOST_FUNCTION_GETCHAR, .b = 0 }
+	);
+}
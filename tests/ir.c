@@ -0,0 +1,81 @@
+#include "dragon/test/ir.h"
+
+#include "dragon/ast.h"
+#include "dragon/core/str.h"
+#include "dragon/ir.h"
+#include "dragon/test/program.h"
+
+// Lowers `return <expr>;` without folding it, and checks the printed IR.
+static TEST_FUNC(state, ir, str expr, str expected)
+{
+	TEST_PARSE_RETURN(state, program, expr, NO_CLEANUP);
+
+	IrFunction func = ir_lower_function(program.function);
+	str actual = ir_function_to_str(&func, &program.symbols);
+	ir_function_free(func);
+	program_free(program);
+	TEST_ASSERT(
+	        state,
+	        str_eq(actual, expected),
+	        CLEANUP(str_free(actual)),
+	        "got\n" STR_FMT "expected\n" STR_FMT,
+	        STR_ARG(actual),
+	        STR_ARG(expected)
+	);
+	str_free(actual);
+	PASS();
+}
+
+#define IR_TEST(state, expr, expected) \
+	RUN_TEST(state, ir, str_lit("lowering " expr), str_lit(expr), str_lit(expected))
+
+SUITE_FUNC(state, ir)
+{
+	IR_TEST(state, "2", "function main\nb0:\n    return 2\n");
+	IR_TEST(
+	        state,
+	        "-(1 + 2) * ~3",
+	        "function main\n"
+	        "b0:\n"
+	        "    v0 = add 1, 2\n"
+	        "    v1 = neg v0\n"
+	        "    v2 = not 3\n"
+	        "    v3 = mul v1, v2\n"
+	        "    return v3\n"
+	);
+	// the right operand only runs if the left one doesn't decide the result
+	IR_TEST(
+	        state,
+	        "1 && 2",
+	        "function main\n"
+	        "b0:\n"
+	        "    v0 = 0\n"
+	        "    branch 1, b1, b2\n"
+	        "b1:\n"
+	        "    v0 = ne 2, 0\n"
+	        "    jump b2\n"
+	        "b2:\n"
+	        "    return v0\n"
+	);
+	// blocks are laid out in evaluation order, not in creation order
+	IR_TEST(
+	        state,
+	        "1 || (2 && 3 < 4)",
+	        "function main\n"
+	        "b0:\n"
+	        "    v0 = 1\n"
+	        "    branch 1, b4, b1\n"
+	        "b1:\n"
+	        "    v1 = 0\n"
+	        "    branch 2, b2, b3\n"
+	        "b2:\n"
+	        "    v2 = lt 3, 4\n"
+	        "    v1 = v2\n"
+	        "    jump b3\n"
+	        "b3:\n"
+	        "    v0 = v1\n"
+	        "    jump b4\n"
+	        "b4:\n"
+	        "    return v0\n"
+	);
+}
@@ -0,0 +1,134 @@
+#include "dragon/test/ir_opt.h"
+
+#include <stdbool.h>
+
+#include "dragon/ast.h"
+#include "dragon/core/str.h"
+#include "dragon/ir.h"
+#include "dragon/ir_opt.h"
+#include "dragon/test/program.h"
+
+// Lowers `return <expr>;` without folding it, runs the IR passes in `options`
+// and checks the printed SSA form.
+static TEST_FUNC(state, ir_opt, str expr, IrOptOptions options, str expected)
+{
+	TEST_PARSE_RETURN(state, program, expr, NO_CLEANUP);
+
+	IrFunction func = ir_lower_function(program.function);
+	(void)ir_optimize(&func, options);
+	str actual = ir_function_to_str(&func, &program.symbols);
+	ir_function_free(func);
+	program_free(program);
+	TEST_ASSERT(
+	        state,
+	        str_eq(actual, expected),
+	        CLEANUP(str_free(actual)),
+	        "got\n" STR_FMT "expected\n" STR_FMT,
+	        STR_ARG(actual),
+	        STR_ARG(expected)
+	);
+	str_free(actual);
+	PASS();
+}
+
+#define IR_OPT_TEST(state, name, expr, options, expected) \
+	RUN_TEST(state, ir_opt, str_lit(name " " expr), str_lit(expr), options, str_lit(expected))
+
+static const IrOptOptions NO_PASSES = { .sccp = false, .gvn = false, .dce = false };
+static const IrOptOptions SCCP = { .sccp = true, .gvn = false, .dce = false };
+static const IrOptOptions GVN = { .sccp = false, .gvn = true, .dce = false };
+static const IrOptOptions DCE = { .sccp = false, .gvn = false, .dce = true };
+static const IrOptOptions ALL_PASSES = { .sccp = true, .gvn = true, .dce = true };
+
+SUITE_FUNC(state, ir_opt)
+{
+	// copies disappear, and the values of && and || meet in phis
+	IR_OPT_TEST(
+	        state,
+	        "constructing SSA for",
+	        "1 || (2 && 3 < 4)",
+	        NO_PASSES,
+	        "function main\n"
+	        "b0:\n"
+	        "    branch 1, b4, b1\n"
+	        "b1:\n"
+	        "    branch 2, b2, b3\n"
+	        "b2:\n"
+	        "    v0 = lt 3, 4\n"
+	        "    jump b3\n"
+	        "b3:\n"
+	        "    v1 = phi [0, b1], [v0, b2]\n"
+	        "    jump b4\n"
+	        "b4:\n"
+	        "    v2 = phi [1, b0], [v1, b3]\n"
+	        "    v3 = phi [0, b0], [v1, b3]\n"
+	        "    return v2\n"
+	);
+	IR_OPT_TEST(
+	        state,
+	        "propagating constants through",
+	        "1 || (2 && 3 < 4)",
+	        SCCP,
+	        "function main\nb0:\n    return 1\n"
+	);
+	// the division traps at run time, so it stays
+	IR_OPT_TEST(
+	        state,
+	        "propagating constants through",
+	        "(1 / 0 || 2) + 3",
+	        SCCP,
+	        "function main\n"
+	        "b0:\n"
+	        "    v0 = div 1, 0\n"
+	        "    branch v0, b2, b1\n"
+	        "b1:\n"
+	        "    jump b2\n"
+	        "b2:\n"
+	        "    return 4\n"
+	);
+	IR_OPT_TEST(
+	        state,
+	        "numbering values in",
+	        "1 / 0 + 2 / 0 == 2 / 0 + 1 / 0",
+	        GVN,
+	        "function main\n"
+	        "b0:\n"
+	        "    v0 = div 1, 0\n"
+	        "    v1 = div 2, 0\n"
+	        "    v2 = add v0, v1\n"
+	        "    v3 = eq v2, v2\n"
+	        "    return v3\n"
+	);
+	// the phi for the result of && is never read
+	IR_OPT_TEST(
+	        state,
+	        "removing dead code from",
+	        "1 || (2 && 3 < 4)",
+	        DCE,
+	        "function main\n"
+	        "b0:\n"
+	        "    branch 1, b4, b1\n"
+	        "b1:\n"
+	        "    branch 2, b2, b3\n"
+	        "b2:\n"
+	        "    v0 = lt 3, 4\n"
+	        "    jump b3\n"
+	        "b3:\n"
+	        "    v1 = phi [0, b1], [v0, b2]\n"
+	        "    jump b4\n"
+	        "b4:\n"
+	        "    v2 = phi [1, b0], [v1, b3]\n"
+	        "    return v2\n"
+	);
+	// multiplying by 0 makes the sum unused, but not the division
+	IR_OPT_TEST(
+	        state,
+	        "removing dead code from",
+	        "(1 / 0 + 3) * 0",
+	        ALL_PASSES,
+	        "function main\n"
+	        "b0:\n"
+	        "    v0 = div 1, 0\n"
+	        "    return 0\n"
+	);
+}
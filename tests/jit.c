@@ -0,0 +1,58 @@
+#include "dragon/test/jit.h"
+
+#include <inttypes.h>
+#include <stdint.h>
+
+#include "dragon/core/buf.h"
+#include "dragon/core/str.h"
+#include "dragon/jit.h"
+#include "dragon/object.h"
+
+// Runs `code` as the function `f` and checks that it returns `expected`, or,
+// if `expected` is NULL, that it traps.
+static TEST_FUNC(state, jit, ByteBuf code, const int64_t* expected)
+{
+	Object object = object_new();
+	object_define(&object, str_lit("f"), true);
+	for (uint64_t i = 0; i < code.len; i++) {
+		bytes_push8(&object.text, code.ptr[i]);
+	}
+	object_finish(&object);
+	JitResult result = jit_call(&object, str_lit("f"));
+	object_free(object);
+	if (expected == NULL) {
+		TEST_ASSERT(state, !result.ok, NO_CLEANUP, "returned %" PRId64 " instead of trapping", result.get.value);
+		str_free(result.get.error);
+		PASS();
+	}
+	TEST_ASSERT(
+	        state,
+	        result.ok,
+	        CLEANUP(str_free(result.get.error)),
+	        "trapped: " STR_FMT,
+	        STR_ARG(result.get.error)
+	);
+	TEST_ASSERT(
+	        state,
+	        result.get.value == *expected,
+	        NO_CLEANUP,
+	        "returned %" PRId64 ", expected %" PRId64,
+	        result.get.value,
+	        *expected
+	);
+	PASS();
+}
+
+#define JIT_TEST(state, name, expected, ...) \
+	RUN_TEST(state, jit, str_lit(name), (ByteBuf)BUF_ARRAY(((uint8_t[]) { __VA_ARGS__ })), expected)
+
+SUITE_FUNC(state, jit)
+{
+	static const int64_t FORTY_TWO = 42;
+	// mov eax, 42; ret
+	JIT_TEST(state, "return a value", &FORTY_TWO, 0xb8, 0x2a, 0x00, 0x00, 0x00, 0xc3);
+	// ud2
+	JIT_TEST(state, "invalid instruction", NULL, 0x0f, 0x0b);
+	// push rbp; jmp back to the push
+	JIT_TEST(state, "stack overflow", NULL, 0x55, 0xeb, 0xfd);
+}
@@ -1,18 +1,26 @@
 #include "dragon/test/lexer.h"
 
+#include <inttypes.h>
 #include <stdint.h>
 
 #include "dragon/core/buf.h"
 #include "dragon/core/file.h"
+#include "dragon/core/source.h"
 #include "dragon/core/str.h"
 #include "dragon/lexer.h"
+#include "dragon/test/alloc.h"
 #include "dragon/test/info.h"
 #include "dragon/test/list.h"
 #include "dragon/token.h"
+#include "dragon/token_stream.h"
+
+typedef BUF(const TokenType) TokenTypeBuf;
 
 static TEST_FUNC(state, lex, str path, bool skipOnFailure)
 {
+	uint64_t slurpAllocsBefore = test_alloc_count();
 	SlurpFileResult sourceResult = slurp_file(path);
+	uint64_t slurpAllocs = test_alloc_count() - slurpAllocsBefore;
 	TEST_ASSERT(
 	        state,
 	        sourceResult.ok,
@@ -20,31 +28,201 @@ static TEST_FUNC(state, lex, str path, bool skipOnFailure)
 	        STR_FMT,
 	        STR_ARG(sourceResult.get.error)
 	);
+	// the file's size is known, so its buffer never has to grow
+	TEST_ASSERT(
+	        state,
+	        slurpAllocs == 1,
+	        CLEANUP(str_free(sourceResult.get.value)),
+	        "reading the file allocated %" PRIu64 " times",
+	        slurpAllocs
+	);
 
-	Lexer lexer = lexer_new(sourceResult.get.value, str_ref(path));
+	// The interner preallocates enough room for the identifiers in any of the
+	// test cases, so lexing itself shouldn't allocate at all.
+	Interner symbols = interner_new();
+	uint64_t allocsBefore = test_alloc_count();
+	Lexer lexer = lexer_new(sourceResult.get.value, &symbols);
 	for (Token tok = lexer_first(&lexer); !lexer_done(&lexer); tok = lexer_next(&lexer)) {
 		if (tok.type == TT_ERROR) {
 			if (skipOnFailure) {
 				token_free(tok);
+				interner_free(symbols);
 				str_free(sourceResult.get.value);
 				SKIP();
 			}
+			SourceFile file = source_file_new(path, sourceResult.get.value);
+			SourceLocation loc = source_file_location(&file, tok.offset);
 			FAIL(
 			        state,
-			        CLEANUP(token_free(tok); str_free(sourceResult.get.value)),
+			        CLEANUP(
+			                token_free(tok);
+			                source_file_free(file);
+			                interner_free(symbols);
+			                str_free(sourceResult.get.value)
+			        ),
 			        "lex failed on " SOURCE_LOCATION_FMT ": '" STR_FMT "'",
-			        SOURCE_LOCATION_ARG(tok.location),
+			        SOURCE_LOCATION_ARG(loc),
 			        STR_ARG(tok.text)
 			);
 		}
 		token_free(tok);
 	}
 
+	uint64_t allocs = test_alloc_count() - allocsBefore;
+	interner_free(symbols);
+	TEST_ASSERT(
+	        state,
+	        allocs == 0,
+	        CLEANUP(str_free(sourceResult.get.value)),
+	        "lexer allocated %" PRIu64 " times",
+	        allocs
+	);
+
 	str_free(sourceResult.get.value);
 
 	PASS();
 }
 
+static TEST_FUNC(state, token_stream, str path)
+{
+	MapFileResult fileResult = map_file(path);
+	TEST_ASSERT(
+	        state,
+	        fileResult.ok,
+	        CLEANUP(str_free(fileResult.get.error)),
+	        STR_FMT,
+	        STR_ARG(fileResult.get.error)
+	);
+	MappedFile file = fileResult.get.value;
+	str source = file.contents;
+	for (uint64_t i = 0; i < FILE_PADDING; i++) {
+		TEST_ASSERT(
+		        state,
+		        str_end(source)[i] == '\0',
+		        CLEANUP(mapped_file_free(file)),
+		        "byte %" PRIu64 " after the end of the file isn't zero",
+		        i
+		);
+	}
+
+	// Both sides share the interner, so identifiers must map to the same symbols.
+	Interner symbols = interner_new();
+	TokenStream stream = token_stream_new(source, str_ref(path), &symbols);
+	Lexer lexer = lexer_new(source, &symbols);
+	uint32_t i = 0;
+	for (Token tok = lexer_first(&lexer);; tok = lexer_next(&lexer), i++) {
+		TEST_ASSERT(
+		        state,
+		        i < token_stream_len(&stream),
+		        CLEANUP(token_stream_free(stream); interner_free(symbols); mapped_file_free(file)),
+		        "token stream ended early at token %" PRIu32,
+		        i
+		);
+		TEST_ASSERT(
+		        state,
+		        token_stream_kind(&stream, i) == tok.type
+		        && str_eq(token_stream_text(&stream, i), tok.text),
+		        CLEANUP(token_stream_free(stream); interner_free(symbols); mapped_file_free(file)),
+		        "token %" PRIu32 " differs: %s '" STR_FMT "' vs %s '" STR_FMT "'",
+		        i,
+		        TOKEN_STRINGS[token_stream_kind(&stream, i)],
+		        STR_ARG(token_stream_text(&stream, i)),
+		        TOKEN_STRINGS[tok.type],
+		        STR_ARG(tok.text)
+		);
+		if (tok.value.kind == TK_NUM) {
+			TEST_ASSERT(
+			        state,
+			        token_stream_num(&stream, i) == tok.value.get.num,
+			        CLEANUP(token_stream_free(stream); interner_free(symbols); mapped_file_free(file)),
+			        "token %" PRIu32 " has the wrong value",
+			        i
+			);
+		}
+		if (tok.value.kind == TK_SYM) {
+			TEST_ASSERT(
+			        state,
+			        token_stream_sym(&stream, i) == tok.value.get.sym
+			        && str_eq(interner_get(&symbols, tok.value.get.sym), tok.text),
+			        CLEANUP(token_stream_free(stream); interner_free(symbols); mapped_file_free(file)),
+			        "token %" PRIu32 " has the wrong symbol",
+			        i
+			);
+		}
+		if (tok.type == TT_EOF) {
+			break;
+		}
+	}
+	TEST_ASSERT(
+	        state,
+	        i + 1 == token_stream_len(&stream),
+	        CLEANUP(token_stream_free(stream); interner_free(symbols); mapped_file_free(file)),
+	        "token stream has %" PRIu32 " extra tokens",
+	        token_stream_len(&stream) - i - 1
+	);
+
+	token_stream_free(stream);
+	interner_free(symbols);
+	mapped_file_free(file);
+
+	PASS();
+}
+
+static TEST_FUNC(state, comments, str source, TokenTypeBuf expected)
+{
+	Interner symbols = interner_new();
+	TokenStream stream = token_stream_new(source, str_lit("<comments>"), &symbols);
+	interner_free(symbols);
+	TEST_ASSERT(
+	        state,
+	        token_stream_len(&stream) == expected.len,
+	        CLEANUP(token_stream_free(stream)),
+	        "expected %" PRIu64 " tokens, got %" PRIu32,
+	        expected.len,
+	        token_stream_len(&stream)
+	);
+	for (uint32_t i = 0; i < expected.len; i++) {
+		TEST_ASSERT(
+		        state,
+		        token_stream_kind(&stream, i) == expected.ptr[i],
+		        CLEANUP(token_stream_free(stream)),
+		        "token %" PRIu32 " is %s, expected %s",
+		        i,
+		        TOKEN_STRINGS[token_stream_kind(&stream, i)],
+		        TOKEN_STRINGS[expected.ptr[i]]
+		);
+	}
+	token_stream_free(stream);
+	PASS();
+}
+
+#define TOKEN_TYPES(...) (TokenTypeBuf)BUF_ARRAY(((const TokenType[]) {__VA_ARGS__}))
+
+static void comment_tests(TestState* state)
+{
+	RUN_TEST(
+	        state,
+	        comments,
+	        str_lit("line comments"),
+	        str_lit("// leading\nreturn // trailing\n1; //"),
+	        TOKEN_TYPES(KW_RETURN, TT_NUM, TT_SEMI, TT_EOF)
+	);
+	RUN_TEST(
+	        state,
+	        comments,
+	        str_lit("block comments"),
+	        str_lit("/**/return/* a * b\n ** / */1 /*/ x */ / /***/2;"),
+	        TOKEN_TYPES(KW_RETURN, TT_NUM, TT_SLASH, TT_NUM, TT_SEMI, TT_EOF)
+	);
+	RUN_TEST(
+	        state,
+	        comments,
+	        str_lit("unterminated block comment"),
+	        str_lit("return 1; /* never closed *"),
+	        TOKEN_TYPES(KW_RETURN, TT_NUM, TT_SEMI, TT_ERROR, TT_EOF)
+	);
+}
+
 SUITE_FUNC(state, lexer)
 {
 	TestCaseBuf tests = get_tests(IMPLEMENTED_STAGES);
@@ -58,7 +236,15 @@ SUITE_FUNC(state, lexer)
 		        str_ref(test.path),
 		        test.skipOnFailure
 		);
+		RUN_TEST(
+		        state,
+		        token_stream,
+		        str_fmt("batch lexing " STR_FMT, STR_ARG(test.path)),
+		        str_ref(test.path)
+		);
 		str_free(test.path);
 	}
 	BUF_FREE(tests);
+
+	comment_tests(state);
 }
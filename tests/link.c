@@ -0,0 +1,124 @@
+#include "dragon/test/link.h"
+
+#include <elf.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "dragon/core/buf.h"
+#include "dragon/core/str.h"
+#include "dragon/link.h"
+#include "dragon/object.h"
+
+// An object defining `defined`, 16 bytes into its text, after a call to
+// `called`.
+static Object object_calling(str defined, bool global, str called)
+{
+	Object object = object_new();
+	bytes_push8(&object.text, 0xe8);
+	object_call(&object, called);
+	while (object.text.len < 16) {
+		bytes_push8(&object.text, 0xcc);
+	}
+	object_define(&object, defined, global);
+	bytes_push8(&object.text, 0xc3);
+	object_finish(&object);
+	return object;
+}
+
+static uint32_t read32(const uint8_t* bytes)
+{
+	uint32_t value;
+	memcpy(&value, bytes, sizeof(value));
+	return value;
+}
+
+static TEST_FUNC(state, link_two)
+{
+	Object objects[] = {
+		object_calling(str_lit("_start"), true, str_lit("f")),
+		object_calling(str_lit("f"), true, str_lit("_start")),
+	};
+	ByteBuf image = BUF_NEW;
+	LinkError error = link_executable(objects, 2, &image);
+	object_free(objects[0]);
+	object_free(objects[1]);
+	TEST_ASSERT(state, !error.present, CLEANUP(str_free(error.value); BUF_FREE(image)), "linking failed");
+
+	Elf64_Ehdr header;
+	memcpy(&header, image.ptr, sizeof(header));
+	// the headers take 120 bytes, so the first text starts at 128 and the
+	// second at 128 + 17 rounded up to 16
+	uint64_t first = 128;
+	uint64_t second = 160;
+	uint32_t firstCall = read32(image.ptr + first + 1);
+	uint32_t secondCall = read32(image.ptr + second + 1);
+	uint64_t len = image.len;
+	BUF_FREE(image);
+	TEST_ASSERT(
+	        state,
+	        header.e_entry == LINK_BASE_ADDRESS + first + 16,
+	        NO_CLEANUP,
+	        "entry point at %#" PRIx64,
+	        (uint64_t)header.e_entry
+	);
+	TEST_ASSERT(state, len == second + 17, NO_CLEANUP, "image is %" PRIu64 " bytes", len);
+	TEST_ASSERT(
+	        state,
+	        firstCall == second + 16 - (first + 5) && secondCall == (uint32_t)(first + 16 - (second + 5)),
+	        NO_CLEANUP,
+	        "calls relocated to %#x and %#x",
+	        firstCall,
+	        secondCall
+	);
+	PASS();
+}
+
+static TEST_FUNC(state, link_error, str defined, bool global, str called, str expected)
+{
+	Object objects[] = {
+		object_calling(str_lit("_start"), true, str_lit("f")),
+		object_calling(defined, global, called),
+	};
+	ByteBuf image = BUF_NEW;
+	LinkError error = link_executable(objects, 2, &image);
+	object_free(objects[0]);
+	object_free(objects[1]);
+	uint64_t len = image.len;
+	BUF_FREE(image);
+	TEST_ASSERT(state, error.present, NO_CLEANUP, "linking succeeded");
+	TEST_ASSERT(
+	        state,
+	        str_eq(error.value, expected),
+	        CLEANUP(str_free(error.value)),
+	        "got '" STR_FMT "'",
+	        STR_ARG(error.value)
+	);
+	str_free(error.value);
+	TEST_ASSERT(state, len == 0, NO_CLEANUP, "image is %" PRIu64 " bytes", len);
+	PASS();
+}
+
+SUITE_FUNC(state, link)
+{
+	RUN_TEST(state, link_two, str_lit("linking calls between objects"));
+	RUN_TEST(
+	        state,
+	        link_error,
+	        str_lit("linking a call to a local symbol of another object"),
+	        str_lit("f"),
+	        false,
+	        str_lit("g"),
+	        str_lit("undefined symbol 'f'")
+	);
+	RUN_TEST(
+	        state,
+	        link_error,
+	        str_lit("linking a symbol defined twice"),
+	        str_lit("_start"),
+	        true,
+	        str_lit("f"),
+	        str_lit("duplicate symbol '_start'")
+	);
+}
@@ -0,0 +1,195 @@
+#include "dragon/test/peephole.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dragon/asm.h"
+#include "dragon/core/buf.h"
+#include "dragon/core/intern.h"
+#include "dragon/core/str.h"
+#include "dragon/peephole.h"
+
+// Optimizes `code` and checks that it became `expected` by applying `rule`,
+// or that nothing changed if `rule` is PEEPHOLE_RULE_COUNT. `symbols` names
+// the symbols `code` refers to, if any.
+static TEST_FUNC(state, peephole, InstructionBuf code, const char* expected, PeepholeRule rule, const Interner* symbols)
+{
+	PeepholeStats stats = peephole_optimize(&code);
+	char* text = NULL;
+	size_t len = 0;
+	FILE* fp = open_memstream(&text, &len);
+	TEST_ASSERT(state, fp != NULL, NO_CLEANUP, "open_memstream failed");
+	asm_write(&code, symbols, fp);
+	(void)fclose(fp);
+	TEST_ASSERT(
+	        state,
+	        strcmp(text, expected) == 0,
+	        CLEANUP(free(text)),
+	        "got\n%sexpected\n%s",
+	        text,
+	        expected
+	);
+	free(text);
+	uint64_t hits = 0;
+	for (PeepholeRule i = 0; i < PEEPHOLE_RULE_COUNT; i++) {
+		hits += stats.hits[i];
+	}
+	if (rule == PEEPHOLE_RULE_COUNT) {
+		TEST_ASSERT(state, hits == 0, NO_CLEANUP, "%" PRIu64 " rules applied", hits);
+	} else {
+		TEST_ASSERT(
+		        state,
+		        stats.hits[rule] > 0,
+		        NO_CLEANUP,
+		        "rule '%s' wasn't applied",
+		        peephole_rule_description(rule)
+		);
+	}
+	PASS();
+}
+
+#define RAX asm_reg(MREG_RAX)
+#define RCX asm_reg(MREG_RCX)
+#define RDX asm_reg(MREG_RDX)
+#define RDI asm_reg(MREG_RDI)
+
+#define INSN(op, ...) ((Instruction) { .opcode = OPCODE_##op, .operands = { __VA_ARGS__ } })
+
+#define PEEPHOLE_TEST(state, name, expected, rule, ...) \
+	RUN_TEST( \
+	        state, \
+	        peephole, \
+	        str_lit(name), \
+	        (InstructionBuf)BUF_ARRAY(((Instruction[]) { __VA_ARGS__ })), \
+	        expected, \
+	        PEEPHOLE_RULE_##rule, \
+	        NULL \
+	)
+
+SUITE_FUNC(state, peephole)
+{
+	PEEPHOLE_TEST(state, "push and pop of one register", "", PUSH_POP_SAME, INSN(PUSH, RAX), INSN(POP, RAX));
+	PEEPHOLE_TEST(
+	        state,
+	        "push and pop of an immediate",
+	        "    mov rdi, 5\n",
+	        PUSH_POP,
+	        INSN(PUSH, asm_imm(5)),
+	        INSN(POP, RDI)
+	);
+	PEEPHOLE_TEST(
+	        state,
+	        "push and pop around an instruction",
+	        "    mov rdi, 5\n    mov rcx, rax\n",
+	        PUSH_INSTRUCTION_POP,
+	        INSN(PUSH, RAX),
+	        INSN(MOV, RDI, asm_imm(5)),
+	        INSN(POP, RCX)
+	);
+	// stack machine code for 1 + 5 leaves nothing to pop
+	PEEPHOLE_TEST(
+	        state,
+	        "nested push and pop",
+	        "    mov rdi, 5\n",
+	        PUSH_INSTRUCTION_POP,
+	        INSN(PUSH, RAX),
+	        INSN(PUSH, asm_imm(5)),
+	        INSN(POP, RDI),
+	        INSN(POP, RAX)
+	);
+	PEEPHOLE_TEST(
+	        state,
+	        "push and pop around a write to the pushed register",
+	        "    push rdx\n    cqo\n    pop rcx\n",
+	        COUNT,
+	        INSN(PUSH, RDX),
+	        INSN(CQO),
+	        INSN(POP, RCX)
+	);
+	PEEPHOLE_TEST(
+	        state,
+	        "push and pop around a label",
+	        "    push rax\n.L0:\n    pop rdi\n",
+	        COUNT,
+	        INSN(PUSH, RAX),
+	        INSN(LABEL, asm_label(0)),
+	        INSN(POP, RDI)
+	);
+	PEEPHOLE_TEST(
+	        state,
+	        "push and pop around a syscall",
+	        "    push 60\n    syscall\n    pop rdi\n",
+	        COUNT,
+	        INSN(PUSH, asm_imm(60)),
+	        INSN(SYSCALL),
+	        INSN(POP, RDI)
+	);
+	// the callee sees the pushed value on its stack
+	Interner symbols = interner_new();
+	Operand callee = asm_symbol(interner_intern(&symbols, str_lit("f")));
+	RUN_TEST(
+	        state,
+	        peephole,
+	        str_lit("push and pop around a call"),
+	        (InstructionBuf)BUF_ARRAY(((Instruction[]) { INSN(PUSH, asm_imm(5)), INSN(CALL, callee), INSN(POP, RDI) })),
+	        "    push 5\n    call f\n    pop rdi\n",
+	        PEEPHOLE_RULE_COUNT,
+	        &symbols
+	);
+	interner_free(symbols);
+	PEEPHOLE_TEST(
+	        state,
+	        "load of a stored register",
+	        "    mov qword [rbp - 8], rax\n",
+	        STORE_LOAD,
+	        INSN(MOV, asm_frame(-8), RAX),
+	        INSN(MOV, RAX, asm_frame(-8))
+	);
+	PEEPHOLE_TEST(state, "move to itself", "", MOVE_SELF, INSN(MOV, RAX, RAX));
+	PEEPHOLE_TEST(
+	        state,
+	        "compare after and",
+	        "    and rax, rdi\n",
+	        TEST_AFTER_LOGIC,
+	        INSN(AND, RAX, RDI),
+	        INSN(CMP, RAX, asm_imm(0))
+	);
+	PEEPHOLE_TEST(
+	        state,
+	        "test after sub read by je",
+	        "    sub rax, rdi\n    je .L0\n",
+	        TEST_AFTER_ARITHMETIC,
+	        INSN(SUB, RAX, RDI),
+	        INSN(TEST, RAX, RAX),
+	        INSN(JE, asm_label(0))
+	);
+	// sub sets the overflow flag, which jl reads
+	PEEPHOLE_TEST(
+	        state,
+	        "test after sub read by jl",
+	        "    sub rax, rdi\n    test rax, rax\n    jl .L0\n",
+	        COUNT,
+	        INSN(SUB, RAX, RDI),
+	        INSN(TEST, RAX, RAX),
+	        INSN(JL, asm_label(0))
+	);
+	PEEPHOLE_TEST(
+	        state,
+	        "jumps to the next label",
+	        ".L0:\n",
+	        JUMP_TO_NEXT,
+	        INSN(JNE, asm_label(0)),
+	        INSN(JMP, asm_label(0)),
+	        INSN(LABEL, asm_label(0))
+	);
+	PEEPHOLE_TEST(
+	        state,
+	        "jump to another label",
+	        "    jmp .L1\n.L0:\n",
+	        COUNT,
+	        INSN(JMP, asm_label(1)),
+	        INSN(LABEL, asm_label(0))
+	);
+}
@@ -0,0 +1,16 @@
+#include "dragon/test/program.h"
+
+str return_source(str expr)
+{
+	return str_fmt("int main() { return " STR_FMT "; }", STR_ARG(expr));
+}
+
+ProgramResult parse_return(str expr)
+{
+	str source = return_source(expr);
+	Parser parser = parser_new(source, str_lit("<test>"));
+	ProgramResult result = parser_parse(&parser);
+	parser_free(parser);
+	str_free(source);
+	return result;
+}
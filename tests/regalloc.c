@@ -0,0 +1,62 @@
+#include "dragon/test/regalloc.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "dragon/ast.h"
+#include "dragon/core/str.h"
+#include "dragon/ir.h"
+#include "dragon/ir_opt.h"
+#include "dragon/regalloc.h"
+#include "dragon/ssa.h"
+#include "dragon/test/program.h"
+
+// Lowers `return <expr>;` without optimizing it, allocates its values with
+// `strategy` and checks how many ended up where.
+static TEST_FUNC(state, regalloc, str expr, RegallocStrategy strategy, uint64_t registers, uint64_t spilled, uint64_t saved)
+{
+	TEST_PARSE_RETURN(state, program, expr, NO_CLEANUP);
+
+	IrFunction func = ir_lower_function(program.function);
+	(void)ir_optimize(&func, (IrOptOptions) {
+		.sccp = false, .gvn = false, .dce = false
+	});
+	ssa_destruct(&func);
+	RegisterAllocation allocation = regalloc_function(&func, strategy);
+	RegallocStats stats = allocation.stats;
+	uint64_t savedLen = allocation.saved.len;
+	register_allocation_free(allocation);
+	ir_function_free(func);
+	program_free(program);
+	TEST_ASSERT(
+	        state,
+	        stats.registers == registers && stats.spilled == spilled && savedLen == saved,
+	        NO_CLEANUP,
+	        "got %" PRIu64 " in registers, %" PRIu64 " spilled, %" PRIu64 " saved, "
+	        "expected %" PRIu64 ", %" PRIu64 ", %" PRIu64,
+	        stats.registers,
+	        stats.spilled,
+	        savedLen,
+	        registers,
+	        spilled,
+	        saved
+	);
+	PASS();
+}
+
+#define REGALLOC_TEST(state, name, expr, strategy, registers, spilled, saved) \
+	RUN_TEST(state, regalloc, str_lit(name " " expr), str_lit(expr), strategy, registers, spilled, saved)
+
+// 13 products that are all live when the sum starts
+#define WIDE_SUM \
+	"1*2 + (3*4 + (5*6 + (7*8 + (9*10 + (11*12 + (13*14 + (15*16 + " \
+	"(17*18 + (19*20 + (21*22 + (23*24 + 25*26)))))))))))"
+
+SUITE_FUNC(state, regalloc)
+{
+	REGALLOC_TEST(state, "one value in a caller-saved register", "1 + 2", REGALLOC_STRATEGY_LINEAR, 1, 0, 0);
+	REGALLOC_TEST(state, "no registers without an allocator", "1 + 2 * 3", REGALLOC_STRATEGY_NONE, 0, 2, 0);
+	REGALLOC_TEST(state, "registers are reused once a value dies", "1 + 2 + 3 + 4 + 5", REGALLOC_STRATEGY_LINEAR, 4, 0, 0);
+	REGALLOC_TEST(state, "callee-saved registers and spills", WIDE_SUM, REGALLOC_STRATEGY_LINEAR, 23, 2, 5);
+}
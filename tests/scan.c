@@ -0,0 +1,90 @@
+#include "dragon/test/scan.h"
+
+#include <stdint.h>
+
+#include "dragon/core/scan.h"
+#include "dragon/core/str.h"
+
+#define SCAN_TEST_LEN 300
+
+static bool is_space(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static void fill_buffer(char* buf, uint64_t len)
+{
+	static const char ALPHABET[] = " \t\r\n \t\r\n  */xa";
+	uint32_t seed = 12345;
+	for (uint64_t i = 0; i < len; i++) {
+		seed = seed * 1103515245U + 12345U;
+		// long runs of whitespace make the vector paths do actual work
+		buf[i] = (seed >> 16U) % 7 == 0 ? ALPHABET[(seed >> 20U) % (sizeof(ALPHABET) - 1)] : ' ';
+	}
+}
+
+static TEST_FUNC(state, scan, ScanImpl impl)
+{
+	if (!scan_impl_supported(impl)) {
+		SKIP();
+	}
+	scan_use_impl(impl);
+
+	char buf[SCAN_TEST_LEN];
+	fill_buffer(buf, sizeof(buf));
+	const char* end = buf + sizeof(buf);
+	for (const char* p = buf; p <= end; p++) {
+		const char* expected = p;
+		while (expected < end && is_space(*expected)) {
+			expected++;
+		}
+		const char* actual = scan_skip_space(p, end);
+		TEST_ASSERT(
+		        state,
+		        actual == expected,
+		        CLEANUP(scan_use_impl(scan_best_impl())),
+		        "scan_skip_space from %td: got %td, expected %td",
+		        p - buf,
+		        actual - buf,
+		        expected - buf
+		);
+
+		for (const char* c = "\n*x"; *c != '\0'; c++) {
+			expected = p;
+			while (expected < end && *expected != *c) {
+				expected++;
+			}
+			actual = scan_find_char(p, end, *c);
+			TEST_ASSERT(
+			        state,
+			        actual == expected,
+			        CLEANUP(scan_use_impl(scan_best_impl())),
+			        "scan_find_char('%c') from %td: got %td, expected %td",
+			        *c,
+			        p - buf,
+			        actual - buf,
+			        expected - buf
+			);
+		}
+	}
+
+	scan_use_impl(scan_best_impl());
+	PASS();
+}
+
+SUITE_FUNC(state, scan)
+{
+	static const ScanImpl IMPLS[] = {
+		SCAN_IMPL_SCALAR,
+		SCAN_IMPL_SSE2,
+		SCAN_IMPL_AVX2,
+	};
+	for (uint64_t i = 0; i < sizeof(IMPLS) / sizeof(IMPLS[0]); i++) {
+		RUN_TEST(
+		        state,
+		        scan,
+		        str_fmt("scanning with %s", scan_impl_name(IMPLS[i])),
+		        IMPLS[i]
+		);
+	}
+}
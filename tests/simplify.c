@@ -0,0 +1,132 @@
+#include "dragon/test/simplify.h"
+
+#include <inttypes.h>
+#include <stdint.h>
+
+#include "dragon/ast.h"
+#include "dragon/core/source.h"
+#include "dragon/core/str.h"
+#include "dragon/fold.h"
+#include "dragon/rewrite.h"
+#include "dragon/simplify.h"
+#include "dragon/test/program.h"
+
+// Simplifies `return <expr>;` and checks that `rule` turned it into
+// `expected`. The operands are unfolded constant expressions, which stand in
+// for the variables the rules are meant for.
+static TEST_FUNC(state, simplify, str expr, str expected, SimplifyRule rule)
+{
+	TEST_PARSE_RETURN(state, program, expr, NO_CLEANUP);
+	TEST_PARSE_RETURN(state, expectedProgram, expected, program_free(program));
+
+	SimplifyStats stats = simplify_program(&program);
+	str actualStr = program_to_str(program);
+	str expectedStr = program_to_str(expectedProgram);
+	program_free(program);
+	program_free(expectedProgram);
+
+	TEST_ASSERT(
+	        state,
+	        str_eq(actualStr, expectedStr),
+	        CLEANUP(str_free(actualStr); str_free(expectedStr)),
+	        "got\n" STR_FMT "expected\n" STR_FMT,
+	        STR_ARG(actualStr),
+	        STR_ARG(expectedStr)
+	);
+	str_free(actualStr);
+	str_free(expectedStr);
+	TEST_ASSERT(
+	        state,
+	        stats.hits[rule] > 0,
+	        NO_CLEANUP,
+	        "'%s' wasn't counted",
+	        simplify_rule_description(rule)
+	);
+	PASS();
+}
+
+// Folds `x <op> 2^k` after simplifying it, and checks that the result is
+// what folding it directly computes.
+static TEST_FUNC(state, simplify_power_of_two, BinaryOpKind kind)
+{
+	static const int64_t VALUES[] = {
+		INT64_MIN, INT64_MIN + 1, -1000003, -9, -8, -7, -2, -1,
+		0, 1, 2, 7, 8, 9, 1000003, INT64_MAX - 1, INT64_MAX,
+	};
+	static const int64_t SHIFTS[] = { 1, 2, 3, 31, 32, 62 };
+	TEST_PARSE_RETURN(state, program, str_lit("0"), NO_CLEANUP);
+	SourceFile file = source_file_new(str_lit("<simplify>"), str_lit(""));
+	Expression** root = &program.function.statement.expression;
+	for (uint64_t i = 0; i < sizeof(VALUES) / sizeof(VALUES[0]); i++) {
+		for (uint64_t j = 0; j < sizeof(SHIFTS) / sizeof(SHIFTS[0]); j++) {
+			int64_t divisor = (int64_t)1 << SHIFTS[j];
+			Expression* left = expression_new_constant(&program.nodes, VALUES[i]);
+			Expression* right = expression_new_constant(&program.nodes, divisor);
+			Expression* expr = expression_new_binary(&program.nodes, kind, 0, left, right);
+			*root = expr;
+			fold_result_free(fold_program(&program, &file));
+			int64_t expected = ((ConstantExpression*)*root)->number;
+
+			*root = expr;
+			SimplifyStats stats = simplify_program(&program);
+			fold_result_free(fold_program(&program, &file));
+			int64_t actual = ((ConstantExpression*)*root)->number;
+			uint64_t hits = 0;
+			for (SimplifyRule rule = 0; rule < SIMPLIFY_RULE_COUNT; rule++) {
+				hits += stats.hits[rule];
+			}
+			TEST_ASSERT(
+			        state,
+			        hits > 0 && actual == expected,
+			        CLEANUP(source_file_free(file); program_free(program)),
+			        "%" PRId64 " and 2^%" PRId64 ": got %" PRId64 " after %" PRIu64 " rewrites, expected %" PRId64,
+			        VALUES[i],
+			        SHIFTS[j],
+			        actual,
+			        hits,
+			        expected
+			);
+		}
+	}
+	source_file_free(file);
+	program_free(program);
+	PASS();
+}
+
+#define SIMPLIFY_TEST(state, expr, expected, rule) \
+	RUN_TEST( \
+	        state, \
+	        simplify, \
+	        str_lit("simplifying " expr), \
+	        str_lit(expr), \
+	        str_lit(expected), \
+	        SIMPLIFY_RULE_##rule \
+	)
+
+SUITE_FUNC(state, simplify)
+{
+	SIMPLIFY_TEST(state, "(1 + 2) + 0", "1 + 2", ADD_ZERO);
+	SIMPLIFY_TEST(state, "0 + (1 + 2)", "1 + 2", ADD_ZERO);
+	SIMPLIFY_TEST(state, "(1 + 2) - 0", "1 + 2", SUBTRACT_ZERO);
+	SIMPLIFY_TEST(state, "1 * (1 + 2) * 1", "1 + 2", MULTIPLY_ONE);
+	SIMPLIFY_TEST(state, "(1 + 2) / 1", "1 + 2", DIVIDE_ONE);
+	SIMPLIFY_TEST(state, "(1 + 2) * 8", "(1 + 2) << 3", MULTIPLY_POWER_OF_TWO);
+	SIMPLIFY_TEST(state, "4 * (1 + 2)", "(1 + 2) << 2", MULTIPLY_POWER_OF_TWO);
+	SIMPLIFY_TEST(
+	        state,
+	        "(1 - 8) / 4",
+	        "((1 - 8) + (((1 - 8) >> 63) & 3)) >> 2",
+	        DIVIDE_POWER_OF_TWO
+	);
+	// duplicating a larger operand would cost more than the idiv
+	SIMPLIFY_TEST(state, "(1 - 5 * 3) / 1 / 4", "(1 - (5 * 3)) / 4", DIVIDE_ONE);
+	SIMPLIFY_TEST(state, "!!(1 + 2)", "(1 + 2) != 0", DOUBLE_LOGICAL_NEGATION);
+	SIMPLIFY_TEST(state, "!!(1 < 2)", "1 < 2", DOUBLE_LOGICAL_NEGATION);
+	SIMPLIFY_TEST(state, "~~(1 + 2)", "1 + 2", DOUBLE_BITWISE_NEGATION);
+	SIMPLIFY_TEST(state, "-(-(1 + 2))", "1 + 2", DOUBLE_ARITHMETIC_NEGATION);
+	RUN_TEST(state, simplify_power_of_two, str_lit("simplifying x * 2^k"), BINARY_OP_KIND_MULTIPLICATION);
+	RUN_TEST(state, simplify_power_of_two, str_lit("simplifying x / 2^k"), BINARY_OP_KIND_DIVISION);
+	RUN_TEST(state, simplify_power_of_two, str_lit("simplifying x % 2^k"), BINARY_OP_KIND_MODULUS);
+	// rewrites enable each other
+	SIMPLIFY_TEST(state, "~~(-(-(1 + 2)) * 1) + 0", "1 + 2", DOUBLE_BITWISE_NEGATION);
+}
@@ -2,15 +2,43 @@
 #include <stdio.h>
 
 #include "dragon/core/str.h"
+#include "dragon/test/codegen.h"
+#include "dragon/test/divide.h"
+#include "dragon/test/encode.h"
 #include "dragon/test/execute.h"
+#include "dragon/test/fold.h"
+#include "dragon/test/intern.h"
+#include "dragon/test/interp.h"
+#include "dragon/test/ir.h"
+#include "dragon/test/ir_opt.h"
+#include "dragon/test/jit.h"
 #include "dragon/test/lexer.h"
+#include "dragon/test/link.h"
 #include "dragon/test/parser.h"
+#include "dragon/test/peephole.h"
+#include "dragon/test/regalloc.h"
+#include "dragon/test/scan.h"
+#include "dragon/test/simplify.h"
 #include "dragon/test/test.h"
 
 static void run_all(TestState* state)
 {
+	RUN_SUITE(state, scan, str_lit("scan"));
+	RUN_SUITE(state, intern, str_lit("intern"));
 	RUN_SUITE(state, lexer, str_lit("lexer"));
 	RUN_SUITE(state, parser, str_lit("parser"));
+	RUN_SUITE(state, fold, str_lit("fold"));
+	RUN_SUITE(state, simplify, str_lit("simplify"));
+	RUN_SUITE(state, divide, str_lit("divide"));
+	RUN_SUITE(state, codegen, str_lit("codegen"));
+	RUN_SUITE(state, peephole, str_lit("peephole"));
+	RUN_SUITE(state, ir, str_lit("ir"));
+	RUN_SUITE(state, ir_opt, str_lit("ir_opt"));
+	RUN_SUITE(state, regalloc, str_lit("regalloc"));
+	RUN_SUITE(state, encode, str_lit("encode"));
+	RUN_SUITE(state, link, str_lit("link"));
+	RUN_SUITE(state, jit, str_lit("jit"));
+	RUN_SUITE(state, interp, str_lit("interp"));
 	RUN_SUITE(state, execute, str_lit("execute"));
 }
 